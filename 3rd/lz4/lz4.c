@@ -0,0 +1,553 @@
+/*
+ * LZ4 block format, the compressor, the safe decompressor and the dictionary/streaming api of lz4.h v1.9.4.
+ *
+ * this is not the upstream lz4.c, it implements the api subset of lz4.h that lxnet use,
+ * the output is the standard LZ4 block format, it is checked against liblz4 1.9.4 in both direction
+ * (with and without dictionary). the upstream lz4.c of v1.9.4 can replace it without any change.
+ *
+ * the stream state is LZ4_stream_t_internal of lz4.h:
+ * hashTable --- the index of positions, the index of a position is currentOffset - (distance to the end of history),
+ *               so the index of source byte i is currentOffset + i, and the history is just before it.
+ * dictionary, dictSize --- the history (the last 64KB of previous source or the loaded dictionary).
+ * dictCtx --- the attached dictionary stream, only used when the stream has not any history.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#define LZ4_STATIC_LINKING_ONLY
+#include "lz4.h"
+
+#define LZ4_MINMATCH 4
+#define LZ4_LASTLITERALS 5
+#define LZ4_MFLIMIT 12
+#define LZ4_MIN_LENGTH (LZ4_MFLIMIT + 1)
+#define LZ4_SKIP_TRIGGER 6
+#define LZ4_WINDOW (64 * 1024)
+
+#define LZ4_RUN_BITS 4
+#define LZ4_RUN_MASK ((1U << LZ4_RUN_BITS) - 1)
+#define LZ4_ML_MASK LZ4_RUN_MASK
+
+/* the table is cleared and the index restart when the index is more than it. */
+#define LZ4_INDEX_REBASE (1U << 30)
+
+/* the value of tableType, the table hold 32 bits index. */
+#define LZ4_TABLE_BY_U32 2
+
+typedef unsigned char lz4_byte;
+typedef unsigned int lz4_u32;
+
+/* the match found in the history or the source. */
+struct lz4_match {
+	const lz4_byte *ptr;
+	const lz4_byte *low;		/* the begin of the segment that the match is in. */
+	const lz4_byte *end;		/* the end of the history segment, NULL if the match is in the source. */
+	size_t offset;
+};
+
+static lz4_u32 lz4_read32(const void *ptr) {
+	lz4_u32 value;
+	memcpy(&value, ptr, sizeof(value));
+	return value;
+}
+
+static size_t lz4_read_arch(const void *ptr) {
+	size_t value;
+	memcpy(&value, ptr, sizeof(value));
+	return value;
+}
+
+static lz4_u32 lz4_hash(lz4_u32 sequence) {
+	return (sequence * 2654435761U) >> (32 - LZ4_HASHLOG);
+}
+
+/* return the common length of ip and match, ip is not more than limit. */
+static size_t lz4_count(const lz4_byte *ip, const lz4_byte *match, const lz4_byte *limit) {
+	const lz4_byte *start = ip;
+	while (ip + sizeof(size_t) <= limit) {
+		if (lz4_read_arch(ip) != lz4_read_arch(match))
+			break;
+
+		ip += sizeof(size_t);
+		match += sizeof(size_t);
+	}
+
+	while ((ip < limit) && (*ip == *match)) {
+		++ip;
+		++match;
+	}
+	return (size_t)(ip - start);
+}
+
+/* write the rest of length more than the mask of token. */
+static lz4_byte *lz4_write_length(lz4_byte *op, size_t length) {
+	while (length >= 255) {
+		*op++ = 255;
+		length -= 255;
+	}
+	*op++ = (lz4_byte)length;
+	return op;
+}
+
+int LZ4_versionNumber(void) {
+	return LZ4_VERSION_NUMBER;
+}
+
+const char *LZ4_versionString(void) {
+	return LZ4_VERSION_STRING;
+}
+
+int LZ4_compressBound(int inputSize) {
+	return LZ4_COMPRESSBOUND(inputSize);
+}
+
+int LZ4_sizeofState(void) {
+	return (int)sizeof(LZ4_stream_t);
+}
+
+LZ4_stream_t *LZ4_initStream(void *buffer, size_t size) {
+	if (!buffer || size < sizeof(LZ4_stream_t))
+		return NULL;
+
+	memset(buffer, 0, sizeof(LZ4_stream_t));
+	((LZ4_stream_t *)buffer)->internal_donotuse.tableType = LZ4_TABLE_BY_U32;
+	return (LZ4_stream_t *)buffer;
+}
+
+LZ4_stream_t *LZ4_createStream(void) {
+	LZ4_stream_t *stream = (LZ4_stream_t *)malloc(sizeof(LZ4_stream_t));
+	return LZ4_initStream(stream, sizeof(LZ4_stream_t));
+}
+
+int LZ4_freeStream(LZ4_stream_t *streamPtr) {
+	free(streamPtr);
+	return 0;
+}
+
+void LZ4_resetStream(LZ4_stream_t *streamPtr) {
+	LZ4_initStream(streamPtr, sizeof(LZ4_stream_t));
+}
+
+/*
+ * forget the history, the table is not cleared, the old index is less than currentOffset,
+ * it is out of the history (dictSize is 0), so it is never used.
+ */
+void LZ4_resetStream_fast(LZ4_stream_t *streamPtr) {
+	LZ4_stream_t_internal *ctx = &streamPtr->internal_donotuse;
+	if (ctx->currentOffset > LZ4_INDEX_REBASE) {
+		LZ4_initStream(streamPtr, sizeof(LZ4_stream_t));
+		return;
+	}
+
+	ctx->dictionary = NULL;
+	ctx->dictCtx = NULL;
+	ctx->dictSize = 0;
+	ctx->tableType = LZ4_TABLE_BY_U32;
+}
+
+int LZ4_loadDict(LZ4_stream_t *streamPtr, const char *dictionary, int dictSize) {
+	LZ4_stream_t_internal *ctx = &streamPtr->internal_donotuse;
+	const lz4_byte *dict_end = (const lz4_byte *)dictionary + (dictSize > 0 ? dictSize : 0);
+	const lz4_byte *p;
+
+	LZ4_initStream(streamPtr, sizeof(LZ4_stream_t));
+	ctx->currentOffset = LZ4_WINDOW;
+	if (!dictionary || dictSize < (int)sizeof(lz4_u32))
+		return 0;
+
+	p = (dictSize > LZ4_WINDOW) ? dict_end - LZ4_WINDOW : (const lz4_byte *)dictionary;
+	ctx->dictionary = p;
+	ctx->dictSize = (lz4_u32)(dict_end - p);
+
+	/* the later position override the earlier, the nearer match is preferred. */
+	for (; p + sizeof(lz4_u32) <= dict_end; ++p)
+		ctx->hashTable[lz4_hash(lz4_read32(p))] = ctx->currentOffset - (lz4_u32)(dict_end - p);
+
+	return (int)ctx->dictSize;
+}
+
+void LZ4_attach_dictionary(LZ4_stream_t *workingStream, const LZ4_stream_t *dictionaryStream) {
+	const LZ4_stream_t_internal *dict_ctx = dictionaryStream ? &dictionaryStream->internal_donotuse : NULL;
+	if (dict_ctx && dict_ctx->dictSize == 0)
+		dict_ctx = NULL;
+
+	workingStream->internal_donotuse.dictCtx = dict_ctx;
+}
+
+int LZ4_saveDict(LZ4_stream_t *streamPtr, char *safeBuffer, int maxDictSize) {
+	LZ4_stream_t_internal *ctx = &streamPtr->internal_donotuse;
+	int size = (int)ctx->dictSize;
+	if (size > maxDictSize)
+		size = maxDictSize;
+	if (size > LZ4_WINDOW)
+		size = LZ4_WINDOW;
+	if (size < 0)
+		size = 0;
+
+	if (size > 0)
+		memmove(safeBuffer, ctx->dictionary + ctx->dictSize - size, (size_t)size);
+
+	ctx->dictionary = (const lz4_byte *)safeBuffer;
+	ctx->dictSize = (lz4_u32)size;
+	return size;
+}
+
+/*
+ * find the candidate of hash h for ip, in the history of the stream, or in the attached dictionary stream.
+ * src_index is the index of src, the history is just before src.
+ */
+static int lz4_find_match(const LZ4_stream_t_internal *ctx, lz4_u32 h,
+		const lz4_byte *src, const lz4_byte *ip, lz4_u32 candidate, struct lz4_match *match) {
+
+	lz4_u32 src_index = ctx->currentOffset;
+	lz4_u32 ip_index = src_index + (lz4_u32)(ip - src);
+	size_t pos = (size_t)(ip - src);
+
+	if ((candidate < ip_index) && (ip_index - candidate <= LZ4_DISTANCE_MAX)) {
+		if (candidate >= src_index) {
+			match->ptr = src + (candidate - src_index);
+			match->low = src;
+			match->end = NULL;
+			match->offset = ip_index - candidate;
+			return 1;
+		}
+
+		if (src_index - candidate <= ctx->dictSize) {
+			match->end = ctx->dictionary + ctx->dictSize;
+			match->ptr = match->end - (src_index - candidate);
+			match->low = ctx->dictionary;
+			match->offset = ip_index - candidate;
+			return 1;
+		}
+	}
+
+	/* the attached dictionary is just before src. */
+	if (ctx->dictCtx && ctx->dictSize == 0) {
+		const LZ4_stream_t_internal *dict_ctx = ctx->dictCtx;
+		lz4_u32 dict_candidate = dict_ctx->hashTable[h];
+		lz4_u32 back = dict_ctx->currentOffset - dict_candidate;
+		if ((dict_candidate < dict_ctx->currentOffset) && (back <= dict_ctx->dictSize) &&
+				(pos + back <= LZ4_DISTANCE_MAX)) {
+			match->end = dict_ctx->dictionary + dict_ctx->dictSize;
+			match->ptr = match->end - back;
+			match->low = dict_ctx->dictionary;
+			match->offset = pos + back;
+			return 1;
+		}
+	}
+
+	return 0;
+}
+
+static int lz4_compress_generic(LZ4_stream_t_internal *ctx, const char *source, char *dest,
+		int inputSize, int maxOutputSize, int acceleration) {
+
+	const lz4_byte *src = (const lz4_byte *)source;
+	const lz4_byte *ip = src;
+	const lz4_byte *anchor = src;
+	const lz4_byte *iend = src + inputSize;
+	const lz4_byte *mflimit = iend - LZ4_MFLIMIT;
+	const lz4_byte *matchlimit = iend - LZ4_LASTLITERALS;
+	lz4_byte *op = (lz4_byte *)dest;
+	lz4_byte *oend = op + maxOutputSize;
+	lz4_u32 src_index = ctx->currentOffset;
+	size_t last_run;
+
+	if ((inputSize < 0) || ((unsigned)inputSize > (unsigned)LZ4_MAX_INPUT_SIZE) || (maxOutputSize <= 0))
+		return 0;
+
+	if (acceleration < 1)
+		acceleration = 1;
+	if (acceleration > 65537)
+		acceleration = 65537;
+
+	if (inputSize < LZ4_MIN_LENGTH)
+		goto last_literals;
+
+	for (;;) {
+		struct lz4_match match;
+		const lz4_byte *forward = ip;
+		unsigned int attempts = (unsigned int)acceleration << LZ4_SKIP_TRIGGER;
+		unsigned int step = (unsigned int)acceleration;
+		size_t lit_len, match_len;
+		lz4_byte *token;
+
+		/* find a match, the step grow when not found for a while. */
+		for (;;) {
+			lz4_u32 h, candidate;
+			ip = forward;
+			if (ip > mflimit)
+				goto last_literals;
+
+			forward = ip + step;
+			step = attempts++ >> LZ4_SKIP_TRIGGER;
+
+			h = lz4_hash(lz4_read32(ip));
+			candidate = ctx->hashTable[h];
+			ctx->hashTable[h] = src_index + (lz4_u32)(ip - src);
+			if (lz4_find_match(ctx, h, src, ip, candidate, &match) &&
+					(lz4_read32(match.ptr) == lz4_read32(ip)))
+				break;
+		}
+
+		/* catch up, the match is not before the begin of its segment. */
+		while ((ip > anchor) && (match.ptr > match.low) && (ip[-1] == match.ptr[-1])) {
+			--ip;
+			--match.ptr;
+		}
+
+		/* the history segment is followed by src. */
+		if (match.end) {
+			const lz4_byte *limit = ip + (match.end - match.ptr);
+			if (limit > matchlimit)
+				limit = matchlimit;
+
+			match_len = LZ4_MINMATCH + lz4_count(ip + LZ4_MINMATCH, match.ptr + LZ4_MINMATCH, limit);
+			if (ip + match_len == limit && limit < matchlimit)
+				match_len += lz4_count(limit, src, matchlimit);
+		} else {
+			match_len = LZ4_MINMATCH + lz4_count(ip + LZ4_MINMATCH, match.ptr + LZ4_MINMATCH, matchlimit);
+		}
+
+		lit_len = (size_t)(ip - anchor);
+		if ((size_t)(oend - op) < 1 + lit_len / 255 + 1 + lit_len + 2 + (match_len - LZ4_MINMATCH) / 255 + 1 +
+				1 + LZ4_LASTLITERALS)
+			return 0;
+
+		token = op++;
+		if (lit_len >= LZ4_RUN_MASK) {
+			*token = (lz4_byte)(LZ4_RUN_MASK << LZ4_RUN_BITS);
+			op = lz4_write_length(op, lit_len - LZ4_RUN_MASK);
+		} else {
+			*token = (lz4_byte)(lit_len << LZ4_RUN_BITS);
+		}
+		memcpy(op, anchor, lit_len);
+		op += lit_len;
+
+		*op++ = (lz4_byte)(match.offset & 0xff);
+		*op++ = (lz4_byte)(match.offset >> 8);
+
+		if (match_len - LZ4_MINMATCH >= LZ4_ML_MASK) {
+			*token |= (lz4_byte)LZ4_ML_MASK;
+			op = lz4_write_length(op, match_len - LZ4_MINMATCH - LZ4_ML_MASK);
+		} else {
+			*token |= (lz4_byte)(match_len - LZ4_MINMATCH);
+		}
+
+		ip += match_len;
+		anchor = ip;
+		if (ip > mflimit)
+			break;
+
+		ctx->hashTable[lz4_hash(lz4_read32(ip - 2))] = src_index + (lz4_u32)(ip - 2 - src);
+	}
+
+last_literals:
+	last_run = (size_t)(iend - anchor);
+	if ((size_t)(oend - op) < 1 + (last_run + 255 - LZ4_RUN_MASK) / 255 + last_run)
+		return 0;
+
+	if (last_run >= LZ4_RUN_MASK) {
+		*op++ = (lz4_byte)(LZ4_RUN_MASK << LZ4_RUN_BITS);
+		op = lz4_write_length(op, last_run - LZ4_RUN_MASK);
+	} else {
+		*op++ = (lz4_byte)(last_run << LZ4_RUN_BITS);
+	}
+	memcpy(op, anchor, last_run);
+	op += last_run;
+	return (int)(op - (lz4_byte *)dest);
+}
+
+int LZ4_compress_fast_extState(void *state, const char *src, char *dst, int srcSize, int dstCapacity, int acceleration) {
+	LZ4_stream_t *stream = LZ4_initStream(state, sizeof(LZ4_stream_t));
+	if (!stream)
+		return 0;
+
+	return lz4_compress_generic(&stream->internal_donotuse, src, dst, srcSize, dstCapacity, acceleration);
+}
+
+int LZ4_compress_fast(const char *src, char *dst, int srcSize, int dstCapacity, int acceleration) {
+	LZ4_stream_t state;
+	return LZ4_compress_fast_extState(&state, src, dst, srcSize, dstCapacity, acceleration);
+}
+
+int LZ4_compress_default(const char *src, char *dst, int srcSize, int dstCapacity) {
+	return LZ4_compress_fast(src, dst, srcSize, dstCapacity, 1);
+}
+
+/* compress with the history, and then src is the history of next. */
+int LZ4_compress_fast_continue(LZ4_stream_t *streamPtr, const char *src, char *dst, int srcSize, int dstCapacity, int acceleration) {
+	LZ4_stream_t_internal *ctx = &streamPtr->internal_donotuse;
+	const lz4_byte *src_end = (const lz4_byte *)src + (srcSize > 0 ? srcSize : 0);
+	const lz4_byte *dict_end;
+	int res;
+
+	/* the index restart, the history is kept but not indexed. */
+	if (ctx->currentOffset > LZ4_INDEX_REBASE) {
+		memset(ctx->hashTable, 0, sizeof(ctx->hashTable));
+		ctx->currentOffset = LZ4_WINDOW;
+	}
+
+	/* the history overlap the source, only the part after the source is usable. */
+	dict_end = ctx->dictionary + ctx->dictSize;
+	if (ctx->dictSize > 0 && (src_end > ctx->dictionary) && (src_end < dict_end)) {
+		ctx->dictSize = (lz4_u32)(dict_end - src_end);
+		if (ctx->dictSize < sizeof(lz4_u32))
+			ctx->dictSize = 0;
+		ctx->dictionary = dict_end - ctx->dictSize;
+	}
+
+	res = lz4_compress_generic(ctx, src, dst, srcSize, dstCapacity, acceleration);
+	if (res <= 0)
+		return res;
+
+	/* the contiguous source extend the history. */
+	if (ctx->dictSize > 0 && dict_end == (const lz4_byte *)src)
+		ctx->dictSize += (lz4_u32)srcSize;
+	else
+		ctx->dictSize = (lz4_u32)srcSize;
+
+	if (ctx->dictSize > LZ4_WINDOW)
+		ctx->dictSize = LZ4_WINDOW;
+
+	ctx->dictionary = src_end - ctx->dictSize;
+	ctx->dictCtx = NULL;
+	ctx->currentOffset += (lz4_u32)srcSize;
+	return res;
+}
+
+/* read the rest of length more than the mask of token, return 0 if the input is end or the length overflow. */
+static int lz4_read_length(const lz4_byte **ip, const lz4_byte *iend, size_t *length) {
+	unsigned int s;
+	do {
+		if (*ip >= iend)
+			return 0;
+
+		s = *(*ip)++;
+		*length += s;
+		if (*length > (size_t)LZ4_MAX_INPUT_SIZE)
+			return 0;
+	} while (s == 255);
+	return 1;
+}
+
+/*
+ * the generic safe decompressor, the history (dict_start, dict_size) is just before dst,
+ * it can be contiguous with dst (the prefix) or not.
+ */
+static int lz4_decompress_generic(const char *source, char *dest, int compressedSize, int dstCapacity,
+		const char *dict_start, size_t dict_size) {
+
+	const lz4_byte *ip = (const lz4_byte *)source;
+	const lz4_byte *iend = ip + compressedSize;
+	lz4_byte *op = (lz4_byte *)dest;
+	lz4_byte *const ostart = op;
+	lz4_byte *const oend = op + dstCapacity;
+	const lz4_byte *dict_end = (const lz4_byte *)dict_start + dict_size;
+
+	if (!source || !dest || compressedSize <= 0 || dstCapacity < 0)
+		return -1;
+
+	for (;;) {
+		unsigned int token;
+		size_t length, offset;
+		const lz4_byte *match;
+
+		if (ip >= iend)
+			return -1;
+
+		token = *ip++;
+
+		/* literals. */
+		length = token >> LZ4_RUN_BITS;
+		if (length == LZ4_RUN_MASK && !lz4_read_length(&ip, iend, &length))
+			return -1;
+
+		if (length > (size_t)(iend - ip) || length > (size_t)(oend - op))
+			return -1;
+
+		/* the short literals is copied by fixed size when there is room, the overwritten part is written later. */
+		if ((length <= 16) && (iend - ip >= 16) && (oend - op >= 16))
+			memcpy(op, ip, 16);
+		else
+			memcpy(op, ip, length);
+		ip += length;
+		op += length;
+
+		/* the last sequence has only literals. */
+		if (ip == iend)
+			break;
+
+		/* match. */
+		if (iend - ip < 2)
+			return -1;
+
+		offset = (size_t)ip[0] | ((size_t)ip[1] << 8);
+		ip += 2;
+		if (offset == 0)
+			return -1;
+
+		length = token & LZ4_ML_MASK;
+		if (length == LZ4_ML_MASK && !lz4_read_length(&ip, iend, &length))
+			return -1;
+
+		length += LZ4_MINMATCH;
+		if (length > (size_t)(oend - op))
+			return -1;
+
+		/* the match begin in the history, copy the history part, and the rest is from the begin of dst. */
+		if (offset > (size_t)(op - ostart)) {
+			size_t back = offset - (size_t)(op - ostart);
+			size_t copy;
+			if (back > dict_size)
+				return -1;
+
+			copy = (back < length) ? back : length;
+			memmove(op, dict_end - back, copy);
+			op += copy;
+			length -= copy;
+			match = ostart;
+		} else {
+			match = op - offset;
+		}
+
+		/* the match not overlapped is copied by 16 bytes, the overwritten part is written later. */
+		if ((size_t)(op - match) >= 16 && (size_t)(oend - op) >= length + 16) {
+			lz4_byte *end = op + length;
+			do {
+				memcpy(op, match, 16);
+				op += 16;
+				match += 16;
+			} while (op < end);
+			op = end;
+			length = 0;
+		}
+
+		/* the overlapped match repeat the pattern, copy offset bytes once. */
+		while (length > 0) {
+			size_t copy = (size_t)(op - match);
+			if (copy > length)
+				copy = length;
+
+			memcpy(op, match, copy);
+			op += copy;
+			match += copy;
+			length -= copy;
+		}
+	}
+
+	return (int)(op - ostart);
+}
+
+int LZ4_decompress_safe(const char *src, char *dst, int compressedSize, int dstCapacity) {
+	return lz4_decompress_generic(src, dst, compressedSize, dstCapacity, NULL, 0);
+}
+
+int LZ4_decompress_safe_usingDict(const char *src, char *dst, int compressedSize, int dstCapacity,
+		const char *dictStart, int dictSize) {
+
+	if (!dictStart || dictSize <= 0)
+		return lz4_decompress_generic(src, dst, compressedSize, dstCapacity, NULL, 0);
+
+	return lz4_decompress_generic(src, dst, compressedSize, dstCapacity, dictStart, (size_t)dictSize);
+}
@@ -14,19 +14,37 @@ extern "C" {
 #include <string.h>
 #include <assert.h>
 #include "platform_config.h"
+#include "catomic.h"
 #include "buf/buf_info.h"
 
 #ifndef min
 #define min(a, b)	(((a) < (b)) ? (a) : (b))
 #endif
 
-/* block buffer */
+#ifndef max
+#define max(a, b)	(((a) > (b)) ? (a) : (b))
+#endif
+
+/* the read/write position of ring block is wrap in this mask, the ring size need be power of 2. */
+#define BLOCK_RING_POS_MASK 0x7fffffff
+
+/*
+ * block buffer.
+ * if ring_size is not 0, it is a ring block, the data is mapped twice back-to-back, 
+ * so the readable or writable region is always contiguous, the read/write position wrap around, 
+ * and it is never write over.
+ */
 struct block {
 	int read;
 	volatile int write;
 	int process_pos;		/* process pos. */
-	int maxsize;
+	volatile int maxsize;	/* writer can seal it to write position. */
+	int size;				/* block size, include block header. */
 	struct block *next;
+	char *data;				/* is buf, or the buf of shared block. */
+	struct block *shared;	/* if not NULL, the data is read only of this shared block. */
+	catomic ref;			/* reference num of shared block. */
+	int ring_size;			/* if not 0, is ring block, the data size. */
 	char buf[0];
 };
 
@@ -37,7 +55,81 @@ static inline void block_init(struct block *self, int size) {
 	self->write = 0;
 	self->process_pos = 0;
 	self->maxsize = size - (int)sizeof(struct block);
+	self->size = size;
+	self->next = NULL;
+	self->data = self->buf;
+	self->shared = NULL;
+	catomic_set(&self->ref, 1);
+	self->ring_size = 0;
+}
+
+/*
+ * init the block as ring block, size is the block size, 
+ * data is ring_size bytes memory and mapped twice back-to-back, ring_size need be power of 2.
+ */
+static inline void block_init_ring(struct block *self, int size, char *data, int ring_size) {
+	assert(self != NULL);
+	assert(data != NULL);
+	assert(size >= (int)sizeof(struct block));
+	assert(ring_size > 0 && (ring_size & (ring_size - 1)) == 0);
+	self->read = 0;
+	self->write = 0;
+	self->process_pos = 0;
+	self->maxsize = ring_size;
+	self->size = size;
+	self->next = NULL;
+	self->data = data;
+	self->shared = NULL;
+	catomic_set(&self->ref, 1);
+	self->ring_size = ring_size;
+}
+
+static inline bool block_is_ring(struct block *self) {
+	assert(self != NULL);
+	return self->ring_size != 0;
+}
+
+static inline int block_ring_pos_add(int pos, int len) {
+	return (int)(((unsigned int)pos + (unsigned int)len) & BLOCK_RING_POS_MASK);
+}
+
+static inline int block_ring_pos_sub(int end, int begin) {
+	return (end - begin) & BLOCK_RING_POS_MASK;
+}
+
+static inline char *block_ring_pos_buf(struct block *self, int pos) {
+	return &self->data[pos & (self->ring_size - 1)];
+}
+
+/*
+ * init the block as reference of shared block, the data is all data of the shared block, 
+ * and is write over, so it can not write.
+ */
+static inline void block_init_reference(struct block *self, int size, struct block *shared) {
+	assert(self != NULL);
+	assert(shared != NULL && shared->shared == NULL);
+	assert(size >= (int)sizeof(struct block));
+	self->read = 0;
+	self->write = shared->write;
+	self->process_pos = 0;
+	self->maxsize = shared->write;
+	self->size = size;
 	self->next = NULL;
+	self->data = shared->data;
+	self->shared = shared;
+	catomic_set(&self->ref, 1);
+	catomic_inc_explicit(&shared->ref, CATOMIC_RELAXED);
+	self->ring_size = 0;
+}
+
+static inline bool block_is_reference(struct block *self) {
+	assert(self != NULL);
+	return self->shared != NULL;
+}
+
+static inline int block_get_size(struct block *self) {
+	assert(self != NULL);
+	return self->size;
 }
 
 
@@ -51,6 +143,14 @@ static inline struct buf_info block_get_do_process(struct block *self) {
 	struct buf_info pinfo;
 
 	assert(self != NULL);
+	if (block_is_ring(self)) {
+		int write = self->write;
+		pinfo.len = block_ring_pos_sub(write, self->process_pos);
+		pinfo.buf = (pinfo.len > 0) ? block_ring_pos_buf(self, self->process_pos) : NULL;
+		self->process_pos = write;
+		return pinfo;
+	}
+
 	assert(self->maxsize >= self->write);
 	assert(self->write >= self->read);
 	assert(self->write >= self->process_pos);
@@ -59,7 +159,7 @@ static inline struct buf_info block_get_do_process(struct block *self) {
 	pinfo.len = 0;
 	if (self->write > self->process_pos) {
 		pinfo.len = self->write - self->process_pos;
-		pinfo.buf = &self->buf[self->process_pos];
+		pinfo.buf = &self->data[self->process_pos];
 		assert(pinfo.len > 0);
 		assert(self->write >= pinfo.len);
 
@@ -73,32 +173,50 @@ static inline struct buf_info block_get_do_process(struct block *self) {
 
 static inline bool block_is_read_over(struct block *self) {
 	assert(self != NULL);
-	assert(self->maxsize > 0);
+	assert(self->maxsize >= 0);
+	if (block_is_ring(self))
+		return (self->read == self->write);
+
 	return (self->read == self->maxsize);
 }
 
 static inline bool block_is_write_over(struct block *self) {
 	assert(self != NULL);
-	assert(self->maxsize > 0);
+	assert(self->maxsize >= 0);
+	if (block_is_ring(self))
+		return false;
+
 	return (self->write == self->maxsize);
 }
 
 static inline int block_get_readsize(struct block *self) {
 	assert(self != NULL);
+	if (block_is_ring(self))
+		return block_ring_pos_sub(self->write, self->read);
+
 	assert(self->write >= self->read);
 	return (self->write - self->read);
 }
 
 static inline char *block_get_readbuf(struct block *self) {
 	assert(self != NULL);
+	if (block_is_ring(self))
+		return block_ring_pos_buf(self, self->read);
+
 	assert(self->write >= self->read);
 	assert(self->maxsize > self->read);
-	return &self->buf[self->read];
+	return &self->data[self->read];
 }
 
 static inline void block_add_read(struct block *self, int len) {
 	assert(self != NULL);
 	assert(len >= 0);
+	if (block_is_ring(self)) {
+		assert(block_get_readsize(self) >= len);
+		self->read = block_ring_pos_add(self->read, len);
+		return;
+	}
+
 	assert(self->write >= (self->read + len));
 	self->read += len;
 }
@@ -106,11 +224,18 @@ static inline void block_add_read(struct block *self, int len) {
 static inline int block_get(struct block *self, void *data, int len) {
 	int readsize;
 	assert(self != NULL);
-	assert(self->write >= self->read);
 	assert(data != NULL);
 	assert(len != 0);
+	if (block_is_ring(self)) {
+		readsize = min(block_get_readsize(self), len);
+		memcpy(data, block_ring_pos_buf(self, self->read), readsize);
+		block_add_read(self, readsize);
+		return readsize;
+	}
+
+	assert(self->write >= self->read);
 	readsize = min(block_get_readsize(self), len);
-	memcpy(data, &self->buf[self->read], readsize);
+	memcpy(data, &self->data[self->read], readsize);
 	self->read += readsize;
 	assert(self->read <= self->write);
 	return readsize;
@@ -125,31 +250,58 @@ static inline int block_get(struct block *self, void *data, int len) {
  */
 static inline int block_get_writesize(struct block *self) {
 	assert(self != NULL);
+	if (block_is_ring(self))
+		return self->ring_size - block_ring_pos_sub(self->write, self->read);
+
 	assert(self->maxsize >= self->write);
 	return (self->maxsize - self->write);
 }
 
 static inline char *block_get_writebuf(struct block *self) {
 	assert(self != NULL);
+	if (block_is_ring(self))
+		return block_ring_pos_buf(self, self->write);
+
 	assert(self->maxsize > self->write);
-	return &self->buf[self->write];
+	return &self->data[self->write];
 }
 
 static inline void block_add_write(struct block *self, int len) {
 	assert(self != NULL);
 	assert(len >= 0);
+	if (block_is_ring(self)) {
+		assert(block_get_writesize(self) >= len);
+		self->write = block_ring_pos_add(self->write, len);
+		return;
+	}
+
 	assert(self->maxsize >= (self->write + len));
 	self->write += len;
 }
 
+/* seal the block at write position, so it is write over, the rest room not use. */
+static inline void block_seal(struct block *self) {
+	assert(self != NULL);
+	assert(!block_is_ring(self) && "ring block can not seal!");
+	assert(self->maxsize >= self->write);
+	self->maxsize = self->write;
+}
+
 static inline int block_put(struct block *self, void *data, int len) {
 	int writesize;
 	assert(self != NULL);
-	assert(self->maxsize > self->write);
 	assert(data != NULL);
 	assert(len != 0);
+	if (block_is_ring(self)) {
+		writesize = min(block_get_writesize(self), len);
+		memcpy(block_ring_pos_buf(self, self->write), data, writesize);
+		block_add_write(self, writesize);
+		return writesize;
+	}
+
+	assert(self->maxsize > self->write);
 	writesize = min(block_get_writesize(self), len);
-	memcpy(&self->buf[self->write], data, writesize);
+	memcpy(&self->data[self->write], data, writesize);
 	self->write += writesize;
 	assert(self->write <= self->maxsize);
 	return writesize;
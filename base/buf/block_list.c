@@ -8,6 +8,21 @@
 #include "buf/block_list.h"
 
 
+static inline void blocklist_frame_init(struct blocklist_frame *frame) {
+	frame->ring_block = NULL;
+	frame->ring = NULL;
+	frame->ring_size = 0;
+
+	frame->header_len = 0;
+	frame->message_len = 0;
+	frame->message_left = 0;
+	frame->push_local = 0;
+
+	catomic_set(&frame->push_num, 0);
+	catomic_set(&frame->pop_num, 0);
+	catomic_set(&frame->spill_num, 0);
+}
+
 void blocklist_init(struct blocklist *self, create_block_func create_func, 
 		release_block_func release_func, void *func_arg, size_t block_size) {
 
@@ -17,53 +32,73 @@ void blocklist_init(struct blocklist *self, create_block_func create_func,
 	assert(block_size < INT_MAX && "the size of the block need less than INT_MAX");
 
 	self->head = NULL;
-	self->tail = NULL;
-
 	self->is_new_message = false;
 	self->message_len = 0;
+	self->peek_len = 0;
+
+	self->tail = NULL;
+	self->can_write_size = 0;
+	self->reserve_len = 0;
+	self->reserve_blocks = NULL;
+	self->write_pending = 0;
+
+	catomic_set(&self->datasize, 0);
 
 	self->message_maxlen = 128 * 1024;
 	self->custom_put_func = NULL;
 	self->custom_get_func = NULL;
 
-	self->can_write_size = 0;
-	catomic_set(&self->datasize, 0);
-
 	self->create_func = create_func;
 	self->release_func = release_func;
 	self->func_arg = func_arg;
 	self->block_size = block_size;
 
-	cspin_init(&self->list_lock);
+	blocklist_frame_init(&self->frame);
+	self->ring = NULL;
 }
 
+static inline struct block *blocklist_get_next(struct block *bk) {
+	return (struct block *)catomic_ptr_read_acquire((void *volatile *)&bk->next);
+}
+
+/*
+ * pop the head block, only the reader call it and the head need has next block, 
+ * or both reader and writer are not use the list.
+ * the tail is written by the writer, so it is only reset when pop the last block.
+ */
 static inline struct block *blocklist_pop_front(struct blocklist *self) {
-	struct block *bk;
-	cspin_lock(&self->list_lock);
-	bk = self->head;
-	if (self->head) {
-		self->head = self->head->next;
-		if (self->tail == bk) {
+	struct block *bk = self->head;
+	if (bk) {
+		self->head = blocklist_get_next(bk);
+		if (!self->head) {
+			assert(self->tail == bk);
 			self->tail = NULL;
-			assert(self->head == NULL);
-			assert(bk->next == NULL);
 		}
 	}
-	cspin_unlock(&self->list_lock);
 	return bk;
 }
 
+/*
+ * only the writer call it, the block is initialized before link, so the reader see it after acquire load.
+ * the head is set by writer only when the list is empty, the reader not use head until data is published.
+ */
 static inline void blocklist_push_back(struct blocklist *self, struct block *bk) {
-	cspin_lock(&self->list_lock);
 	bk->next = NULL;
 	if (self->tail) {
-		self->tail->next = bk;
+		catomic_ptr_set_release((void *volatile *)&self->tail->next, bk);
 	} else {
 		assert(self->head == NULL);
 		self->head = bk;
 	}
 	self->tail = bk;
-	cspin_unlock(&self->list_lock);
+}
+
+/* release block, if it is reference of shared block, then release the shared block when not any reference. */
+static inline void blocklist_release_block(struct blocklist *self, struct block *bk) {
+	struct block *shared = bk->shared;
+	self->release_func(self->func_arg, bk);
+	if (shared && catomic_dec_explicit(&shared->ref, CATOMIC_ACQ_REL) == 0)
+		self->release_func(self->func_arg, shared);
 }
 
 void blocklist_release(struct blocklist *self) {
@@ -72,28 +107,60 @@ void blocklist_release(struct blocklist *self) {
 		if (!bk)
 			break;
 
-		self->release_func(self->func_arg, bk);
+		blocklist_release_block(self, bk);
 	}
 
-	self->head = NULL;
-	self->tail = NULL;
+	while (self->reserve_blocks) {
+		struct block *bk = self->reserve_blocks;
+		self->reserve_blocks = bk->next;
+		blocklist_release_block(self, bk);
+	}
+
+	if (self->frame.ring_block)
+		self->release_func(self->func_arg, self->frame.ring_block);
+	blocklist_frame_init(&self->frame);
+	self->ring = NULL;
 
+	self->head = NULL;
 	self->is_new_message = false;
 	self->message_len = 0;
+	self->peek_len = 0;
+
+	self->tail = NULL;
+	self->can_write_size = 0;
+	self->reserve_len = 0;
+	self->reserve_blocks = NULL;
+	self->write_pending = 0;
+
+	catomic_set(&self->datasize, 0);
 
 	self->message_maxlen = 0;
 	self->custom_put_func = NULL;
 	self->custom_get_func = NULL;
 
-	self->can_write_size = 0;
-	catomic_set(&self->datasize, 0);
-
 	self->create_func = NULL;
 	self->release_func = NULL;
 	self->func_arg = NULL;
 	self->block_size = 0;
+}
+
+/* if the list has not any data, release all block of it, and return true. */
+bool blocklist_release_idle_block(struct blocklist *self) {
+	/* the ring block is kept until the list is released. */
+	if (blocklist_get_datasize(self) != 0 || self->reserve_len != 0 || 
+			self->write_pending != 0 || self->ring)
+		return false;
+
+	while (true) {
+		struct block *bk = blocklist_pop_front(self);
+		if (!bk)
+			break;
+
+		blocklist_release_block(self, bk);
+	}
 
-	cspin_destroy(&self->list_lock);
+	self->can_write_size = 0;
+	return true;
 }
 
 void blocklist_set_message_custom_arg(struct blocklist *self, 
@@ -108,26 +175,198 @@ void blocklist_set_message_custom_arg(struct blocklist *self,
 	self->custom_get_func = get_func;
 }
 
-static inline struct block *blocklist_create_block(struct blocklist *self) {
-	struct block *bk = (struct block *)self->create_func(self->func_arg, self->block_size);
+/*
+ * use the ring block instead of block chain, must be called before push any data, 
+ * the ring block is released by release function of the list.
+ * the readable or writable region of ring is always contiguous, but the size is fixed, 
+ * if it is full, write failed (put returns false, get write bufinfo returns empty).
+ */
+bool blocklist_use_ring(struct blocklist *self, struct block *ring) {
+	assert(self != NULL);
+	assert(ring != NULL && block_is_ring(ring));
+	assert(blocklist_get_datasize(self) == 0 && "use ring need before push any data!");
+	if (self->ring || !blocklist_release_idle_block(self))
+		return false;
+
+	blocklist_push_back(self, ring);
+	self->ring = ring;
+	self->can_write_size = block_get_writesize(ring);
+	return true;
+}
+
+/*
+ * use message framing by writer, must be called before push any data, the default message format only.
+ * after that, the writer call blocklist_frame_data after the data is written, 
+ * and the reader only get the framed messages, not support get data.
+ */
+bool blocklist_use_frame(struct blocklist *self) {
+	enum {
+		enum_frame_ring_block_size = 512,
+	};
+
+	struct block *bk;
+	size_t size = enum_frame_ring_block_size;
+	assert(self != NULL);
+	assert(blocklist_get_datasize(self) == 0 && "use frame need before push any data!");
+	if (self->custom_get_func || blocklist_get_datasize(self) != 0)
+		return false;
+
+	if (blocklist_is_use_frame(self))
+		return true;
+
+	/* the ring is in a block, so it is from the same pool and count to the block memory budget. */
+	bk = (struct block *)self->create_func(self->func_arg, &size);
+	if (!bk)
+		return false;
+
+	block_init(bk, (int)size);
+	self->frame.ring_block = bk;
+	self->frame.ring = (int *)block_get_writebuf(bk);
+	self->frame.ring_size = block_get_writesize(bk) / (int)sizeof(int);
+	assert(self->frame.ring_size > 0);
+	return true;
+}
+
+static inline void blocklist_frame_publish(struct blocklist_frame *frame) {
+	int64 pending = frame->push_local - catomic_read(&frame->push_num);
+	if (pending > 0)
+		catomic_fetch_add_explicit(&frame->push_num, pending, CATOMIC_RELEASE);
+}
+
+static inline void blocklist_frame_push(struct blocklist_frame *frame, int message_len) {
+	/*
+	 * if has spilled message, the new message must be spilled too, 
+	 * so the messages in ring are always before the spilled messages.
+	 */
+	if (catomic_read(&frame->spill_num) == 0 && 
+			frame->push_local - catomic_read_acquire(&frame->pop_num) < frame->ring_size) {
+		frame->ring[frame->push_local % frame->ring_size] = message_len;
+		frame->push_local++;
+		return;
+	}
+
+	/* publish the ring first. */
+	blocklist_frame_publish(frame);
+	catomic_inc_explicit(&frame->spill_num, CATOMIC_RELEASE);
+}
+
+/*
+ * split the written data into messages, and publish them to the reader, data must be in write order.
+ * if the message length is invalid, return false.
+ */
+bool blocklist_frame_data(struct blocklist *self, const char *data, int len) {
+	const int length_len = 4;
+	struct blocklist_frame *frame = &self->frame;
+	assert(self != NULL);
+	assert(blocklist_is_use_frame(self));
+	assert(len >= 0);
+
+	while (len > 0) {
+		int n;
+		if (frame->message_left == 0) {
+			/* the message length header maybe straddle the write. */
+			n = min(length_len - frame->header_len, len);
+			memcpy(&frame->header[frame->header_len], data, n);
+			frame->header_len += n;
+			data += n;
+			len -= n;
+			if (frame->header_len < length_len)
+				break;
+
+			frame->header_len = 0;
+			memcpy(&frame->message_len, frame->header, length_len);
+			if (frame->message_len < length_len || frame->message_len > self->message_maxlen) {
+				blocklist_frame_publish(frame);
+				return false;
+			}
+
+			frame->message_left = frame->message_len - length_len;
+		} else {
+			n = min(frame->message_left, len);
+			frame->message_left -= n;
+			data += n;
+			len -= n;
+		}
+
+		if (frame->message_left == 0)
+			blocklist_frame_push(frame, frame->message_len);
+	}
+
+	blocklist_frame_publish(frame);
+	return true;
+}
+
+/* the next framed message length, 0 is not any message, less than 0 is spilled message. */
+static inline int blocklist_frame_front(struct blocklist *self) {
+	struct blocklist_frame *frame = &self->frame;
+	int64 pop = catomic_read(&frame->pop_num);
+	if (pop < catomic_read_acquire(&frame->push_num))
+		return frame->ring[pop % frame->ring_size];
+
+	/* the ring is published before spill, so check the ring again, it maybe published after the first check. */
+	if (catomic_read_acquire(&frame->spill_num) > 0) {
+		if (pop < catomic_read_acquire(&frame->push_num))
+			return frame->ring[pop % frame->ring_size];
+
+		return -1;
+	}
+
+	return 0;
+}
+
+static inline struct block *blocklist_create_block(struct blocklist *self, size_t need_size) {
+	struct block *bk;
+	size_t size = min(need_size + sizeof(struct block), self->block_size);
+	bk = (struct block *)self->create_func(self->func_arg, &size);
 	if (bk) {
-		block_init(bk, (int)self->block_size);
+		assert(size > sizeof(struct block) && size <= self->block_size);
+		block_init(bk, (int)size);
 	}
 	return bk;
 }
 
+/*
+ * free the read over head blocks, the block has next block is always write over.
+ * the tail block is kept even if it is read over and write over, the writer maybe use it at the same time, 
+ * it is freed after the writer link new block.
+ */
 static inline void blocklist_check_free_block(struct blocklist *self) {
-	/* check is need free. */
-	if (block_is_read_over(self->head) && block_is_write_over(self->head)) {
+	while (blocklist_get_next(self->head) && block_is_read_over(self->head)) {
 		struct block *bk = blocklist_pop_front(self);
-		self->release_func(self->func_arg, bk);
+		assert(block_is_write_over(bk));
+		blocklist_release_block(self, bk);
 	}
 }
 
-static inline bool blocklist_check_alloc_block(struct blocklist *self) {
+/*
+ * new block size is the queue depth add the pending write size,
+ * if the queue is not drained, at least double the tail block, 
+ * so it grow geometrically with queue depth, and back to small when drained.
+ */
+static inline bool blocklist_check_alloc_block(struct blocklist *self, int pending) {
 	assert(self->can_write_size >= 0);
+
+	/*
+	 * the ring is never write over, the room grow when reader read, need not create block.
+	 * the room is got from datasize, the reader give back it after read, so the writer not overwrite the unread data.
+	 */
+	if (self->ring) {
+		int64 used = blocklist_get_datasize(self) + self->write_pending;
+		self->can_write_size = self->ring->ring_size - (int)used;
+		assert(self->can_write_size >= 0 && self->can_write_size <= block_get_writesize(self->ring));
+		return (self->can_write_size > 0) && (self->can_write_size >= pending);
+	}
+
 	if (self->can_write_size == 0) {
-		struct block *bk = blocklist_create_block(self);
+		struct block *bk;
+		size_t datasize = (size_t)(blocklist_get_datasize(self) + self->write_pending);
+		size_t need_size = datasize + (size_t)pending;
+
+		/* the tail block is write over, the reader never free it. */
+		if (self->tail && datasize > 0)
+			need_size = max(need_size, (size_t)block_get_size(self->tail) * 2);
+
+		bk = blocklist_create_block(self, need_size);
 		if (!bk)
 			return false;
 
@@ -150,15 +389,16 @@ struct buf_info blocklist_get_write_bufinfo(struct blocklist *self) {
 	writebuf.buf = NULL;
 	writebuf.len = 0;
 
-	if (blocklist_check_alloc_block(self)) {
+	if (blocklist_check_alloc_block(self, 0)) {
 		writebuf.buf = block_get_writebuf(self->tail);
-		writebuf.len = block_get_writesize(self->tail);
+		writebuf.len = self->can_write_size;
+		assert(writebuf.len <= block_get_writesize(self->tail));
 	}
 
-	assert(self->can_write_size == writebuf.len);
 	return writebuf;
 }
 
+/* add write position, the data is not visible to reader until blocklist_publish. */
 void blocklist_add_write(struct blocklist *self, int len) {
 	assert(self != NULL);
 	assert(len > 0);
@@ -166,13 +406,21 @@ void blocklist_add_write(struct blocklist *self, int len) {
 
 	self->can_write_size -= len;
 
-	/*
-	 * add block write position first,
-	 * then add datasize!
-	 */
+	/* the reader only read the data in datasize, so the block write position can go ahead. */
 	block_add_write(self->tail, len);
+	self->write_pending += len;
+}
 
-	catomic_fetch_add(&self->datasize, len);
+/* publish all written data to reader at once. */
+void blocklist_publish(struct blocklist *self) {
+	assert(self != NULL);
+	assert(self->write_pending >= 0);
+	if (self->write_pending == 0)
+		return;
+
+	/* the data and block write position is visible before the datasize. */
+	catomic_fetch_add_explicit(&self->datasize, self->write_pending, CATOMIC_RELEASE);
+	self->write_pending = 0;
 }
 
 bool blocklist_put_data(struct blocklist *self, const void *data, int datalen) {
@@ -182,14 +430,20 @@ bool blocklist_put_data(struct blocklist *self, const void *data, int datalen) {
 	assert(data != NULL);
 	assert(datalen > 0);
 	assert(self->can_write_size >= 0);
+	assert(self->reserve_len == 0 && "need commit the reserved buffer first!");
 	if (datalen <= 0)
 		return false;
 
+	/* the ring is full, not put part of data. */
+	if (self->ring && !blocklist_check_alloc_block(self, datalen))
+		return false;
+
 	writesize = 0;
 	putsize = 0;
 	while (writesize < datalen) {
-		if (!blocklist_check_alloc_block(self)) {
-			assert(false && "why create new block failed? error!");
+		/* create block failed, maybe the block memory is over budget, publish the written part. */
+		if (!blocklist_check_alloc_block(self, datalen - writesize)) {
+			blocklist_publish(self);
 			return false;
 		}
 
@@ -200,11 +454,11 @@ bool blocklist_put_data(struct blocklist *self, const void *data, int datalen) {
 		self->can_write_size -= putsize;
 
 		writesize += putsize;
-
-		catomic_fetch_add(&self->datasize, putsize);
+		self->write_pending += putsize;
 	}
 
 	assert(writesize == datalen);
+	blocklist_publish(self);
 	return true;
 }
 
@@ -225,6 +479,220 @@ bool blocklist_put_message(struct blocklist *self, const void *data, int datalen
 	}
 }
 
+/*
+ * push all data of the shared block by reference, not copy.
+ * the shared block is created by the same create function, it is released when not any reference.
+ */
+bool blocklist_put_shared(struct blocklist *self, struct block *shared) {
+	struct block *bk;
+	size_t size = sizeof(struct block);
+	int len;
+	assert(self != NULL);
+	assert(shared != NULL && !block_is_reference(shared));
+	assert(self->reserve_len == 0 && "need commit the reserved buffer first!");
+
+	len = shared->write;
+	assert(len > 0);
+	if (len <= 0)
+		return false;
+
+	/* the ring only hold contiguous data of itself, copy it. */
+	if (self->ring)
+		return blocklist_put_data(self, shared->data, len);
+
+	/* create reference block failed, maybe the block memory is over budget. */
+	bk = (struct block *)self->create_func(self->func_arg, &size);
+	if (!bk)
+		return false;
+
+	block_init_reference(bk, (int)size, shared);
+
+	/* the sealed block is write over, next write will create new block after the reference block. */
+	if (self->can_write_size > 0) {
+		block_seal(self->tail);
+		self->can_write_size = 0;
+	}
+
+	blocklist_push_back(self, bk);
+
+	self->write_pending += len;
+	blocklist_publish(self);
+	return true;
+}
+
+/*
+ * reserve len contiguous bytes in tail block for write, if tail block has not enough room, 
+ * then seal it and create a new block. len can not greater than max block size (the room of ring if use ring).
+ * return the write buffer, if failed, return NULL.
+ */
+char *blocklist_reserve_write(struct blocklist *self, int len) {
+	assert(self != NULL);
+	assert(len > 0);
+	assert(self->reserve_len == 0 && "need commit the reserved buffer first!");
+	if (len <= 0)
+		return NULL;
+
+	if (self->ring) {
+		if (!blocklist_check_alloc_block(self, len))
+			return NULL;
+	} else if ((size_t)len + sizeof(struct block) > self->block_size) {
+		return NULL;
+	} else if (self->can_write_size < len) {
+		/* the sealed block is write over, the reader free it after read over. */
+		if (self->can_write_size > 0) {
+			block_seal(self->tail);
+			self->can_write_size = 0;
+		}
+
+		/* create block failed, maybe the block memory is over budget. */
+		if (!blocklist_check_alloc_block(self, len))
+			return NULL;
+
+		if (self->can_write_size < len)
+			return NULL;
+	}
+
+	self->reserve_len = len;
+	return block_get_writebuf(self->tail);
+}
+
+/* commit len bytes of the reserved buffer, len can be 0 for cancel. */
+bool blocklist_commit_write(struct blocklist *self, int len) {
+	assert(self != NULL);
+	assert(len >= 0 && len <= self->reserve_len);
+	if (len < 0 || len > self->reserve_len)
+		return false;
+
+	self->reserve_len = 0;
+	if (len > 0) {
+		blocklist_add_write(self, len);
+		blocklist_publish(self);
+	}
+	return true;
+}
+
+/* commit message of the reserved buffer, write the message length header, len can be 0 for cancel. */
+bool blocklist_commit_message(struct blocklist *self, int len) {
+	const int length_len = 4;
+	assert(self != NULL);
+	assert(self->custom_put_func == NULL);
+	if (len == 0)
+		return blocklist_commit_write(self, 0);
+
+	if (len < length_len || len > self->message_maxlen || len > self->reserve_len) {
+		assert(false && "commit message length is invalid, error!");
+		blocklist_commit_write(self, 0);
+		return false;
+	}
+
+	memcpy(block_get_writebuf(self->tail), &len, length_len);
+	return blocklist_commit_write(self, len);
+}
+
+/*
+ * reserve num regions for write at once, region i is lens[i] contiguous bytes, bufs[i] is its write buffer.
+ * the first region is in the room of tail block if it is enough, the others are each in a new block,
+ * the new blocks are linked to the list on commit, so all regions can be written at the same time.
+ * each len can not greater than max block size, not support ring. if failed, nothing is reserved.
+ */
+bool blocklist_reserve_write_batch(struct blocklist *self, const int *lens, char **bufs, int num) {
+	struct block **pre = &self->reserve_blocks;
+	int i;
+	assert(self != NULL);
+	assert(lens != NULL && bufs != NULL);
+	assert(num > 0);
+	assert(!self->ring && "ring not support batch reserve!");
+	assert(self->reserve_len == 0 && self->reserve_blocks == NULL && "need commit the reserved buffer first!");
+	if (self->ring || num <= 0)
+		return false;
+
+	for (i = 0; i < num; ++i) {
+		if (lens[i] <= 0 || (size_t)lens[i] + sizeof(struct block) > self->block_size)
+			return false;
+	}
+
+	i = 0;
+	if (self->tail && self->can_write_size >= lens[0]) {
+		self->reserve_len = lens[0];
+		bufs[0] = block_get_writebuf(self->tail);
+		i = 1;
+	}
+
+	for (; i < num; ++i) {
+		/* create block failed, maybe the block memory is over budget, cancel all. */
+		struct block *bk = blocklist_create_block(self, (size_t)lens[i]);
+		if (!bk || block_get_writesize(bk) < lens[i]) {
+			if (bk)
+				blocklist_release_block(self, bk);
+
+			while (self->reserve_blocks) {
+				bk = self->reserve_blocks;
+				self->reserve_blocks = bk->next;
+				blocklist_release_block(self, bk);
+			}
+			self->reserve_len = 0;
+			return false;
+		}
+
+		*pre = bk;
+		pre = &bk->next;
+		bufs[i] = block_get_writebuf(bk);
+	}
+
+	return true;
+}
+
+/*
+ * commit lens[i] bytes of region i in order, len can be 0 for cancel the region,
+ * the block of a region is sealed when the next region is linked, the last block is the tail.
+ */
+bool blocklist_commit_write_batch(struct blocklist *self, const int *lens, int num) {
+	bool res = true;
+	int i = 0;
+	assert(self != NULL);
+	assert(lens != NULL);
+	if (self->reserve_len > 0) {
+		assert(lens[0] >= 0 && lens[0] <= self->reserve_len);
+		if (lens[0] > 0 && lens[0] <= self->reserve_len)
+			blocklist_add_write(self, lens[0]);
+		else
+			res = (lens[0] == 0);
+
+		self->reserve_len = 0;
+		i = 1;
+	}
+
+	for (; i < num; ++i) {
+		struct block *bk = self->reserve_blocks;
+		assert(bk != NULL);
+		if (!bk)
+			return false;
+
+		self->reserve_blocks = bk->next;
+		assert(lens[i] >= 0 && lens[i] <= block_get_writesize(bk));
+		if (lens[i] <= 0 || lens[i] > block_get_writesize(bk)) {
+			res = res && (lens[i] == 0);
+			blocklist_release_block(self, bk);
+			continue;
+		}
+
+		/* the sealed block is write over, the reader free it after read over. */
+		if (self->can_write_size > 0) {
+			block_seal(self->tail);
+			self->can_write_size = 0;
+		}
+
+		block_add_write(bk, lens[i]);
+		blocklist_push_back(self, bk);
+		self->can_write_size = block_get_writesize(bk);
+		self->write_pending += lens[i];
+	}
+
+	assert(self->reserve_blocks == NULL);
+	blocklist_publish(self);
+	return res;
+}
+
 
 
 
@@ -242,6 +710,8 @@ struct buf_info blocklist_get_read_bufinfo(struct blocklist *self) {
 	readbuf.len = 0;
 
 	if (max_readsize > 0) {
+		/* the head block maybe sealed after read over. */
+		blocklist_check_free_block(self);
 		readbuf.buf = block_get_readbuf(self->head);
 		readbuf.len = min(block_get_readsize(self->head), max_readsize);
 	}
@@ -257,9 +727,48 @@ void blocklist_add_read(struct blocklist *self, int len) {
 	/* add block read position. */
 	block_add_read(self->head, len);
 
-	catomic_fetch_add(&self->datasize, (-len));
+	/* the read data is not used after give the room back to writer. */
+	catomic_fetch_add_explicit(&self->datasize, (-len), CATOMIC_RELEASE);
+
+	blocklist_check_free_block(self);
+}
+
+/*
+ * get the published data as views of the blocks in order without read them, not copy,
+ * a view is in one block and not greater than view_maxlen, return the view num, at most max.
+ * after use, call blocklist_add_read for each view in order.
+ */
+int blocklist_get_read_views(struct blocklist *self, struct buf_info *views, int max, int view_maxlen) {
+	struct block *bk;
+	int left = (int)blocklist_get_datasize(self);
+	int num = 0;
+	assert(self != NULL);
+	assert(views != NULL);
+	assert(self->peek_len == 0 && "need release the peeked message first!");
+	assert(!blocklist_is_use_frame(self) && "framed list not support get data!");
+	if (left <= 0 || max <= 0 || view_maxlen <= 0)
+		return 0;
 
+	/* the blocks before the published data end are linked, the empty sealed block is skipped. */
 	blocklist_check_free_block(self);
+	for (bk = self->head; bk && (left > 0) && (num < max); bk = blocklist_get_next(bk)) {
+		int len = min(block_get_readsize(bk), left);
+		char *buf;
+		if (len <= 0)
+			continue;
+
+		left -= len;
+		buf = block_get_readbuf(bk);
+		while ((len > 0) && (num < max)) {
+			views[num].buf = buf;
+			views[num].len = min(len, view_maxlen);
+			buf += views[num].len;
+			len -= views[num].len;
+			++num;
+		}
+	}
+
+	return num;
 }
 
 static int blocklist_get_data_by_size(struct blocklist *self, 
@@ -287,12 +796,13 @@ static int blocklist_get_data_by_size(struct blocklist *self,
 		getsize = block_get(self->head, &buf[readsize], needread - readsize);
 		assert(getsize > 0);
 		readsize += getsize;
-
-		catomic_fetch_add(&self->datasize, (-getsize));
 	}
 
 	assert(readsize == needread);
 
+	/* the read room is given back to writer at once. */
+	catomic_fetch_add_explicit(&self->datasize, (-readsize), CATOMIC_RELEASE);
+
 	blocklist_check_free_block(self);
 	return readsize;
 }
@@ -303,6 +813,8 @@ bool blocklist_get_data(struct blocklist *self, char *buf, int buf_size, int *re
 	assert(buf != NULL);
 	assert(buf_size > 0);
 	assert(blocklist_get_datasize(self) > 0);
+	assert(self->peek_len == 0 && "need release the peeked message first!");
+	assert(!blocklist_is_use_frame(self) && "framed list not support get data!");
 
 	*read_len = 0;
 	needread = (int)min(buf_size, blocklist_get_datasize(self));
@@ -374,6 +886,87 @@ int blocklist_find_data_end_size(struct blocklist *self, const char *data, int d
 	return 0;
 }
 
+/* get the message of default format, parse the message length header. */
+static int blocklist_parse_message(struct blocklist *self, char *buf, int buf_size) {
+	/* check new message. */
+	const int length_len = 4;
+	int res = 0;
+	assert((int)sizeof(self->message_len) >= length_len);
+	if (!self->is_new_message) {
+		res = blocklist_get_data_by_size(self, 
+				(char *)&self->message_len, length_len, length_len);
+
+		if (res == 0) {
+			return 0;
+		} else if (res < 0) {
+			assert(false && "why get new message length failed? error!");
+			return res;
+		}
+
+		assert(res == length_len);
+		self->is_new_message = true;
+	}
+
+	/* check message length. */
+	if (self->message_len > buf_size || 
+		self->message_len < length_len || self->message_len > self->message_maxlen) {
+		assert(false && "new message length is invalid, error!");
+		return -1;
+	}
+
+	/* first load message length. */
+	memcpy(&buf[0], &self->message_len, length_len);
+	res = blocklist_get_data_by_size(self, &buf[length_len], 
+			(self->message_len - length_len), (self->message_len - length_len));
+
+	if (res == 0) {
+		return 0;
+	} else if (res < 0) {
+		assert(false && "why get new message data failed? error!");
+		return res;
+	}
+
+	assert(res == (self->message_len - length_len));
+
+	if (self->message_len - length_len != res) {
+		assert(false && "why get new message data length is not need read len?");
+		return -1;
+	}
+
+	res = self->message_len;
+	self->is_new_message = false;
+	self->message_len = 0;
+	return res;
+}
+
+/* get the message framed by writer. */
+static int blocklist_get_framed_message(struct blocklist *self, char *buf, int buf_size) {
+	int res;
+	int message_len = blocklist_frame_front(self);
+	if (message_len == 0)
+		return 0;
+
+	/* the spilled message, it is complete, parse it as default. */
+	if (message_len < 0) {
+		res = blocklist_parse_message(self, buf, buf_size);
+		if (res > 0)
+			catomic_dec_explicit(&self->frame.spill_num, CATOMIC_RELAXED);
+		return res;
+	}
+
+	if (message_len > buf_size)
+		return -1;
+
+	res = blocklist_get_data_by_size(self, buf, buf_size, message_len);
+	if (res != message_len) {
+		assert(false && "why get framed message data failed? error!");
+		return -1;
+	}
+
+	catomic_inc_explicit(&self->frame.pop_num, CATOMIC_RELEASE);
+	return res;
+}
+
 /*
  * if get new message succeed, return message length.
  * if do not gather together enough for a message, return 0.
@@ -384,63 +977,178 @@ int blocklist_get_message(struct blocklist *self, char *buf, int buf_size) {
 	assert(buf != NULL);
 	assert(buf_size >= self->message_maxlen && 
 			"get message need greater than message max length buffer, error!");
+	assert(self->peek_len == 0 && "need release the peeked message first!");
+
+	if (blocklist_is_use_frame(self))
+		return blocklist_get_framed_message(self, buf, buf_size);
 
 	if (!self->custom_get_func) {
-		/* check new message. */
-		const int length_len = 4;
-		int res = 0;
-		assert((int)sizeof(self->message_len) >= length_len);
-		if (!self->is_new_message) {
-			res = blocklist_get_data_by_size(self, 
-					(char *)&self->message_len, length_len, length_len);
+		return blocklist_parse_message(self, buf, buf_size);
+	} else {
+		return self->custom_get_func(blocklist_get_data_by_size, self, 
+									blocklist_get_datasize(self), 
+									&self->is_new_message, &self->message_len, 
+									buf, buf_size);
+	}
+}
 
-			if (res == 0) {
-				return 0;
-			} else if (res < 0) {
-				assert(false && "why get new message length failed? error!");
-				return res;
-			}
+/*
+ * peek new message, if the message is contiguous in head block, *msg point to it and not copy,
+ * else copy it to buf as blocklist_get_message, and *msg point to buf.
+ * return value is same as blocklist_get_message.
+ * if return greater than 0, must call blocklist_release_message before get next message or data.
+ */
+int blocklist_peek_message(struct blocklist *self, char *buf, int buf_size, char **msg) {
+	assert(self != NULL);
+	assert(msg != NULL);
+	assert(self->peek_len == 0 && "need release the peeked message first!");
+
+	*msg = buf;
+
+	/* the framed message, the length is known, need not parse. */
+	if (blocklist_is_use_frame(self)) {
+		int message_len = blocklist_frame_front(self);
+		if (message_len == 0)
+			return 0;
 
-			assert(res == length_len);
-			self->is_new_message = true;
+		if (message_len > 0) {
+			blocklist_check_free_block(self);
+			assert(self->head != NULL);
+			if (block_get_readsize(self->head) >= message_len) {
+				*msg = block_get_readbuf(self->head);
+				self->peek_len = message_len;
+				catomic_inc_explicit(&self->frame.pop_num, CATOMIC_RELEASE);
+				return message_len;
+			}
 		}
+	} else if (!self->custom_get_func && !self->is_new_message) {
+		/* only the default message format and the length is not yet read, can peek in block. */
+		const int length_len = 4;
+		int datasize = (int)blocklist_get_datasize(self);
+		int message_len;
+		if (datasize < length_len)
+			return 0;
 
-		/* check message length. */
-		if (self->message_len > buf_size || 
-			self->message_len < length_len || self->message_len > self->message_maxlen) {
-			assert(false && "new message length is invalid, error!");
-			return -1;
+		blocklist_check_free_block(self);
+		assert(self->head != NULL);
+
+		/*
+		 * the block write position is add before datasize, so the readsize maybe has not yet published data,
+		 * only the data in datasize can be peeked.
+		 */
+		if (block_get_readsize(self->head) >= length_len) {
+			memcpy(&message_len, block_get_readbuf(self->head), length_len);
+			if (message_len >= length_len && message_len <= self->message_maxlen) {
+				if (datasize < message_len)
+					return 0;
+
+				if (block_get_readsize(self->head) >= message_len) {
+					*msg = block_get_readbuf(self->head);
+					self->peek_len = message_len;
+					return message_len;
+				}
+			}
 		}
+	}
 
-		/* first load message length. */
-		memcpy(&buf[0], &self->message_len, length_len);
-		res = blocklist_get_data_by_size(self, &buf[length_len], 
-				(self->message_len - length_len), (self->message_len - length_len));
+	/* straddle blocks or the length is invalid, copy it or report error. */
+	return blocklist_get_message(self, buf, buf_size);
+}
 
-		if (res == 0) {
-			return 0;
-		} else if (res < 0) {
-			assert(false && "why get new message data failed? error!");
-			return res;
+/*
+ * peek all complete messages in one pass, up to max, msgs[i] point to them.
+ * the messages in head block are not copied, a message straddle blocks is copied to the arena,
+ * only when it is the first of the head block and arena has room for a max length message.
+ * return the message num, 0 is no message, less than 0 is error.
+ * if return greater than 0, must call blocklist_release_message before get next message or data.
+ */
+int blocklist_peek_message_batch(struct blocklist *self, char *arena, int arena_size, char **msgs, int max) {
+	const int length_len = 4;
+	int num = 0;
+	int res;
+	assert(self != NULL);
+	assert(msgs != NULL);
+	assert(self->peek_len == 0 && "need release the peeked message first!");
+
+	while (num < max) {
+		if (blocklist_is_use_frame(self)) {
+			/* the framed message, the length is known, need not parse. */
+			int message_len = blocklist_frame_front(self);
+			if (message_len == 0)
+				break;
+
+			if (message_len > 0) {
+				if (self->peek_len == 0)
+					blocklist_check_free_block(self);
+				assert(self->head != NULL);
+
+				if (block_get_readsize(self->head) - self->peek_len >= message_len) {
+					msgs[num++] = block_get_readbuf(self->head) + self->peek_len;
+					self->peek_len += message_len;
+					catomic_inc_explicit(&self->frame.pop_num, CATOMIC_RELEASE);
+					continue;
+				}
+			}
+		} else if (!self->custom_get_func && !self->is_new_message) {
+			/* only the default message format and the length is not yet read, can peek in block. */
+			int datasize = (int)blocklist_get_datasize(self) - self->peek_len;
+			int readsize;
+			int message_len;
+			if (datasize < length_len)
+				break;
+
+			if (self->peek_len == 0)
+				blocklist_check_free_block(self);
+			assert(self->head != NULL);
+
+			/* the same as blocklist_peek_message, only the data in datasize can be peeked. */
+			readsize = block_get_readsize(self->head) - self->peek_len;
+			if (readsize >= length_len) {
+				char *readbuf = block_get_readbuf(self->head) + self->peek_len;
+				memcpy(&message_len, readbuf, length_len);
+				if (message_len >= length_len && message_len <= self->message_maxlen) {
+					if (datasize < message_len)
+						break;
+
+					if (readsize >= message_len) {
+						msgs[num++] = readbuf;
+						self->peek_len += message_len;
+						continue;
+					}
+				}
+			}
 		}
 
-		assert(res == (self->message_len - length_len));
+		/*
+		 * straddle blocks, custom format or the length is invalid, copy it or report error,
+		 * the blocks of peeked messages must not be read, so stop at here.
+		 */
+		if (self->peek_len != 0 || !arena || arena_size < self->message_maxlen)
+			break;
 
-		if (self->message_len - length_len != res) {
-			assert(false && "why get new message data length is not need read len?");
-			return -1;
-		}
+		res = blocklist_get_message(self, arena, arena_size);
+		if (res == 0)
+			break;
 
-		res = self->message_len;
-		self->is_new_message = false;
-		self->message_len = 0;
-		return res;
+		if (res < 0)
+			return (num == 0) ? res : num;
 
-	} else {
-		return self->custom_get_func(blocklist_get_data_by_size, self, 
-									blocklist_get_datasize(self), 
-									&self->is_new_message, &self->message_len, 
-									buf, buf_size);
+		msgs[num++] = arena;
+		arena += res;
+		arena_size -= res;
 	}
+
+	return num;
 }
 
+/* release the message of blocklist_peek_message. */
+void blocklist_release_message(struct blocklist *self) {
+	int len;
+	assert(self != NULL);
+	if (self->peek_len == 0)
+		return;
+
+	len = self->peek_len;
+	self->peek_len = 0;
+	blocklist_add_read(self, len);
+}
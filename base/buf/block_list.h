@@ -12,41 +12,113 @@ extern "C" {
 #endif
 
 #include "catomic.h"
-#include "cthread.h"
 #include "buf/block.h"
 #include "buf/block_list_func.h"
 
+/*
+ * message framing by writer, optional.
+ * the writer split the data into messages after write, push the message length to the ring,
+ * if the ring is full, then count it to spill_num, the reader parse the spilled message header by itself.
+ * the messages in ring are always before the spilled messages.
+ */
+struct blocklist_frame {
+	struct block *ring_block;				/* the block hold the ring. */
+	int *ring;								/* message length ring, NULL is not use framing. */
+	int ring_size;
+
+	/* writer. */
+	int header_len;							/* received length of the message length header. */
+	char header[4];
+	int message_len;						/* current message length. */
+	int message_left;						/* current message left length, 0 is wait for header. */
+	int64 push_local;						/* pushed num, not yet published to push_num. */
+
+	catomic push_num;						/* writer add. */
+	catomic pop_num;						/* reader add. */
+	catomic spill_num;						/* writer add and reader dec. */
+};
+
+/*
+ * single producer and single consumer block list, not any lock.
+ * the writer own the tail and link new block with release store, 
+ * the reader own the head and only free it when it has next block, so the tail is never freed by reader.
+ * the written data is published to reader by datasize once per operation (or batch of blocklist_add_write), 
+ * the reader only read the data in datasize.
+ */
 struct blocklist {
+	/* reader. */
 	struct block *head;
-	struct block *tail;
-
 	bool is_new_message;					/* is new message? */
 	int message_len;						/* current message length. */
+	int peek_len;							/* peeked message length in head block, wait for release. */
+
+	/* writer. */
+	struct block *tail;
+	int can_write_size;						/* can write size for pusher. */
+	int reserve_len;						/* reserved write length in tail block, wait for commit. */
+	struct block *reserve_blocks;			/* the new blocks of batch reserve, wait for commit. */
+	int write_pending;						/* written data length, not yet published to datasize. */
+
+	catomic datasize;						/* this block list published data total, pusher add and getter dec. */
 
 	int message_maxlen;						/* message max length. */
 	put_message_func custom_put_func;		/* custom put message function. */
 	get_message_func custom_get_func;		/* custom get message function. */
 
-	int can_write_size;						/* can write size for pusher. */
-	catomic datasize;						/* this block list data total, pusher add and getter dec. */
-
 	create_block_func create_func;
 	release_block_func release_func;
 	void *func_arg;
-	size_t block_size;
+	size_t block_size;						/* max block size. */
 
-	cspin list_lock;
+	struct blocklist_frame frame;			/* message framing by writer. */
+	struct block *ring;						/* if not NULL, the list only has this ring block. */
 };
 
 
+/*
+ * block_size is max block size, new block size is grow with the queue depth,
+ * create_func can return block of any size not greater than it.
+ */
 void blocklist_init(struct blocklist *self, create_block_func create_func, 
 		release_block_func release_func, void *func_arg, size_t block_size);
 
 void blocklist_release(struct blocklist *self);
 
+/* if the list has not any data, release all block of it, and return true. */
+bool blocklist_release_idle_block(struct blocklist *self);
+
 void blocklist_set_message_custom_arg(struct blocklist *self, 
 		int message_maxlen, put_message_func put_func, get_message_func get_func);
 
+/*
+ * use the ring block instead of block chain, must be called before push any data, 
+ * the ring block is released by release function of the list.
+ * the readable or writable region of ring is always contiguous, but the size is fixed, 
+ * if it is full, write failed (put returns false, get write bufinfo returns empty).
+ */
+bool blocklist_use_ring(struct blocklist *self, struct block *ring);
+
+static inline bool blocklist_is_use_ring(struct blocklist *self) {
+	return (self->ring != NULL);
+}
+
+/*
+ * use message framing by writer, must be called before push any data, the default message format only.
+ * after that, the writer call blocklist_frame_data after the data is written, 
+ * and the reader only get the framed messages, not support get data.
+ */
+bool blocklist_use_frame(struct blocklist *self);
+
+static inline bool blocklist_is_use_frame(struct blocklist *self) {
+	return (self->frame.ring != NULL);
+}
+
+/*
+ * split the written data into messages, and publish them to the reader, data must be in write order.
+ * if the message length is invalid, return false.
+ */
+bool blocklist_frame_data(struct blocklist *self, const char *data, int len);
+
 static inline int blocklist_get_message_len(struct blocklist *self) {
 	return self->message_len;
 }
@@ -55,8 +127,9 @@ static inline int blocklist_get_message_maxlen(struct blocklist *self) {
 	return self->message_maxlen;
 }
 
+/* the published data size. */
 static inline int64 blocklist_get_datasize(struct blocklist *self) {
-	return catomic_read(&self->datasize);
+	return catomic_read_acquire(&self->datasize);
 }
 
 
@@ -68,12 +141,57 @@ static inline int64 blocklist_get_datasize(struct blocklist *self) {
  */
 struct buf_info blocklist_get_write_bufinfo(struct blocklist *self);
 
+/* add write position, the data is not visible to reader until blocklist_publish. */
 void blocklist_add_write(struct blocklist *self, int len);
 
+/* publish all written data to reader at once. */
+void blocklist_publish(struct blocklist *self);
+
 bool blocklist_put_data(struct blocklist *self, const void *data, int datalen);
 
 bool blocklist_put_message(struct blocklist *self, const void *data, int datalen);
 
+/*
+ * push all data of the shared block by reference, not copy.
+ * the shared block is created by the same create function, it is released when not any reference.
+ */
+bool blocklist_put_shared(struct blocklist *self, struct block *shared);
+
+/*
+ * reserve len contiguous bytes in tail block for write, if tail block has not enough room, 
+ * then seal it and create a new block. len can not greater than max block size (the room of ring if use ring).
+ * return the write buffer, if failed, return NULL.
+ */
+char *blocklist_reserve_write(struct blocklist *self, int len);
+
+/* max len of blocklist_reserve_write, the room of tail block is can_write_size. */
+static inline int blocklist_get_reserve_maxlen(struct blocklist *self) {
+	if (self->ring)
+		return self->ring->ring_size;
+
+	return (int)(self->block_size - sizeof(struct block));
+}
+
+/* commit len bytes of the reserved buffer, len can be 0 for cancel. */
+bool blocklist_commit_write(struct blocklist *self, int len);
+
+/* commit message of the reserved buffer, write the message length header, len can be 0 for cancel. */
+bool blocklist_commit_message(struct blocklist *self, int len);
+
+/*
+ * reserve num regions for write at once, region i is lens[i] contiguous bytes, bufs[i] is its write buffer.
+ * the first region is in the room of tail block if it is enough, the others are each in a new block,
+ * the new blocks are linked to the list on commit, so all regions can be written at the same time.
+ * each len can not greater than max block size, not support ring. if failed, nothing is reserved.
+ */
+bool blocklist_reserve_write_batch(struct blocklist *self, const int *lens, char **bufs, int num);
+
+/*
+ * commit lens[i] bytes of region i in order, len can be 0 for cancel the region,
+ * the block of a region is sealed when the next region is linked, the last block is the tail.
+ */
+bool blocklist_commit_write_batch(struct blocklist *self, const int *lens, int num);
+
 
 
 
@@ -88,6 +206,13 @@ struct buf_info blocklist_get_read_bufinfo(struct blocklist *self);
 
 void blocklist_add_read(struct blocklist *self, int len);
 
+/*
+ * get the published data as views of the blocks in order without read them, not copy,
+ * a view is in one block and not greater than view_maxlen, return the view num, at most max.
+ * after use, call blocklist_add_read for each view in order.
+ */
+int blocklist_get_read_views(struct blocklist *self, struct buf_info *views, int max, int view_maxlen);
+
 bool blocklist_get_data(struct blocklist *self, char *buf, int buf_size, int *read_len);
 
 int blocklist_find_data_end_size(struct blocklist *self, const char *data, int datalen);
@@ -99,6 +224,26 @@ int blocklist_find_data_end_size(struct blocklist *self, const char *data, int d
  */
 int blocklist_get_message(struct blocklist *self, char *buf, int buf_size);
 
+/*
+ * peek new message, if the message is contiguous in head block, *msg point to it and not copy,
+ * else copy it to buf as blocklist_get_message, and *msg point to buf.
+ * return value is same as blocklist_get_message.
+ * if return greater than 0, must call blocklist_release_message before get next message or data.
+ */
+int blocklist_peek_message(struct blocklist *self, char *buf, int buf_size, char **msg);
+
+/*
+ * peek all complete messages in one pass, up to max, msgs[i] point to them.
+ * the messages in head block are not copied, a message straddle blocks is copied to the arena,
+ * only when it is the first of the head block and arena has room for a max length message.
+ * return the message num, 0 is no message, less than 0 is error.
+ * if return greater than 0, must call blocklist_release_message before get next message or data.
+ */
+int blocklist_peek_message_batch(struct blocklist *self, char *arena, int arena_size, char **msgs, int max);
+
+/* release the message of blocklist_peek_message or blocklist_peek_message_batch. */
+void blocklist_release_message(struct blocklist *self);
+
 #ifdef __cplusplus
 }
 #endif
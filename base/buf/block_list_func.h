@@ -15,7 +15,8 @@ extern "C" {
 
 struct blocklist;
 
-typedef void *(*create_block_func)(void *arg, size_t size);
+/* size is need block size, and return the real block size. */
+typedef void *(*create_block_func)(void *arg, size_t *size);
 typedef void (*release_block_func)(void *arg, void *bobj);
 typedef bool (*put_data_func)(struct blocklist *self, const void *data, int datalen);
 typedef int (*get_data_func)(struct blocklist *self, char *buf, int buf_size, int needread);
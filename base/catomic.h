@@ -13,6 +13,10 @@ extern "C" {
 
 #include "platform_config.h"
 
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
 
 typedef struct {
 	volatile int64 counter
@@ -84,21 +88,218 @@ bool catomic_compare_set(catomic *atom_value, int64 old, int64 set) {
 
 
 
-int64 catomic_read(catomic *atom_value);
-void catomic_set(catomic *atom_value, int64 value);
+/*
+ * memory order of the *_explicit functions, same as C11/C++11.
+ * CATOMIC_RELAXED --- only atomic, not order other memory, for counter and statistics.
+ * CATOMIC_ACQUIRE --- load or read-modify-write, the memory access after it is not move before it.
+ * CATOMIC_RELEASE --- store or read-modify-write, the memory access before it is not move after it.
+ * CATOMIC_ACQ_REL --- read-modify-write, both acquire and release.
+ * CATOMIC_SEQ_CST --- full barrier.
+ *
+ * the functions without order are CATOMIC_SEQ_CST, except catomic_read and catomic_set are CATOMIC_RELAXED.
+ */
+#ifdef _MSC_VER
+#define CATOMIC_RELAXED 0
+#define CATOMIC_ACQUIRE 2
+#define CATOMIC_RELEASE 3
+#define CATOMIC_ACQ_REL 4
+#define CATOMIC_SEQ_CST 5
+#else
+#define CATOMIC_RELAXED __ATOMIC_RELAXED
+#define CATOMIC_ACQUIRE __ATOMIC_ACQUIRE
+#define CATOMIC_RELEASE __ATOMIC_RELEASE
+#define CATOMIC_ACQ_REL __ATOMIC_ACQ_REL
+#define CATOMIC_SEQ_CST __ATOMIC_SEQ_CST
+#endif
+
+#ifdef _MSC_VER
+
+/* the interlocked function is full barrier, use it for all order except relaxed. */
+#define msvc_catomic_compare_swap64(counter, old, set)	\
+	_InterlockedCompareExchange64((volatile __int64 *)(counter), (set), (old))
+
+#define MSVC_CATOMIC_FETCH_OP(counter, op, value, old)	\
+	do {	\
+		old = (counter);	\
+	} while (msvc_catomic_compare_swap64(&(counter), old, old op (value)) != old)
+
+#endif
+
+
+
+static inline int64 catomic_load_explicit(catomic *atom_value, int order) {
+#ifdef _MSC_VER
+	if (order == CATOMIC_RELAXED)
+		return atom_value->counter;
+
+	return msvc_catomic_compare_swap64(&atom_value->counter, 0, 0);
+#else
+	return __atomic_load_n(&atom_value->counter, order);
+#endif
+}
+
+static inline void catomic_store_explicit(catomic *atom_value, int64 value, int order) {
+#ifdef _MSC_VER
+	int64 old;
+	if (order == CATOMIC_RELAXED) {
+		atom_value->counter = value;
+		return;
+	}
+
+	do {
+		old = atom_value->counter;
+	} while (msvc_catomic_compare_swap64(&atom_value->counter, old, value) != old);
+#else
+	__atomic_store_n(&atom_value->counter, value, order);
+#endif
+}
+
+static inline int64 catomic_fetch_add_explicit(catomic *atom_value, int64 value, int order) {
+#ifdef _MSC_VER
+	int64 old;
+	MSVC_CATOMIC_FETCH_OP(atom_value->counter, +, value, old);
+	return old;
+#else
+	return __atomic_fetch_add(&atom_value->counter, value, order);
+#endif
+}
+
+static inline int64 catomic_fetch_or_explicit(catomic *atom_value, int64 value, int order) {
+#ifdef _MSC_VER
+	int64 old;
+	MSVC_CATOMIC_FETCH_OP(atom_value->counter, |, value, old);
+	return old;
+#else
+	return __atomic_fetch_or(&atom_value->counter, value, order);
+#endif
+}
 
+static inline int64 catomic_fetch_and_explicit(catomic *atom_value, int64 value, int order) {
+#ifdef _MSC_VER
+	int64 old;
+	MSVC_CATOMIC_FETCH_OP(atom_value->counter, &, value, old);
+	return old;
+#else
+	return __atomic_fetch_and(&atom_value->counter, value, order);
+#endif
+}
 
+/* if failed, the order of load is relaxed for CATOMIC_RELEASE, acquire for CATOMIC_ACQ_REL. */
+static inline bool catomic_compare_set_explicit(catomic *atom_value, int64 old, int64 set, int order) {
+#ifdef _MSC_VER
+	return msvc_catomic_compare_swap64(&atom_value->counter, old, set) == old;
+#else
+	int fail_order = order;
+	if (order == CATOMIC_RELEASE)
+		fail_order = CATOMIC_RELAXED;
+	else if (order == CATOMIC_ACQ_REL)
+		fail_order = CATOMIC_ACQUIRE;
+
+	return __atomic_compare_exchange_n(&atom_value->counter, &old, set, false, order, fail_order);
+#endif
+}
+
+static inline void catomic_thread_fence(int order) {
+#ifdef _MSC_VER
+	volatile long barrier = 0;
+	if (order != CATOMIC_RELAXED)
+		_InterlockedOr(&barrier, 0);
+#else
+	__atomic_thread_fence(order);
+#endif
+}
+
+
+
+static inline int64 catomic_read(catomic *atom_value) {
+	return catomic_load_explicit(atom_value, CATOMIC_RELAXED);
+}
 
-int64 catomic_inc(catomic *atom_value);
-int64 catomic_dec(catomic *atom_value);
-int64 catomic_fetch_add(catomic *atom_value, int64 value);
-int64 catomic_fetch_or(catomic *atom_value, int64 value);
-int64 catomic_fetch_and(catomic *atom_value, int64 value);
-int64 catomic_add_fetch(catomic *atom_value, int64 value);
-int64 catomic_or_fetch(catomic *atom_value, int64 value);
-int64 catomic_and_fetch(catomic *atom_value, int64 value);
-bool catomic_compare_set(catomic *atom_value, int64 old, int64 set);
-void catomic_synchronize();
+static inline void catomic_set(catomic *atom_value, int64 value) {
+	catomic_store_explicit(atom_value, value, CATOMIC_RELAXED);
+}
+
+/*
+ * acquire load and release store, for single producer and single consumer handoff.
+ * the writer fill data and then release store the position or pointer,
+ * the reader acquire load it, and then read the data, need not full barrier.
+ */
+static inline int64 catomic_read_acquire(catomic *atom_value) {
+	return catomic_load_explicit(atom_value, CATOMIC_ACQUIRE);
+}
+
+static inline void catomic_set_release(catomic *atom_value, int64 value) {
+	catomic_store_explicit(atom_value, value, CATOMIC_RELEASE);
+}
+
+static inline void *catomic_ptr_read_acquire(void *volatile *ptr) {
+#ifdef _MSC_VER
+	return _InterlockedCompareExchangePointer(ptr, NULL, NULL);
+#else
+	return __atomic_load_n(ptr, __ATOMIC_ACQUIRE);
+#endif
+}
+
+static inline void catomic_ptr_set_release(void *volatile *ptr, void *value) {
+#ifdef _MSC_VER
+	_InterlockedExchangePointer(ptr, value);
+#else
+	__atomic_store_n(ptr, value, __ATOMIC_RELEASE);
+#endif
+}
+
+
+
+/* return the new value. */
+static inline int64 catomic_inc_explicit(catomic *atom_value, int order) {
+	return catomic_fetch_add_explicit(atom_value, 1, order) + 1;
+}
+
+static inline int64 catomic_dec_explicit(catomic *atom_value, int order) {
+	return catomic_fetch_add_explicit(atom_value, -1, order) - 1;
+}
+
+
+
+static inline int64 catomic_inc(catomic *atom_value) {
+	return catomic_fetch_add_explicit(atom_value, 1, CATOMIC_SEQ_CST) + 1;
+}
+
+static inline int64 catomic_dec(catomic *atom_value) {
+	return catomic_fetch_add_explicit(atom_value, -1, CATOMIC_SEQ_CST) - 1;
+}
+
+static inline int64 catomic_fetch_add(catomic *atom_value, int64 value) {
+	return catomic_fetch_add_explicit(atom_value, value, CATOMIC_SEQ_CST);
+}
+
+static inline int64 catomic_fetch_or(catomic *atom_value, int64 value) {
+	return catomic_fetch_or_explicit(atom_value, value, CATOMIC_SEQ_CST);
+}
+
+static inline int64 catomic_fetch_and(catomic *atom_value, int64 value) {
+	return catomic_fetch_and_explicit(atom_value, value, CATOMIC_SEQ_CST);
+}
+
+static inline int64 catomic_add_fetch(catomic *atom_value, int64 value) {
+	return catomic_fetch_add_explicit(atom_value, value, CATOMIC_SEQ_CST) + value;
+}
+
+static inline int64 catomic_or_fetch(catomic *atom_value, int64 value) {
+	return catomic_fetch_or_explicit(atom_value, value, CATOMIC_SEQ_CST) | value;
+}
+
+static inline int64 catomic_and_fetch(catomic *atom_value, int64 value) {
+	return catomic_fetch_and_explicit(atom_value, value, CATOMIC_SEQ_CST) & value;
+}
+
+static inline bool catomic_compare_set(catomic *atom_value, int64 old, int64 set) {
+	return catomic_compare_set_explicit(atom_value, old, set, CATOMIC_SEQ_CST);
+}
+
+static inline void catomic_synchronize() {
+	catomic_thread_fence(CATOMIC_SEQ_CST);
+}
 
 #ifdef __cplusplus
 }
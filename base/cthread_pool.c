@@ -187,7 +187,7 @@ static void cthread_pool_resume_some_thread(struct cthread_pool *self,
 }
 
 static void cthread_pool_do_thread_exit(struct cthread_info *th) {
-	catomic_dec(&th->mgr->activity_num);
+	catomic_dec_explicit(&th->mgr->activity_num, CATOMIC_RELAXED);
 
 	if (cthread_info_is_header(th)) {
 
@@ -198,7 +198,7 @@ static void cthread_pool_do_thread_exit(struct cthread_info *th) {
 	}
 
 	cthread_info_state_to_exit(th);
-	catomic_inc(&th->mgr->exit_num);
+	catomic_inc_explicit(&th->mgr->exit_num, CATOMIC_RELEASE);
 
 	thread_pool_debuglog("func:[%s] thread id:%d, activity num:%d, exit num:%d, has_leader:%d", 
 			__FUNCTION__, cthread_info_get_id(th), 
@@ -216,26 +216,26 @@ static void th_pro_func(cthread *th) {
 	cthread_suspend(cthread_info_get_handle_ptr(cinfo));
 
 	/* check need run. */
-	if (catomic_read(&mgr->run) == 0)
+	if (catomic_load_explicit(&mgr->run, CATOMIC_ACQUIRE) == 0)
 		return;
 
 	cinfo_id = (int)cthread_info_get_id(cinfo);
 	(void)cinfo_id;
 
 	cthread_info_state_to_activity(cinfo);
-	catomic_inc(&mgr->resume_num);
-	catomic_inc(&mgr->activity_num);
-	catomic_inc(&mgr->need_exit_num);
+	catomic_inc_explicit(&mgr->resume_num, CATOMIC_RELAXED);
+	catomic_inc_explicit(&mgr->activity_num, CATOMIC_RELAXED);
+	catomic_inc_explicit(&mgr->need_exit_num, CATOMIC_ACQ_REL);
 
 	/* wait all run to here. */
-	while (catomic_read(&mgr->need_exit_num) != (int64)mgr->thread_num) {
+	while (catomic_load_explicit(&mgr->need_exit_num, CATOMIC_ACQUIRE) != (int64)mgr->thread_num) {
 		cthread_self_sleep(0);
 	}
 
 	thread_pool_debuglog("func:[%s][start thread] id:%d", 
 			__FUNCTION__, cthread_info_get_id(cinfo));
 
-	while (catomic_read(&mgr->run) != 0) {
+	while (catomic_load_explicit(&mgr->run, CATOMIC_ACQUIRE) != 0) {
 		if (cthread_info_is_header(cinfo)) {
 			/*
 			 * do leader function,
@@ -254,8 +254,9 @@ static void th_pro_func(cthread *th) {
 
 				cthread_info_change_to_henchman(cinfo);
 
-				catomic_set(&mgr->has_leader, 0);
-				catomic_set(&mgr->resume_num, real_resume_num);
+				/* the followers see the result of leader function after acquire resume_num. */
+				catomic_store_explicit(&mgr->has_leader, 0, CATOMIC_RELEASE);
+				catomic_store_explicit(&mgr->resume_num, real_resume_num, CATOMIC_RELEASE);
 
 				cthread_pool_resume_some_thread(mgr, real_resume_num - 1, cinfo);
 			} else if (resume_num < 0) {
@@ -272,13 +273,13 @@ static void th_pro_func(cthread *th) {
 				break;
 
 			/* If own is the last activity of the followers, set own to leader. */
-			if (catomic_dec(&mgr->resume_num) == 0) {
+			if (catomic_dec_explicit(&mgr->resume_num, CATOMIC_ACQ_REL) == 0) {
 
 				assert(catomic_read(&mgr->activity_num) >= 1);
 				assert(catomic_read(&mgr->has_leader) == 0);
 
 				/* competition leader. */
-				if (catomic_compare_set(&mgr->has_leader, 0, 1)) {
+				if (catomic_compare_set_explicit(&mgr->has_leader, 0, 1, CATOMIC_ACQ_REL)) {
 
 					/* change own to leader. */
 					cthread_info_change_to_header(cinfo);
@@ -299,8 +300,8 @@ static void th_pro_func(cthread *th) {
 
 			/* suspend. */
 			cthread_info_state_to_suspend(cinfo);
-			catomic_dec(&mgr->activity_num);
-			catomic_inc(&mgr->suspend_num);
+			catomic_dec_explicit(&mgr->activity_num, CATOMIC_RELAXED);
+			catomic_inc_explicit(&mgr->suspend_num, CATOMIC_RELAXED);
 
 			thread_pool_debuglog("func:[%s][suspend thread] thread id:%d, activity num:%d, " 
 					"exit num:%d, has_leader:%d", __FUNCTION__, cthread_info_get_id(cinfo), 
@@ -312,8 +313,8 @@ static void th_pro_func(cthread *th) {
 
 			/* from resume. */
 			cthread_info_state_to_activity(cinfo);
-			catomic_dec(&mgr->suspend_num);
-			catomic_inc(&mgr->activity_num);
+			catomic_dec_explicit(&mgr->suspend_num, CATOMIC_RELAXED);
+			catomic_inc_explicit(&mgr->activity_num, CATOMIC_RELAXED);
 
 			thread_pool_debuglog("func:[%s][thread for resume] thread id:%d, activity num:%d, " 
 					"exit num:%d, has_leader:%d", __FUNCTION__,	cthread_info_get_id(cinfo), 
@@ -372,7 +373,7 @@ struct cthread_pool *cthread_pool_create(int thread_num, void *udata,
 		--thread_num;
 	}
 
-	catomic_set(&self->run, 1);
+	catomic_store_explicit(&self->run, 1, CATOMIC_RELEASE);
 
 	thread_pool_debuglog("func[%s] mgr:%p", __FUNCTION__, self);
 
@@ -380,7 +381,7 @@ struct cthread_pool *cthread_pool_create(int thread_num, void *udata,
 	cthread_pool_resume_some_thread(self, self->thread_num, NULL);
 
 	/* wait thread run. */
-	while (catomic_read(&self->need_exit_num) != (int64)self->thread_num) {
+	while (catomic_load_explicit(&self->need_exit_num, CATOMIC_ACQUIRE) != (int64)self->thread_num) {
 		cthread_self_sleep(0);
 	}
 
@@ -401,9 +402,10 @@ void cthread_pool_release(struct cthread_pool *self) {
 
 	thread_pool_debuglog("func[%s] mgr:%p", __FUNCTION__, self);
 
-	catomic_set(&self->run, 0);
+	catomic_store_explicit(&self->run, 0, CATOMIC_RELEASE);
 
-	while (catomic_read(&self->exit_num) != catomic_read(&self->need_exit_num)) {
+	while (catomic_load_explicit(&self->exit_num, CATOMIC_ACQUIRE) != 
+			catomic_load_explicit(&self->need_exit_num, CATOMIC_ACQUIRE)) {
 
 		cthread_pool_resume_some_thread(self, self->thread_num, NULL);
 
@@ -10,6 +10,23 @@
 #include "pool.h"
 #include "log.h"
 
+#if defined(__linux__) && !defined(NOTUSE_POOL)
+#include <unistd.h>
+#include <sys/mman.h>
+
+/* node pool backed by huge page, map size is align to this. */
+#define POOL_HUGE_PAGE_SIZE (2 * 1024 * 1024)
+
+/* trim can advise the pages of long free node pool back to system. */
+#ifdef MADV_DONTNEED
+#define POOL_TRIM_ADVISE
+#endif
+#endif
+
+/* decay of the object used num on each trim, and the keep ratio of the decayed used num. */
+#define POOL_TRIM_DECAY 0.125
+#define POOL_TRIM_KEEP_RATIO 1.25
+
 #ifndef NDEBUG
 #define NODE_IS_USED_VALUE(mgr) ((mgr) - (0x000000AB))
 #define NODE_IS_FREED_VALUE(mgr) (mgr)
@@ -23,6 +40,11 @@ enum {
 	enum_free,
 };
 
+enum {
+	enum_mem_malloc = 0,
+	enum_mem_mmap,
+};
+
 struct node_flag {
 	void *pool_addr;
 
@@ -52,7 +74,10 @@ struct node_pool {
 
 	struct node *head;
 	short type;
+	short mem_type;		/* raw from malloc or mmap. */
 	bool need_free;		/* if need_free is true, then must call free function. */
+	size_t mem_size;	/* raw memory size, for munmap. */
+	time_t free_time;	/* first seen free by trim, 0 is not seen. */
 };
 
 struct listobj {
@@ -86,6 +111,15 @@ struct poolmgr {
 	size_t free_pool_num_for_shrink;
 	double free_node_ratio_for_shrink;
 
+	/* new node pool use huge page memory. */
+	bool use_hugepage;
+
+	/* for trim */
+	double used_decay;
+	size_t trim_release_pool_num;
+	size_t trim_release_bytes;
+	size_t trim_advise_bytes;
+
 	/* full use node pool list. */
 	struct listobj full_use_list;
 
@@ -102,6 +136,11 @@ struct poolmgr {
 #define F_MAKE_ALIGNMENT(num, align)	(((num) + ((align) - 1)) & (~((align) - 1)))
 #define F_THIS_POOL_ALIGNMENT_SIZE		16
 #define F_THIS_POOL_ALIGNMENT(num)		F_MAKE_ALIGNMENT(num, F_THIS_POOL_ALIGNMENT_SIZE)
+
+/* memory size of node pool, the first node is aligned to alignment, so all node is aligned. */
+#define F_NODE_POOL_MEM_SIZE(block_size, node_num, alignment)	\
+	(F_THIS_POOL_ALIGNMENT_SIZE + F_THIS_POOL_ALIGNMENT(sizeof(struct node_pool)) + \
+	 (alignment) + (block_size) * (node_num))
 static inline bool alignment_check(size_t alignment) {
 	switch (alignment) {
 	case 1:
@@ -181,15 +220,13 @@ static inline void node_pool_push_node(struct poolmgr *mgr, struct node_pool *se
 }
 
 static inline struct node_pool *node_pool_create(void *mem, size_t mem_size, 
-		size_t block_size, size_t node_num) {
+		size_t block_size, size_t alignment, size_t node_num) {
 
 	struct node_pool *self;
 	assert(mem != NULL);
 	assert(block_size > 0);
 	assert(node_num > 0);
-	assert(mem_size == (F_THIS_POOL_ALIGNMENT_SIZE + 
-						F_THIS_POOL_ALIGNMENT(sizeof(struct node_pool)) + 
-						block_size * node_num));
+	assert(mem_size >= F_NODE_POOL_MEM_SIZE(block_size, node_num, alignment));
 
 	self = (struct node_pool *)F_THIS_POOL_ALIGNMENT((uintptr_t)mem);
 
@@ -199,12 +236,16 @@ static inline struct node_pool *node_pool_create(void *mem, size_t mem_size,
 	self->block_size = block_size;
 	self->node_num = node_num;
 	self->free_num = node_num;
-	self->current_pos = (char *)self + F_THIS_POOL_ALIGNMENT(sizeof(struct node_pool));
+	self->current_pos = (char *)F_MAKE_ALIGNMENT(
+			(uintptr_t)self + F_THIS_POOL_ALIGNMENT(sizeof(struct node_pool)), alignment);
 	self->end = self->current_pos + (block_size * node_num);
 
 	self->head = NULL;
 	self->type = enum_unknow;
+	self->mem_type = enum_mem_malloc;
 	self->need_free = true;
+	self->mem_size = mem_size;
+	self->free_time = 0;
 
 	assert(self->end <= (char *)mem + mem_size);
 	assert(self->current_pos <= self->end && 
@@ -213,9 +254,114 @@ static inline struct node_pool *node_pool_create(void *mem, size_t mem_size,
 }
 
 static inline void node_pool_release(struct node_pool *self) {
-	if (self->need_free)
-		free(self->raw);
+	if (!self->need_free)
+		return;
+
+#ifdef POOL_HUGE_PAGE_SIZE
+	if (self->mem_type == enum_mem_mmap) {
+		munmap(self->raw, self->mem_size);
+		return;
+	}
+#endif
+
+	free(self->raw);
+}
+
+static inline size_t pool_page_size() {
+	size_t page_size = 4096;
+
+#ifdef POOL_HUGE_PAGE_SIZE
+	long sys_page_size = sysconf(_SC_PAGESIZE);
+	if (sys_page_size > 0)
+		page_size = (size_t)sys_page_size;
+#endif
+
+	return page_size;
+}
+
+/* touch the not yet alloc memory of node pool, let page fault happen now. */
+static inline void node_pool_prefault(struct node_pool *self) {
+	volatile char *pos;
+	size_t page_size = pool_page_size();
+
+	for (pos = self->current_pos; pos < self->end; pos += page_size)
+		*pos = 0;
+
+	if (self->current_pos < self->end)
+		*(self->end - 1) = 0;
+}
+
+#ifdef POOL_TRIM_ADVISE
+/*
+ * advise the used pages of free node pool back to system, 
+ * and reset the node pool to not yet alloc, so the pages fault in again when alloc.
+ * return advised bytes.
+ */
+static inline size_t node_pool_advise(struct node_pool *self) {
+	char *begin = self->end - (self->block_size * self->node_num);
+	size_t page_size = pool_page_size();
+	uintptr_t advise_begin, advise_end;
+
+	assert(node_pool_is_free(self));
+	if (self->mem_type == enum_mem_mmap)
+		page_size = POOL_HUGE_PAGE_SIZE;
+
+	advise_begin = F_MAKE_ALIGNMENT((uintptr_t)begin, page_size);
+	advise_end = (uintptr_t)self->current_pos & ~((uintptr_t)page_size - 1);
+
+	self->head = NULL;
+	self->current_pos = begin;
+
+	if (advise_begin >= advise_end)
+		return 0;
+
+	if (madvise((void *)advise_begin, advise_end - advise_begin, MADV_DONTNEED) != 0)
+		return 0;
+
+	return advise_end - advise_begin;
 }
+#endif
+
+#ifdef POOL_HUGE_PAGE_SIZE
+/* mmap huge page memory, first try reserved huge page, then transparent huge page. */
+static void *hugepage_mem_alloc(size_t *size) {
+	size_t map_size = F_MAKE_ALIGNMENT(*size, POOL_HUGE_PAGE_SIZE);
+	size_t head, tail;
+	char *mem;
+
+#ifdef MAP_HUGETLB
+	mem = (char *)mmap(NULL, map_size, PROT_READ | PROT_WRITE, 
+			MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+	if (mem != (char *)MAP_FAILED) {
+		*size = map_size;
+		return mem;
+	}
+#endif
+
+	/* more one huge page, for align the address to huge page. */
+	mem = (char *)mmap(NULL, map_size + POOL_HUGE_PAGE_SIZE, PROT_READ | PROT_WRITE, 
+			MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (mem == (char *)MAP_FAILED)
+		return NULL;
+
+	head = F_MAKE_ALIGNMENT((uintptr_t)mem, POOL_HUGE_PAGE_SIZE) - (uintptr_t)mem;
+	tail = POOL_HUGE_PAGE_SIZE - head;
+	if (head > 0)
+		munmap(mem, head);
+
+	if (tail > 0)
+		munmap(mem + head + map_size, tail);
+
+	mem += head;
+
+#ifdef MADV_HUGEPAGE
+	madvise(mem, map_size, MADV_HUGEPAGE);
+#endif
+
+	*size = map_size;
+	return mem;
+}
+#endif
 
 static inline void poolmgr_push_to_list(struct poolmgr *mgr, 
 		struct listobj *lt, struct node_pool *self) {
@@ -225,6 +371,7 @@ static inline void poolmgr_push_to_list(struct poolmgr *mgr,
 	self->next = lt->head;
 	self->prev = NULL;
 	self->type = lt->type;
+	self->free_time = 0;
 
 	if (lt->head) {
 		lt->head->prev = self;
@@ -294,9 +441,24 @@ static inline struct node_pool *poolmgr_create_node_pool(struct poolmgr *self) {
 	assert(((self->block_size * current_max_num) / self->block_size) == current_max_num && 
 			"poolmgr_create_node_pool exist overflow!");
 
-	total_mem_size = F_THIS_POOL_ALIGNMENT_SIZE + 
-					 F_THIS_POOL_ALIGNMENT(sizeof(struct node_pool)) + 
-					 self->block_size * current_max_num;
+	total_mem_size = F_NODE_POOL_MEM_SIZE(self->block_size, current_max_num, self->alignment);
+
+#ifdef POOL_HUGE_PAGE_SIZE
+	if (self->use_hugepage) {
+		size_t map_size = total_mem_size;
+		mem = hugepage_mem_alloc(&map_size);
+		if (mem) {
+			self->current_max_num = current_max_num;
+
+			/* the rest of huge page also for node. */
+			current_max_num += (map_size - total_mem_size) / self->block_size;
+			np = node_pool_create(mem, map_size, self->block_size, self->alignment, current_max_num);
+			np->mem_type = enum_mem_mmap;
+			poolmgr_push_to_list(self, &self->free_list, np);
+			return np;
+		}
+	}
+#endif
 
 	mem = malloc(total_mem_size);
 	if (!mem) {
@@ -307,7 +469,7 @@ static inline struct node_pool *poolmgr_create_node_pool(struct poolmgr *self) {
 
 	self->current_max_num = current_max_num;
 
-	np = node_pool_create(mem, total_mem_size, self->block_size, current_max_num);
+	np = node_pool_create(mem, total_mem_size, self->block_size, self->alignment, current_max_num);
 	poolmgr_push_to_list(self, &self->free_list, np);
 	return np;
 }
@@ -413,7 +575,7 @@ static inline struct node *poolmgr_node_pool_alloc_node(struct poolmgr *self) {
 /*
  * create poolmgr.
  * size is block size,
- * alignment is align number,
+ * alignment is align number, the object address is aligned to it (except NOTUSE_POOL),
  * num is initialize block num,
  * next_multiple is next num,
  *		the next num is num * next_multiple, if next_multiple is zero, then only has one sub pool.
@@ -449,8 +611,7 @@ struct poolmgr *poolmgr_create(size_t size, size_t alignment,
 #ifndef NOTUSE_POOL
 	/* for memory address alignment. (in risc cpu memory address must alignment.) */
 	poolmgr_mem_size = F_THIS_POOL_ALIGNMENT_SIZE + F_THIS_POOL_ALIGNMENT(sizeof(struct poolmgr));
-	node_pool_mem_size = F_THIS_POOL_ALIGNMENT_SIZE + 
-						F_THIS_POOL_ALIGNMENT(sizeof(struct node_pool)) + size * num;
+	node_pool_mem_size = F_NODE_POOL_MEM_SIZE(size, num, alignment);
 	total_mem_size = poolmgr_mem_size + node_pool_mem_size;
 	mem = (char *)malloc(total_mem_size);
 #else
@@ -495,6 +656,13 @@ struct poolmgr *poolmgr_create(size_t size, size_t alignment,
 	self->free_pool_num_for_shrink = 1;
 	self->free_node_ratio_for_shrink = 0.618;
 
+	self->use_hugepage = false;
+
+	self->used_decay = 0;
+	self->trim_release_pool_num = 0;
+	self->trim_release_bytes = 0;
+	self->trim_advise_bytes = 0;
+
 	listobj_init(&self->full_use_list, enum_full_use);
 	listobj_init(&self->portion_use_list, enum_portion_use);
 	listobj_init(&self->free_list, enum_free);
@@ -505,7 +673,7 @@ struct poolmgr *poolmgr_create(size_t size, size_t alignment,
 	/* create node_pool and push it. */
 	mem = (char *)self;
 	mem += F_THIS_POOL_ALIGNMENT(sizeof(struct poolmgr));
-	np = node_pool_create(mem, node_pool_mem_size, size, num);
+	np = node_pool_create(mem, node_pool_mem_size, size, alignment, num);
 
 	/* set free flag. */
 	np->need_free = false;
@@ -542,6 +710,141 @@ void poolmgr_set_shrink(struct poolmgr *self, size_t free_pool_num, double free_
 	self->free_node_ratio_for_shrink = free_node_ratio;
 }
 
+/*
+ * set new node pool use huge page memory.
+ * the first node pool is in the poolmgr memory, so only advise it.
+ */
+void poolmgr_set_hugepage(struct poolmgr *self, bool flag) {
+#if !defined(NOTUSE_POOL) && defined(POOL_HUGE_PAGE_SIZE) && defined(MADV_HUGEPAGE)
+	struct node_pool *np;
+	uintptr_t begin, end;
+#endif
+	if (!self)
+		return;
+
+	self->use_hugepage = flag;
+
+#if !defined(NOTUSE_POOL) && defined(POOL_HUGE_PAGE_SIZE) && defined(MADV_HUGEPAGE)
+	if (!flag)
+		return;
+
+	for (np = self->free_list.head; np; np = np->next) {
+		if (np->need_free)
+			continue;
+
+		begin = F_MAKE_ALIGNMENT((uintptr_t)np->current_pos, POOL_HUGE_PAGE_SIZE);
+		end = (uintptr_t)np->end & ~((uintptr_t)POOL_HUGE_PAGE_SIZE - 1);
+		if (begin < end)
+			madvise((void *)begin, end - begin, MADV_HUGEPAGE);
+	}
+#endif
+}
+
+/*
+ * create node pool until the object total num is not less than num, 
+ * and touch all not yet alloc memory, so alloc object no page fault.
+ */
+void poolmgr_prefault(struct poolmgr *self, size_t num) {
+#ifndef NOTUSE_POOL
+	struct node_pool *np;
+#endif
+	if (!self)
+		return;
+
+#ifndef NOTUSE_POOL
+	while (self->node_total < num) {
+		if (!poolmgr_create_node_pool(self))
+			break;
+	}
+
+	for (np = self->free_list.head; np; np = np->next)
+		node_pool_prefault(np);
+
+	for (np = self->portion_use_list.head; np; np = np->next)
+		node_pool_prefault(np);
+#else
+	(void)num;
+#endif
+}
+
+/*
+ * trim the poolmgr, call it periodically (e.g. once a second).
+ * the object used num is decayed on each call, if the free node pool is not need for the decayed used num, 
+ * then release it, else advise the pages of node pool that free more than free_seconds back to system. (only linux.)
+ * each call only release or advise one node pool, so the trim is gradual.
+ * return reclaimed bytes of this call.
+ */
+size_t poolmgr_trim(struct poolmgr *self, int free_seconds) {
+#ifndef NOTUSE_POOL
+	struct node_pool *np, *release_np = NULL;
+	size_t used_num, keep_num, bytes;
+	time_t now;
+#endif
+	if (!self)
+		return 0;
+
+#ifndef NOTUSE_POOL
+	now = time(NULL);
+
+	/* rise at once, fall by decay. */
+	used_num = self->node_total - self->node_free_total;
+	if ((double)used_num >= self->used_decay)
+		self->used_decay = (double)used_num;
+	else
+		self->used_decay += ((double)used_num - self->used_decay) * POOL_TRIM_DECAY;
+
+	keep_num = (size_t)(self->used_decay * POOL_TRIM_KEEP_RATIO);
+
+	/* release the biggest free node pool that not need. */
+	for (np = self->free_list.head; np; np = np->next) {
+		if (np->free_time == 0)
+			np->free_time = now;
+
+		if (!np->need_free || (self->node_total - np->node_num < keep_num))
+			continue;
+
+		if (!release_np || np->node_num > release_np->node_num)
+			release_np = np;
+	}
+
+	if (release_np) {
+		bytes = release_np->mem_size;
+		poolmgr_remove_from_list(self, &self->free_list, release_np);
+		if (self->first == release_np)
+			self->first = NULL;
+
+		node_pool_release(release_np);
+
+		++self->trim_release_pool_num;
+		self->trim_release_bytes += bytes;
+		return bytes;
+	}
+
+#ifdef POOL_TRIM_ADVISE
+	for (np = self->free_list.head; np; np = np->next) {
+		if (np->current_pos == np->end - (np->block_size * np->node_num))
+			continue;
+
+		if (now - np->free_time < (time_t)free_seconds)
+			continue;
+
+		bytes = node_pool_advise(np);
+		if (bytes > 0) {
+			self->trim_advise_bytes += bytes;
+			return bytes;
+		}
+	}
+#else
+	(void)free_seconds;
+#endif
+
+#else
+	(void)free_seconds;
+#endif
+
+	return 0;
+}
+
 void *poolmgr_alloc_object(struct poolmgr *self) {
 #ifndef NOTUSE_POOL
 	struct node *nd;
@@ -696,6 +999,10 @@ void poolmgr_get_info(struct poolmgr *self, struct poolmgr_info *info) {
 
 	info->shrink_free_pool_num = self->free_pool_num_for_shrink;
 	info->shrink_free_object_ratio = self->free_node_ratio_for_shrink;
+
+	info->trim_release_pool_num = self->trim_release_pool_num;
+	info->trim_release_bytes = self->trim_release_bytes;
+	info->trim_advise_bytes = self->trim_advise_bytes;
 #endif
 }
 
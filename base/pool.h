@@ -13,6 +13,7 @@ extern "C" {
 
 #include <stddef.h>
 #include <time.h>
+#include "platform_config.h"
 
 struct poolmgr;
 struct poolmgr_info {
@@ -37,12 +38,17 @@ struct poolmgr_info {
 
 	size_t shrink_free_pool_num;
 	double shrink_free_object_ratio;
+
+	/* reclaimed by poolmgr_trim. */
+	size_t trim_release_pool_num;
+	size_t trim_release_bytes;
+	size_t trim_advise_bytes;
 };
 
 /*
  * create poolmgr.
  * size is object size,
- * alignment is align number,
+ * alignment is align number, the object address is aligned to it (except NOTUSE_POOL),
  * num is initialize object num,
  * next_multiple is next num,
  *		the next num is num * next_multiple, if next_multiple is zero, then only has one sub pool.
@@ -55,6 +61,27 @@ void poolmgr_release(struct poolmgr *self);
 
 void poolmgr_set_shrink(struct poolmgr *self, size_t free_pool_num, double free_node_ratio);
 
+/*
+ * set new node pool use huge page memory. (only linux, other platform same as malloc.)
+ * first try MAP_HUGETLB, if not has reserved huge page, then mmap and advise transparent huge page.
+ */
+void poolmgr_set_hugepage(struct poolmgr *self, bool flag);
+
+/*
+ * create node pool until the object total num is not less than num, 
+ * and touch all not yet alloc memory, so alloc object no page fault.
+ */
+void poolmgr_prefault(struct poolmgr *self, size_t num);
+
+/*
+ * trim the poolmgr, call it periodically (e.g. once a second).
+ * the object used num is decayed on each call, if the free node pool is not need for the decayed used num, 
+ * then release it, else advise the pages of node pool that free more than free_seconds back to system. (only linux.)
+ * each call only release or advise one node pool, so the trim is gradual.
+ * return reclaimed bytes of this call.
+ */
+size_t poolmgr_trim(struct poolmgr *self, int free_seconds);
+
 void *poolmgr_alloc_object(struct poolmgr *self);
 
 void poolmgr_free_object(struct poolmgr *self, void *bk);
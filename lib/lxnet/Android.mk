@@ -8,14 +8,17 @@ LOCAL_MODULE_FILENAME := liblxnet
 LOCAL_SRC_FILES := ./../../base/crosslib.c \
 					./../../base/log.c \
 					./../../base/pool.c \
-					./../../base/catomic.c \
 					./../../base/cthread.c \
 					./../../base/cthread_pool.c \
 					./../../base/buf/block_list.c \
 					./../../3rd/quicklz/quicklz.c \
+					./../../3rd/lz4/lz4.c \
 					./src/buf/net_buf.c \
 					./src/buf/net_bufpool.c \
 					./src/buf/net_compress.c \
+					./src/buf/net_compress_stream.c \
+					./src/buf/net_compress_worker.c \
+					./src/buf/net_crypt.c \
 					./src/buf/net_thread_buf.c \
 					./src/event/net_eventmgr.c \
 					./src/event/net_module.c \
@@ -27,6 +30,7 @@ LOCAL_SRC_FILES := ./../../base/crosslib.c \
 
 LOCAL_C_INCLUDES := $(LOCAL_PATH)/../../base \
 					$(LOCAL_PATH)/../../3rd/quicklz \
+					$(LOCAL_PATH)/../../3rd/lz4 \
                     $(LOCAL_PATH)/src/buf \
 					$(LOCAL_PATH)/src/event \
 					$(LOCAL_PATH)/src/sock \
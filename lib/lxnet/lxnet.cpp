@@ -7,8 +7,10 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
+#include <stddef.h>
 #include "cthread.h"
 #include "net_module.h"
+#include "net_eventmgr.h"
 #include "lxnet.h"
 #include "net_buf.h"
 #include "pool.h"
@@ -20,20 +22,78 @@
 
 struct infomgr {
 	bool is_init;
-	struct poolmgr *encrypt_pool;
-	cspin encrypt_lock;
+	struct poolmgr *listen_pool;
+	cspin listen_lock;
 
-	struct poolmgr *proxy_pool;
-	cspin proxy_lock;
+	struct poolmgr *channel_pool;
+	cspin channel_lock;
 
-	struct poolmgr *socket_pool;
-	cspin socket_lock;
+	struct poolmgr *channel_node_pool;
+	cspin channel_node_lock;
 
-	struct poolmgr *listen_pool;
-	cspin listen_lock;
+	struct poolmgr *channel_msg_pool;
+	cspin channel_msg_lock;
 };
 
 static struct infomgr s_infomgr = {false};
+
+enum {
+	/* broadcast message length less than it, copy it to each socket. */
+	enum_broadcast_shared_min_len = 1024,
+
+	/* GetMsgBatch max message num of once. */
+	enum_msg_batch_max = 256,
+
+	/* channel object pool initialize num. */
+	enum_channel_pool_num = 64,
+
+	/* the published message waiting for the publish job, pool initialize num. */
+	enum_channel_msg_pool_num = 256,
+};
+
+/* a subscription, linked in the channel list and the socketer list. */
+struct channel_node {
+	lxnet::Channel *channel;
+	lxnet::Socketer *sock;
+
+	struct channel_node *prev;
+	struct channel_node *next;
+
+	struct channel_node *sock_prev;
+	struct channel_node *sock_next;
+};
+
+/* a published message waiting for the publish job. */
+struct channel_msg {
+	struct block *shared;
+	int len;
+	lxnet::Socketer *except;
+	struct channel_msg *next;
+};
+
+/*
+ * the Channel object and its publish job, the job walk the subscribers on a network thread.
+ * the published messages are queued, the job is posted when the queue become not empty,
+ * and take them until it is empty, so only one job of the channel is running, the messages are pushed in order.
+ */
+struct channel_obj {
+	lxnet::Channel channel;
+	cspin lock;							/* protect the subscriber list, the job hold it when walk the list. */
+	cspin queue_lock;					/* protect the message queue and the flags. */
+	struct channel_msg *msg_head;
+	struct channel_msg *msg_tail;
+	bool job_posted;					/* the job is posted or running. */
+	bool released;						/* if true, the running job release the object. */
+	struct eventmgr_job job;
+};
+
+struct pooltrim {
+	bool enable;
+	int free_seconds;
+	int64 last_time;
+};
+
+static struct pooltrim s_pooltrim = {false, 0, 0};
 static struct datainfomgr *s_datainfomgr = NULL;
 static bool s_datainfo_need_release = false;
 
@@ -57,6 +117,17 @@ struct proxy_info {
 	char proxy_buff[enum_proxy_buff_len];
 };
 
+/*
+ * the per connection objects of C++ side, they are the user data of socketer,
+ * allocated from socketer pool together with the socketer and its bufs.
+ */
+struct socketer_udata {
+	lxnet::Socketer sock;
+	struct encrypt_info encrypt;
+	struct encrypt_info decrypt;
+	struct proxy_info proxy;
+};
+
 
 static inline void on_send_msg(struct datainfomgr *infomgr, size_t msg_num, size_t len) {
 	if (infomgr) {
@@ -82,28 +153,30 @@ static bool infomgr_init(size_t socketer_num, size_t listener_num) {
 	if (s_infomgr.is_init)
 		return false;
 
-	s_infomgr.encrypt_pool = poolmgr_create(sizeof(struct encrypt_info), 8, socketer_num * 2, 1, 
-																		"encrypt buffer pool");
-	s_infomgr.proxy_pool = poolmgr_create(sizeof(struct proxy_info), 8, socketer_num, 1, 
-																		"proxy info pool");
-	s_infomgr.socket_pool = poolmgr_create(sizeof(lxnet::Socketer), 8, socketer_num, 1, 
-																	"Socketer object pool");
 	s_infomgr.listen_pool = poolmgr_create(sizeof(lxnet::Listener), 8, listener_num, 1, 
 																	"Listen object pool");
-	if (!s_infomgr.encrypt_pool || !s_infomgr.proxy_pool || 
-			!s_infomgr.listen_pool || !s_infomgr.socket_pool) {
-		poolmgr_release(s_infomgr.socket_pool);
+	s_infomgr.channel_pool = poolmgr_create(sizeof(struct channel_obj), 8, enum_channel_pool_num, 1, 
+																	"Channel object pool");
+	s_infomgr.channel_node_pool = poolmgr_create(sizeof(struct channel_node), 8, socketer_num, 1, 
+																	"Channel subscription pool");
+	s_infomgr.channel_msg_pool = poolmgr_create(sizeof(struct channel_msg), 8, enum_channel_msg_pool_num, 1, 
+																	"Channel publish queue pool");
+	if (!s_infomgr.listen_pool || !s_infomgr.channel_pool || !s_infomgr.channel_node_pool || 
+			!s_infomgr.channel_msg_pool) {
 		poolmgr_release(s_infomgr.listen_pool);
-
-		poolmgr_release(s_infomgr.encrypt_pool);
-		poolmgr_release(s_infomgr.proxy_pool);
+		poolmgr_release(s_infomgr.channel_pool);
+		poolmgr_release(s_infomgr.channel_node_pool);
+		poolmgr_release(s_infomgr.channel_msg_pool);
 		return false;
 	}
 
-	cspin_init(&s_infomgr.encrypt_lock);
-	cspin_init(&s_infomgr.proxy_lock);
-	cspin_init(&s_infomgr.socket_lock);
+	/* Socketer, encrypt info and proxy info are carved from socketer object. */
+	socketer_set_udata_size(sizeof(struct socketer_udata));
+
 	cspin_init(&s_infomgr.listen_lock);
+	cspin_init(&s_infomgr.channel_lock);
+	cspin_init(&s_infomgr.channel_node_lock);
+	cspin_init(&s_infomgr.channel_msg_lock);
 	s_infomgr.is_init = true;
 	return true;
 }
@@ -112,60 +185,218 @@ static void infomgr_release() {
 	if (!s_infomgr.is_init)
 		return;
 
-	poolmgr_release(s_infomgr.socket_pool);
 	poolmgr_release(s_infomgr.listen_pool);
-	poolmgr_release(s_infomgr.encrypt_pool);
-	poolmgr_release(s_infomgr.proxy_pool);
-	cspin_destroy(&s_infomgr.socket_lock);
+	poolmgr_release(s_infomgr.channel_pool);
+	poolmgr_release(s_infomgr.channel_node_pool);
+	poolmgr_release(s_infomgr.channel_msg_pool);
 	cspin_destroy(&s_infomgr.listen_lock);
-	cspin_destroy(&s_infomgr.encrypt_lock);
-	cspin_destroy(&s_infomgr.proxy_lock);
+	cspin_destroy(&s_infomgr.channel_lock);
+	cspin_destroy(&s_infomgr.channel_node_lock);
+	cspin_destroy(&s_infomgr.channel_msg_lock);
 
 	s_infomgr.is_init = false;
 }
 
-struct encrypt_info *encrypt_info_create() {
-	struct encrypt_info *info = NULL;
-	cspin_lock(&s_infomgr.encrypt_lock);
-	info = (struct encrypt_info *)poolmgr_alloc_object(s_infomgr.encrypt_pool);
-	cspin_unlock(&s_infomgr.encrypt_lock);
+static void infomgr_trim(int free_seconds) {
+	if (!s_infomgr.is_init)
+		return;
+
+	cspin_lock(&s_infomgr.listen_lock);
+	poolmgr_trim(s_infomgr.listen_pool, free_seconds);
+	cspin_unlock(&s_infomgr.listen_lock);
+
+	cspin_lock(&s_infomgr.channel_lock);
+	poolmgr_trim(s_infomgr.channel_pool, free_seconds);
+	cspin_unlock(&s_infomgr.channel_lock);
+
+	cspin_lock(&s_infomgr.channel_node_lock);
+	poolmgr_trim(s_infomgr.channel_node_pool, free_seconds);
+	cspin_unlock(&s_infomgr.channel_node_lock);
+
+	cspin_lock(&s_infomgr.channel_msg_lock);
+	poolmgr_trim(s_infomgr.channel_msg_pool, free_seconds);
+	cspin_unlock(&s_infomgr.channel_msg_lock);
+}
+
+enum {
+	/* listen, channel, subscription and publish queue pool. */
+	enum_infomgr_pool_num = 4,
+};
 
-	if (info) {
-		info->max_idx = 0;
-		info->now_idx = 0;
-		memset(info->buf, 0, sizeof(info->buf));
+/* get the info of listen and channel pools, fill at most num entries, return the filled num. */
+static size_t infomgr_get_memory_info(struct poolmgr_info *array, size_t num) {
+	struct poolmgr *pools[enum_infomgr_pool_num] = {s_infomgr.listen_pool, s_infomgr.channel_pool, 
+		s_infomgr.channel_node_pool, s_infomgr.channel_msg_pool};
+	cspin *locks[enum_infomgr_pool_num] = {&s_infomgr.listen_lock, &s_infomgr.channel_lock, 
+		&s_infomgr.channel_node_lock, &s_infomgr.channel_msg_lock};
+	size_t i;
+	for (i = 0; i < num && i < enum_infomgr_pool_num; ++i) {
+		cspin_lock(locks[i]);
+		poolmgr_get_info(pools[i], &array[i]);
+		cspin_unlock(locks[i]);
 	}
+	return i;
+}
+
+static struct encrypt_info *encrypt_info_init(struct encrypt_info *info) {
+	info->max_idx = 0;
+	info->now_idx = 0;
+	memset(info->buf, 0, sizeof(info->buf));
 	return info;
 }
 
-static void encrypt_info_release(void *info) {
-	if (!s_infomgr.is_init)
-		return;
+static struct proxy_info *proxy_info_init(struct proxy_info *info) {
+	memset(info, 0, sizeof(*info));
+	return info;
+}
+
+/* the Socketer object is the user data of socketer, it is released with socketer. */
+static lxnet::Socketer *socketer_object_create(struct socketer *so) {
+	struct socketer_udata *udata = (struct socketer_udata *)socketer_get_udata(so);
+	if (!udata)
+		return NULL;
+
+	lxnet::Socketer *self = &udata->sock;
+	self->m_infomgr = s_datainfomgr;
+	self->m_encrypt = NULL;
+	self->m_decrypt = NULL;
+	self->m_proxy = NULL;
+	self->m_channel = NULL;
+	self->m_self = so;
+	return self;
+}
 
-	cspin_lock(&s_infomgr.encrypt_lock);
-	poolmgr_free_object(s_infomgr.encrypt_pool, info);
-	cspin_unlock(&s_infomgr.encrypt_lock);
+static inline struct socketer_udata *socketer_object_udata(lxnet::Socketer *self) {
+	return (struct socketer_udata *)socketer_get_udata(self->m_self);
 }
 
-struct proxy_info *proxy_info_create() {
-	struct proxy_info *info = NULL;
-	cspin_lock(&s_infomgr.proxy_lock);
-	info = (struct proxy_info *)poolmgr_alloc_object(s_infomgr.proxy_pool);
-	cspin_unlock(&s_infomgr.proxy_lock);
+static struct channel_node *channel_node_create(lxnet::Channel *channel, lxnet::Socketer *sock) {
+	struct channel_node *node = NULL;
+	cspin_lock(&s_infomgr.channel_node_lock);
+	node = (struct channel_node *)poolmgr_alloc_object(s_infomgr.channel_node_pool);
+	cspin_unlock(&s_infomgr.channel_node_lock);
+	if (!node)
+		return NULL;
 
-	if (info) {
-		memset(info, 0, sizeof(*info));
-	}
-	return info;
+	node->channel = channel;
+	node->sock = sock;
+
+	/* the publish job push data to it after linked, lock its send buffer before it. */
+	socketer_subscribe(sock->m_self);
+
+	struct channel_obj *obj = (struct channel_obj *)channel;
+	cspin_lock(&obj->lock);
+	node->prev = NULL;
+	node->next = channel->m_head;
+	if (channel->m_head)
+		channel->m_head->prev = node;
+	channel->m_head = node;
+	channel->m_num++;
+	cspin_unlock(&obj->lock);
+
+	node->sock_prev = NULL;
+	node->sock_next = sock->m_channel;
+	if (sock->m_channel)
+		sock->m_channel->sock_prev = node;
+	sock->m_channel = node;
+	return node;
 }
 
-static void proxy_info_release(struct proxy_info *info) {
+static void channel_node_release(struct channel_node *node) {
+	lxnet::Channel *channel = node->channel;
+	lxnet::Socketer *sock = node->sock;
+
+	/* wait for the publish job walking the list, after unlinked, the job not access the socketer. */
+	struct channel_obj *obj = (struct channel_obj *)channel;
+	cspin_lock(&obj->lock);
+	if (node->prev)
+		node->prev->next = node->next;
+	else
+		channel->m_head = node->next;
+	if (node->next)
+		node->next->prev = node->prev;
+	channel->m_num--;
+	cspin_unlock(&obj->lock);
+
+	socketer_unsubscribe(sock->m_self);
+
+	if (node->sock_prev)
+		node->sock_prev->sock_next = node->sock_next;
+	else
+		sock->m_channel = node->sock_next;
+	if (node->sock_next)
+		node->sock_next->sock_prev = node->sock_prev;
+
 	if (!s_infomgr.is_init)
 		return;
 
-	cspin_lock(&s_infomgr.proxy_lock);
-	poolmgr_free_object(s_infomgr.proxy_pool, info);
-	cspin_unlock(&s_infomgr.proxy_lock);
+	cspin_lock(&s_infomgr.channel_node_lock);
+	poolmgr_free_object(s_infomgr.channel_node_pool, node);
+	cspin_unlock(&s_infomgr.channel_node_lock);
+}
+
+static void channel_obj_release(struct channel_obj *obj) {
+	cspin_destroy(&obj->lock);
+	cspin_destroy(&obj->queue_lock);
+
+	cspin_lock(&s_infomgr.channel_lock);
+	poolmgr_free_object(s_infomgr.channel_pool, obj);
+	cspin_unlock(&s_infomgr.channel_lock);
+}
+
+static void channel_msg_release(struct channel_msg *msg) {
+	bufmgr_release_shared_block(msg->shared);
+
+	cspin_lock(&s_infomgr.channel_msg_lock);
+	poolmgr_free_object(s_infomgr.channel_msg_pool, msg);
+	cspin_unlock(&s_infomgr.channel_msg_lock);
+}
+
+/*
+ * the publish job, run on a network thread, take the queued messages in order,
+ * push each of them to the subscribers with the subscriber list locked.
+ * the small message is copied, the large one is pushed by reference of the shared block.
+ */
+static void channel_publish_job(struct eventmgr_job *job) {
+	struct channel_obj *obj = (struct channel_obj *)((char *)job - offsetof(struct channel_obj, job));
+	for (;;) {
+		cspin_lock(&obj->queue_lock);
+		struct channel_msg *msg = obj->msg_head;
+		if (!msg) {
+			bool released = obj->released;
+			obj->job_posted = false;
+			cspin_unlock(&obj->queue_lock);
+
+			if (released)
+				channel_obj_release(obj);
+			return;
+		}
+
+		obj->msg_head = msg->next;
+		if (!obj->msg_head)
+			obj->msg_tail = NULL;
+		cspin_unlock(&obj->queue_lock);
+
+		bool copy = (msg->len < enum_broadcast_shared_min_len);
+		cspin_lock(&obj->lock);
+		for (struct channel_node *node = obj->channel.m_head; node; node = node->next) {
+			if (node->sock != msg->except)
+				socketer_publish_shared(node->sock->m_self, msg->shared, copy);
+		}
+		cspin_unlock(&obj->lock);
+
+		channel_msg_release(msg);
+	}
+}
+
+/* find the subscription of sock in channel, walk the socketer list, it is usually shorter. */
+static struct channel_node *channel_node_find(lxnet::Channel *channel, lxnet::Socketer *sock) {
+	struct channel_node *node;
+	for (node = sock->m_channel; node; node = node->sock_next) {
+		if (node->channel == channel)
+			return node;
+	}
+	return NULL;
 }
 
 
@@ -231,19 +462,11 @@ Socketer *Listener::Accept(bool bigbuf) {
 	if (!sock)
 		return NULL;
 
-	cspin_lock(&s_infomgr.socket_lock);
-	Socketer *self = (Socketer *)poolmgr_alloc_object(s_infomgr.socket_pool);
-	cspin_unlock(&s_infomgr.socket_lock);
+	Socketer *self = socketer_object_create(sock);
 	if (!self) {
 		socketer_release(sock);
 		return NULL;
 	}
-
-	self->m_infomgr = s_datainfomgr;
-	self->m_encrypt = NULL;
-	self->m_decrypt = NULL;
-	self->m_proxy = NULL;
-	self->m_self = sock;
 	return self;
 }
 
@@ -265,19 +488,11 @@ Socketer *Socketer::Create(bool bigbuf) {
 	if (!so)
 		return NULL;
 
-	cspin_lock(&s_infomgr.socket_lock);
-	Socketer *self = (Socketer *)poolmgr_alloc_object(s_infomgr.socket_pool);
-	cspin_unlock(&s_infomgr.socket_lock);
+	Socketer *self = socketer_object_create(so);
 	if (!self) {
 		socketer_release(so);
 		return NULL;
 	}
-
-	self->m_infomgr = s_datainfomgr;
-	self->m_encrypt = NULL;
-	self->m_decrypt = NULL;
-	self->m_proxy = NULL;
-	self->m_self = so;
 	return self;
 }
 
@@ -286,23 +501,20 @@ void Socketer::Release(Socketer *self) {
 	if (!self)
 		return;
 
-	if (self->m_self) {
-		socketer_release(self->m_self);
-		self->m_self = NULL;
+	while (self->m_channel) {
+		channel_node_release(self->m_channel);
 	}
 
+	struct socketer *so = self->m_self;
 	self->m_infomgr = NULL;
 	self->m_encrypt = NULL;
 	self->m_decrypt = NULL;
+	self->m_proxy = NULL;
+	self->m_self = NULL;
 
-	if (self->m_proxy) {
-		proxy_info_release(self->m_proxy);
-		self->m_proxy = NULL;
-	}
-
-	cspin_lock(&s_infomgr.socket_lock);
-	poolmgr_free_object(s_infomgr.socket_pool, self);
-	cspin_unlock(&s_infomgr.socket_lock);
+	/* self is the user data of so, released with it after the delay close. */
+	if (so)
+		socketer_release(so);
 }
 
 /* 设置关联的统计对象 */
@@ -321,14 +533,53 @@ void Socketer::SetSendLimit(int size) {
 	socketer_set_send_limit(m_self, size);
 }
 
-/* (对发送数据起作用)设置启用压缩，若要启用压缩，则此函数在创建socket对象后即刻调用 */
-void Socketer::UseCompress() {
-	socketer_use_compress(m_self);
+/* (对发送数据起作用)设置启用压缩，codec为压缩算法，失败返回false，若要启用压缩，则此函数在创建socket对象后即刻调用 */
+bool Socketer::UseCompress(int codec) {
+	return socketer_use_compress(m_self, codec);
 }
 
-/* (慎用)(对接收的数据起作用)启用解压缩，网络库会负责解压缩操作，仅供客户端使用 */
-void Socketer::UseUncompress() {
-	socketer_use_uncompress(m_self);
+/*
+ * (对接收的数据起作用)启用解压缩，网络库会负责解压缩操作，客户端与服务器均可使用，
+ * 非流式算法按数据块头中的算法ID解压缩，对端使用流式算法时codec必须与之相同，失败返回false
+ * 数据块的膨胀率及未被逻辑读取的解压数据受SetUncompressOption限制，超出的数据块将断开连接
+ */
+bool Socketer::UseUncompress(int codec) {
+	return socketer_use_uncompress(m_self, codec);
+}
+
+/* 获取发送数据的压缩统计，节省的字节数及压缩花费的时间，见SetCompressOption */
+void Socketer::GetCompressStat(struct compress_stat *stat) {
+	struct buf_compress_stat info;
+	if (!stat)
+		return;
+
+	socketer_get_compress_stat(m_self, &info);
+	stat->raw_bytes = info.raw_bytes;
+	stat->out_bytes = info.out_bytes;
+	stat->compressed_chunk_num = info.compressed_chunk_num;
+	stat->stored_chunk_num = info.stored_chunk_num;
+	stat->compress_microsecond = info.compress_microsecond;
+	stat->ratio = info.ratio;
+	stat->paused = info.paused;
+}
+
+/*
+ * (对接收的数据起作用)启用网络线程分包，网络线程在接收(解密/解压缩)后即切分出完整的包并校验包长，
+ * 包长非法则在网络线程中断开连接，GetMsg等无需再解析包头，启用后不能再使用GetData，
+ * 若要启用，则此函数在创建socket对象后即刻调用(接收数据之前)
+ */
+bool Socketer::UseMsgPreparse() {
+	return socketer_use_msg_preparse(m_self);
+}
+
+/*
+ * 发送/接收缓冲使用环形缓冲(内存映射两次首尾相接)代替块链表，大小为0则不使用，至少为最大包长，向上取2的幂
+ * 缓冲中的数据总是连续的，一次系统调用即可收发，包不会跨块，PeekMsg/GetMsgBatch总是不拷贝，
+ * 环形缓冲的大小是固定的，发送缓冲满则断开连接(同超出SetSendLimit)，接收缓冲满则暂停接收
+ * 若要启用，则此函数在创建socket对象后即刻调用，失败返回false(仍使用块链表)，仅linux
+ */
+bool Socketer::UseRingBuffer(size_t sendsize, size_t recvsize) {
+	return socketer_use_ring_buffer(m_self, sendsize, recvsize);
 }
 
 /*
@@ -346,13 +597,9 @@ void Socketer::SetEncryptDecryptFunction(void (*encryptfunc)(void *logicdata, ch
 
 static void encrypt_decrypt_as_key_do_func(void *logicdata, char *buf, int len) {
 	struct encrypt_info *o = (struct encrypt_info *)logicdata;
-	for (int i = 0; i < len; ++i) {
-		if (o->now_idx >= o->max_idx)
-			o->now_idx = 0;
 
-		buf[i] ^= o->buf[o->now_idx];
-		++o->now_idx;
-	}
+	/* the empty key is xor with the first byte, as before. */
+	crypt_xor(buf, len, o->buf, (o->max_idx > 0) ? o->max_idx : 1, &o->now_idx);
 }
 
 /* 设置加密key */
@@ -361,11 +608,8 @@ void Socketer::SetEncryptKey(const char *key, int key_len) {
 		return;
 
 	if (!m_encrypt) {
-		m_encrypt = encrypt_info_create();
-		if (m_encrypt) {
-			socketer_set_encrypt_function(m_self, 
-					encrypt_decrypt_as_key_do_func, encrypt_info_release, m_encrypt);
-		}
+		m_encrypt = encrypt_info_init(&socketer_object_udata(this)->encrypt);
+		socketer_set_encrypt_function(m_self, encrypt_decrypt_as_key_do_func, NULL, m_encrypt);
 	}
 
 	if (m_encrypt) {
@@ -381,11 +625,8 @@ void Socketer::SetDecryptKey(const char *key, int key_len) {
 		return;
 
 	if (!m_decrypt) {
-		m_decrypt = encrypt_info_create();
-		if (m_decrypt) {
-			socketer_set_decrypt_function(m_self, 
-					encrypt_decrypt_as_key_do_func, encrypt_info_release, m_decrypt);
-		}
+		m_decrypt = encrypt_info_init(&socketer_object_udata(this)->decrypt);
+		socketer_set_decrypt_function(m_self, encrypt_decrypt_as_key_do_func, NULL, m_decrypt);
 	}
 
 	if (m_decrypt) {
@@ -395,6 +636,30 @@ void Socketer::SetDecryptKey(const char *key, int key_len) {
 	}
 }
 
+/*
+ * 设置ChaCha20加密(RFC 8439)，key为32字节，nonce为12字节，发送与接收各自使用不同的nonce，
+ * 对端以相同的key与nonce调用SetDecryptChaCha20，同一key下nonce不可重复使用(如每个连接协商新的key)，
+ * 同一key与nonce最多加密/解密256G字节(块计数器不回绕)，超出则断开连接，需在此之前协商新的key并重新设置，
+ * 密钥流按整块批量生成(avx2/sse2)，调用UseEncrypt启用，失败返回false
+ */
+bool Socketer::SetEncryptChaCha20(const char *key, const char *nonce) {
+	if (!socketer_set_encrypt_chacha20(m_self, key, nonce))
+		return false;
+
+	/* the key function is replaced, SetEncryptKey set it again. */
+	m_encrypt = NULL;
+	return true;
+}
+
+/* 设置ChaCha20解密，key与nonce同对端的SetEncryptChaCha20，调用UseDecrypt启用，失败返回false */
+bool Socketer::SetDecryptChaCha20(const char *key, const char *nonce) {
+	if (!socketer_set_decrypt_chacha20(m_self, key, nonce))
+		return false;
+
+	m_decrypt = NULL;
+	return true;
+}
+
 /* (启用加密) */
 void Socketer::UseEncrypt() {
 	socketer_use_encrypt(m_self);
@@ -413,10 +678,7 @@ void Socketer::SetProxyParam(const char *proxy_end_char, int proxy_end_char_len)
 	if (m_proxy || proxy_end_char_len > proxy_info::enum_proxy_end_char_len)
 		return;
 
-	m_proxy = proxy_info_create();
-	if (!m_proxy)
-		return;
-
+	m_proxy = proxy_info_init(&socketer_object_udata(this)->proxy);
 	memcpy(&m_proxy->proxy_end_char, proxy_end_char, proxy_end_char_len);
 
 	socketer_set_proxy_param(m_self, 
@@ -498,9 +760,12 @@ bool Socketer::SendMsg(Msg *msg, void *adddata, size_t addsize) {
 		return false;
 	}
 
-	if (socketer_send_is_limit(m_self, msg->GetLength() + addsize)) {
+	int action = socketer_send_check(m_self, msg->GetLength() + addsize);
+	if (action == enum_send_close) {
 		Close();
 		return false;
+	} else if (action == enum_send_drop) {
+		return false;
 	}
 
 	bool res = false;
@@ -527,6 +792,40 @@ bool Socketer::SendMsg(Msg *msg, void *adddata, size_t addsize) {
 	return res;
 }
 
+/*
+ * 预留发送缓冲，返回发送块中可直接写入包的连续内存(maxlen字节，含包头)，可用MessageWriter在其上写包，
+ * 写好后调用CommitSend提交，在此之前不能再发送数据
+ * maxlen 不能超过最大块大小，失败返回NULL(此时可改用SendMsg)
+ */
+char *Socketer::ReserveSend(size_t maxlen) {
+	if (maxlen < sizeof(Msg) || maxlen > MessagePack::message_max_length)
+		return NULL;
+
+	int action = socketer_send_check(m_self, maxlen);
+	if (action == enum_send_close) {
+		Close();
+		return NULL;
+	} else if (action == enum_send_drop) {
+		return NULL;
+	}
+
+	return socketer_reserve_send(m_self, (int)maxlen);
+}
+
+/* 提交ReserveSend预留的缓冲，actual为实际的包长度(含包头)，会自动填写包头中的长度，为0则取消 */
+bool Socketer::CommitSend(size_t actual) {
+	if (actual != 0 && actual < sizeof(Msg)) {
+		socketer_commit_send(m_self, 0);
+		return false;
+	}
+
+	bool res = socketer_commit_send(m_self, (int)actual);
+	if (res && actual != 0) {
+		on_send_msg(m_infomgr, 1, actual);
+	}
+	return res;
+}
+
 /* 接收数据 */
 Msg *Socketer::GetMsg(char *buf, size_t bufsize) {
 	Msg *msg = (Msg *)socketer_get_msg(m_self, buf, bufsize);
@@ -541,14 +840,80 @@ Msg *Socketer::GetMsg(char *buf, size_t bufsize) {
 	return msg;
 }
 
+/*
+ * 接收数据，不拷贝，若包在接收块中是连续的，则直接返回指向接收块的指针，否则同GetMsg拷贝到buf中
+ * 若返回不为NULL，则使用完后必须调用ReleaseMsg，在此之前不能再接收数据
+ */
+Msg *Socketer::PeekMsg(char *buf, size_t bufsize) {
+	Msg *msg = (Msg *)socketer_peek_msg(m_self, buf, bufsize);
+	if (msg) {
+		if (msg->GetLength() < (int)sizeof(Msg)) {
+			socketer_release_msg(m_self);
+			Close();
+			return NULL;
+		}
+
+		on_recv_msg(m_infomgr, 1, msg->GetLength());
+	}
+	return msg;
+}
+
+/* 释放PeekMsg或GetMsgBatch获取的包 */
+void Socketer::ReleaseMsg() {
+	socketer_release_msg(m_self);
+}
+
+/*
+ * 批量接收数据，一次取出缓冲中所有完整的包(最多max个)，返回包的数目
+ * 接收块中连续的包不拷贝，跨块的包拷贝到arena中(arena为NULL则使用线程缓冲，arenasize不能小于最大包长)
+ * 若返回大于0，则使用完后必须调用ReleaseMsg，在此之前不能再接收数据
+ */
+size_t Socketer::GetMsgBatch(MsgView *out, size_t max, char *arena, size_t arenasize) {
+	if (!out || max == 0)
+		return 0;
+
+	char *msgs[enum_msg_batch_max];
+	if (max > enum_msg_batch_max)
+		max = enum_msg_batch_max;
+
+	int num = socketer_peek_msg_batch(m_self, msgs, (int)max, arena, arenasize);
+	if (num <= 0)
+		return 0;
+
+	size_t bytes = 0;
+	for (int i = 0; i < num; ++i) {
+		Msg *msg = (Msg *)msgs[i];
+		if (msg->GetLength() < (int)sizeof(Msg)) {
+			Close();
+			num = i;
+			break;
+		}
+
+		out[i].msg = msg;
+		out[i].len = msg->GetLength();
+		bytes += out[i].len;
+	}
+
+	if (num == 0) {
+		socketer_release_msg(m_self);
+		return 0;
+	}
+
+	on_recv_msg(m_infomgr, num, bytes);
+	return (size_t)num;
+}
+
 /* 发送数据 */
 bool Socketer::SendData(const void *data, size_t datasize) {
 	if (!data)
 		return false;
 
-	if (socketer_send_is_limit(m_self, datasize)) {
+	int action = socketer_send_check(m_self, datasize);
+	if (action == enum_send_close) {
 		Close();
 		return false;
+	} else if (action == enum_send_drop) {
+		return false;
 	}
 
 	bool res = socketer_send_data(m_self, (void *)data, (int)datasize);
@@ -588,6 +953,7 @@ void Socketer::CheckRecv() {
  * 初始化网络
  * big_buf_size 指定大块的大小，big_buf_num 指定大块的数目，
  * small_buf_size 指定小块的大小，small_buf_num 指定小块的数目
+ * 大块与小块的总内存平均分摊到不大于其大小的各尺寸块池作为初始内存，块池按需增长
  * listener_num 指定用于监听的对象的数目，socketer_num 指定用于连接的对象的数目
  * thread_num 指定网络线程数目，若设置为小于等于0，则会开启cpu个数的线程数目
  * infomgr 默认的网络数据统计管理器，一般为NULL
@@ -619,10 +985,39 @@ bool net_init(size_t big_buf_size, size_t big_buf_num, size_t small_buf_size, si
 	return true;
 }
 
+/*
+ * 设置块池选项，需要在net_init之前调用，之后调用则忽略
+ * use_hugepage 为true则块池使用2M大页内存(仅linux，无预留大页时退化为透明大页)
+ * prefault 为true则在net_init时预先触碰块池内存，避免首批连接在网络线程上产生缺页
+ */
+void SetBlockPoolOption(bool use_hugepage, bool prefault) {
+	bufmgr_set_pool_option(use_hugepage, prefault);
+}
+
+/*
+ * 设置空闲缓冲的释放时间(毫秒)，若socket的接收/发送缓冲持续为空超过此时间，则归还其块到池中，
+ * 下次收发时再重新分配，压缩/加密/代理等设置保持不变，若小于等于0则不释放(默认)
+ */
+void SetIdleBufferReleaseTime(int ms) {
+	socketmgr_set_idle_buf_release_time(ms);
+}
+
+/*
+ * 设置池的后台回收，在net_run中每秒执行一次，可在任意时刻调用
+ * 按衰减后的使用量逐步释放不再需要的空闲子池，每次每个池最多释放一个，
+ * 无法释放且空闲超过free_seconds秒的子池，将其内存页归还系统(仅linux，madvise(MADV_DONTNEED))
+ * 回收的字节数见net_get_memory_info获取的poolmgr_info
+ */
+void SetPoolTrim(bool enable, int free_seconds) {
+	s_pooltrim.enable = enable;
+	s_pooltrim.free_seconds = (free_seconds > 0) ? free_seconds : 0;
+}
+
 /* 释放网络相关 */
 void net_release() {
-	infomgr_release();
+	/* the network threads exit first, and run the publish jobs not run, then release the channel pools. */
 	net_module_release();
+	infomgr_release();
 
 	if (s_datainfo_need_release)
 		DataInfoMgr_ReleaseObj(s_datainfomgr);
@@ -634,35 +1029,332 @@ void net_release() {
 /* 执行相关操作，需要在主逻辑中调用此函数 */
 void net_run() {
 	net_module_run();
+
+	if (s_pooltrim.enable) {
+		int64 currenttime = get_millisecond();
+		if (currenttime - s_pooltrim.last_time >= 1000) {
+			s_pooltrim.last_time = currenttime;
+			infomgr_trim(s_pooltrim.free_seconds);
+			net_module_trim(s_pooltrim.free_seconds);
+		}
+	}
+
 	DataInfoMgr_Run(s_datainfomgr);
 }
 
-/* 获取socket对象池，listen对象池，大块池，小块池的使用情况 */
-size_t net_get_memory_info(struct poolmgr_info *array, size_t num) {
-	if (!array || num < 8)
-		return 0;
+/*
+ * 设置压缩字典(compress_codec_lz4_dict使用)，需要在net_init之前调用(网络线程无锁读取字典，之后调用返回false)，net_release时释放，
+ * 字典可由test/dict_train从抓取的数据训练得到，仅使用最后64K，收发双方必须使用相同的字典(数据块中带有字典的校验值)
+ */
+bool SetCompressDict(const void *dict, size_t size) {
+	return bufmgr_set_compress_dict(dict, size);
+}
 
-	size_t index = 0;
+/*
+ * 设置自适应压缩，对启用压缩的全部连接起作用，可在任意时刻调用
+ * 小于min_size字节的数据块不压缩(默认64)，压缩后不变小的数据块也不压缩(流式压缩除外)，
+ * 连接的压缩率估计值高于max_ratio(千分比，默认900)则暂停此连接的压缩，每32个数据块尝试压缩一次，压缩率恢复则继续压缩，
+ * max_ratio为0则不暂停
+ */
+void SetCompressOption(int min_size, int max_ratio) {
+	bufmgr_set_compress_option(min_size, max_ratio);
+}
 
-	cspin_lock(&s_infomgr.encrypt_lock);
-	poolmgr_get_info(s_infomgr.encrypt_pool, &array[index]);
-	cspin_unlock(&s_infomgr.encrypt_lock);
-	++index;
+/*
+ * 设置并行压缩，需要在net_init之前调用(之后调用则忽略)，thread_num为压缩线程数，为0则不使用(默认)
+ * 发送缓冲中待压缩的数据不少于min_size字节时(如服务器间传输大量数据)，将其分为多个数据块，
+ * 由压缩线程与发送线程并行压缩，再按顺序放入发送队列，流式压缩的数据块相互依赖，不并行压缩，
+ * 压缩线程最多16个，各占用一个线程缓冲(网络线程，调用收发接口的线程与压缩线程共用64个)
+ */
+void SetParallelCompress(int thread_num, int min_size) {
+	bufmgr_set_parallel_compress(thread_num, min_size);
+}
 
-	cspin_lock(&s_infomgr.socket_lock);
-	poolmgr_get_info(s_infomgr.socket_pool, &array[index]);
-	cspin_unlock(&s_infomgr.socket_lock);
-	++index;
+/*
+ * 设置流式压缩(compress_codec_quicklz_stream)，需要在net_init之前调用(之后调用则忽略)，
+ * window为历史窗口字节数，不超过编译选项NET_COMPRESS_STREAM_BUFFER(每个连接的压缩状态按其分配)，为0则取其值(默认)，
+ * 收发双方必须使用相同的窗口，state_num为压缩状态池的初始数目，按此数目增长
+ */
+void SetCompressStreamOption(size_t window, size_t state_num) {
+	bufmgr_set_compress_stream_option(window, state_num);
+}
 
-	cspin_lock(&s_infomgr.listen_lock);
-	poolmgr_get_info(s_infomgr.listen_pool, &array[index]);
-	cspin_unlock(&s_infomgr.listen_lock);
-	++index;
+/*
+ * 设置接收数据的解压缩限制(对端不可信)，max_ratio为数据块解压后长度与其长度之比的上限，超出则视为恶意数据断开连接，
+ * 各算法的实际膨胀率不超过256(lz4约255，quicklz约82)，budget为每个连接未被逻辑读取的解压数据字节数上限，
+ * 达到则暂停接收与解压缩，待逻辑读取后(CheckRecv)继续，解压后长度超出budget的数据块断开连接，
+ * 超出接收块的数据块分段解压到多个块中，参数为0则不检查
+ */
+void SetUncompressOption(int max_ratio, int budget) {
+	bufmgr_set_uncompress_option(max_ratio, budget);
+}
+
+/*
+ * 获取listen对象池，频道对象池，频道订阅池，频道待发布包池，各尺寸块池，流式压缩状态池，加密状态池，socket对象池(含收发缓冲及加密/代理信息)的使用情况，
+ * 最多填充array的num个元素，返回填充的个数，array为NULL时返回全部的个数(随块尺寸的种类等变化，可先以此获取所需的大小)
+ * 若budget不为NULL，则同时获取块内存预算的使用情况
+ */
+size_t net_get_memory_info(struct poolmgr_info *array, size_t num, struct net_budget_info *budget) {
+	if (budget) {
+		struct bufmgr_budget_info info;
+		bufmgr_get_budget_info(&info);
+		budget->budget = info.budget;
+		budget->used_bytes = info.used_bytes;
+		budget->max_used_bytes = info.max_used_bytes;
+		budget->alloc_fail_num = info.alloc_fail_num;
+		budget->recv_throttle_num = info.recv_throttle_num;
+		budget->send_drop_num = info.send_drop_num;
+		budget->send_close_num = info.send_close_num;
+	}
 
+	if (!array)
+		return enum_infomgr_pool_num + net_module_get_memory_info(NULL, 0);
+
+	size_t index = infomgr_get_memory_info(array, num);
 	return index + net_module_get_memory_info(&array[index], num - index);
 }
 
 
+/*
+ * 设置全进程的块内存预算(字节)，为0表示不限制(默认)，可在任意时刻调用
+ * 超出预算则分配块失败，预算将要耗尽时，接收队列较大的socket会优先暂停接收(需再次调用CheckRecv恢复)，
+ * 发送时由发送策略决定接受、丢弃或断开连接
+ */
+void SetBufferBudget(size_t budget) {
+	bufmgr_set_budget(budget);
+}
+
+/*
+ * 设置发送策略，若为NULL，则使用默认策略(预算将要耗尽时，断开发送队列较大的连接)
+ * Channel::Publish的包在网络线程中压入，策略函数也会在网络线程中调用
+ * queue_bytes 此连接发送缓冲中的字节数，data_len 此次发送的字节数，
+ * used_bytes 当前使用的块内存字节数，budget 块内存预算
+ * 返回 send_policy_accept, send_policy_drop 或 send_policy_close
+ */
+void SetSendPolicy(int (*policy)(size_t queue_bytes, size_t data_len, size_t used_bytes, size_t budget)) {
+	bufmgr_set_send_policy(policy);
+}
+
+/*
+ * 广播包给多个socket，返回成功压入发送队列的socket数目
+ * 包较大时只存储一份，各socket的发送队列引用它，不再逐个拷贝，需要压缩的socket直接从共享的包压缩，
+ * 需要加密(不压缩)的socket因加密需可写内存，仍需为每个socket拷贝一次，在网络线程中发送时每次拷贝一个块后加密发送，不一次拷贝整个包，
+ * 包较小或超过最大块大小时，同逐个调用SendMsg
+ */
+static struct block *broadcast_create_shared(Msg *msg, size_t n) {
+	int len = msg->GetLength();
+	if (n > 1 && len >= enum_broadcast_shared_min_len)
+		return bufmgr_create_shared_block(msg, len);
+	return NULL;
+}
+
+/* send msg to one target of broadcast, if shared is NULL, then same as SendMsg. */
+static bool broadcast_send(Socketer *sock, Msg *msg, struct block *shared) {
+	if (!shared)
+		return sock->SendMsg(msg);
+
+	int len = msg->GetLength();
+	int action = socketer_send_check(sock->m_self, len);
+	if (action == enum_send_close) {
+		sock->Close();
+		return false;
+	} else if (action == enum_send_drop) {
+		return false;
+	}
+
+	if (!socketer_send_shared(sock->m_self, shared))
+		return false;
+
+	on_send_msg(sock->m_infomgr, 1, len);
+	return true;
+}
+
+size_t net_broadcast(Socketer **targets, size_t n, Msg *msg) {
+	if (!targets || n == 0 || !msg)
+		return 0;
+
+	int len = msg->GetLength();
+	if (len < (int)sizeof(Msg) || len > MessagePack::message_max_length)
+		return 0;
+
+	struct block *shared = broadcast_create_shared(msg, n);
+
+	size_t num = 0;
+	for (size_t i = 0; i < n; ++i) {
+		if (targets[i] && broadcast_send(targets[i], msg, shared))
+			++num;
+	}
+
+	bufmgr_release_shared_block(shared);
+	return num;
+}
+
+
+
+/* 创建一个频道对象 */
+Channel *Channel::Create() {
+	if (!s_infomgr.is_init) {
+		assert(false && "Channel Create not init!");
+		return NULL;
+	}
+
+	cspin_lock(&s_infomgr.channel_lock);
+	struct channel_obj *obj = (struct channel_obj *)poolmgr_alloc_object(s_infomgr.channel_pool);
+	cspin_unlock(&s_infomgr.channel_lock);
+	if (!obj)
+		return NULL;
+
+	Channel *self = &obj->channel;
+	self->m_head = NULL;
+	self->m_num = 0;
+
+	cspin_init(&obj->lock);
+	cspin_init(&obj->queue_lock);
+	obj->msg_head = NULL;
+	obj->msg_tail = NULL;
+	obj->job_posted = false;
+	obj->released = false;
+	obj->job.func = channel_publish_job;
+	obj->job.next = NULL;
+	return self;
+}
+
+/* 释放频道对象，会自动退订所有订阅者 */
+void Channel::Release(Channel *self) {
+	if (!self)
+		return;
+
+	while (self->m_head) {
+		channel_node_release(self->m_head);
+	}
+
+	/* if the publish job is posted or running, it release the queued messages and the object. */
+	struct channel_obj *obj = (struct channel_obj *)self;
+	cspin_lock(&obj->queue_lock);
+	obj->released = true;
+	bool posted = obj->job_posted;
+	cspin_unlock(&obj->queue_lock);
+
+	if (!posted)
+		channel_obj_release(obj);
+}
+
+/* 订阅此频道，若已订阅则返回false */
+bool Channel::Subscribe(Socketer *sock) {
+	if (!sock || sock->IsClose())
+		return false;
+
+	if (channel_node_find(this, sock))
+		return false;
+
+	return channel_node_create(this, sock) != NULL;
+}
+
+/* 退订此频道 */
+void Channel::Unsubscribe(Socketer *sock) {
+	if (!sock)
+		return;
+
+	struct channel_node *node = channel_node_find(this, sock);
+	if (node)
+		channel_node_release(node);
+}
+
+/* 测试是否已订阅此频道 */
+bool Channel::IsSubscribed(Socketer *sock) {
+	if (!sock)
+		return false;
+
+	return channel_node_find(this, sock) != NULL;
+}
+
+/* 获取订阅者数目 */
+size_t Channel::GetSubscriberNum() {
+	return m_num;
+}
+
+/*
+ * the message can not be queued (larger than the biggest block, or the budget is exhausted),
+ * push it to each subscriber on the caller, wait for the queued messages pushed before it, keep the order.
+ */
+static size_t channel_publish_on_caller(struct channel_obj *obj, Msg *msg, Socketer *except) {
+	for (;;) {
+		cspin_lock(&obj->queue_lock);
+		bool posted = obj->job_posted;
+		cspin_unlock(&obj->queue_lock);
+		if (!posted)
+			break;
+
+		cthread_self_sleep(0);
+	}
+
+	size_t num = 0;
+	for (struct channel_node *node = obj->channel.m_head; node; node = node->next) {
+		Socketer *sock = node->sock;
+		if (sock != except && broadcast_send(sock, msg, NULL)) {
+			sock->CheckSend();
+			++num;
+		}
+	}
+	return num;
+}
+
+/*
+ * 发布包给所有订阅者(except除外，可为NULL)，返回发布时的订阅者数目(不含except)
+ * 包存储一份后排队，由网络线程逐个订阅者压入(较小的包拷贝，较大的包只压入共享包的引用)并触发发送，调用线程不遍历订阅者，
+ * 加密(不压缩)的订阅者发送时仍逐块拷贝共享包后加密(同net_broadcast)，
+ * 同一频道的包按发布顺序压入，与SendMsg等直接发送的包之间不保证先后顺序，
+ * 包超过最大块大小或块内存预算耗尽时，等待此频道之前发布的包压入后在调用线程中逐个压入，
+ * 网络线程中压入时检查发送策略，已关闭或被丢弃的订阅者不计入，发送统计计入默认的网络数据统计管理器
+ */
+size_t Channel::Publish(Msg *msg, Socketer *except) {
+	if (!msg || !m_head)
+		return 0;
+
+	int len = msg->GetLength();
+	if (len < (int)sizeof(Msg) || len > MessagePack::message_max_length)
+		return 0;
+
+	struct channel_obj *obj = (struct channel_obj *)this;
+	struct block *shared = bufmgr_create_shared_block(msg, len);
+	if (!shared)
+		return channel_publish_on_caller(obj, msg, except);
+
+	cspin_lock(&s_infomgr.channel_msg_lock);
+	struct channel_msg *cmsg = (struct channel_msg *)poolmgr_alloc_object(s_infomgr.channel_msg_pool);
+	cspin_unlock(&s_infomgr.channel_msg_lock);
+	if (!cmsg) {
+		bufmgr_release_shared_block(shared);
+		return channel_publish_on_caller(obj, msg, except);
+	}
+
+	cmsg->shared = shared;
+	cmsg->len = len;
+	cmsg->except = except;
+	cmsg->next = NULL;
+
+	size_t num = m_num;
+	if (except && channel_node_find(this, except))
+		--num;
+
+	/* post the job when the queue become not empty, the running job take the message pushed later. */
+	cspin_lock(&obj->queue_lock);
+	if (obj->msg_tail)
+		obj->msg_tail->next = cmsg;
+	else
+		obj->msg_head = cmsg;
+	obj->msg_tail = cmsg;
+	bool post = !obj->job_posted;
+	obj->job_posted = true;
+	cspin_unlock(&obj->queue_lock);
+
+	if (post)
+		eventmgr_post_job(&obj->job);
+
+	on_send_msg(s_datainfomgr, num, num * len);
+	return num;
+}
+
 /* 启用/禁用接受的连接导致的错误日志，并返回之前的值 */
 bool SetEnableErrorLog(bool flag) {
 	return buf_set_enable_errorlog(flag);
@@ -15,10 +15,38 @@ struct poolmgr_info;
 struct datainfomgr;
 struct encrypt_info;
 struct proxy_info;
+struct channel_node;
 
 namespace lxnet {
 
 class Socketer;
+class Channel;
+struct compress_stat;
+
+/* GetMsgBatch获取的包 */
+struct MsgView {
+	Msg *msg;
+	int len;
+};
+
+/* 压缩算法，UseCompress/UseUncompress的参数，每个压缩数据块头中带有算法ID，解压缩时据此检查 */
+enum {
+	compress_codec_quicklz = 1,			/* quicklz，压缩速度与压缩率均衡(默认) */
+	compress_codec_lz4 = 2,				/* lz4，解压缩最快，适合客户端 */
+
+	/*
+	 * 流式quicklz，每次压缩可引用此连接之前发送的数据(历史窗口)，重复结构多的小包压缩率更高，适合服务器之间的连接，
+	 * 每个连接额外占用约(NET_COMPRESS_STREAM_BUFFER + 68K)字节的压缩状态，窗口大小由SetCompressStreamOption设置，
+	 * 不超过编译选项NET_COMPRESS_STREAM_BUFFER(默认64K)
+	 */
+	compress_codec_quicklz_stream = 3,
+
+	/*
+	 * lz4+共享字典，压缩和解压缩都引用字典，几百字节的小数据块也有较高的压缩率，无需每个连接的压缩状态，
+	 * 收发双方需要在net_init之前以SetCompressDict设置相同的字典
+	 */
+	compress_codec_lz4_dict = 4,
+};
 
 /* listener对象 */
 class Listener {
@@ -88,11 +116,33 @@ public:
 	/* 设置发送数据字节的临界值，若缓冲中数据长度大于此值，则断开此连接，若为0，则视为不限制 */
 	void SetSendLimit(int size);
 
-	/* (对发送数据起作用)设置启用压缩，若要启用压缩，则此函数在创建socket对象后即刻调用 */
-	void UseCompress();
+	/* (对发送数据起作用)设置启用压缩，codec为压缩算法，失败返回false，若要启用压缩，则此函数在创建socket对象后即刻调用 */
+	bool UseCompress(int codec = compress_codec_quicklz);
+
+	/*
+	 * (对接收的数据起作用)启用解压缩，网络库会负责解压缩操作，客户端与服务器均可使用，
+	 * 非流式算法按数据块头中的算法ID解压缩，对端使用流式算法时codec必须与之相同，失败返回false
+	 * 数据块的膨胀率及未被逻辑读取的解压数据受SetUncompressOption限制，超出的数据块将断开连接
+	 */
+	bool UseUncompress(int codec = compress_codec_quicklz);
 
-	/* (慎用)(对接收的数据起作用)启用解压缩，网络库会负责解压缩操作，仅供客户端使用 */
-	void UseUncompress();
+	/* 获取发送数据的压缩统计，节省的字节数及压缩花费的时间，见SetCompressOption */
+	void GetCompressStat(struct compress_stat *stat);
+
+	/*
+	 * (对接收的数据起作用)启用网络线程分包，网络线程在接收(解密/解压缩)后即切分出完整的包并校验包长，
+	 * 包长非法则在网络线程中断开连接，GetMsg等无需再解析包头，启用后不能再使用GetData，
+	 * 若要启用，则此函数在创建socket对象后即刻调用(接收数据之前)
+	 */
+	bool UseMsgPreparse();
+
+	/*
+	 * 发送/接收缓冲使用环形缓冲(内存映射两次首尾相接)代替块链表，大小为0则不使用，至少为最大包长，向上取2的幂
+	 * 缓冲中的数据总是连续的，一次系统调用即可收发，包不会跨块，PeekMsg/GetMsgBatch总是不拷贝，
+	 * 环形缓冲的大小是固定的，发送缓冲满则断开连接(同超出SetSendLimit)，接收缓冲满则暂停接收
+	 * 若要启用，则此函数在创建socket对象后即刻调用，失败返回false(仍使用块链表)，仅linux
+	 */
+	bool UseRingBuffer(size_t sendsize, size_t recvsize);
 
 	/*
 	 * 设置加密/解密函数， 以及特殊用途的参与加密/解密逻辑的数据。
@@ -109,6 +159,17 @@ public:
 	/* 设置解密key */
 	void SetDecryptKey(const char *key, int key_len);
 
+	/*
+	 * 设置ChaCha20加密(RFC 8439)，key为32字节，nonce为12字节，发送与接收各自使用不同的nonce，
+	 * 对端以相同的key与nonce调用SetDecryptChaCha20，同一key下nonce不可重复使用(如每个连接协商新的key)，
+	 * 同一key与nonce最多加密/解密256G字节(块计数器不回绕)，超出则断开连接，需在此之前协商新的key并重新设置，
+	 * 密钥流按整块批量生成(avx2/sse2)，调用UseEncrypt启用，失败返回false
+	 */
+	bool SetEncryptChaCha20(const char *key, const char *nonce);
+
+	/* 设置ChaCha20解密，key与nonce同对端的SetEncryptChaCha20，调用UseDecrypt启用，失败返回false */
+	bool SetDecryptChaCha20(const char *key, const char *nonce);
+
 	/* (启用加密) */
 	void UseEncrypt();
 
@@ -151,9 +212,35 @@ public:
 	 */
 	bool SendMsg(Msg *msg, void *adddata = 0, size_t addsize = 0);
 
+	/*
+	 * 预留发送缓冲，返回发送块中可直接写入包的连续内存(maxlen字节，含包头)，可用MessageWriter在其上写包，
+	 * 写好后调用CommitSend提交，在此之前不能再发送数据
+	 * maxlen 不能超过最大块大小，失败返回NULL(此时可改用SendMsg)
+	 */
+	char *ReserveSend(size_t maxlen);
+
+	/* 提交ReserveSend预留的缓冲，actual为实际的包长度(含包头)，会自动填写包头中的长度，为0则取消 */
+	bool CommitSend(size_t actual);
+
 	/* 接收数据 */
 	Msg *GetMsg(char *buf = 0, size_t bufsize = 0);
 
+	/*
+	 * 接收数据，不拷贝，若包在接收块中是连续的，则直接返回指向接收块的指针，否则同GetMsg拷贝到buf中
+	 * 若返回不为NULL，则使用完后必须调用ReleaseMsg，在此之前不能再接收数据
+	 */
+	Msg *PeekMsg(char *buf = 0, size_t bufsize = 0);
+
+	/* 释放PeekMsg或GetMsgBatch获取的包 */
+	void ReleaseMsg();
+
+	/*
+	 * 批量接收数据，一次取出缓冲中所有完整的包(最多max个)，返回包的数目
+	 * 接收块中连续的包不拷贝，跨块的包拷贝到arena中(arena为NULL则使用线程缓冲，arenasize不能小于最大包长)
+	 * 若返回大于0，则使用完后必须调用ReleaseMsg，在此之前不能再接收数据
+	 */
+	size_t GetMsgBatch(MsgView *out, size_t max, char *arena = 0, size_t arenasize = 0);
+
 	/* 发送数据 */
 	bool SendData(const void *data, size_t datasize);
 
@@ -174,15 +261,68 @@ public:
 	struct encrypt_info *m_encrypt;
 	struct encrypt_info *m_decrypt;
 	struct proxy_info *m_proxy;
+	struct channel_node *m_channel;
 	struct socketer *m_self;
 };
 
+/*
+ * 频道对象(聊天、公会、场景等的订阅者集合)，订阅关系挂在Socketer上，
+ * Socketer释放时自动退出所有频道，已关闭未释放的Socketer仍在频道中，发布时跳过，
+ * 发布的包由网络线程压入订阅者的发送队列，故订阅者的发送缓冲在逻辑线程写入时加锁(ReserveSend到CommitSend之间持有)
+ */
+class Channel {
+private:
+	Channel(const Channel&);
+	Channel &operator =(const Channel&);
+	void *operator new[](size_t count);
+	void operator delete[](void *p, size_t count);
+	void *operator new(size_t size);
+	void operator delete(void *p);
+	Channel();
+	~Channel();
+
+public:
+	/* 创建一个频道对象 */
+	static Channel *Create();
+
+	/* 释放频道对象，会自动退订所有订阅者 */
+	static void Release(Channel *self);
+
+public:
+	/* 订阅此频道，若已订阅则返回false */
+	bool Subscribe(Socketer *sock);
+
+	/* 退订此频道 */
+	void Unsubscribe(Socketer *sock);
+
+	/* 测试是否已订阅此频道 */
+	bool IsSubscribed(Socketer *sock);
+
+	/* 获取订阅者数目 */
+	size_t GetSubscriberNum();
+
+	/*
+	 * 发布包给所有订阅者(except除外，可为NULL)，返回发布时的订阅者数目(不含except)
+	 * 包存储一份后排队，由网络线程逐个订阅者压入(较小的包拷贝，较大的包只压入共享包的引用)并触发发送，调用线程不遍历订阅者，
+	 * 加密(不压缩)的订阅者发送时仍逐块拷贝共享包后加密(同net_broadcast)，
+	 * 同一频道的包按发布顺序压入，与SendMsg等直接发送的包之间不保证先后顺序，
+	 * 包超过最大块大小或块内存预算耗尽时，等待此频道之前发布的包压入后在调用线程中逐个压入，
+	 * 网络线程中压入时检查发送策略，已关闭或被丢弃的订阅者不计入，发送统计计入默认的网络数据统计管理器
+	 */
+	size_t Publish(Msg *msg, Socketer *except = NULL);
+
+public:
+	struct channel_node *m_head;
+	size_t m_num;
+};
+
 
 
 /*
  * 初始化网络
  * big_buf_size 指定大块的大小，big_buf_num 指定大块的数目，
  * small_buf_size 指定小块的大小，small_buf_num 指定小块的数目
+ * 大块与小块的总内存平均分摊到不大于其大小的各尺寸块池作为初始内存，块池按需增长
  * listener_num 指定用于监听的对象的数目，socketer_num 指定用于连接的对象的数目
  * thread_num 指定网络线程数目，若设置为小于等于0，则会开启cpu个数的线程数目
  * infomgr 默认的网络数据统计管理器，一般为NULL
@@ -190,14 +330,129 @@ public:
 bool net_init(size_t big_buf_size, size_t big_buf_num, size_t small_buf_size, size_t small_buf_num, 
 		size_t listener_num, size_t socketer_num, int thread_num, struct datainfomgr *infomgr = NULL);
 
+/*
+ * 设置块池选项，需要在net_init之前调用，之后调用则忽略
+ * use_hugepage 为true则块池使用2M大页内存(仅linux，无预留大页时退化为透明大页)
+ * prefault 为true则在net_init时预先触碰块池内存，避免首批连接在网络线程上产生缺页
+ */
+void SetBlockPoolOption(bool use_hugepage, bool prefault);
+
+/*
+ * 设置空闲缓冲的释放时间(毫秒)，若socket的接收/发送缓冲持续为空超过此时间，则归还其块到池中，
+ * 下次收发时再重新分配，压缩/加密/代理等设置保持不变，若小于等于0则不释放(默认)
+ */
+void SetIdleBufferReleaseTime(int ms);
+
+/*
+ * 设置池的后台回收，在net_run中每秒执行一次，可在任意时刻调用
+ * 按衰减后的使用量逐步释放不再需要的空闲子池，每次每个池最多释放一个，
+ * 无法释放且空闲超过free_seconds秒的子池，将其内存页归还系统(仅linux，madvise(MADV_DONTNEED))
+ * 回收的字节数见net_get_memory_info获取的poolmgr_info
+ */
+void SetPoolTrim(bool enable, int free_seconds = 60);
+
 /* 释放网络相关 */
 void net_release();
 
 /* 执行相关操作，需要在主逻辑中调用此函数 */
 void net_run();
 
-/* 获取socket对象池，listen对象池，大块池，小块池的使用情况 */
-size_t net_get_memory_info(struct poolmgr_info *array, size_t num);
+/* 块内存预算的使用情况 */
+struct net_budget_info {
+	size_t budget;					/* 块内存预算字节数，为0表示不限制 */
+	size_t used_bytes;				/* 当前使用的块内存字节数 */
+	size_t max_used_bytes;			/* 使用过的最大块内存字节数 */
+	size_t alloc_fail_num;			/* 因超出预算而分配块失败的次数 */
+	size_t recv_throttle_num;		/* 因预算紧张而暂停接收的次数 */
+	size_t send_drop_num;			/* 被发送策略丢弃的发送次数 */
+	size_t send_close_num;			/* 被发送策略断开连接的次数 */
+};
+
+/* 发送数据的压缩统计 */
+struct compress_stat {
+	size_t raw_bytes;				/* 压缩前的字节数 */
+	size_t out_bytes;				/* 压缩后(含数据块头)的字节数，raw_bytes - out_bytes为节省的字节数 */
+	size_t compressed_chunk_num;	/* 压缩后发送的数据块数 */
+	size_t stored_chunk_num;		/* 未压缩直接发送的数据块数(过小、压缩后不变小或已暂停压缩) */
+	size_t compress_microsecond;	/* 压缩花费的时间(微秒) */
+	int ratio;						/* 压缩率的估计值(压缩后/压缩前，千分比) */
+	bool paused;					/* 压缩率不理想，已暂停压缩(仍定期尝试压缩以重新评估) */
+};
+
+/*
+ * 设置压缩字典(compress_codec_lz4_dict使用)，需要在net_init之前调用(网络线程无锁读取字典，之后调用返回false)，net_release时释放，
+ * 字典可由test/dict_train从抓取的数据训练得到，仅使用最后64K，收发双方必须使用相同的字典(数据块中带有字典的校验值)
+ */
+bool SetCompressDict(const void *dict, size_t size);
+
+/*
+ * 设置自适应压缩，对启用压缩的全部连接起作用，可在任意时刻调用
+ * 小于min_size字节的数据块不压缩(默认64)，压缩后不变小的数据块也不压缩(流式压缩除外)，
+ * 连接的压缩率估计值高于max_ratio(千分比，默认900)则暂停此连接的压缩，每32个数据块尝试压缩一次，压缩率恢复则继续压缩，
+ * max_ratio为0则不暂停
+ */
+void SetCompressOption(int min_size, int max_ratio = 900);
+
+/*
+ * 设置并行压缩，需要在net_init之前调用(之后调用则忽略)，thread_num为压缩线程数，为0则不使用(默认)
+ * 发送缓冲中待压缩的数据不少于min_size字节时(如服务器间传输大量数据)，将其分为多个数据块，
+ * 由压缩线程与发送线程并行压缩，再按顺序放入发送队列，流式压缩的数据块相互依赖，不并行压缩，
+ * 压缩线程最多16个，各占用一个线程缓冲(网络线程，调用收发接口的线程与压缩线程共用64个)
+ */
+void SetParallelCompress(int thread_num, int min_size = 256 * 1024);
+
+/*
+ * 设置流式压缩(compress_codec_quicklz_stream)，需要在net_init之前调用(之后调用则忽略)，
+ * window为历史窗口字节数，不超过编译选项NET_COMPRESS_STREAM_BUFFER(每个连接的压缩状态按其分配)，为0则取其值(默认)，
+ * 收发双方必须使用相同的窗口，state_num为压缩状态池的初始数目，按此数目增长
+ */
+void SetCompressStreamOption(size_t window, size_t state_num = 16);
+
+/*
+ * 设置接收数据的解压缩限制(对端不可信)，max_ratio为数据块解压后长度与其长度之比的上限，超出则视为恶意数据断开连接，
+ * 各算法的实际膨胀率不超过256(lz4约255，quicklz约82)，budget为每个连接未被逻辑读取的解压数据字节数上限，
+ * 达到则暂停接收与解压缩，待逻辑读取后(CheckRecv)继续，解压后长度超出budget的数据块断开连接，
+ * 超出接收块的数据块分段解压到多个块中，参数为0则不检查
+ */
+void SetUncompressOption(int max_ratio = 256, int budget = 16 * 1024 * 1024);
+
+/*
+ * 获取listen对象池，频道对象池，频道订阅池，频道待发布包池，各尺寸块池，流式压缩状态池，加密状态池，socket对象池(含收发缓冲及加密/代理信息)的使用情况，
+ * 最多填充array的num个元素，返回填充的个数，array为NULL时返回全部的个数(随块尺寸的种类等变化，可先以此获取所需的大小)
+ * 若budget不为NULL，则同时获取块内存预算的使用情况
+ */
+size_t net_get_memory_info(struct poolmgr_info *array, size_t num, struct net_budget_info *budget = NULL);
+
+/* 发送策略的返回值 */
+enum {
+	send_policy_accept = 0,			/* 接受此次发送 */
+	send_policy_drop = 1,			/* 丢弃此次发送，保持连接 */
+	send_policy_close = 2,			/* 断开此连接 */
+};
+
+/*
+ * 设置全进程的块内存预算(字节)，为0表示不限制(默认)，可在任意时刻调用
+ * 超出预算则分配块失败，预算将要耗尽时，接收队列较大的socket会优先暂停接收(需再次调用CheckRecv恢复)，
+ * 发送时由发送策略决定接受、丢弃或断开连接
+ */
+void SetBufferBudget(size_t budget);
+
+/*
+ * 设置发送策略，若为NULL，则使用默认策略(预算将要耗尽时，断开发送队列较大的连接)
+ * Channel::Publish的包在网络线程中压入，策略函数也会在网络线程中调用
+ * queue_bytes 此连接发送缓冲中的字节数，data_len 此次发送的字节数，
+ * used_bytes 当前使用的块内存字节数，budget 块内存预算
+ * 返回 send_policy_accept, send_policy_drop 或 send_policy_close
+ */
+void SetSendPolicy(int (*policy)(size_t queue_bytes, size_t data_len, size_t used_bytes, size_t budget));
+
+/*
+ * 广播包给多个socket，返回成功压入发送队列的socket数目
+ * 包较大时只存储一份，各socket的发送队列引用它，不再逐个拷贝，需要压缩的socket直接从共享的包压缩，
+ * 需要加密(不压缩)的socket因加密需可写内存，仍需为每个socket拷贝一次，在网络线程中发送时每次拷贝一个块后加密发送，不一次拷贝整个包，
+ * 包较小或超过最大块大小时，同逐个调用SendMsg
+ */
+size_t net_broadcast(Socketer **targets, size_t n, Msg *msg);
 
 
 /* 启用/禁用接受的连接导致的错误日志，并返回之前的值 */
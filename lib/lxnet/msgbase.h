@@ -31,7 +31,8 @@ struct Msg {
 	int16 GetType() { return msgtype; }
 };
 
-struct MessagePack:public Msg {
+//MessagePack的缓冲，包体紧跟在包头之后
+struct MessagePackBuffer:public Msg {
 	enum {
 		//消息最大长度
 		message_max_length = 128 * 1024,
@@ -52,66 +53,67 @@ struct MessagePack:public Msg {
 	int m_error_num;		//出错次数
 	bool m_enable_assert;	//是否开启assert
 
-	MessagePack() {
-		header.length = sizeof(Msg);
-		memset(m_buf, 0, sizeof(m_buf));
-		m_index = 0;
-		m_maxindex = 0;
-		m_error_num = 0;
-		m_enable_assert = true;
+	bool CanPush(size_t size) {
+		if (m_index + size <= message_data_max_length)
+			return true;
+		return false;
 	}
 
-	bool HasError() {
-		return m_error_num != 0;
-	}
+protected:
 
-	int GetErrorNum() {
-		return m_error_num;
+	inline char *__body() {
+		return m_buf;
 	}
 
-	void SetIndex(size_t idx) {
-		if (idx >= message_data_max_length)
-			idx = message_data_max_length - 1;
-
-		if ((int)idx < 0)
-			idx = 0;
+	inline size_t __body_maxlength() {
+		return message_data_max_length;
+	}
 
-		m_index = idx;
-		m_maxindex = GetLength() - (int)sizeof(Msg);
+	inline void __write_data(const void *data, size_t size) {
+		memcpy(&m_buf[m_index], data, size);
+		m_index += size;
+		header.length += size;
 	}
+};
 
-	int GetIndex() {
-		return m_index;
+//MessageWriter的缓冲，包头与包体在外部缓冲上
+struct MessageWriterBuffer {
+	Msg *m_msg;				//包头所在的缓冲
+	size_t m_maxlength;		//缓冲最大长度(含包头)
+	int m_error_num;		//出错次数
+	bool m_enable_assert;	//是否开启assert
+
+	bool CanPush(size_t size) {
+		if ((size_t)m_msg->GetLength() + size <= m_maxlength)
+			return true;
+		return false;
 	}
 
-	//切记在从包中取出时。调用此函数，重置缓冲索引
-	void Begin(bool enable_assert = true) {
-		m_index = 0;
-		m_maxindex = GetLength() - (int)sizeof(Msg);
+protected:
 
-		m_error_num = 0;
-		m_enable_assert = enable_assert;
+	inline char *__body() {
+		return (char *)m_msg + sizeof(Msg);
 	}
 
-	void Reset(bool enable_assert = true) {
-		m_index = 0;
-		m_maxindex = 0;
-		header.length = sizeof(Msg);
+	inline size_t __body_maxlength() {
+		return m_maxlength - sizeof(Msg);
+	}
 
-		m_error_num = 0;
-		m_enable_assert = enable_assert;
+	inline void __write_data(const void *data, size_t size) {
+		memcpy((char *)m_msg + m_msg->GetLength(), data, size);
+		m_msg->SetLength(m_msg->GetLength() + (int32)size);
 	}
+};
 
-	bool CanPush(size_t size) {
-		if (m_index + size <= message_data_max_length)
-			return true;
-		return false;
+//写包接口，MessagePack与MessageWriter共用，Buffer提供包体缓冲及其写入
+template <typename Buffer>
+struct MessagePusher:public Buffer {
+	bool HasError() {
+		return this->m_error_num != 0;
 	}
 
-	bool CanGet(size_t size) {
-		if ((int)(m_index + size) <= m_maxindex)
-			return true;
-		return false;
+	int GetErrorNum() {
+		return this->m_error_num;
 	}
 
 
@@ -167,8 +169,8 @@ struct MessagePack:public Msg {
 
 	bool PushBlock(const void *data, size_t size) {
 		if (data) {
-			if (CanPush(size)) {
-				__write_data(data, size);
+			if (this->CanPush(size)) {
+				this->__write_data(data, size);
 				return true;
 			}
 		}
@@ -180,9 +182,9 @@ struct MessagePack:public Msg {
 	bool PushLBlock(const void *data, size_t size) {
 		if (data) {
 			uint32 temp_size = (uint32)size;
-			if (CanPush(sizeof(temp_size) + size)) {
-				__write_data(&temp_size, sizeof(temp_size));
-				__write_data(data, size);
+			if (this->CanPush(sizeof(temp_size) + size)) {
+				this->__write_data(&temp_size, sizeof(temp_size));
+				this->__write_data(data, size);
 				return true;
 			}
 		}
@@ -191,8 +193,8 @@ struct MessagePack:public Msg {
 		return false;
 	}
 
-	bool PushLString(const char *str, size_t str_size, size_t max_push = string_max_length) {
-		if (!str || str_size > string_max_length || max_push > string_max_length) {
+	bool PushLString(const char *str, size_t str_size, size_t max_push = MessagePackBuffer::string_max_length) {
+		if (!str || str_size > MessagePackBuffer::string_max_length || max_push > MessagePackBuffer::string_max_length) {
 			__on_error();
 			return false;
 		}
@@ -201,9 +203,9 @@ struct MessagePack:public Msg {
 			str_size = max_push;
 
 		uint16 temp_size = (uint16)str_size;
-		if (CanPush(sizeof(temp_size) + str_size)) {
-			__write_data(&temp_size, sizeof(temp_size));
-			__write_data(str, str_size);
+		if (this->CanPush(sizeof(temp_size) + str_size)) {
+			this->__write_data(&temp_size, sizeof(temp_size));
+			this->__write_data(str, str_size);
 			return true;
 		}
 
@@ -211,7 +213,7 @@ struct MessagePack:public Msg {
 		return false;
 	}
 
-	bool PushString(const char *str, size_t max_push = string_max_length) {
+	bool PushString(const char *str, size_t max_push = MessagePackBuffer::string_max_length) {
 		if (!str) {
 			__on_error();
 			return false;
@@ -221,8 +223,8 @@ struct MessagePack:public Msg {
 		return PushLString(str, str_size, max_push);
 	}
 
-	bool PushLBigString(const char *str, size_t str_size, size_t max_push = big_string_max_length) {
-		if (!str || str_size > big_string_max_length || max_push > big_string_max_length) {
+	bool PushLBigString(const char *str, size_t str_size, size_t max_push = MessagePackBuffer::big_string_max_length) {
+		if (!str || str_size > MessagePackBuffer::big_string_max_length || max_push > MessagePackBuffer::big_string_max_length) {
 			__on_error();
 			return false;
 		}
@@ -231,9 +233,9 @@ struct MessagePack:public Msg {
 			str_size = max_push;
 
 		uint32 temp_size = (uint32)str_size;
-		if (CanPush(sizeof(temp_size) + str_size)) {
-			__write_data(&temp_size, sizeof(temp_size));
-			__write_data(str, str_size);
+		if (this->CanPush(sizeof(temp_size) + str_size)) {
+			this->__write_data(&temp_size, sizeof(temp_size));
+			this->__write_data(str, str_size);
 			return true;
 		}
 
@@ -241,7 +243,7 @@ struct MessagePack:public Msg {
 		return false;
 	}
 
-	bool PushBigString(const char *str, size_t max_push = big_string_max_length) {
+	bool PushBigString(const char *str, size_t max_push = MessagePackBuffer::big_string_max_length) {
 		if (!str) {
 			__on_error();
 			return false;
@@ -251,22 +253,83 @@ struct MessagePack:public Msg {
 		return PushLBigString(str, str_size, max_push);
 	}
 
-	//用于覆盖数据。不做包长度的累加
+	//用于覆盖数据。不做包长度的累加，index为包体中的索引
 	bool PutDataNotAddLength(size_t index, const void *data, size_t size) {
 		if (!data) {
 			__on_error();
 			return false;
 		}
 
-		if ((index + size) > message_data_max_length) {
+		if ((index + size) > this->__body_maxlength()) {
 			__on_error();
 			return false;
 		}
 
-		memcpy(&m_buf[index], data, size);
+		memcpy(this->__body() + index, data, size);
 		return true;
 	}
 
+protected:
+
+	inline void __on_error() {
+		++this->m_error_num;
+
+		if (this->m_enable_assert) {
+			assert(false && "error!");
+		}
+	}
+
+};
+
+struct MessagePack:public MessagePusher<MessagePackBuffer> {
+	MessagePack() {
+		header.length = sizeof(Msg);
+		memset(m_buf, 0, sizeof(m_buf));
+		m_index = 0;
+		m_maxindex = 0;
+		m_error_num = 0;
+		m_enable_assert = true;
+	}
+
+	void SetIndex(size_t idx) {
+		if (idx >= message_data_max_length)
+			idx = message_data_max_length - 1;
+
+		if ((int)idx < 0)
+			idx = 0;
+
+		m_index = idx;
+		m_maxindex = GetLength() - (int)sizeof(Msg);
+	}
+
+	int GetIndex() {
+		return m_index;
+	}
+
+	//切记在从包中取出时。调用此函数，重置缓冲索引
+	void Begin(bool enable_assert = true) {
+		m_index = 0;
+		m_maxindex = GetLength() - (int)sizeof(Msg);
+
+		m_error_num = 0;
+		m_enable_assert = enable_assert;
+	}
+
+	void Reset(bool enable_assert = true) {
+		m_index = 0;
+		m_maxindex = 0;
+		header.length = sizeof(Msg);
+
+		m_error_num = 0;
+		m_enable_assert = enable_assert;
+	}
+
+	bool CanGet(size_t size) {
+		if ((int)(m_index + size) <= m_maxindex)
+			return true;
+		return false;
+	}
+
 
 
 	/*
@@ -498,12 +561,6 @@ struct MessagePack:public Msg {
 
 private:
 
-	inline void __write_data(const void *data, size_t size) {
-		memcpy(&m_buf[m_index], data, size);
-		m_index += size;
-		header.length += size;
-	}
-
 	inline void __read_data(void *buf, size_t size) {
 		memcpy(buf, &m_buf[m_index], size);
 		m_index += size;
@@ -515,12 +572,30 @@ private:
 		return data;
 	}
 
-	inline void __on_error() {
-		++m_error_num;
+};
 
-		if (m_enable_assert) {
-			assert(false && "error!");
-		}
+//在外部缓冲上写包(如Socketer::ReserveSend返回的发送缓冲)，写入接口同MessagePack
+struct MessageWriter:public MessagePusher<MessageWriterBuffer> {
+	MessageWriter(void *buf, size_t maxlength, bool enable_assert = true) {
+		assert(buf != NULL && maxlength >= sizeof(Msg));
+		m_msg = (Msg *)buf;
+		m_msg->SetLength(sizeof(Msg));
+		m_msg->SetType(0);
+		m_maxlength = maxlength;
+		m_error_num = 0;
+		m_enable_assert = enable_assert;
+	}
+
+	Msg *GetMsg() {
+		return m_msg;
+	}
+
+	int32 GetLength() {
+		return m_msg->GetLength();
+	}
+
+	void SetType(int16 type) {
+		m_msg->SetType(type);
 	}
 
 };
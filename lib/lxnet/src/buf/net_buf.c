@@ -12,11 +12,66 @@
 #include "buf/block_list.h"
 #include "net_thread_buf.h"
 #include "net_compress.h"
+#include "net_compress_worker.h"
+#include "catomic.h"
+#include "crosslib.h"
 #include "log.h"
 
 
 static bool s_enable_errorlog = false;
 
+static int default_send_policy(size_t queue_bytes, size_t data_len, size_t used_bytes, size_t budget);
+
+struct budget_stat {
+	send_policy_func send_policy;
+	catomic recv_throttle_num;
+	catomic send_drop_num;
+	catomic send_close_num;
+};
+static struct budget_stat s_budget_stat = {default_send_policy, 
+	catomic_init(0), catomic_init(0), catomic_init(0)};
+
+/* adaptive compress option. */
+struct compress_option {
+	int min_size;				/* the chunk less than it is stored, not compressed. */
+	int max_ratio;				/* per mille, pause compress when the ratio estimate is more than it, 0 is not pause. */
+};
+static struct compress_option s_compress_option = {64, 900};
+
+/* when compress is paused, probe it once per chunks, and the min samples before pause. */
+#define _COMPRESS_PROBE_INTERVAL 32
+#define _COMPRESS_MIN_SAMPLE 8
+
+/* parallel compress option, the send backlog not less than min_size is compressed by the workers. */
+struct parallel_compress_option {
+	int thread_num;				/* worker thread num, 0 is not use. */
+	int min_size;
+};
+static struct parallel_compress_option s_parallel_option = {0, 256 * 1024};
+
+/* streaming compress option, the history window (0 is the max) and the initialize num of state pool. */
+struct stream_compress_option {
+	size_t window;
+	size_t state_num;
+};
+static struct stream_compress_option s_stream_option = {0, 16};
+
+/*
+ * uncompress option of the received data, the peer is not trusted.
+ * max_ratio --- the raw length of chunk must not be more than its length (include header) * max_ratio, 0 is not check.
+ * budget --- the max uncompressed data not read by logic of a connection, stop recv and uncompress when it is reached,
+ * the raw length of chunk must not be more than it, 0 is not limit.
+ */
+struct uncompress_option {
+	int max_ratio;
+	int budget;
+};
+static struct uncompress_option s_uncompress_option = {256, 16 * 1024 * 1024};
+
+/* max chunk len (include header) and max chunk num of once parallel compress. */
+#define _COMPRESS_PARALLEL_CHUNK_LEN (64 * 1024)
+#define _COMPRESS_PARALLEL_MAX_TASK 16
+
 enum enum_some {
 	enum_unknow = 0,
 	enum_compress,
@@ -32,6 +87,12 @@ struct block_size {
 
 static struct block_size s_block_info;
 
+/* the option that must be set before bufmgr_init is read by network and compress threads without lock. */
+static bool s_bufmgr_is_init = false;
+
+/* default block size class, the big and small block size is also a class. */
+static const size_t s_default_block_class[] = {512, 4 * 1024, 32 * 1024, 256 * 1024};
+
 
 struct net_buf {
 	bool is_bigbuf;				/* big or small flag. */
@@ -39,6 +100,8 @@ struct net_buf {
 	char crypt_flag;
 	bool use_proxy;
 	volatile bool already_do_proxy;
+	bool frame_error;			/* the message framed by network thread has invalid length. */
+	bool crypt_error;			/* the keystream of chacha20 is exhausted, the connection must be rekeyed. */
 
 	const char *proxy_end_char;
 	size_t proxy_end_char_len;
@@ -55,6 +118,12 @@ struct net_buf {
 
 	int io_limit_size;			/* io handle limit size. */
 
+	void *stream_state;			/* if not NULL, compress/uncompress in streaming mode with this state. */
+	const struct compress_codec *codec;	/* the codec of compress. */
+	int compress_sample_num;	/* compressed chunks for the ratio estimate. */
+	int compress_skip_num;		/* stored chunks since paused or last probe. */
+	struct buf_compress_stat compress_stat;
+
 	struct blocklist iolist;	/* io block list. */
 
 	struct blocklist logiclist;	/* if use compress/uncompress, logic block list is can use. */
@@ -90,24 +159,25 @@ static void buf_real_release(struct net_buf *self) {
 	self->release_logicdata = NULL;
 	self->do_logicdata = NULL;
 
+	if (self->stream_state) {
+		bufpool_release_stream_state(self->stream_state);
+		self->stream_state = NULL;
+	}
+
 	blocklist_release(&self->iolist);
 	blocklist_release(&self->logiclist);
 }
 
-static void *create_small_block_f(void *arg, size_t size) {
-	return bufpool_create_small_block();
-}
-
-static void release_small_block_f(void *arg, void *bobj) {
-	bufpool_release_small_block(bobj);
+static void *create_block_f(void *arg, size_t *size) {
+	return bufpool_create_block(size);
 }
 
-static void *create_big_block_f(void *arg, size_t size) {
-	return bufpool_create_big_block();
-}
+static void release_block_f(void *arg, void *bobj) {
+	struct block *bk = (struct block *)bobj;
+	if (block_is_ring(bk))
+		bufpool_release_ring(bk->data, (size_t)bk->ring_size);
 
-static void release_big_block_f(void *arg, void *bobj) {
-	bufpool_release_big_block(bobj);
+	bufpool_release_block(bobj, (size_t)block_get_size(bk));
 }
 
 
@@ -119,6 +189,8 @@ static void buf_init(struct net_buf *self, bool is_bigbuf) {
 	self->crypt_flag = enum_unknow;
 	self->use_proxy = false;
 	self->already_do_proxy = false;
+	self->frame_error = false;
+	self->crypt_error = false;
 
 	self->proxy_end_char = NULL;
 	self->proxy_end_char_len = 0;
@@ -134,33 +206,45 @@ static void buf_init(struct net_buf *self, bool is_bigbuf) {
 
 	self->io_limit_size = 0;
 
+	self->stream_state = NULL;
+	self->codec = NULL;
+	self->compress_sample_num = 0;
+	self->compress_skip_num = 0;
+	memset(&self->compress_stat, 0, sizeof(self->compress_stat));
+
+	/* big or small block size is the max block size of this buf. */
 	if (is_bigbuf) {
 		blocklist_init(&self->iolist, 
-				create_big_block_f, release_big_block_f, 
+				create_block_f, release_block_f, 
 					NULL, s_block_info.big_block_size);
 		blocklist_init(&self->logiclist, 
-				create_big_block_f, release_big_block_f, 
+				create_block_f, release_block_f, 
 					NULL, s_block_info.big_block_size);
 	} else {
 		blocklist_init(&self->iolist, 
-				create_small_block_f, release_small_block_f, 
+				create_block_f, release_block_f, 
 					NULL, s_block_info.small_block_size);
 		blocklist_init(&self->logiclist, 
-				create_small_block_f, release_small_block_f, 
+				create_block_f, release_block_f, 
 					NULL, s_block_info.small_block_size);
 	}
 }
 
+/* get buf object size. */
+size_t buf_get_size() {
+	return sizeof(struct net_buf);
+}
+
 /*
- * create buf.
+ * create buf in mem, the buf is a part of its owner object, not alloc from pool.
+ * mem --- at least buf_get_size() bytes.
  * bigbuf --- big or small buf, if is true, then is big buf, or else is small buf.
  */
-struct net_buf *buf_create(bool bigbuf) {
-	struct net_buf *self = (struct net_buf *)bufpool_create_net_buf();
-	if (!self) {
-		log_error("if (!self)");
+struct net_buf *buf_create(void *mem, bool bigbuf) {
+	struct net_buf *self = (struct net_buf *)mem;
+	assert(mem != NULL);
+	if (!self)
 		return NULL;
-	}
 
 	buf_init(self, bigbuf);
 	return self;
@@ -168,6 +252,7 @@ struct net_buf *buf_create(bool bigbuf) {
 
 /*
  * set buf encrypt function or decrypt function, and some logic data.
+ * the logic data replaced is released by its release function.
  */
 void buf_set_do_func(struct net_buf *self, dofunc_f func, 
 		void (*release_logicdata)(void *logicdata), void *logicdata) {
@@ -176,18 +261,68 @@ void buf_set_do_func(struct net_buf *self, dofunc_f func,
 	if (!self || !func)
 		return;
 
+	if (self->release_logicdata && self->do_logicdata && (self->do_logicdata != logicdata))
+		self->release_logicdata(self->do_logicdata);
+
 	self->dofunc = func;
 	self->release_logicdata = release_logicdata;
 	self->do_logicdata = logicdata;
 }
 
-/* release buf. */
+static void buf_chacha20_do(void *logicdata, char *buf, int len) {
+	crypt_chacha20_xor((struct crypt_chacha20 *)logicdata, buf, len);
+}
+
+/* test the keystream of chacha20 is less than len, the data is not encrypted or decrypted then. */
+static inline bool buf_is_chacha20_exhausted(struct net_buf *self, uint64 len) {
+	return (self->dofunc == buf_chacha20_do) && self->do_logicdata && 
+			(crypt_chacha20_left((struct crypt_chacha20 *)self->do_logicdata) < len);
+}
+
+/* encrypt or decrypt, if the keystream of chacha20 is exhausted, set the error and return false. */
+static inline bool buf_do_crypt(struct net_buf *self, char *buf, int len) {
+	if (buf_is_chacha20_exhausted(self, (uint64)len)) {
+		self->crypt_error = true;
+		return false;
+	}
+
+	self->dofunc(self->do_logicdata, buf, len);
+	return true;
+}
+
+static void buf_release_chacha20(void *logicdata) {
+	bufpool_release_crypt_state(logicdata);
+}
+
+/*
+ * set the encrypt or decrypt function to chacha20, key is 32 bytes, nonce is 12 bytes,
+ * if it is already chacha20, then reset the key and nonce. it is enabled by buf_use_encrypt/buf_use_decrypt.
+ */
+bool buf_use_chacha20(struct net_buf *self, const char *key, const char *nonce) {
+	struct crypt_chacha20 *cipher;
+	if (!self || !key || !nonce)
+		return false;
+
+	if ((self->dofunc == buf_chacha20_do) && self->do_logicdata) {
+		cipher = (struct crypt_chacha20 *)self->do_logicdata;
+	} else {
+		cipher = (struct crypt_chacha20 *)bufpool_create_crypt_state();
+		if (!cipher)
+			return false;
+
+		buf_set_do_func(self, buf_chacha20_do, buf_release_chacha20, cipher);
+	}
+
+	crypt_chacha20_init(cipher, key, nonce, 0);
+	return true;
+}
+
+/* release buf, the memory of buf is released by its owner. */
 void buf_release(struct net_buf *self) {
 	if (!self)
 		return;
 
 	buf_real_release(self);
-	bufpool_release_net_buf(self);
 }
 
 
@@ -202,18 +337,111 @@ void buf_set_limit_size(struct net_buf *self, int limit_len) {
 		self->io_limit_size = limit_len;
 }
 
-void buf_use_compress(struct net_buf *self) {
-	if (!self)
-		return;
+static bool buf_create_stream_state(struct net_buf *self) {
+	if (self->stream_state)
+		return true;
+
+	self->stream_state = bufpool_create_stream_state();
+	if (!self->stream_state)
+		return false;
 
+	memset(self->stream_state, 0, compressmgr_stream_state_size());
+	return true;
+}
+
+/*
+ * compress with the codec, must be called before push any data.
+ * if the codec is stream, each compress chunk reference the history of earlier chunks.
+ */
+bool buf_use_compress(struct net_buf *self, int codec_id) {
+	const struct compress_codec *codec = compressmgr_get_codec(codec_id);
+	if (!self || !codec)
+		return false;
+
+	if (codec->is_stream && !buf_create_stream_state(self))
+		return false;
+
+	self->codec = codec;
 	self->compress_flag = enum_compress;
+	return true;
 }
 
-void buf_use_uncompress(struct net_buf *self) {
-	if (!self)
-		return;
+/*
+ * uncompress, must be called before recv any data.
+ * the codec of each chunk is in the chunk header, but the stream codec need the state of this connection,
+ * so if the peer compress with stream codec, codec_id must be it.
+ */
+bool buf_use_uncompress(struct net_buf *self, int codec_id) {
+	const struct compress_codec *codec = compressmgr_get_codec(codec_id);
+	if (!self || !codec)
+		return false;
+
+	if (codec->is_stream && !buf_create_stream_state(self))
+		return false;
 
 	self->compress_flag = enum_uncompress;
+	return true;
+}
+
+/*
+ * set the shared compress dictionary, must be called before bufmgr_init, or else return false,
+ * it is released by bufmgr_release.
+ */
+bool bufmgr_set_compress_dict(const void *dict, size_t size) {
+	if (s_bufmgr_is_init) {
+		log_error("set compress dictionary after bufmgr init");
+		return false;
+	}
+
+	return compressmgr_set_dict(dict, size);
+}
+
+/*
+ * set parallel compress, must be called before bufmgr_init, or else it is ignored.
+ * the send backlog not less than min_size is split into chunks, and compressed by thread_num workers and the sending thread.
+ */
+void bufmgr_set_parallel_compress(int thread_num, int min_size) {
+	if (s_bufmgr_is_init) {
+		log_error("set parallel compress after bufmgr init");
+		return;
+	}
+
+	s_parallel_option.thread_num = (thread_num > 0) ? thread_num : 0;
+	s_parallel_option.min_size = (min_size > 0) ? min_size : 0;
+}
+
+/*
+ * set streaming compress option, must be called before bufmgr_init, or else it is ignored.
+ * window is the history window, not more than NET_COMPRESS_STREAM_BUFFER, 0 is the max, both sides must use the same window.
+ * state_num is the initialize num of state pool, it grows by the num.
+ */
+void bufmgr_set_compress_stream_option(size_t window, size_t state_num) {
+	if (s_bufmgr_is_init) {
+		log_error("set compress stream option after bufmgr init");
+		return;
+	}
+
+	s_stream_option.window = window;
+	s_stream_option.state_num = (state_num > 0) ? state_num : 1;
+}
+
+/* set the uncompress limit of the received data. */
+void bufmgr_set_uncompress_option(int max_ratio, int budget) {
+	s_uncompress_option.max_ratio = (max_ratio > 0) ? max_ratio : 0;
+	s_uncompress_option.budget = (budget > 0) ? budget : 0;
+}
+
+/* get compress stat of the buf. */
+void buf_get_compress_stat(struct net_buf *self, struct buf_compress_stat *stat) {
+	if (!stat)
+		return;
+
+	if (!self) {
+		memset(stat, 0, sizeof(*stat));
+		return;
+	}
+
+	*stat = self->compress_stat;
 }
 
 void buf_use_encrypt(struct net_buf *self) {
@@ -230,6 +458,51 @@ void buf_use_decrypt(struct net_buf *self) {
 	self->crypt_flag = enum_decrypt;
 }
 
+/*
+ * network thread split the recv data into messages, must be called before recv any data,
+ * the logic thread get the message need not parse the length header.
+ */
+bool buf_use_msg_preparse(struct net_buf *self) {
+	if (!self)
+		return false;
+
+	return blocklist_use_frame(&self->logiclist);
+}
+
+/*
+ * use ring buffer of size bytes (at least the max message length) for logic block list, 
+ * must be called before push any data. (only linux.)
+ */
+bool buf_use_ring(struct net_buf *self, size_t size) {
+	struct block *bk;
+	char *ring;
+	size_t block_size = sizeof(struct block);
+	if (!self)
+		return false;
+
+	if (blocklist_is_use_ring(&self->logiclist))
+		return true;
+
+	/* the ring need hold a max length message at least. */
+	size = max(size, (size_t)blocklist_get_message_maxlen(&self->logiclist));
+	ring = (char *)bufpool_create_ring(&size);
+	if (!ring)
+		return false;
+
+	bk = (struct block *)bufpool_create_block(&block_size);
+	if (!bk) {
+		bufpool_release_ring(ring, size);
+		return false;
+	}
+
+	block_init_ring(bk, (int)block_size, ring, (int)size);
+	if (!blocklist_use_ring(&self->logiclist, bk)) {
+		release_block_f(NULL, bk);
+		return false;
+	}
+	return true;
+}
+
 void buf_use_proxy(struct net_buf *self, bool flag) {
 	if (!self)
 		return;
@@ -271,6 +544,42 @@ int buf_get_data_size(struct net_buf *self) {
 	return (int)(blocklist_get_datasize(&self->iolist) + blocklist_get_datasize(&self->logiclist));
 }
 
+/*
+ * if the buf has not any data, release all block of it, and return true.
+ * the buf keep its setting, and create block again on next push.
+ */
+bool buf_release_idle_block(struct net_buf *self) {
+	if (!self)
+		return false;
+
+	if ((blocklist_get_datasize(&self->iolist) != 0) || 
+			(blocklist_get_datasize(&self->logiclist) != 0))
+		return false;
+
+	blocklist_release_idle_block(&self->iolist);
+	blocklist_release_idle_block(&self->logiclist);
+	return true;
+}
+
+/* test the buf setting is same as just created, so it can be released and created again. */
+bool buf_is_default_setting(struct net_buf *self, dofunc_f default_func) {
+	if (!self)
+		return false;
+
+	return (self->compress_flag == enum_unknow) && 
+			(self->crypt_flag == enum_unknow) && 
+			(!self->use_proxy) && 
+			(!self->proxy_end_char) && 
+			(self->raw_size_for_encrypt == 0) && 
+			(self->raw_size_for_compress == 0) && 
+			(self->dofunc == default_func) && 
+			(!self->do_logicdata) && 
+			(self->io_limit_size == 0) && 
+			(!blocklist_is_use_frame(&self->logiclist)) && 
+			(!blocklist_is_use_ring(&self->logiclist)) && 
+			(!blocklist_get_message_len(&self->logiclist));
+}
+
 /* push len, if is more than the limit, return true. */
 bool buf_add_is_limit(struct net_buf *self, size_t len) {
 	if (!self)
@@ -287,11 +596,81 @@ bool buf_add_is_limit(struct net_buf *self, size_t len) {
 	return false;
 }
 
+/*
+ * the remain budget less than a quarter, is near exhaustion,
+ * then the recv queue more than an eighth of the remain budget stop recv, 
+ * as the remain budget is smaller, the stop queue is smaller, so the largest queue stop first.
+ */
+static bool buf_budget_recv_throttle(struct net_buf *self) {
+	size_t budget, used_bytes, remain, queue_bytes;
+	if (!bufpool_get_budget(&budget, &used_bytes))
+		return false;
+
+	remain = (budget > used_bytes) ? (budget - used_bytes) : 0;
+	if (remain >= budget / 4)
+		return false;
+
+	queue_bytes = (size_t)(blocklist_get_datasize(&self->iolist) + blocklist_get_datasize(&self->logiclist));
+	return (queue_bytes >= remain / 8);
+}
+
+/* default send policy, close the connection that has large queue when budget is near exhaustion. */
+static int default_send_policy(size_t queue_bytes, size_t data_len, size_t used_bytes, size_t budget) {
+	size_t remain = (budget > used_bytes) ? (budget - used_bytes) : 0;
+
+	/* can not push the data, close it, because push some of data will break the stream. */
+	if (remain < data_len)
+		return enum_send_close;
+
+	if ((remain < budget / 4) && (queue_bytes + data_len >= remain / 8))
+		return enum_send_close;
+
+	return enum_send_accept;
+}
+
+/*
+ * check push len, as the limit and the send policy.
+ * return enum_send_accept, enum_send_drop or enum_send_close.
+ */
+int buf_send_check(struct net_buf *self, size_t len) {
+	size_t budget, used_bytes, queue_bytes;
+	int res;
+	if (!self)
+		return enum_send_close;
+
+	if (buf_add_is_limit(self, len))
+		return enum_send_close;
+
+	if (!bufpool_get_budget(&budget, &used_bytes))
+		return enum_send_accept;
+
+	queue_bytes = (size_t)(blocklist_get_datasize(&self->iolist) + blocklist_get_datasize(&self->logiclist));
+	res = s_budget_stat.send_policy(queue_bytes, len, used_bytes, budget);
+	if (res == enum_send_drop)
+		catomic_inc(&s_budget_stat.send_drop_num);
+	else if (res == enum_send_close)
+		catomic_inc(&s_budget_stat.send_close_num);
+	return res;
+}
+
+/* test the uncompressed data not read by logic is over budget. */
+static inline bool buf_is_uncompress_over_budget(struct net_buf *self) {
+	return buf_is_use_uncompress(self) && (s_uncompress_option.budget > 0) && 
+		((int)blocklist_get_datasize(&self->logiclist) >= s_uncompress_option.budget);
+}
+
 /* test limit, buffer data as limit */
 static bool buf_islimit(struct net_buf *self) {
 	if (!self)
 		return true;
 
+	if (buf_budget_recv_throttle(self))
+		return true;
+
+	/* the uncompressed data is not read by logic, not recv more. */
+	if (buf_is_uncompress_over_budget(self))
+		return true;
+
 	if (self->io_limit_size == 0)
 		return false;
 
@@ -329,8 +708,11 @@ struct buf_info buf_get_write_bufinfo(struct net_buf *self) {
 	writebuf.buf = NULL;
 	writebuf.len = 0;
 
-	if (buf_islimit(self))
+	if (buf_islimit(self)) {
+		if (buf_budget_recv_throttle(self))
+			catomic_inc(&s_budget_stat.recv_throttle_num);
 		return writebuf;
+	}
 
 	if (buf_is_use_uncompress(self))
 		return blocklist_get_write_bufinfo(&self->iolist);
@@ -387,6 +769,7 @@ static bool buf_try_parse_proxy(struct net_buf *self, struct blocklist *lst, cha
 void buf_add_write(struct net_buf *self, char *buf, int len) {
 	char *temp_buf = buf;
 	int newlen = len;
+	bool proxy_done = false;
 	struct blocklist *lst;
 	assert(len > 0);
 	if (!self)
@@ -399,17 +782,77 @@ void buf_add_write(struct net_buf *self, char *buf, int len) {
 
 	blocklist_add_write(lst, len);
 
-
+	/* the logic thread do not read before the proxy is done, so publish it for parse. */
 	if (self->use_proxy && (!self->already_do_proxy)) {
-		if (buf_try_parse_proxy(self, lst, &temp_buf, &newlen))
-			self->already_do_proxy = true;
+		blocklist_publish(lst);
+		if (!buf_try_parse_proxy(self, lst, &temp_buf, &newlen))
+			return;
+
+		proxy_done = true;
 	}
 
-	/* decrypt opt. */
+	/* decrypt opt, decrypt before publish, the reader never see the encrypted data. */
 	if (buf_is_use_decrypt(self)) {
-		if (temp_buf && (newlen > 0))
-			self->dofunc(self->do_logicdata, temp_buf, newlen);
+		/* the keystream is exhausted, not publish the data, close in buf_recv_end_do. */
+		if (temp_buf && (newlen > 0) && !buf_do_crypt(self, temp_buf, newlen))
+			return;
+	}
+
+	blocklist_publish(lst);
+
+	/* split messages after decrypt, if uncompress, then split after uncompress. */
+	if (blocklist_is_use_frame(lst) && !self->frame_error) {
+		if (temp_buf && (newlen > 0) && !blocklist_frame_data(lst, temp_buf, newlen))
+			self->frame_error = true;
+	}
+
+	if (proxy_done)
+		self->already_do_proxy = true;
+}
+
+/* get the next piece of the uncompressed chunk from the tail of logiclist, it is written but not published. */
+static int buf_uncompress_next_piece(void *arg, int len, char **buf) {
+	struct blocklist *lst = (struct blocklist *)arg;
+
+	/* create block failed, maybe the block memory is over budget, or the ring is full. */
+	struct buf_info writebuf = blocklist_get_write_bufinfo(lst);
+	if (!writebuf.buf || (writebuf.len <= 0)) {
+		if (s_enable_errorlog) {
+			log_error("if (!writebuf.buf)");
+		}
+		return 0;
+	}
+
+	len = min(len, writebuf.len);
+	blocklist_add_write(lst, len);
+	*buf = writebuf.buf;
+	return len;
+}
+
+/*
+ * uncompress the chunk that is more than a block (the peer has larger block) into multiple blocks of logiclist 
+ * in pieces, not copy again. the pieces are published when the chunk is done, so the logic thread never 
+ * read and free them before, the codec reference the earlier pieces as history. the piece table is in tablebuf.
+ */
+static bool buf_uncompress_pieces(struct net_buf *self, void *scratch, struct buf_info tablebuf, 
+		char *chunk, int len, int rawlen) {
+	struct compress_pieces out;
+	int i;
+	compressmgr_pieces_init(&out, buf_uncompress_next_piece, &self->logiclist, tablebuf.buf, tablebuf.len, rawlen);
+	if (!compressmgr_uncompress_pieces(scratch, self->stream_state, chunk, len, &out))
+		return false;
+
+	blocklist_publish(&self->logiclist);
+
+	if (blocklist_is_use_frame(&self->logiclist)) {
+		for (i = 0; i < out.piece_num; ++i) {
+			if (!blocklist_frame_data(&self->logiclist, out.pieces[i].buf, out.pieces[i].len)) {
+				self->frame_error = true;
+				break;
+			}
+		}
 	}
+	return true;
 }
 
 /*
@@ -419,18 +862,43 @@ bool buf_recv_end_do(struct net_buf *self) {
 	if (!self)
 		return false;
 
+	if (self->crypt_error) {
+		log_error("chacha20 keystream is exhausted, need rekey");
+		return false;
+	}
+
+	/* the invalid message is rejected before the logic thread get it. */
+	if (self->frame_error) {
+		if (s_enable_errorlog) {
+			log_error("msg length error. max message len:%d, message len:%d", 
+					blocklist_get_message_maxlen(&self->logiclist), self->logiclist.frame.message_len);
+		}
+		return false;
+	}
+
 	if (buf_is_use_uncompress(self)) {
 		/* get a compress packet, uncompress it, and then push the queue. */
 		struct blocklist *lst = &self->iolist;
-		int res;
-		struct buf_info srcbuf;
+		int res, rawlen;
+		char *chunk;
+		char *reservebuf;
 		struct buf_info resbuf;
-		bool pushresult;
+		bool done;
 		struct buf_info compressbuf = threadbuf_get_compress_buf();
 		struct buf_info msgbuf = threadbuf_get_msg_buf();
-		char *quicklzbuf = threadbuf_get_quicklz_buf();
+		void *scratch = threadbuf_get_codec_buf();
 		for (;;) {
-			res = blocklist_get_message(lst, msgbuf.buf, msgbuf.len);
+			/* the ring is nearly full, uncompress the rest after the logic thread read. */
+			if (blocklist_is_use_ring(&self->logiclist) && 
+					self->logiclist.ring->ring_size - blocklist_get_datasize(&self->logiclist) < compressbuf.len)
+				break;
+
+			/* the uncompressed data is over budget, uncompress the rest after the logic thread read. */
+			if (buf_is_uncompress_over_budget(self))
+				break;
+
+			/* the chunk is read in place if it is contiguous in the block, or else it is copied to msgbuf. */
+			res = blocklist_peek_message(lst, msgbuf.buf, msgbuf.len, &chunk);
 			if (res == 0)
 				break;
 
@@ -442,27 +910,66 @@ bool buf_recv_end_do(struct net_buf *self) {
 				return false;
 			}
 
-			srcbuf.buf = msgbuf.buf;
-			srcbuf.len = res;
+			/*
+			 * the raw length in the chunk header is from the peer, check it before allocate any memory,
+			 * reject the chunk that expands more than any codec can (decompression bomb) or more than the budget.
+			 */
+			rawlen = compressmgr_chunk_rawlen(chunk, res);
+			if ((rawlen <= 0) || 
+					((s_uncompress_option.max_ratio > 0) && (rawlen / s_uncompress_option.max_ratio > res)) || 
+					((s_uncompress_option.budget > 0) && (rawlen > s_uncompress_option.budget))) {
+				if (s_enable_errorlog) {
+					log_error("uncompress chunk length error. chunk len:%d, raw len:%d, max ratio:%d, budget:%d", 
+							res, rawlen, s_uncompress_option.max_ratio, s_uncompress_option.budget);
+				}
+				blocklist_release_message(lst);
+				return false;
+			}
+
+			/*
+			 * uncompress into the reserved room of logiclist tail, not copy again.
+			 * the chunk is not more than a block if the peer has the same block size, 
+			 * if it is more than a block (the peer has larger block), or create block failed, 
+			 * uncompress it into multiple blocks in pieces, the thread compress buffer hold the piece table.
+			 */
+			reservebuf = blocklist_reserve_write(&self->logiclist, rawlen);
+
+			/* uncompress function will be responsible for chunk header of removed, the codec is by the header. */
+			if (reservebuf) {
+				resbuf = compressmgr_uncompressdata(reservebuf, rawlen, 
+						scratch, self->stream_state, chunk, res);
+
+				/* the stored chunk is in place, copy it. */
+				if (resbuf.buf && (resbuf.buf != reservebuf)) {
+					memcpy(reservebuf, resbuf.buf, resbuf.len);
+					resbuf.buf = reservebuf;
+				}
 
-			/* uncompress function will be responsible for header length of removed. */
-			resbuf = compressmgr_uncompressdata(compressbuf.buf, compressbuf.len, quicklzbuf, srcbuf.buf, srcbuf.len);
+				blocklist_commit_write(&self->logiclist, resbuf.buf? resbuf.len : 0);
+
+				/* frame the uncompressed data. */
+				if (resbuf.buf && blocklist_is_use_frame(&self->logiclist) && 
+						!blocklist_frame_data(&self->logiclist, resbuf.buf, resbuf.len))
+					self->frame_error = true;
+
+				done = (resbuf.buf != NULL);
+			} else {
+				done = buf_uncompress_pieces(self, scratch, compressbuf, chunk, res, rawlen);
+			}
+
+			blocklist_release_message(lst);
 
 			/*
-			 * if return null, then uncompress error,
-			 * uncompress error, probably because the uncompress buffer is less than uncompress data length.
+			 * if failed, then uncompress error (the reason is logged), unknown codec, stream codec mismatch, 
+			 * corrupt data, or get piece failed (maybe the block memory is over budget).
 			 */
-			if (!resbuf.buf) {
-				log_error("uncompress buf is too small!");
+			if (!done)
 				return false;
-			}
 
-			assert(resbuf.len > 0);
-			pushresult = blocklist_put_data(&self->logiclist, resbuf.buf, resbuf.len);
-			assert(pushresult);
-			if (!pushresult) {
+			if (self->frame_error) {
 				if (s_enable_errorlog) {
-					log_error("if (!pushresult)");
+					log_error("msg length error. max message len:%d, message len:%d", 
+							blocklist_get_message_maxlen(&self->logiclist), self->logiclist.frame.message_len);
 				}
 				return false;
 			}
@@ -471,12 +978,54 @@ bool buf_recv_end_do(struct net_buf *self) {
 	return true;
 }
 
+/* test has the received data not uncompressed (stopped by budget or ring). */
+bool buf_has_uncompress_data(struct net_buf *self) {
+	if (!self)
+		return false;
+
+	return buf_is_use_uncompress(self) && (blocklist_get_datasize(&self->iolist) > 0);
+}
+
 /*
  * ================================================================================
  * some send interface.
  * ================================================================================
  */
 
+/*
+ * the data of shared block is read only, can not encrypt in place, 
+ * so copy it to iolist (not use when not compress), then encrypt and send from iolist.
+ * copy at most one iolist block each time the iolist is drained, so a large shared payload 
+ * is streamed through one block of each socket, not copied whole.
+ */
+static void buf_copy_shared_to_iolist(struct net_buf *self) {
+	struct buf_info readbuf, writebuf;
+	int copied = 0;
+	int len;
+	for (;;) {
+		readbuf = blocklist_get_read_bufinfo(&self->logiclist);
+		if ((readbuf.len <= 0) || !block_is_reference(self->logiclist.head))
+			break;
+
+		/* the write block is full, send it first. */
+		if ((copied > 0) && (self->iolist.can_write_size <= 0))
+			break;
+
+		/* create block failed, maybe the block memory is over budget, send the copied data first. */
+		writebuf = blocklist_get_write_bufinfo(&self->iolist);
+		if ((writebuf.len <= 0) || (!writebuf.buf))
+			break;
+
+		len = min(readbuf.len, writebuf.len);
+		memcpy(writebuf.buf, readbuf.buf, len);
+		blocklist_add_write(&self->iolist, len);
+		blocklist_add_read(&self->logiclist, len);
+		copied += len;
+	}
+
+	blocklist_publish(&self->iolist);
+}
+
 /* get read buffer info. */
 struct buf_info buf_get_read_bufinfo(struct net_buf *self) {
 	struct buf_info readbuf;
@@ -488,10 +1037,24 @@ struct buf_info buf_get_read_bufinfo(struct net_buf *self) {
 	if (!self)
 		return readbuf;
 
-	if (buf_is_use_compress(self))
+	if (buf_is_use_compress(self)) {
 		lst = &self->iolist;
-	else
+	} else if (buf_is_use_encrypt(self)) {
+		if (blocklist_get_datasize(&self->iolist) == 0)
+			buf_copy_shared_to_iolist(self);
+
+		if (blocklist_get_datasize(&self->iolist) > 0) {
+			lst = &self->iolist;
+		} else {
+			lst = &self->logiclist;
+
+			/* the shared block not yet copy, wait for next send. */
+			if ((blocklist_get_datasize(lst) > 0) && block_is_reference(lst->head))
+				return readbuf;
+		}
+	} else {
 		lst = &self->logiclist;
+	}
 
 	readbuf = blocklist_get_read_bufinfo(lst);
 	if (readbuf.len > 0) {
@@ -503,7 +1066,12 @@ struct buf_info buf_get_read_bufinfo(struct net_buf *self) {
 				encrybuf.len -= self->raw_size_for_encrypt;
 				encrybuf.buf = &encrybuf.buf[self->raw_size_for_encrypt];
 				self->raw_size_for_encrypt = 0;
-				self->dofunc(self->do_logicdata, encrybuf.buf, encrybuf.len);
+
+				/* the keystream is exhausted, not send the data, close in buf_send_before_do. */
+				if (!buf_do_crypt(self, encrybuf.buf, encrybuf.len)) {
+					readbuf.buf = NULL;
+					readbuf.len = 0;
+				}
 			} else {
 				self->raw_size_for_encrypt -= encrybuf.len;
 			}
@@ -518,24 +1086,207 @@ void buf_add_read(struct net_buf *self, int len) {
 	if (!self)
 		return;
 
-	if (buf_is_use_compress(self))
+	/* if not compress, the iolist maybe has the copied data of shared block. */
+	if (buf_is_use_compress(self) || (blocklist_get_datasize(&self->iolist) > 0))
 		blocklist_add_read(&self->iolist, len);
 	else
 		blocklist_add_read(&self->logiclist, len);
 }
 
-/* before send, do something. */
-void buf_send_before_do(struct net_buf *self) {
+/* update the ratio estimate by a compressed chunk, and pause or resume compress. */
+static void buf_compress_update_ratio(struct net_buf *self, int rawlen, int outlen) {
+	struct buf_compress_stat *stat = &self->compress_stat;
+	int sample = (int)((int64)outlen * 1000 / rawlen);
+	int max_ratio = s_compress_option.max_ratio;
+
+	/* moving average, the probe when paused is weighted more, so resume quickly. */
+	if (++self->compress_sample_num == 1)
+		stat->ratio = sample;
+	else if (stat->paused)
+		stat->ratio = (stat->ratio + sample) / 2;
+	else
+		stat->ratio += (sample - stat->ratio) / 8;
+
+	if (max_ratio <= 0)
+		stat->paused = false;
+	else if (stat->paused)
+		stat->paused = (stat->ratio > max_ratio);
+	else
+		stat->paused = (self->compress_sample_num >= _COMPRESS_MIN_SAMPLE) && (stat->ratio > max_ratio);
+}
+
+/*
+ * max source len of next chunk, the chunk is compressed into the reserved room of iolist tail, so it is not more than a block.
+ * if the room of tail block is enough for the pending data, or not too small, fill it, or else use a new block.
+ */
+static int buf_compress_chunk_maxlen(struct net_buf *self, int pending) {
+	int chunk_maxlen = min(blocklist_get_reserve_maxlen(&self->iolist), blocklist_get_message_maxlen(&self->logiclist));
+	int maxlen = compressmgr_source_maxlen(self->codec, chunk_maxlen);
+	int roomlen = compressmgr_source_maxlen(self->codec, self->iolist.can_write_size);
+	if ((roomlen >= min(pending, maxlen)) || (roomlen >= maxlen / 4))
+		maxlen = roomlen;
+
+	return min(pending, maxlen);
+}
+
+/*
+ * compress a chunk into the reserved room of iolist,
+ * store it if it is small, or the compress is paused, or the compressed is not smaller.
+ */
+static bool buf_compress_chunk(struct net_buf *self, void *state, struct buf_info srcbuf) {
+	struct buf_compress_stat *stat = &self->compress_stat;
+	bool store = (srcbuf.len < s_compress_option.min_size);
+	int reservelen;
+	char *reservebuf;
+
+	stat->raw_bytes += srcbuf.len;
+	if (!store && stat->paused)
+		store = (++self->compress_skip_num < _COMPRESS_PROBE_INTERVAL);
+
+	/* the bound is not less than the source len, so the stored chunk also can be in it. */
+	reservelen = (int)COMPRESS_CHUNK_HEADER_LEN + (store? srcbuf.len : self->codec->bound(srcbuf.len));
+
+	/* reserve failed, maybe the block memory is over budget. */
+	reservebuf = blocklist_reserve_write(&self->iolist, reservelen);
+	if (!reservebuf) {
+		if (s_enable_errorlog) {
+			log_error("if (!reservebuf)");
+		}
+		return false;
+	}
+
+	if (!store) {
+		struct buf_info resbuf;
+		int64 begin = get_microsecond();
+		self->compress_skip_num = 0;
+		resbuf = compressmgr_compressdata(self->codec, state, 
+				reservebuf, reservelen, srcbuf.buf, srcbuf.len);
+		stat->compress_microsecond += (size_t)(get_microsecond() - begin);
+		if (!resbuf.buf) {
+			blocklist_commit_write(&self->iolist, 0);
+			log_error("compress failed, codec:%s, len:%d", self->codec->name, srcbuf.len);
+			return false;
+		}
+
+		buf_compress_update_ratio(self, srcbuf.len, resbuf.len);
+
+		/* the stream state has recorded the chunk, so it must be sent compressed. */
+		if (self->codec->is_stream || (resbuf.len < srcbuf.len + (int)COMPRESS_CHUNK_HEADER_LEN)) {
+			stat->out_bytes += resbuf.len;
+			++stat->compressed_chunk_num;
+			return blocklist_commit_write(&self->iolist, resbuf.len);
+		}
+	}
+
+	stat->out_bytes += srcbuf.len + COMPRESS_CHUNK_HEADER_LEN;
+	++stat->stored_chunk_num;
+	compressmgr_store_header(reservebuf, srcbuf.len);
+	memcpy(&reservebuf[COMPRESS_CHUNK_HEADER_LEN], srcbuf.buf, srcbuf.len);
+	return blocklist_commit_write(&self->iolist, srcbuf.len + (int)COMPRESS_CHUNK_HEADER_LEN);
+}
+
+/* test the backlog can be compressed in parallel, the stream codec is in order, and the paused need not. */
+static bool buf_compress_can_parallel(struct net_buf *self, int pending) {
+	return (compressworker_num() > 0) && 
+			(!self->codec->is_stream) && 
+			(!self->compress_stat.paused) && 
+			(pending >= s_parallel_option.min_size) && 
+			(pending >= _COMPRESS_PARALLEL_CHUNK_LEN * 2);
+}
+
+/*
+ * split the backlog into chunks by the logiclist blocks, compress them in parallel, and push them into iolist in order.
+ * the workers compress the block views of logiclist into the regions of iolist reserved at once, not copy,
+ * only the stored chunk is copied to its region.
+ */
+static bool buf_compress_parallel(struct net_buf *self) {
+	struct buf_compress_stat *stat = &self->compress_stat;
+	struct compress_task tasks[_COMPRESS_PARALLEL_MAX_TASK];
+	struct buf_info views[_COMPRESS_PARALLEL_MAX_TASK];
+	char *regions[_COMPRESS_PARALLEL_MAX_TASK];
+	int lens[_COMPRESS_PARALLEL_MAX_TASK];
+	struct compress_job job;
+	int chunk_maxlen = min(min(_COMPRESS_PARALLEL_CHUNK_LEN, blocklist_get_reserve_maxlen(&self->iolist)), 
+			blocklist_get_message_maxlen(&self->logiclist));
+	int srcmaxlen = compressmgr_source_maxlen(self->codec, chunk_maxlen);
+	int64 begin;
+	int i;
+
+	assert(srcmaxlen > 0);
+	job.codec = self->codec;
+	job.tasks = tasks;
+	job.task_num = blocklist_get_read_views(&self->logiclist, views, _COMPRESS_PARALLEL_MAX_TASK, srcmaxlen);
+	if (job.task_num <= 0)
+		return false;
+
+	/* the bound is not less than the source len, so the stored chunk also can be in the region. */
+	for (i = 0; i < job.task_num; ++i)
+		lens[i] = (int)COMPRESS_CHUNK_HEADER_LEN + self->codec->bound(views[i].len);
+
+	/* reserve failed, maybe the block memory is over budget. */
+	if (!blocklist_reserve_write_batch(&self->iolist, lens, regions, job.task_num))
+		return false;
+
+	for (i = 0; i < job.task_num; ++i) {
+		tasks[i].src = views[i].buf;
+		tasks[i].srclen = views[i].len;
+		tasks[i].dst = regions[i];
+		tasks[i].dstlen = lens[i];
+		tasks[i].reslen = 0;
+	}
+
+	/* the time is the elapsed time of all chunks, not the cpu time. */
+	begin = get_microsecond();
+	compressworker_run(&job);
+	stat->compress_microsecond += (size_t)(get_microsecond() - begin);
+
+	for (i = 0; i < job.task_num; ++i) {
+		if (tasks[i].reslen <= 0) {
+			log_error("compress failed, codec:%s, len:%d", self->codec->name, tasks[i].srclen);
+			memset(lens, 0, sizeof(lens));
+			blocklist_commit_write_batch(&self->iolist, lens, job.task_num);
+			return false;
+		}
+	}
+
+	for (i = 0; i < job.task_num; ++i) {
+		struct compress_task *task = &tasks[i];
+		stat->raw_bytes += task->srclen;
+		buf_compress_update_ratio(self, task->srclen, task->reslen);
+		if (task->reslen < task->srclen + (int)COMPRESS_CHUNK_HEADER_LEN) {
+			stat->out_bytes += task->reslen;
+			++stat->compressed_chunk_num;
+			lens[i] = task->reslen;
+		} else {
+			stat->out_bytes += task->srclen + COMPRESS_CHUNK_HEADER_LEN;
+			++stat->stored_chunk_num;
+			compressmgr_store_header(task->dst, task->srclen);
+			memcpy(&task->dst[COMPRESS_CHUNK_HEADER_LEN], task->src, task->srclen);
+			lens[i] = task->srclen + (int)COMPRESS_CHUNK_HEADER_LEN;
+		}
+	}
+
+	if (!blocklist_commit_write_batch(&self->iolist, lens, job.task_num))
+		return false;
+
+	/* the sources are not used after commit, give the room back to logic. */
+	for (i = 0; i < job.task_num; ++i)
+		blocklist_add_read(&self->logiclist, views[i].len);
+
+	return true;
+}
+
+/* before send, do something, if return false, then close connect. */
+bool buf_send_before_do(struct net_buf *self) {
 	if (!self)
-		return;
+		return false;
 
 	if (buf_is_use_compress(self)) {
 		/* get all can read data, compress it. (compress data header is compress function do.) */
-		bool pushresult = false;
-		struct buf_info resbuf;
 		struct buf_info srcbuf;
 		struct buf_info compressbuf = threadbuf_get_compress_buf();
-		char *quicklzbuf = threadbuf_get_quicklz_buf();
+		void *state = self->codec->is_stream? self->stream_state : threadbuf_get_codec_buf();
+		int pending, chunklen;
 		for (;;) {
 			srcbuf = blocklist_get_read_bufinfo(&self->logiclist);
 			srcbuf.len = min(srcbuf.len, blocklist_get_message_maxlen(&self->logiclist));
@@ -550,21 +1301,64 @@ void buf_send_before_do(struct net_buf *self) {
 					self->raw_size_for_compress -= srcbuf.len;
 				}
 
-				resbuf.len = srcbuf.len;
-				resbuf.buf = srcbuf.buf;
+				/* push failed, maybe the block memory is over budget, the stream is broken. */
+				if (!blocklist_put_data(&self->iolist, srcbuf.buf, srcbuf.len)) {
+					if (s_enable_errorlog) {
+						log_error("if (!pushresult)");
+					}
+					return false;
+				}
 			} else {
-				resbuf = compressmgr_do_compressdata(compressbuf.buf, quicklzbuf, srcbuf.buf, srcbuf.len);
-			}
+				/* the compressed chunk is a message of peer, it must not be more than the max message len. */
+				pending = (int)blocklist_get_datasize(&self->logiclist);
+
+				/* the large backlog is split into chunks, and compressed in parallel. */
+				if (buf_compress_can_parallel(self, pending)) {
+					if (!buf_compress_parallel(self)) {
+						if (s_enable_errorlog) {
+							log_error("if (!buf_compress_parallel)");
+						}
+						return false;
+					}
+					continue;
+				}
+
+				chunklen = min(buf_compress_chunk_maxlen(self, pending), compressbuf.len);
+				assert(chunklen > 0);
 
-			assert(resbuf.len > 0);
-			pushresult = blocklist_put_data(&self->iolist, resbuf.buf, resbuf.len);
-			assert(pushresult);
-			if (!pushresult) {
-				log_error("if (!pushresult)");
+				/*
+				 * the chunk is compressed from the block view, it is cut by the block end,
+				 * only the short tail of block is gathered with the head of next block, so it is not a tiny chunk.
+				 * the stream codec reference the earlier chunks, need not gather.
+				 */
+				if ((srcbuf.len < chunklen / 4) && (srcbuf.len < pending) && !self->codec->is_stream) {
+					if (!blocklist_get_data(&self->logiclist, compressbuf.buf, chunklen / 4, &srcbuf.len))
+						return false;
+
+					srcbuf.buf = compressbuf.buf;
+					if (!buf_compress_chunk(self, state, srcbuf))
+						return false;
+
+					continue;
+				}
+
+				srcbuf.len = min(srcbuf.len, chunklen);
+				if (!buf_compress_chunk(self, state, srcbuf))
+					return false;
 			}
+
 			blocklist_add_read(&self->logiclist, srcbuf.len);
 		}
 	}
+
+	/* the keystream must not wrap (RFC 8439), close when the pending data is more than it, the peer need rekey. */
+	if (self->crypt_error || (buf_is_use_encrypt(self) && buf_is_chacha20_exhausted(self, 
+			(uint64)blocklist_get_datasize(&self->iolist) + (uint64)blocklist_get_datasize(&self->logiclist)))) {
+		log_error("chacha20 keystream is exhausted, need rekey");
+		return false;
+	}
+
+	return true;
 }
 
 /* push packet into the buffer. */
@@ -587,6 +1381,43 @@ bool buf_put_data(struct net_buf *self, const void *data, int len) {
 	return blocklist_put_data(&self->logiclist, data, len);
 }
 
+/*
+ * push all data of the shared block into the buffer by reference, not copy.
+ * if use custom message format, then copy it.
+ */
+bool buf_put_shared(struct net_buf *self, struct block *shared) {
+	if (!self || !shared)
+		return false;
+
+	if (self->logiclist.custom_put_func)
+		return blocklist_put_message(&self->logiclist, block_get_readbuf(shared), block_get_readsize(shared));
+
+	return blocklist_put_shared(&self->logiclist, shared);
+}
+
+/*
+ * reserve len contiguous bytes in the send buffer for write in place, 
+ * return the write buffer, if failed, return NULL.
+ */
+char *buf_reserve_send(struct net_buf *self, int len) {
+	if (!self || (len <= 0))
+		return NULL;
+
+	/* custom message format need push by custom function. */
+	if (self->logiclist.custom_put_func)
+		return NULL;
+
+	return blocklist_reserve_write(&self->logiclist, len);
+}
+
+/* commit the reserved buffer as message of len bytes, write the length header, len can be 0 for cancel. */
+bool buf_commit_send(struct net_buf *self, int len) {
+	if (!self)
+		return false;
+
+	return blocklist_commit_message(&self->logiclist, len);
+}
+
 /* get packet from the buffer, if error, then need_close is true. */
 char *buf_get_message(struct net_buf *self, bool *need_close, char *buf, size_t bufsize) {
 	struct buf_info dst;
@@ -625,6 +1456,98 @@ char *buf_get_message(struct net_buf *self, bool *need_close, char *buf, size_t
 	}
 }
 
+/*
+ * peek packet from the buffer, if the packet is contiguous in block, then return the pointer to block,
+ * else copy to buf as buf_get_message. if error, then need_close is true.
+ * if return not NULL, must call buf_release_message after use it.
+ */
+char *buf_peek_message(struct net_buf *self, bool *need_close, char *buf, size_t bufsize) {
+	struct buf_info dst;
+	char *msg;
+	int res;
+	if (!self || !need_close)
+		return NULL;
+
+	if (self->use_proxy && (!self->already_do_proxy))
+		return NULL;
+
+	if (!buf || bufsize <= 0) {
+		dst = threadbuf_get_msg_buf();
+	} else {
+		if (bufsize < _MAX_MSG_LEN) {
+			assert(false && "why bufsize < _MAX_MSG_LEN");
+			return NULL;
+		}
+
+		dst.buf = buf;
+		dst.len = (int)bufsize;
+	}
+
+	res = blocklist_peek_message(&self->logiclist, dst.buf, dst.len, &msg);
+	if (res == 0) {
+		return NULL;
+	} else if (res > 0) {
+		return msg;
+	} else {
+		*need_close = true;
+		if (s_enable_errorlog) {
+			log_error("msg length error. max message len:%d, message len:%d", 
+					blocklist_get_message_maxlen(&self->logiclist), 
+					blocklist_get_message_len(&self->logiclist));
+		}
+		return NULL;
+	}
+}
+
+/*
+ * peek all complete packets in one pass, up to max, msgs[i] point to them,
+ * the packet straddle blocks is copied to arena (if arena is NULL, then use the thread buffer).
+ * return the packet num, if error, then need_close is true.
+ * if return greater than 0, must call buf_release_message after use them.
+ */
+int buf_peek_message_batch(struct net_buf *self, bool *need_close, char *arena, size_t arenasize, char **msgs, int max) {
+	struct buf_info dst;
+	int res;
+	if (!self || !need_close || !msgs || max <= 0)
+		return 0;
+
+	if (self->use_proxy && (!self->already_do_proxy))
+		return 0;
+
+	if (!arena || arenasize <= 0) {
+		dst = threadbuf_get_msg_buf();
+	} else {
+		if (arenasize < _MAX_MSG_LEN) {
+			assert(false && "why arenasize < _MAX_MSG_LEN");
+			return 0;
+		}
+
+		dst.buf = arena;
+		dst.len = (int)arenasize;
+	}
+
+	res = blocklist_peek_message_batch(&self->logiclist, dst.buf, dst.len, msgs, max);
+	if (res >= 0) {
+		return res;
+	} else {
+		*need_close = true;
+		if (s_enable_errorlog) {
+			log_error("msg length error. max message len:%d, message len:%d", 
+					blocklist_get_message_maxlen(&self->logiclist), 
+					blocklist_get_message_len(&self->logiclist));
+		}
+		return 0;
+	}
+}
+
+/* release the packet of buf_peek_message or buf_peek_message_batch. */
+void buf_release_message(struct net_buf *self) {
+	if (!self)
+		return;
+
+	blocklist_release_message(&self->logiclist);
+}
+
 /* get data from the buffer, if error, then need_close is true. */
 char *buf_get_data(struct net_buf *self, bool *need_close, char *buf, int bufsize, int *datalen) {
 	struct blocklist *lst;
@@ -641,6 +1564,10 @@ char *buf_get_data(struct net_buf *self, bool *need_close, char *buf, int bufsiz
 	if (blocklist_get_datasize(lst) <= 0)
 		return NULL;
 
+	/* the framed list only can get message. */
+	if (blocklist_is_use_frame(lst))
+		return NULL;
+
 	if (!blocklist_get_data(lst, buf, bufsize, datalen)) {
 		*need_close = true;
 		if (s_enable_errorlog) {
@@ -661,52 +1588,210 @@ int buf_find_data_end_size(struct net_buf *self, const char *data, int datalen)
 }
 
 
+/* insert size into the ascending class array, if already exist, then ignore. */
+static size_t block_class_add(size_t *class_size, size_t class_num, size_t size) {
+	size_t i, j;
+	for (i = 0; i < class_num; ++i) {
+		if (class_size[i] == size)
+			return class_num;
+
+		if (class_size[i] > size)
+			break;
+	}
+
+	assert(class_num < _MAX_BLOCK_CLASS_NUM);
+	for (j = class_num; j > i; --j)
+		class_size[j] = class_size[j - 1];
+
+	class_size[i] = size;
+	return class_num + 1;
+}
+
+/*
+ * set block pool option, must be called before bufmgr_init, or else it is ignored.
+ * use_hugepage --- block pool use huge page memory.
+ * prefault --- touch all block pool memory in bufmgr_init, avoid page fault on network thread.
+ */
+void bufmgr_set_pool_option(bool use_hugepage, bool prefault) {
+	if (s_bufmgr_is_init) {
+		log_error("set block pool option after bufmgr init");
+		return;
+	}
+
+	bufpool_set_option(use_hugepage, prefault);
+}
+
 /*
  * create and init buf pool.
  * big_buf_num --- is bigbuf num.
  * big_buf_size --- is bigbuf size.
  * small_buf_num --- is small buf num.
  * small_buf_size --- is small buf size.
- * buf_num --- is buf num.
- *
- * because a socket need 2 buf, so buf_num is * 2, in init function.
+ * the memory of these blocks is split across the block size classes as the initial pools.
  *
  * this function be able to call private thread buffer etc.
  */
 bool bufmgr_init(size_t big_buf_num, size_t big_buf_size, 
-		size_t small_buf_num, size_t small_buf_size, size_t buf_num) {
+		size_t small_buf_num, size_t small_buf_size) {
+
+	size_t class_size[_MAX_BLOCK_CLASS_NUM];
+	size_t class_block_num[_MAX_BLOCK_CLASS_NUM];
+	size_t class_num = 0;
+	size_t big_class_num = 0, small_class_num = 0;
+	size_t i;
 
 	if ((big_buf_num == 0) || (big_buf_size == 0) || (small_buf_num == 0) || (small_buf_size == 0))
 		return false;
 
-	if (!threadbuf_init(_MAX_MSG_LEN + 512, _MAX_MSG_LEN + 512))
+	if (!threadbuf_init(_MAX_MSG_LEN + 512, _MAX_MSG_LEN + 512, compressmgr_scratch_size()))
 		return false;
 
+	class_num = block_class_add(class_size, class_num, big_buf_size);
+	class_num = block_class_add(class_size, class_num, small_buf_size);
+	for (i = 0; i < sizeof(s_default_block_class) / sizeof(s_default_block_class[0]); ++i) {
+		if (s_default_block_class[i] < max(big_buf_size, small_buf_size))
+			class_num = block_class_add(class_size, class_num, s_default_block_class[i]);
+	}
+
+	for (i = 0; i < class_num; ++i) {
+		if (class_size[i] <= big_buf_size)
+			++big_class_num;
+
+		if (class_size[i] <= small_buf_size)
+			++small_class_num;
+	}
+
+	/*
+	 * the memory of big_buf_num big blocks is split evenly across the classes not greater than big_buf_size,
+	 * and so is small buf, so the initial pool memory is the configured amount, each pool grows on demand.
+	 */
+	for (i = 0; i < class_num; ++i) {
+		class_block_num[i] = 0;
+		if (class_size[i] <= big_buf_size)
+			class_block_num[i] += big_buf_num * big_buf_size / big_class_num / class_size[i];
+
+		if (class_size[i] <= small_buf_size)
+			class_block_num[i] += small_buf_num * small_buf_size / small_class_num / class_size[i];
+
+		if (class_block_num[i] == 0)
+			class_block_num[i] = 1;
+
+		class_size[i] += sizeof(struct block);
+	}
+
 	big_buf_size += sizeof(struct block);
 	small_buf_size += sizeof(struct block);
 
-	if (!bufpool_init(big_buf_num, big_buf_size, 
-					 small_buf_num, small_buf_size, 
-					 buf_num * 2, sizeof(struct net_buf))) {
+	compressmgr_set_stream_window(s_stream_option.window);
+	if (!bufpool_init(class_size, class_block_num, class_num, compressmgr_stream_state_size(), 
+				s_stream_option.state_num, sizeof(struct crypt_chacha20))) {
+		return false;
+	}
+
+	if (!compressworker_init(s_parallel_option.thread_num)) {
+		bufpool_release();
 		return false;
 	}
 
 	s_block_info.big_block_size = big_buf_size;
 	s_block_info.small_block_size = small_buf_size;
+	s_bufmgr_is_init = true;
 	return true;
 }
 
 /* release some buf. */
 void bufmgr_release() {
+	s_bufmgr_is_init = false;
+	compressworker_release();
 	bufpool_release();
 	threadbuf_release();
+	compressmgr_set_dict(NULL, 0);
 }
 
-/* get some buf memroy info. */
+/*
+ * get some buf memroy info.
+ * fill at most num entries, return the filled num, if array is NULL, return the num of entries it has.
+ */
 size_t bufmgr_get_memory_info(struct poolmgr_info *array, size_t num) {
 	return bufpool_get_memory_info(array, num);
 }
 
+/*
+ * create shared block by the data, it can be pushed into many buf by reference.
+ * if len is greater than the biggest block, return NULL.
+ * after push, call bufmgr_release_shared_block.
+ */
+struct block *bufmgr_create_shared_block(const void *data, int len) {
+	struct block *bk;
+	size_t size = (size_t)len + sizeof(struct block);
+	if (!data || len <= 0)
+		return NULL;
+
+	bk = (struct block *)create_block_f(NULL, &size);
+	if (!bk)
+		return NULL;
+
+	/* larger than the biggest block, the block is not initialized, release it by the real size. */
+	if (size < (size_t)len + sizeof(struct block)) {
+		bufpool_release_block(bk, size);
+		return NULL;
+	}
+
+	block_init(bk, (int)size);
+	block_put(bk, (void *)data, len);
+	return bk;
+}
+
+/* release the reference of creator, the shared block is released when not any reference. */
+void bufmgr_release_shared_block(struct block *shared) {
+	if (!shared)
+		return;
+
+	if (catomic_dec_explicit(&shared->ref, CATOMIC_ACQ_REL) == 0)
+		release_block_f(NULL, shared);
+}
+
+/* trim some buf pool, return reclaimed bytes. */
+size_t bufmgr_trim(int free_seconds) {
+	return bufpool_trim(free_seconds);
+}
+
+/*
+ * set block memory budget bytes, if 0, then not limit.
+ * when the budget is near exhaustion, the socket which has large recv queue stop recv first, 
+ * and the send policy decide the push data is accept, drop, or close the connection.
+ */
+void bufmgr_set_budget(size_t budget) {
+	bufpool_set_budget(budget);
+}
+
+/* set send policy, if func is NULL, then use default policy. */
+void bufmgr_set_send_policy(send_policy_func func) {
+	s_budget_stat.send_policy = func ? func : default_send_policy;
+}
+
+/*
+ * set adaptive compress option.
+ * min_size --- the chunk less than it is stored, not compressed.
+ * max_ratio --- per mille, pause compress of the connection when the ratio estimate is more than it, 0 is not pause.
+ */
+void bufmgr_set_compress_option(int min_size, int max_ratio) {
+	s_compress_option.min_size = (min_size > 0) ? min_size : 0;
+	s_compress_option.max_ratio = (max_ratio > 0) ? max_ratio : 0;
+}
+
+/* get block memory budget info. */
+void bufmgr_get_budget_info(struct bufmgr_budget_info *info) {
+	if (!info)
+		return;
+
+	bufpool_get_budget_info(&info->budget, &info->used_bytes, 
+			&info->max_used_bytes, &info->alloc_fail_num);
+	info->recv_throttle_num = (size_t)catomic_read(&s_budget_stat.recv_throttle_num);
+	info->send_drop_num = (size_t)catomic_read(&s_budget_stat.send_drop_num);
+	info->send_close_num = (size_t)catomic_read(&s_budget_stat.send_close_num);
+}
+
 /* enable/disable errorlog, and return before value. */
 bool buf_set_enable_errorlog(bool flag) {
 	bool old = s_enable_errorlog;
@@ -19,32 +19,77 @@ extern "C" {
 #define _MAX_MSG_LEN (136 * 1024)
 struct net_buf;
 
+/* get buf object size. */
+size_t buf_get_size();
+
 /*
- * create buf.
+ * create buf in mem, the buf is a part of its owner object, not alloc from pool.
+ * mem --- at least buf_get_size() bytes.
  * bigbuf --- big or small buf, if is true, then is big buf, or else is small buf.
  */
-struct net_buf *buf_create(bool bigbuf);
+struct net_buf *buf_create(void *mem, bool bigbuf);
 
 /*
  * set buf encrypt function or decrypt function, and some logic data.
+ * the logic data replaced is released by its release function.
  */
 void buf_set_do_func(struct net_buf *self, 
 		dofunc_f func, void (*release_logicdata)(void *logicdata), void *logicdata);
 
-/* release buf. */
+/*
+ * set the encrypt or decrypt function to chacha20, key is 32 bytes, nonce is 12 bytes,
+ * if it is already chacha20, then reset the key and nonce. it is enabled by buf_use_encrypt/buf_use_decrypt.
+ */
+bool buf_use_chacha20(struct net_buf *self, const char *key, const char *nonce);
+
+/* release buf, the memory of buf is released by its owner. */
 void buf_release(struct net_buf *self);
 
 /* set buf handle limit size. */
 void buf_set_limit_size(struct net_buf *self, int limit_len);
 
-void buf_use_compress(struct net_buf *self);
+/*
+ * compress with the codec, must be called before push any data.
+ * if the codec is stream, each compress chunk reference the history of earlier chunks.
+ */
+bool buf_use_compress(struct net_buf *self, int codec_id);
+
+/*
+ * uncompress, must be called before recv any data.
+ * the codec of each chunk is in the chunk header, but the stream codec need the state of this connection,
+ * so if the peer compress with stream codec, codec_id must be it.
+ */
+bool buf_use_uncompress(struct net_buf *self, int codec_id);
+
+struct buf_compress_stat {
+	size_t raw_bytes;				/* bytes before compress. */
+	size_t out_bytes;				/* bytes after compress, include chunk header. */
+	size_t compressed_chunk_num;	/* chunks sent compressed. */
+	size_t stored_chunk_num;		/* chunks sent stored, not compressed. */
+	size_t compress_microsecond;	/* time spent in compress. */
+	int ratio;						/* ratio estimate of compressed / raw, per mille. */
+	bool paused;					/* compress is paused, because the ratio is bad. */
+};
 
-void buf_use_uncompress(struct net_buf *self);
+/* get compress stat of the buf. */
+void buf_get_compress_stat(struct net_buf *self, struct buf_compress_stat *stat);
 
 void buf_use_encrypt(struct net_buf *self);
 
 void buf_use_decrypt(struct net_buf *self);
 
+/*
+ * network thread split the recv data into messages, must be called before recv any data,
+ * the logic thread get the message need not parse the length header.
+ */
+bool buf_use_msg_preparse(struct net_buf *self);
+
+/*
+ * use ring buffer of size bytes (at least the max message length) for logic block list, 
+ * must be called before push any data. (only linux.)
+ */
+bool buf_use_ring(struct net_buf *self, size_t size);
+
 void buf_use_proxy(struct net_buf *self, bool flag);
 
 void buf_set_proxy_param(struct net_buf *self, 
@@ -54,11 +99,43 @@ void buf_set_raw_datasize(struct net_buf *self, int size);
 
 int buf_get_now_data_size(struct net_buf *self);
 
+/*
+ * if the buf has not any data, release all block of it, and return true.
+ * the buf keep its setting, and create block again on next push.
+ */
+bool buf_release_idle_block(struct net_buf *self);
+
+/* test the buf setting is same as just created, so it can be released and created again. */
+bool buf_is_default_setting(struct net_buf *self, dofunc_f default_func);
+
 int buf_get_data_size(struct net_buf *self);
 
 /* push len, if is more than the limit, return true.*/
 bool buf_add_is_limit(struct net_buf *self, size_t len);
 
+/* result of send policy. */
+enum {
+	enum_send_accept = 0,		/* push the data. */
+	enum_send_drop,				/* drop the data, keep the connection. */
+	enum_send_close,			/* close the connection. */
+};
+
+/*
+ * send policy when block memory budget is set.
+ * queue_bytes --- the send buf data size.
+ * data_len --- the data length for push.
+ * used_bytes --- the block memory of all buf used.
+ * budget --- the block memory budget.
+ * return enum_send_accept, enum_send_drop or enum_send_close.
+ */
+typedef int (*send_policy_func)(size_t queue_bytes, size_t data_len, size_t used_bytes, size_t budget);
+
+/*
+ * check push len, as the limit and the send policy.
+ * return enum_send_accept, enum_send_drop or enum_send_close.
+ */
+int buf_send_check(struct net_buf *self, size_t len);
+
 /* test can recv data, if not recv, return true. */
 bool buf_can_not_recv(struct net_buf *self);
 
@@ -82,6 +159,9 @@ void buf_add_write(struct net_buf *self, char *buf, int len);
  */
 bool buf_recv_end_do(struct net_buf *self);
 
+/* test has the received data not uncompressed (stopped by budget or ring). */
+bool buf_has_uncompress_data(struct net_buf *self);
+
 /*
  * ================================================================================
  * some send interface.
@@ -94,8 +174,8 @@ struct buf_info buf_get_read_bufinfo(struct net_buf *self);
 /* add read positon. */
 void buf_add_read(struct net_buf *self, int len);
 
-/* before send, do something. */
-void buf_send_before_do(struct net_buf *self);
+/* before send, do something, if return false, then close connect. */
+bool buf_send_before_do(struct net_buf *self);
 
 
 /* push packet into the buffer. */
@@ -104,9 +184,44 @@ bool buf_put_message(struct net_buf *self, const void *msg_data, int len);
 /* push data into the buffer. */
 bool buf_put_data(struct net_buf *self, const void *data, int len);
 
+struct block;
+
+/*
+ * push all data of the shared block into the buffer by reference, not copy.
+ * if use custom message format, then copy it.
+ */
+bool buf_put_shared(struct net_buf *self, struct block *shared);
+
+/*
+ * reserve len contiguous bytes in the send buffer for write in place, 
+ * return the write buffer, if failed, return NULL.
+ */
+char *buf_reserve_send(struct net_buf *self, int len);
+
+/* commit the reserved buffer as message of len bytes, write the length header, len can be 0 for cancel. */
+bool buf_commit_send(struct net_buf *self, int len);
+
 /* get packet from the buffer, if error, then need_close is true. */
 char *buf_get_message(struct net_buf *self, bool *need_close, char *buf, size_t bufsize);
 
+/*
+ * peek packet from the buffer, if the packet is contiguous in block, then return the pointer to block,
+ * else copy to buf as buf_get_message. if error, then need_close is true.
+ * if return not NULL, must call buf_release_message after use it.
+ */
+char *buf_peek_message(struct net_buf *self, bool *need_close, char *buf, size_t bufsize);
+
+/*
+ * peek all complete packets in one pass, up to max, msgs[i] point to them,
+ * the packet straddle blocks is copied to arena (if arena is NULL, then use the thread buffer).
+ * return the packet num, if error, then need_close is true.
+ * if return greater than 0, must call buf_release_message after use them.
+ */
+int buf_peek_message_batch(struct net_buf *self, bool *need_close, char *arena, size_t arenasize, char **msgs, int max);
+
+/* release the packet of buf_peek_message or buf_peek_message_batch. */
+void buf_release_message(struct net_buf *self);
+
 /* get data from the buffer, if error, then need_close is true. */
 char *buf_get_data(struct net_buf *self, bool *need_close, char *buf, int bufsize, int *datalen);
 
@@ -114,20 +229,25 @@ char *buf_get_data(struct net_buf *self, bool *need_close, char *buf, int bufsiz
 int buf_find_data_end_size(struct net_buf *self, const char *data, int datalen);
 
 
+/*
+ * set block pool option, must be called before bufmgr_init, or else it is ignored.
+ * use_hugepage --- block pool use huge page memory.
+ * prefault --- touch all block pool memory in bufmgr_init, avoid page fault on network thread.
+ */
+void bufmgr_set_pool_option(bool use_hugepage, bool prefault);
+
 /*
  * create and init buf pool.
  * big_buf_num --- is bigbuf num.
  * big_buf_size --- is bigbuf size.
  * small_buf_num --- is small buf num.
  * small_buf_size --- is small buf size.
- * buf_num --- is buf num.
- *
- * because a socket need 2 buf, so buf_num is * 2, in init function.
+ * the memory of these blocks is split across the block size classes as the initial pools.
  *
  * this function be able to call private thread buffer etc.
  */
 bool bufmgr_init(size_t big_buf_num, size_t big_buf_size, 
-		size_t small_buf_num, size_t small_buf_size, size_t buf_num);
+		size_t small_buf_num, size_t small_buf_size);
 
 /* release some buf. */
 void bufmgr_release();
@@ -135,9 +255,80 @@ void bufmgr_release();
 
 struct poolmgr_info;
 
-/* get some buf memroy info. */
+/*
+ * get some buf memroy info.
+ * fill at most num entries, return the filled num, if array is NULL, return the num of entries it has.
+ */
 size_t bufmgr_get_memory_info(struct poolmgr_info *array, size_t num);
 
+/*
+ * create shared block by the data, it can be pushed into many buf by reference.
+ * if len is greater than the biggest block, return NULL.
+ * after push, call bufmgr_release_shared_block.
+ */
+struct block *bufmgr_create_shared_block(const void *data, int len);
+
+/* release the reference of creator, the shared block is released when not any reference. */
+void bufmgr_release_shared_block(struct block *shared);
+
+/* trim some buf pool, return reclaimed bytes. */
+size_t bufmgr_trim(int free_seconds);
+
+struct bufmgr_budget_info {
+	size_t budget;					/* block memory budget, 0 is not limit. */
+	size_t used_bytes;				/* block memory in use. */
+	size_t max_used_bytes;			/* max block memory in use. */
+	size_t alloc_fail_num;			/* create block failed because of budget. */
+	size_t recv_throttle_num;		/* stop recv because of budget. */
+	size_t send_drop_num;			/* send data dropped by send policy. */
+	size_t send_close_num;			/* connection closed by send policy. */
+};
+
+/*
+ * set block memory budget bytes, if 0, then not limit.
+ * when the budget is near exhaustion, the socket which has large recv queue stop recv first, 
+ * and the send policy decide the push data is accept, drop, or close the connection.
+ */
+void bufmgr_set_budget(size_t budget);
+
+/* set send policy, if func is NULL, then use default policy. */
+void bufmgr_set_send_policy(send_policy_func func);
+
+/*
+ * set adaptive compress option.
+ * min_size --- the chunk less than it is stored, not compressed.
+ * max_ratio --- per mille, pause compress of the connection when the ratio estimate is more than it, 0 is not pause.
+ */
+void bufmgr_set_compress_option(int min_size, int max_ratio);
+
+/*
+ * set the shared compress dictionary, must be called before bufmgr_init, or else return false,
+ * it is released by bufmgr_release.
+ */
+bool bufmgr_set_compress_dict(const void *dict, size_t size);
+
+/*
+ * set parallel compress, must be called before bufmgr_init, or else it is ignored.
+ * the send backlog not less than min_size is split into chunks, and compressed by thread_num workers and the sending thread.
+ */
+void bufmgr_set_parallel_compress(int thread_num, int min_size);
+
+/*
+ * set streaming compress option, must be called before bufmgr_init, or else it is ignored.
+ * window is the history window, not more than NET_COMPRESS_STREAM_BUFFER, 0 is the max, both sides must use the same window.
+ * state_num is the initialize num of state pool, it grows by the num.
+ */
+void bufmgr_set_compress_stream_option(size_t window, size_t state_num);
+
+/*
+ * set the uncompress limit of the received data, max_ratio is the max expansion ratio of a chunk,
+ * budget is the max uncompressed data (bytes) not read by logic of a connection, 0 is not check.
+ */
+void bufmgr_set_uncompress_option(int max_ratio, int budget);
+
+/* get block memory budget info. */
+void bufmgr_get_budget_info(struct bufmgr_budget_info *info);
+
 /* enable/disable errorlog, and return before value. */
 bool buf_set_enable_errorlog(bool flag);
 
@@ -5,77 +5,164 @@
  */
 
 #include <assert.h>
+#include <stdio.h>
 #include "net_bufpool.h"
 #include "cthread.h"
+#include "catomic.h"
 #include "pool.h"
 
+#if defined(__linux__)
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+
+/* the ring memory is a memfd that mapped twice back-to-back. */
+#ifdef SYS_memfd_create
+#define BUFPOOL_RING_MIRROR
+#endif
+#endif
+
+/* the ring size limit, the ring position is wrap in 31 bits. */
+#define BUFPOOL_RING_MAX_SIZE (1024 * 1024 * 1024)
+
+/* initialize num of built-in cipher state pool. */
+#define _CRYPT_STATE_POOL_NUM 64
+
+struct block_class {
+	size_t size;
+	size_t num;
+	struct poolmgr *pool;
+	cspin lock;
+	char name[64];
+};
+
 struct bufpool {
 	bool is_init;
 
-	size_t big_pool_num;
-	size_t big_pool_size;
-	struct poolmgr *big_block_pool;
-	cspin big_lock;
+	size_t class_num;
+	struct block_class classes[_MAX_BLOCK_CLASS_NUM];
 
-	size_t small_pool_num;
-	size_t small_pool_size;
-	struct poolmgr *small_block_pool;
-	cspin small_lock;
+	/* the state of streaming compress/uncompress, only the buf that use streaming compress has it. */
+	size_t stream_state_size;
+	struct poolmgr *stream_state_pool;
+	cspin stream_state_lock;
 
-	size_t buf_num;
-	size_t buf_size;
-	struct poolmgr *buf_pool;
-	cspin buf_lock;
+	/* the state of built-in cipher, only the buf that use it has it. */
+	struct poolmgr *crypt_state_pool;
+	cspin crypt_state_lock;
 };
 static struct bufpool s_pool = {false};
 
+/* process-wide block memory budget. */
+struct bufpool_budget {
+	volatile size_t budget;		/* if 0, then not limit. */
+	catomic used_bytes;
+	catomic max_used_bytes;
+	catomic alloc_fail_num;
+};
+static struct bufpool_budget s_budget = {0, catomic_init(0), catomic_init(0), catomic_init(0)};
+
+struct bufpool_option {
+	bool use_hugepage;
+	bool prefault;
+};
+static struct bufpool_option s_option = {false, false};
+
+/*
+ * set block pool option, must be called before bufpool_init.
+ * use_hugepage --- block pool use huge page memory.
+ * prefault --- touch all block pool memory in bufpool_init, avoid page fault on network thread.
+ */
+void bufpool_set_option(bool use_hugepage, bool prefault) {
+	s_option.use_hugepage = use_hugepage;
+	s_option.prefault = prefault;
+}
+
+static void bufpool_release_class() {
+	size_t i;
+	for (i = 0; i < s_pool.class_num; ++i) {
+		poolmgr_release(s_pool.classes[i].pool);
+		s_pool.classes[i].pool = NULL;
+	}
+	s_pool.class_num = 0;
+}
+
 /*
  * create and init buf pool.
- * big_block_num --- is big block num.
- * big_block_size --- is big block size.
+ * block_size --- is block size of each class, must be ascending.
+ * block_num --- is block num of each class.
+ * class_num --- is block size class num, can not greater than _MAX_BLOCK_CLASS_NUM.
  *
- * small_block_num --- is small block num.
- * small_block_size --- is small block size.
- *
- * buf_num --- is buf num.
- * buf_size --- is buf size.
+ * stream_state_size --- is the state size of streaming compress/uncompress.
+ * stream_state_num --- is the initialize num of streaming compress state pool, it grows by the num.
+ * crypt_state_size --- is the state size of built-in cipher.
  */
-bool bufpool_init(size_t big_block_num, size_t big_block_size, 
-		size_t small_block_num, size_t small_block_size, size_t buf_num, size_t buf_size) {
+bool bufpool_init(const size_t *block_size, const size_t *block_num, size_t class_num, 
+		size_t stream_state_size, size_t stream_state_num, size_t crypt_state_size) {
 
+	size_t i;
 	if (s_pool.is_init)
 		return false;
 
-	if ((big_block_num == 0) || (big_block_size == 0) ||
-		(small_block_num == 0) || (small_block_size == 0) ||
-		(buf_num == 0) || (buf_size == 0))
+	if (!block_size || !block_num || (class_num == 0) || (class_num > _MAX_BLOCK_CLASS_NUM) ||
+		(stream_state_size == 0) || (stream_state_num == 0) || (crypt_state_size == 0))
 		return false;
 
-	s_pool.big_block_pool = poolmgr_create(big_block_size, 8, big_block_num, 1, 
-																"big block pools");
-	s_pool.small_block_pool = poolmgr_create(small_block_size, 8, small_block_num, 1, 
-																"small block pools");
+	for (i = 0; i < class_num; ++i) {
+		if ((block_size[i] == 0) || (block_num[i] == 0))
+			return false;
+
+		if ((i > 0) && (block_size[i] <= block_size[i - 1]))
+			return false;
+	}
+
+	s_pool.class_num = 0;
+	for (i = 0; i < class_num; ++i) {
+		struct block_class *bc = &s_pool.classes[i];
+		bc->size = block_size[i];
+		bc->num = block_num[i];
+		sprintf(bc->name, "block pools(%u byte)", (unsigned int)block_size[i]);
+		bc->pool = poolmgr_create(bc->size, 8, bc->num, 1, bc->name);
+		if (!bc->pool) {
+			bufpool_release_class();
+			return false;
+		}
+
+		++s_pool.class_num;
+	}
+
+	/* streaming compress is used by few connection, the pool grow on demand. */
+	s_pool.stream_state_pool = poolmgr_create(stream_state_size, 8, 
+											stream_state_num, 1, "compress stream state pools");
+	if (!s_pool.stream_state_pool) {
+		bufpool_release_class();
+		return false;
+	}
 
-	s_pool.buf_pool = poolmgr_create(buf_size, 8, buf_num, 1, "buf pools");
-	if (!s_pool.big_block_pool || !s_pool.small_block_pool || !s_pool.buf_pool) {
-		poolmgr_release(s_pool.big_block_pool);
-		poolmgr_release(s_pool.small_block_pool);
-		poolmgr_release(s_pool.buf_pool);
+	/* the built-in cipher is of the connections that use it, the pool grow on demand. */
+	s_pool.crypt_state_pool = poolmgr_create(crypt_state_size, 8, 
+											_CRYPT_STATE_POOL_NUM, 1, "crypt state pools");
+	if (!s_pool.crypt_state_pool) {
+		poolmgr_release(s_pool.stream_state_pool);
+		s_pool.stream_state_pool = NULL;
+		bufpool_release_class();
 		return false;
 	}
 
-	cspin_init(&s_pool.big_lock);
-	cspin_init(&s_pool.small_lock);
-	cspin_init(&s_pool.buf_lock);
+	for (i = 0; i < s_pool.class_num; ++i) {
+		struct block_class *bc = &s_pool.classes[i];
+		if (s_option.use_hugepage)
+			poolmgr_set_hugepage(bc->pool, true);
 
-	s_pool.big_pool_num = big_block_num;
-	s_pool.big_pool_size = big_block_size;
+		if (s_option.prefault)
+			poolmgr_prefault(bc->pool, bc->num);
 
-	s_pool.small_pool_num = small_block_num;
-	s_pool.small_pool_size = small_block_size;
+		cspin_init(&bc->lock);
+	}
 
-	s_pool.buf_num = buf_num;
-	s_pool.buf_size = buf_size;
+	cspin_init(&s_pool.stream_state_lock);
+	s_pool.stream_state_size = stream_state_size;
+	cspin_init(&s_pool.crypt_state_lock);
 
 	s_pool.is_init = true;
 	return true;
@@ -83,111 +170,320 @@ bool bufpool_init(size_t big_block_num, size_t big_block_size,
 
 /* release buf pool. */
 void bufpool_release() {
+	size_t i;
 	if (!s_pool.is_init)
 		return;
 
-	cspin_lock(&s_pool.big_lock);
-	poolmgr_release(s_pool.big_block_pool);
-	s_pool.big_block_pool = NULL;
-	cspin_unlock(&s_pool.big_lock);
-	cspin_destroy(&s_pool.big_lock);
+	for (i = 0; i < s_pool.class_num; ++i) {
+		struct block_class *bc = &s_pool.classes[i];
+		cspin_lock(&bc->lock);
+		poolmgr_release(bc->pool);
+		bc->pool = NULL;
+		cspin_unlock(&bc->lock);
+		cspin_destroy(&bc->lock);
+	}
+	s_pool.class_num = 0;
 
-	cspin_lock(&s_pool.small_lock);
-	poolmgr_release(s_pool.small_block_pool);
-	s_pool.small_block_pool = NULL;
-	cspin_unlock(&s_pool.small_lock);
-	cspin_destroy(&s_pool.small_lock);
+	cspin_lock(&s_pool.stream_state_lock);
+	poolmgr_release(s_pool.stream_state_pool);
+	s_pool.stream_state_pool = NULL;
+	cspin_unlock(&s_pool.stream_state_lock);
+	cspin_destroy(&s_pool.stream_state_lock);
 
-	cspin_lock(&s_pool.buf_lock);
-	poolmgr_release(s_pool.buf_pool);
-	s_pool.buf_pool = NULL;
-	cspin_unlock(&s_pool.buf_lock);
-	cspin_destroy(&s_pool.buf_lock);
+	cspin_lock(&s_pool.crypt_state_lock);
+	poolmgr_release(s_pool.crypt_state_pool);
+	s_pool.crypt_state_pool = NULL;
+	cspin_unlock(&s_pool.crypt_state_lock);
+	cspin_destroy(&s_pool.crypt_state_lock);
 
 	s_pool.is_init = false;
 }
 
-void *bufpool_create_big_block() {
+/* add block bytes to used, if more than the budget, then failed. */
+static bool bufpool_budget_acquire(size_t size) {
+	size_t budget = s_budget.budget;
+	int64 used = catomic_add_fetch(&s_budget.used_bytes, (int64)size);
+	int64 max_used;
+	if ((budget != 0) && ((size_t)used > budget)) {
+		catomic_fetch_add(&s_budget.used_bytes, -(int64)size);
+		catomic_inc(&s_budget.alloc_fail_num);
+		return false;
+	}
+
+	max_used = catomic_read(&s_budget.max_used_bytes);
+	while (used > max_used) {
+		if (catomic_compare_set(&s_budget.max_used_bytes, max_used, used))
+			break;
+
+		max_used = catomic_read(&s_budget.max_used_bytes);
+	}
+	return true;
+}
+
+/* set block memory budget bytes, if 0, then not limit. */
+void bufpool_set_budget(size_t budget) {
+	s_budget.budget = budget;
+}
+
+/* get block memory budget and used bytes, if not limit, return false. */
+bool bufpool_get_budget(size_t *budget, size_t *used_bytes) {
+	size_t now_budget = s_budget.budget;
+	if (now_budget == 0)
+		return false;
+
+	*budget = now_budget;
+	*used_bytes = (size_t)catomic_read(&s_budget.used_bytes);
+	return true;
+}
+
+/* get block memory budget info. */
+void bufpool_get_budget_info(size_t *budget, size_t *used_bytes, 
+		size_t *max_used_bytes, size_t *alloc_fail_num) {
+
+	*budget = s_budget.budget;
+	*used_bytes = (size_t)catomic_read(&s_budget.used_bytes);
+	*max_used_bytes = (size_t)catomic_read(&s_budget.max_used_bytes);
+	*alloc_fail_num = (size_t)catomic_read(&s_budget.alloc_fail_num);
+}
+
+/*
+ * create block from the smallest class that not less than size, 
+ * if size is greater than all class, then from the biggest class.
+ * size is need size, and return the real block size.
+ */
+void *bufpool_create_block(size_t *size) {
 	void *self = NULL;
-	if (!s_pool.is_init)
+	struct block_class *bc;
+	size_t i;
+	if (!s_pool.is_init || !size)
 		return NULL;
 
-	cspin_lock(&s_pool.big_lock);
-	self = poolmgr_alloc_object(s_pool.big_block_pool);
-	cspin_unlock(&s_pool.big_lock);
+	bc = &s_pool.classes[s_pool.class_num - 1];
+	for (i = 0; i < s_pool.class_num; ++i) {
+		if (s_pool.classes[i].size >= *size) {
+			bc = &s_pool.classes[i];
+			break;
+		}
+	}
+
+	if (!bufpool_budget_acquire(bc->size))
+		return NULL;
+
+	cspin_lock(&bc->lock);
+	self = poolmgr_alloc_object(bc->pool);
+	cspin_unlock(&bc->lock);
+
+	if (self)
+		*size = bc->size;
+	else
+		catomic_fetch_add(&s_budget.used_bytes, -(int64)bc->size);
 	return self;
 }
 
-void bufpool_release_big_block(void *self) {
+/* release block, size is the real block size of bufpool_create_block. */
+void bufpool_release_block(void *self, size_t size) {
+	struct block_class *bc = NULL;
+	size_t i;
 	if (!self)
 		return;
 
-	cspin_lock(&s_pool.big_lock);
-	poolmgr_free_object(s_pool.big_block_pool, self);
-	cspin_unlock(&s_pool.big_lock);
+	for (i = 0; i < s_pool.class_num; ++i) {
+		if (s_pool.classes[i].size == size) {
+			bc = &s_pool.classes[i];
+			break;
+		}
+	}
+
+	assert(bc != NULL && "bufpool_release_block block size is not any class!");
+	if (!bc)
+		return;
+
+	cspin_lock(&bc->lock);
+	poolmgr_free_object(bc->pool, self);
+	cspin_unlock(&bc->lock);
+
+	catomic_fetch_add(&s_budget.used_bytes, -(int64)bc->size);
+}
+
+#ifdef BUFPOOL_RING_MIRROR
+static char *bufpool_ring_map(size_t size) {
+	const unsigned int memfd_cloexec = 1;
+	char *addr;
+	int fd = (int)syscall(SYS_memfd_create, "lxnet_ring", memfd_cloexec);
+	if (fd < 0)
+		return NULL;
+
+	if (ftruncate(fd, (off_t)size) != 0) {
+		close(fd);
+		return NULL;
+	}
+
+	/* reserve the address space of twice size, then map the memfd to both half. */
+	addr = (char *)mmap(NULL, size * 2, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (addr == (char *)MAP_FAILED) {
+		close(fd);
+		return NULL;
+	}
+
+	if ((mmap(addr, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, fd, 0) == MAP_FAILED) || 
+		(mmap(addr + size, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, fd, 0) == MAP_FAILED)) {
+		munmap(addr, size * 2);
+		close(fd);
+		return NULL;
+	}
+
+	/* the mapping keep the memfd. */
+	close(fd);
+	return addr;
+}
+#endif
+
+/*
+ * create ring memory, it is mapped twice back-to-back, so ring[i] and ring[i + size] is same memory.
+ * size is need size, and return the real size, it is power of 2 and not less than page size.
+ * if the platform not support, return NULL. (only linux.)
+ */
+void *bufpool_create_ring(size_t *size) {
+#ifdef BUFPOOL_RING_MIRROR
+	size_t real_size;
+	char *ring;
+	if (!s_pool.is_init || !size || *size == 0 || *size > BUFPOOL_RING_MAX_SIZE)
+		return NULL;
+
+	real_size = (size_t)sysconf(_SC_PAGESIZE);
+	while (real_size < *size)
+		real_size <<= 1;
+
+	if (!bufpool_budget_acquire(real_size))
+		return NULL;
+
+	ring = bufpool_ring_map(real_size);
+	if (!ring) {
+		catomic_fetch_add(&s_budget.used_bytes, -(int64)real_size);
+		return NULL;
+	}
+
+	*size = real_size;
+	return ring;
+#else
+	return NULL;
+#endif
+}
+
+/* release ring memory, size is the real size of bufpool_create_ring. */
+void bufpool_release_ring(void *ring, size_t size) {
+#ifdef BUFPOOL_RING_MIRROR
+	if (!ring)
+		return;
+
+	munmap(ring, size * 2);
+	catomic_fetch_add(&s_budget.used_bytes, -(int64)size);
+#endif
 }
 
-void *bufpool_create_small_block() {
+/* create the state of streaming compress/uncompress, it is not zeroed. */
+void *bufpool_create_stream_state() {
 	void *self = NULL;
 	if (!s_pool.is_init)
 		return NULL;
 
-	cspin_lock(&s_pool.small_lock);
-	self = poolmgr_alloc_object(s_pool.small_block_pool);
-	cspin_unlock(&s_pool.small_lock);
+	cspin_lock(&s_pool.stream_state_lock);
+	self = poolmgr_alloc_object(s_pool.stream_state_pool);
+	cspin_unlock(&s_pool.stream_state_lock);
 	return self;
 }
 
-void bufpool_release_small_block(void *self) {
+void bufpool_release_stream_state(void *self) {
 	if (!self)
 		return;
 
-	cspin_lock(&s_pool.small_lock);
-	poolmgr_free_object(s_pool.small_block_pool, self);
-	cspin_unlock(&s_pool.small_lock);
+	cspin_lock(&s_pool.stream_state_lock);
+	poolmgr_free_object(s_pool.stream_state_pool, self);
+	cspin_unlock(&s_pool.stream_state_lock);
 }
 
-void *bufpool_create_net_buf() {
+/* create the state of built-in cipher, it is not zeroed. */
+void *bufpool_create_crypt_state() {
 	void *self = NULL;
 	if (!s_pool.is_init)
 		return NULL;
 
-	cspin_lock(&s_pool.buf_lock);
-	self = poolmgr_alloc_object(s_pool.buf_pool);
-	cspin_unlock(&s_pool.buf_lock);
+	cspin_lock(&s_pool.crypt_state_lock);
+	self = poolmgr_alloc_object(s_pool.crypt_state_pool);
+	cspin_unlock(&s_pool.crypt_state_lock);
 	return self;
 }
 
-void bufpool_release_net_buf(void *self) {
+void bufpool_release_crypt_state(void *self) {
 	if (!self)
 		return;
 
-	cspin_lock(&s_pool.buf_lock);
-	poolmgr_free_object(s_pool.buf_pool, self);
-	cspin_unlock(&s_pool.buf_lock);
+	cspin_lock(&s_pool.crypt_state_lock);
+	poolmgr_free_object(s_pool.crypt_state_pool, self);
+	cspin_unlock(&s_pool.crypt_state_lock);
 }
 
-/* get buf pool memory info. */
+/*
+ * trim block pools, stream state pool and crypt state pool, call it periodically.
+ * free_seconds --- advise the node pool that free more than this seconds back to system.
+ * return reclaimed bytes.
+ */
+size_t bufpool_trim(int free_seconds) {
+	size_t i;
+	size_t bytes = 0;
+	if (!s_pool.is_init)
+		return 0;
+
+	for (i = 0; i < s_pool.class_num; ++i) {
+		struct block_class *bc = &s_pool.classes[i];
+		cspin_lock(&bc->lock);
+		bytes += poolmgr_trim(bc->pool, free_seconds);
+		cspin_unlock(&bc->lock);
+	}
+
+	cspin_lock(&s_pool.stream_state_lock);
+	bytes += poolmgr_trim(s_pool.stream_state_pool, free_seconds);
+	cspin_unlock(&s_pool.stream_state_lock);
+
+	cspin_lock(&s_pool.crypt_state_lock);
+	bytes += poolmgr_trim(s_pool.crypt_state_pool, free_seconds);
+	cspin_unlock(&s_pool.crypt_state_lock);
+	return bytes;
+}
+
+/*
+ * get buf pool memory info.
+ * fill at most num entries, return the filled num, if array is NULL, return the num of entries it has.
+ */
 size_t bufpool_get_memory_info(struct poolmgr_info *array, size_t num) {
+	size_t i;
 	size_t index = 0;
-	if (!array || num < 3)
-		return 0;
+	if (!array)
+		return s_pool.class_num + 2;
+
+	for (i = 0; (i < s_pool.class_num) && (index < num); ++i) {
+		struct block_class *bc = &s_pool.classes[i];
+		cspin_lock(&bc->lock);
+		poolmgr_get_info(bc->pool, &array[index]);
+		cspin_unlock(&bc->lock);
+		++index;
+	}
 
-	cspin_lock(&s_pool.big_lock);
-	poolmgr_get_info(s_pool.big_block_pool, &array[index]);
-	cspin_unlock(&s_pool.big_lock);
-	++index;
+	if (index >= num)
+		return index;
 
-	cspin_lock(&s_pool.small_lock);
-	poolmgr_get_info(s_pool.small_block_pool, &array[index]);
-	cspin_unlock(&s_pool.small_lock);
+	cspin_lock(&s_pool.stream_state_lock);
+	poolmgr_get_info(s_pool.stream_state_pool, &array[index]);
+	cspin_unlock(&s_pool.stream_state_lock);
 	++index;
 
-	cspin_lock(&s_pool.buf_lock);
-	poolmgr_get_info(s_pool.buf_pool, &array[index]);
-	cspin_unlock(&s_pool.buf_lock);
+	if (index >= num)
+		return index;
+
+	cspin_lock(&s_pool.crypt_state_lock);
+	poolmgr_get_info(s_pool.crypt_state_pool, &array[index]);
+	cspin_unlock(&s_pool.crypt_state_lock);
 	++index;
 
 	return index;
 }
-
@@ -13,39 +13,86 @@ extern "C" {
 
 #include "platform_config.h"
 
+/*
+ * set block pool option, must be called before bufpool_init.
+ * use_hugepage --- block pool use huge page memory.
+ * prefault --- touch all block pool memory in bufpool_init, avoid page fault on network thread.
+ */
+void bufpool_set_option(bool use_hugepage, bool prefault);
+
+/* max block size class num. */
+#define _MAX_BLOCK_CLASS_NUM 8
+
 /*
  * create and init buf pool.
- * big_block_num --- is big block num.
- * big_block_size --- is big block size.
- *
- * small_block_num --- is small block num.
- * small_block_size --- is small block size.
+ * block_size --- is block size of each class, must be ascending.
+ * block_num --- is block num of each class.
+ * class_num --- is block size class num, can not greater than _MAX_BLOCK_CLASS_NUM.
  *
- * buf_num --- is buf num.
- * buf_size --- is buf size.
+ * stream_state_size --- is the state size of streaming compress/uncompress.
+ * stream_state_num --- is the initialize num of streaming compress state pool, it grows by the num.
+ * crypt_state_size --- is the state size of built-in cipher.
  */
-bool bufpool_init(size_t big_block_num, size_t big_block_size, 
-		size_t small_block_num, size_t small_block_size, size_t buf_num, size_t buf_size);
+bool bufpool_init(const size_t *block_size, const size_t *block_num, size_t class_num, 
+		size_t stream_state_size, size_t stream_state_num, size_t crypt_state_size);
 
 /* release buf pool. */
 void bufpool_release();
 
-void *bufpool_create_big_block();
+/*
+ * create block from the smallest class that not less than size, 
+ * if size is greater than all class, then from the biggest class.
+ * size is need size, and return the real block size.
+ */
+void *bufpool_create_block(size_t *size);
+
+/* release block, size is the real block size of bufpool_create_block. */
+void bufpool_release_block(void *self, size_t size);
 
-void bufpool_release_big_block(void *self);
+/* set block memory budget bytes, if 0, then not limit. */
+void bufpool_set_budget(size_t budget);
 
-void *bufpool_create_small_block();
+/* get block memory budget and used bytes, if not limit, return false. */
+bool bufpool_get_budget(size_t *budget, size_t *used_bytes);
 
-void bufpool_release_small_block(void *self);
+/* get block memory budget info. */
+void bufpool_get_budget_info(size_t *budget, size_t *used_bytes, 
+		size_t *max_used_bytes, size_t *alloc_fail_num);
 
-void *bufpool_create_net_buf();
+/*
+ * create ring memory, it is mapped twice back-to-back, so ring[i] and ring[i + size] is same memory.
+ * size is need size, and return the real size, it is power of 2 and not less than page size.
+ * if the platform not support, return NULL. (only linux.)
+ */
+void *bufpool_create_ring(size_t *size);
 
-void bufpool_release_net_buf(void *self);
+/* release ring memory, size is the real size of bufpool_create_ring. */
+void bufpool_release_ring(void *ring, size_t size);
+
+/* create the state of streaming compress/uncompress, it is not zeroed. */
+void *bufpool_create_stream_state();
+
+void bufpool_release_stream_state(void *self);
+
+/* create the state of built-in cipher, it is not zeroed. */
+void *bufpool_create_crypt_state();
+
+void bufpool_release_crypt_state(void *self);
+
+/*
+ * trim block pools, stream state pool and crypt state pool, call it periodically.
+ * free_seconds --- advise the node pool that free more than this seconds back to system.
+ * return reclaimed bytes.
+ */
+size_t bufpool_trim(int free_seconds);
 
 
 struct poolmgr_info;
 
-/* get buf pool memory info. */
+/*
+ * get buf pool memory info.
+ * fill at most num entries, return the filled num, if array is NULL, return the num of entries it has.
+ */
 size_t bufpool_get_memory_info(struct poolmgr_info *array, size_t num);
 
 #ifdef __cplusplus
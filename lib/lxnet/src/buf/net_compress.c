@@ -5,72 +5,849 @@
  */
 
 #include <assert.h>
+#include <stdlib.h>
+#include <string.h>
 #include "net_compress.h"
 #include "quicklz.h"
+#define LZ4_STATIC_LINKING_ONLY
+#include "lz4.h"
 #include "log.h"
 
 /*#define print_debug debug_print_call*/
 #define print_debug(...) ((void) 0)
 
+#if QLZ_STREAMING_BUFFER != 0 || QLZ_COMPRESSION_LEVEL != 1
+	#error define QLZ_STREAMING_BUFFER to the zero value and define QLZ_COMPRESSION_LEVEL to the 1 for this lib
+#endif
+
+#ifndef max
+#define max(a, b) (((a) > (b))? (a) : (b))
+#endif
+
+#ifndef min
+#define min(a, b) (((a) < (b))? (a) : (b))
+#endif
+
+/*
+ * ================================================================================
+ * the output of uncompress in pieces.
+ * ================================================================================
+ */
+
+/*
+ * init the output of uncompress in pieces, mem is the memory of the piece table, 
+ * the piece num is at most memlen / sizeof(struct compress_piece).
+ */
+void compressmgr_pieces_init(struct compress_pieces *out, int (*next_piece)(void *arg, int len, char **buf), void *arg, 
+		void *mem, int memlen, int rawlen) {
+	out->next_piece = next_piece;
+	out->arg = arg;
+	out->pieces = (struct compress_piece *)mem;
+	out->piece_max = memlen / (int)sizeof(struct compress_piece);
+	out->piece_num = 0;
+	out->rawlen = rawlen;
+	out->pos = 0;
+}
+
+/* get the room of the last piece, if it is full, get the next piece, return the room len, if failed, return 0. */
+static int pieces_room(struct compress_pieces *out, char **buf) {
+	struct compress_piece *piece;
+	if (out->piece_num > 0) {
+		piece = &out->pieces[out->piece_num - 1];
+		if (out->pos < piece->pos + piece->len) {
+			*buf = &piece->buf[out->pos - piece->pos];
+			return piece->pos + piece->len - out->pos;
+		}
+	}
+
+	if (out->pos >= out->rawlen)
+		return 0;
+
+	if (out->piece_num >= out->piece_max) {
+		log_error("uncompress pieces is too many, raw len:%d, written len:%d, piece num:%d", 
+				out->rawlen, out->pos, out->piece_num);
+		return 0;
+	}
+
+	piece = &out->pieces[out->piece_num];
+	piece->len = out->next_piece(out->arg, out->rawlen - out->pos, &piece->buf);
+	if (piece->len <= 0)
+		return 0;
+
+	piece->pos = out->pos;
+	++out->piece_num;
+	*buf = piece->buf;
+	return piece->len;
+}
+
+/* write len bytes to the pieces, if the pieces is not enough, return false. */
+bool compressmgr_pieces_write(struct compress_pieces *out, const char *data, int len) {
+	while (len > 0) {
+		char *buf;
+		int room = pieces_room(out, &buf);
+		if (room <= 0)
+			return false;
+
+		room = min(room, len);
+		memcpy(buf, data, room);
+		data += room;
+		len -= room;
+		out->pos += room;
+	}
+	return true;
+}
+
+/* find the piece that has the written position pos. */
+static const struct compress_piece *pieces_find(const struct compress_pieces *out, int pos) {
+	int low = 0;
+	int high = out->piece_num - 1;
+	assert(pos >= 0 && pos < out->pos);
+
+	/* the match is near mostly, it is in the last piece. */
+	if (pos >= out->pieces[high].pos)
+		return &out->pieces[high];
+
+	while (low < high) {
+		int mid = (low + high + 1) / 2;
+		if (out->pieces[mid].pos <= pos)
+			low = mid;
+		else
+			high = mid - 1;
+	}
+	return &out->pieces[low];
+}
+
+/*
+ * copy len bytes from the written position pos to the end, it maybe straddle the pieces.
+ * the source is only overlapped with the end in the last piece, it is copied forward by byte, so repeat the pattern.
+ */
+static bool pieces_copy(struct compress_pieces *out, int pos, int len) {
+	const struct compress_piece *src = pieces_find(out, pos);
+	while (len > 0) {
+		const char *from;
+		char *buf;
+		int room = pieces_room(out, &buf);
+		if (room <= 0)
+			return false;
+
+		if (pos >= src->pos + src->len)
+			++src;
+
+		from = &src->buf[pos - src->pos];
+		room = min(min(room, len), src->pos + src->len - pos);
+		if (room <= out->pos - pos) {
+			memcpy(buf, from, room);
+		} else {
+			int i;
+			for (i = 0; i < room; ++i)
+				buf[i] = from[i];
+		}
+
+		pos += room;
+		len -= room;
+		out->pos += room;
+	}
+	return true;
+}
+
+/* quicklz level 1, the work memory is per thread. */
+static size_t quicklz_state_size() {
+	return max(sizeof(qlz_state_compress), sizeof(qlz_state_decompress));
+}
+
+static int quicklz_bound(int len) {
+	return len + 400;
+}
+
+static int quicklz_compress(void *state, const char *src, int len, char *dst, int dstlen) {
+	if (dstlen < quicklz_bound(len))
+		return 0;
+
+	return (int)qlz_compress(src, dst, (size_t)len, (qlz_state_compress *)state);
+}
+
+static int quicklz_uncompress(void *state, const char *src, int len, char *dst, int dstlen) {
+	if ((len < 3) || ((int)qlz_size_header(src) > len) || ((int)qlz_size_compressed(src) != len))
+		return -1;
+
+	if ((int)qlz_size_decompressed(src) > dstlen)
+		return -1;
+
+	return (int)qlz_decompress(src, dst, (qlz_state_decompress *)state);
+}
+
+/*
+ * quicklz level 1 without history into pieces, it is the same as qlz_decompress of the MEMORY_SAFE build,
+ * but the hash table hold the position of output (add 1, 0 is not set), not the pointer,
+ * the match reference any earlier position of the chunk, so all pieces are referenced.
+ */
+#define _QLZ_CWORD_LEN 4
+#define _QLZ_MINOFFSET 2
+#define _QLZ_UNCONDITIONAL_MATCHLEN 6
+#define _QLZ_UNCOMPRESSED_END 4
+
+static unsigned int quicklz_read32(const unsigned char *src) {
+	return (unsigned int)src[0] | ((unsigned int)src[1] << 8) | ((unsigned int)src[2] << 16) | ((unsigned int)src[3] << 24);
+}
+
+/* hash of 3 bytes at the written position pos, index is the piece of the last hashed position, the position is in order. */
+static unsigned int quicklz_pieces_hashat(const struct compress_pieces *out, int *index, int pos) {
+	const struct compress_piece *piece = &out->pieces[*index];
+	unsigned char bytes[3];
+	unsigned int fetch;
+	int i;
+	assert(pos >= 0 && pos + 3 <= out->pos);
+	while (pos >= piece->pos + piece->len) {
+		++piece;
+		++*index;
+	}
+
+	if (pos + 3 <= piece->pos + piece->len) {
+		memcpy(bytes, &piece->buf[pos - piece->pos], 3);
+	} else {
+		for (i = 0; i < 3; ++i, ++pos) {
+			if (pos >= piece->pos + piece->len)
+				++piece;
+
+			bytes[i] = (unsigned char)piece->buf[pos - piece->pos];
+		}
+	}
+
+	fetch = (unsigned int)bytes[0] | ((unsigned int)bytes[1] << 8) | ((unsigned int)bytes[2] << 16);
+	return ((fetch >> 12) ^ fetch) & (QLZ_HASH_VALUES - 1);
+}
+
+static void quicklz_pieces_hash_upto(int *table, const struct compress_pieces *out, int *index, int *last_hashed, int max) {
+	while (*last_hashed < max) {
+		++*last_hashed;
+		table[quicklz_pieces_hashat(out, index, *last_hashed)] = *last_hashed + 1;
+	}
+}
+
+size_t compressmgr_quicklz_pieces_work_size() {
+	return QLZ_HASH_VALUES * sizeof(int);
+}
+
+/*
+ * uncompress the quicklz (level 1) data without history into pieces, 
+ * work is the work memory of the hash table, at least compressmgr_quicklz_pieces_work_size() bytes.
+ * return uncompressed len, if the data is corrupt or the pieces is not enough, return -1.
+ */
+int compressmgr_quicklz_uncompress_pieces(void *work, const char *source, int len, struct compress_pieces *out) {
+	static const unsigned int bitlut[16] = {4, 0, 1, 0, 2, 0, 1, 0, 3, 0, 1, 0, 2, 0, 1, 0};
+	int *table = (int *)work;
+	const unsigned char *src;
+	const unsigned char *last_source_byte = (const unsigned char *)source + len - 1;
+	unsigned int cword_val = 1;
+	int size, dst, last_destination_byte, last_matchstart;
+	int last_hashed = -1;
+	int index = 0;
+
+	if ((len < 3) || ((int)qlz_size_header(source) > len) || ((int)qlz_size_compressed(source) != len))
+		return -1;
+
+	size = (int)qlz_size_decompressed(source);
+	if ((size <= 0) || (size != out->rawlen - out->pos) || (out->pos != 0))
+		return -1;
+
+	src = (const unsigned char *)source + qlz_size_header(source);
+	if ((*source & 1) == 0) {
+		if (size > len - (int)qlz_size_header(source))
+			return -1;
+
+		return compressmgr_pieces_write(out, (const char *)src, size)? size : -1;
+	}
+
+	memset(table, 0, compressmgr_quicklz_pieces_work_size());
+	dst = 0;
+	last_destination_byte = size - 1;
+	last_matchstart = last_destination_byte - _QLZ_UNCONDITIONAL_MATCHLEN - _QLZ_UNCOMPRESSED_END;
+	for (;;) {
+		unsigned int fetch;
+		if (cword_val == 1) {
+			if (src + _QLZ_CWORD_LEN - 1 > last_source_byte)
+				return -1;
+
+			cword_val = quicklz_read32(src);
+			src += _QLZ_CWORD_LEN;
+		}
+
+		if (src + 4 - 1 > last_source_byte)
+			return -1;
+
+		fetch = quicklz_read32(src);
+		if ((cword_val & 1) == 1) {
+			int matchlen, offset2;
+			cword_val = cword_val >> 1;
+			offset2 = table[(fetch >> 4) & 0xfff] - 1;
+			if ((fetch & 0xf) != 0) {
+				matchlen = (int)(fetch & 0xf) + 2;
+				src += 2;
+			} else {
+				matchlen = *(src + 2);
+				src += 3;
+			}
+
+			/* the match is at least 3 bytes, so the hashed position is written. */
+			if ((offset2 < 0) || (offset2 > dst - _QLZ_MINOFFSET - 1) || (matchlen < 3))
+				return -1;
+
+			if (matchlen > last_destination_byte - dst - _QLZ_UNCOMPRESSED_END + 1)
+				return -1;
+
+			if (!pieces_copy(out, offset2, matchlen))
+				return -1;
+
+			dst += matchlen;
+			quicklz_pieces_hash_upto(table, out, &index, &last_hashed, dst - matchlen);
+			last_hashed = dst - 1;
+		} else if (dst < last_matchstart) {
+			unsigned int n = bitlut[cword_val & 0xf];
+			if (!compressmgr_pieces_write(out, (const char *)src, (int)n))
+				return -1;
+
+			cword_val = cword_val >> n;
+			dst += (int)n;
+			src += n;
+			quicklz_pieces_hash_upto(table, out, &index, &last_hashed, dst - 3);
+		} else {
+			while (dst <= last_destination_byte) {
+				if (cword_val == 1) {
+					src += _QLZ_CWORD_LEN;
+					cword_val = 1U << 31;
+				}
+
+				if (src >= last_source_byte + 1)
+					return -1;
+
+				if (!compressmgr_pieces_write(out, (const char *)src, 1))
+					return -1;
+
+				++dst;
+				++src;
+				cword_val = cword_val >> 1;
+			}
+			return size;
+		}
+	}
+}
+
+static int quicklz_uncompress_pieces(void *state, const char *src, int len, struct compress_pieces *out) {
+	assert(quicklz_state_size() >= compressmgr_quicklz_pieces_work_size());
+	return compressmgr_quicklz_uncompress_pieces(state, src, len, out);
+}
+
+static const struct compress_codec s_quicklz_codec = {
+	enum_codec_quicklz, 
+	"quicklz", 
+	false, 
+	quicklz_state_size, 
+	quicklz_bound, 
+	quicklz_compress, 
+	quicklz_uncompress, 
+	quicklz_uncompress_pieces, 
+};
+
+/* lz4 block, the uncompress need not state. */
+static size_t lz4_state_size() {
+	return (size_t)LZ4_sizeofState();
+}
+
+static int lz4_bound(int len) {
+	return LZ4_compressBound(len);
+}
+
+static int lz4_compress(void *state, const char *src, int len, char *dst, int dstlen) {
+	return LZ4_compress_fast_extState(state, src, dst, len, dstlen, 1);
+}
+
+static int lz4_uncompress(void *state, const char *src, int len, char *dst, int dstlen) {
+	int res = LZ4_decompress_safe(src, dst, len, dstlen);
+	return (res < 0)? -1 : res;
+}
+
+/* read the rest of length more than the mask of token. */
+static bool lz4_read_length(const unsigned char **ip, const unsigned char *iend, int *length) {
+	unsigned int s;
+	do {
+		if ((*ip >= iend) || (*length > 0x7fffffff - 255))
+			return false;
+
+		s = *(*ip)++;
+		*length += (int)s;
+	} while (s == 255);
+	return true;
+}
+
+/*
+ * lz4 block into pieces, the history (dict, dict_size) is just before the output, 
+ * the match is at most 64K back, it maybe in the earlier pieces.
+ */
+static int lz4_uncompress_pieces_dict(const char *src, int len, struct compress_pieces *out, 
+		const char *dict, int dict_size) {
+	const unsigned char *ip = (const unsigned char *)src;
+	const unsigned char *iend = ip + len;
+	for (;;) {
+		unsigned int token;
+		int length, offset;
+		if (ip >= iend)
+			return -1;
+
+		token = *ip++;
+
+		/* literals. */
+		length = (int)(token >> 4);
+		if ((length == 15) && !lz4_read_length(&ip, iend, &length))
+			return -1;
+
+		if ((length > (int)(iend - ip)) || (length > out->rawlen - out->pos))
+			return -1;
+
+		if (!compressmgr_pieces_write(out, (const char *)ip, length))
+			return -1;
+
+		ip += length;
+
+		/* the last sequence has only literals. */
+		if (ip == iend)
+			break;
+
+		/* match. */
+		if (iend - ip < 2)
+			return -1;
+
+		offset = (int)ip[0] | ((int)ip[1] << 8);
+		ip += 2;
+		if (offset == 0)
+			return -1;
+
+		length = (int)(token & 15);
+		if ((length == 15) && !lz4_read_length(&ip, iend, &length))
+			return -1;
+
+		length += 4;
+		if (length > out->rawlen - out->pos)
+			return -1;
+
+		/* the match begin in the dictionary, copy the dictionary part, and the rest is from the begin of output. */
+		if (offset > out->pos) {
+			int back = offset - out->pos;
+			int copy = min(back, length);
+			if (back > dict_size)
+				return -1;
+
+			if (!compressmgr_pieces_write(out, &dict[dict_size - back], copy))
+				return -1;
+
+			length -= copy;
+			if ((length > 0) && !pieces_copy(out, 0, length))
+				return -1;
+		} else if (!pieces_copy(out, out->pos - offset, length)) {
+			return -1;
+		}
+	}
+
+	return out->pos;
+}
+
+static int lz4_uncompress_pieces(void *state, const char *src, int len, struct compress_pieces *out) {
+	return lz4_uncompress_pieces_dict(src, len, out, NULL, 0);
+}
+
+static const struct compress_codec s_lz4_codec = {
+	enum_codec_lz4, 
+	"lz4", 
+	false, 
+	lz4_state_size, 
+	lz4_bound, 
+	lz4_compress, 
+	lz4_uncompress, 
+	lz4_uncompress_pieces, 
+};
+
+/*
+ * the shared dictionary, the compress and uncompress reference it, so the small chunk is compressed well,
+ * and need not the per connection state, only the last 64K is used.
+ */
+#define _COMPRESS_DICT_MAX_SIZE (64 * 1024 - 1)
+
+struct compress_dict {
+	char *data;
+	int size;
+	unsigned int id;		/* hash of the dictionary, it is in each chunk, the peer check it. */
+	LZ4_stream_t *state;	/* the dictionary loaded by LZ4_loadDict, it is read only after set. */
+	size_t work_offset;		/* offset of the lz4 work stream in the per thread work memory. */
+};
+static struct compress_dict s_dict = {NULL, 0, 0, NULL, 0};
+
+static unsigned int compress_dict_hash(const char *data, int size) {
+	unsigned int hash = 2166136261U;
+	int i;
+	for (i = 0; i < size; ++i) {
+		hash ^= (unsigned char)data[i];
+		hash *= 16777619U;
+	}
+	return hash;
+}
+
+/*
+ * set the shared dictionary of dictionary codec, it is copied and indexed,
+ * if data is NULL, release the dictionary. must not be called when any codec is in use.
+ */
+bool compressmgr_set_dict(const void *data, size_t size) {
+	if (s_dict.data) {
+		free(s_dict.data);
+		free(s_dict.state);
+		s_dict.data = NULL;
+		s_dict.state = NULL;
+		s_dict.size = 0;
+		s_dict.id = 0;
+	}
+
+	if (!data || size == 0)
+		return true;
+
+	if (size > _COMPRESS_DICT_MAX_SIZE) {
+		data = (const char *)data + (size - _COMPRESS_DICT_MAX_SIZE);
+		size = _COMPRESS_DICT_MAX_SIZE;
+	}
+
+	s_dict.data = (char *)malloc(size);
+	s_dict.state = (LZ4_stream_t *)malloc(sizeof(LZ4_stream_t));
+	if (!s_dict.data || !s_dict.state) {
+		free(s_dict.data);
+		free(s_dict.state);
+		s_dict.data = NULL;
+		s_dict.state = NULL;
+		return false;
+	}
+
+	memcpy(s_dict.data, data, size);
+	s_dict.size = (int)size;
+	s_dict.id = compress_dict_hash(s_dict.data, s_dict.size);
+	LZ4_loadDict(s_dict.state, s_dict.data, s_dict.size);
+
+	/* the work stream is after the state of other codecs, so they never overwrite it. */
+	s_dict.work_offset = (max(quicklz_state_size(), lz4_state_size()) + 63) & ~(size_t)63;
+	return true;
+}
+
+/*
+ * lz4 block with the shared dictionary, the codec data is | unsigned int dictionary id | lz4 block |.
+ * the per thread work memory is | state of other codecs | lz4 work stream |, the work memory is zeroed
+ * when created, that is an initialized LZ4_stream_t, and only this codec use the work stream,
+ * so it is still valid at next chunk, and is only fast reset.
+ */
+static size_t lz4_dict_state_size() {
+	return s_dict.work_offset + sizeof(LZ4_stream_t);
+}
+
+static int lz4_dict_bound(int len) {
+	return LZ4_compressBound(len) + (int)sizeof(unsigned int);
+}
+
+static int lz4_dict_compress(void *state, const char *src, int len, char *dst, int dstlen) {
+	LZ4_stream_t *work;
+	int res;
+	if (!s_dict.data || (dstlen <= (int)sizeof(unsigned int)))
+		return 0;
+
+	/* attach the prepared dictionary, not copy it, the chunk is only reference the dictionary. */
+	work = (LZ4_stream_t *)((char *)state + s_dict.work_offset);
+	LZ4_resetStream_fast(work);
+	LZ4_attach_dictionary(work, s_dict.state);
+
+	memcpy(dst, &s_dict.id, sizeof(unsigned int));
+	res = LZ4_compress_fast_continue(work, src, &dst[sizeof(unsigned int)], 
+			len, dstlen - (int)sizeof(unsigned int), 1);
+	return (res > 0)? res + (int)sizeof(unsigned int) : 0;
+}
+
+static int lz4_dict_uncompress(void *state, const char *src, int len, char *dst, int dstlen) {
+	unsigned int id;
+	int res;
+	if (!s_dict.data || (len <= (int)sizeof(unsigned int)))
+		return -1;
+
+	memcpy(&id, src, sizeof(unsigned int));
+	if (id != s_dict.id) {
+		log_error("compress dictionary mismatch, id:%u, local id:%u", id, s_dict.id);
+		return -1;
+	}
+
+	res = LZ4_decompress_safe_usingDict(&src[sizeof(unsigned int)], dst, len - (int)sizeof(unsigned int), dstlen, 
+			s_dict.data, s_dict.size);
+	return (res < 0)? -1 : res;
+}
+
+static int lz4_dict_uncompress_pieces(void *state, const char *src, int len, struct compress_pieces *out) {
+	unsigned int id;
+	if (!s_dict.data || (len <= (int)sizeof(unsigned int)))
+		return -1;
+
+	memcpy(&id, src, sizeof(unsigned int));
+	if (id != s_dict.id) {
+		log_error("compress dictionary mismatch, id:%u, local id:%u", id, s_dict.id);
+		return -1;
+	}
+
+	return lz4_uncompress_pieces_dict(&src[sizeof(unsigned int)], len - (int)sizeof(unsigned int), out, 
+			s_dict.data, s_dict.size);
+}
+
+static const struct compress_codec s_lz4_dict_codec = {
+	enum_codec_lz4_dict, 
+	"lz4_dict", 
+	false, 
+	lz4_dict_state_size, 
+	lz4_dict_bound, 
+	lz4_dict_compress, 
+	lz4_dict_uncompress, 
+	lz4_dict_uncompress_pieces, 
+};
+
+/* write the header of stored chunk of len bytes, the data follow it. */
+void compressmgr_store_header(char header[COMPRESS_CHUNK_HEADER_LEN], int len) {
+	int chunk_len = len + (int)COMPRESS_CHUNK_HEADER_LEN;
+	memcpy(header, &chunk_len, sizeof(int));
+	header[sizeof(int)] = (char)enum_codec_none;
+	memcpy(&header[sizeof(int) + sizeof(unsigned char)], &len, sizeof(int));
+}
+
+/* get uncompressed len of the chunk by its header, if the header is invalid, return -1. */
+int compressmgr_chunk_rawlen(const char *data, int len) {
+	int rawlen;
+	if (len < (int)COMPRESS_CHUNK_HEADER_LEN)
+		return -1;
+
+	memcpy(&rawlen, &data[sizeof(int) + sizeof(unsigned char)], sizeof(rawlen));
+	return (rawlen > 0)? rawlen : -1;
+}
+
+/* get codec by id, if not found, or the dictionary codec but not set dictionary, return NULL. */
+const struct compress_codec *compressmgr_get_codec(int id) {
+	switch (id) {
+	case enum_codec_quicklz:
+		return &s_quicklz_codec;
+	case enum_codec_lz4:
+		return &s_lz4_codec;
+	case enum_codec_quicklz_stream:
+		return compressmgr_quicklz_stream_codec();
+	case enum_codec_lz4_dict:
+		return s_dict.data ? &s_lz4_dict_codec : NULL;
+	default:
+		return NULL;
+	}
+}
+
+static size_t compressmgr_max_state_size(bool is_stream) {
+	size_t size = 0;
+	int id;
+	for (id = enum_codec_none + 1; id < enum_codec_max; ++id) {
+		const struct compress_codec *codec = compressmgr_get_codec(id);
+		if (codec && (codec->is_stream == is_stream))
+			size = max(size, codec->state_size());
+	}
+	return size;
+}
+
+/* the per thread work memory size, it is the max state size of codecs that is not stream, it must be zeroed when created. */
+size_t compressmgr_scratch_size() {
+	return compressmgr_max_state_size(false);
+}
+
+/* the per connection state size, it is the max state size of stream codecs. */
+size_t compressmgr_stream_state_size() {
+	return compressmgr_max_state_size(true);
+}
+
+/* max source len, that the compressed chunk (include header) is not more than chunk_maxlen. */
+int compressmgr_source_maxlen(const struct compress_codec *codec, int chunk_maxlen) {
+	int limit = chunk_maxlen - (int)COMPRESS_CHUNK_HEADER_LEN;
+	int len = limit;
+	while ((len > 0) && (codec->bound(len) > limit))
+		len -= codec->bound(len) - limit;
+
+	return max(len, 0);
+}
+
 /*
  * uncompress data.
  * uncompressbuf --- is uncompress buffer.
  * uncompresslen --- is uncompress buffer len.
- * quicklzbuf --- is quicklz lib need buffer.
+ * scratch --- is the per thread work memory, for the codec that is not stream.
+ * stream_state --- is the state of this connection, for the stream codec, can be NULL.
  * data --- is source data.
  * len --- is source data len.
  *
- * return uncompress result data info.
+ * return uncompress result data info, if the codec id is unknown, or is stream codec but no stream_state,
+ * or data is corrupt, or uncompress buffer is too small, return null buf.
+ * the result of stored chunk is in the data, not copy.
  *
- * Attention: Will remove the original header length, and then uncompress, because the header length is the compressed added.
+ * Attention: Will remove the chunk header, and then uncompress, because the header is the compressed added.
  */
-struct buf_info compressmgr_uncompressdata(char *uncompressbuf, int uncompresslen, char *quicklzbuf, char *data, int len) {
-	size_t needsize;
+struct buf_info compressmgr_uncompressdata(char *uncompressbuf, int uncompresslen, void *scratch, void *stream_state, char *data, int len) {
+	const struct compress_codec *codec;
+	int codec_id;
+	int rawlen;
 	struct buf_info resbuf;
-	resbuf.buf= NULL;
+	resbuf.buf = NULL;
 	resbuf.len = 0;
 
-	print_debug("un compress before, msg len:%d\n", *(int *)data);
-
 	assert(data != NULL);
 	assert(len > 0);
-	needsize = qlz_size_decompressed(&data[sizeof(int)]);
-	if (needsize > uncompresslen)
-	{
+	if (len < (int)COMPRESS_CHUNK_HEADER_LEN) {
+		log_error("compress chunk is too short, len:%d", len);
 		return resbuf;
 	}
+
+	codec_id = (unsigned char)data[sizeof(int)];
+	memcpy(&rawlen, &data[sizeof(int) + sizeof(unsigned char)], sizeof(rawlen));
+	print_debug("un compress before, codec:%d, msg len:%d, raw len:%d\n", codec_id, len, rawlen);
+
+	if (codec_id == enum_codec_none) {
+		if ((rawlen <= 0) || (rawlen != len - (int)COMPRESS_CHUNK_HEADER_LEN)) {
+			log_error("stored chunk length error, len:%d, raw len:%d", len, rawlen);
+			return resbuf;
+		}
+
+		resbuf.buf = &data[COMPRESS_CHUNK_HEADER_LEN];
+		resbuf.len = rawlen;
+		return resbuf;
+	}
+
+	codec = compressmgr_get_codec(codec_id);
+	if (!codec) {
+		log_error("unknown compress codec:%d, or the dictionary is not set", codec_id);
+		return resbuf;
+	}
+
+	if (codec->is_stream && !stream_state) {
+		log_error("compress codec mismatch, %s need uncompress in streaming mode", codec->name);
+		return resbuf;
+	}
+
+	if ((rawlen <= 0) || (rawlen > uncompresslen)) {
+		log_error("uncompress buf is too small! codec:%s, uncompress len:%d, buf len:%d", codec->name, rawlen, uncompresslen);
+		return resbuf;
+	}
+
+	if (codec->uncompress(codec->is_stream? stream_state : scratch, &data[COMPRESS_CHUNK_HEADER_LEN], 
+				len - (int)COMPRESS_CHUNK_HEADER_LEN, uncompressbuf, rawlen) != rawlen) {
+		log_error("uncompress failed, the data is corrupt, codec:%s, len:%d", codec->name, len);
+		return resbuf;
+	}
+
 	resbuf.buf = uncompressbuf;
-	resbuf.len = (int)qlz_decompress(&data[sizeof(int)], resbuf.buf, (qlz_state_decompress *)quicklzbuf);
+	resbuf.len = rawlen;
 
 	print_debug("un compress end, msg len:%d\n", resbuf.len);
 	return resbuf;
 }
 
+/*
+ * uncompress data into pieces, the chunk is not need a contiguous buffer of its uncompressed len.
+ * scratch --- is the per thread work memory, for the codec that is not stream.
+ * stream_state --- is the state of this connection, for the stream codec, can be NULL.
+ * data --- is source data.
+ * len --- is source data len.
+ * out --- is the output pieces, its rawlen is the uncompressed len of the chunk header.
+ *
+ * return false if the codec id is unknown, or is stream codec but no stream_state,
+ * or data is corrupt, or get piece failed. the stored chunk is copied to pieces.
+ */
+bool compressmgr_uncompress_pieces(void *scratch, void *stream_state, const char *data, int len, struct compress_pieces *out) {
+	const struct compress_codec *codec;
+	int codec_id;
+	int rawlen;
+
+	assert(data != NULL);
+	assert(len > 0);
+	if (len < (int)COMPRESS_CHUNK_HEADER_LEN) {
+		log_error("compress chunk is too short, len:%d", len);
+		return false;
+	}
+
+	codec_id = (unsigned char)data[sizeof(int)];
+	memcpy(&rawlen, &data[sizeof(int) + sizeof(unsigned char)], sizeof(rawlen));
+	print_debug("un compress pieces before, codec:%d, msg len:%d, raw len:%d\n", codec_id, len, rawlen);
+
+	if ((rawlen <= 0) || (rawlen != out->rawlen) || (out->pos != 0)) {
+		log_error("uncompress pieces length error, len:%d, raw len:%d, pieces len:%d", len, rawlen, out->rawlen);
+		return false;
+	}
+
+	if (codec_id == enum_codec_none) {
+		if (rawlen != len - (int)COMPRESS_CHUNK_HEADER_LEN) {
+			log_error("stored chunk length error, len:%d, raw len:%d", len, rawlen);
+			return false;
+		}
+
+		return compressmgr_pieces_write(out, &data[COMPRESS_CHUNK_HEADER_LEN], rawlen);
+	}
+
+	codec = compressmgr_get_codec(codec_id);
+	if (!codec) {
+		log_error("unknown compress codec:%d, or the dictionary is not set", codec_id);
+		return false;
+	}
+
+	if (codec->is_stream && !stream_state) {
+		log_error("compress codec mismatch, %s need uncompress in streaming mode", codec->name);
+		return false;
+	}
+
+	if ((codec->uncompress_pieces(codec->is_stream? stream_state : scratch, &data[COMPRESS_CHUNK_HEADER_LEN], 
+				len - (int)COMPRESS_CHUNK_HEADER_LEN, out) != rawlen) || (out->pos != rawlen)) {
+		log_error("uncompress pieces failed, the data is corrupt or get piece failed, codec:%s, len:%d, raw len:%d, written len:%d", 
+				codec->name, len, rawlen, out->pos);
+		return false;
+	}
+
+	print_debug("un compress pieces end, msg len:%d, piece num:%d\n", rawlen, out->piece_num);
+	return true;
+}
+
 /*
  * compress data.
+ * codec --- is the compress codec.
+ * state --- is the per connection state if codec is stream, or else is per thread work memory.
  * compressbuf --- is compress buffer.
- * quicklzbuf --- is quicklz lib need buffer.
+ * compresslen --- is compress buffer len.
  * data --- is source data.
  * len --- is source data len.
  *
- * return compress result data info.
+ * return compress result data info, if failed, return null buf.
  *
- * Attention: Will form a compressed data packet, plus the header length.
+ * Attention: Will form a compressed data packet, plus the chunk header.
  */
-struct buf_info compressmgr_do_compressdata(char *compressbuf, char *quicklzbuf, char *data, int len) {
+struct buf_info compressmgr_compressdata(const struct compress_codec *codec, void *state, 
+		char *compressbuf, int compresslen, char *data, int len) {
+	int res;
 	struct buf_info resbuf;
+	resbuf.buf = NULL;
+	resbuf.len = 0;
+
+	assert(codec != NULL);
 	assert(data != NULL);
 	assert(len > 0);
-	print_debug("compress before, msg len:%d\n", len);
+	print_debug("compress before, codec:%s, msg len:%d\n", codec->name, len);
 
-	resbuf.buf = compressbuf;
-	resbuf.len = (int)qlz_compress(data, &resbuf.buf[sizeof(int)], len, (qlz_state_compress *)quicklzbuf);
+	if (compresslen <= (int)COMPRESS_CHUNK_HEADER_LEN)
+		return resbuf;
 
-	resbuf.len += sizeof(int);
-	*(int *)resbuf.buf = resbuf.len;
-	assert(resbuf.len != 0);
+	res = codec->compress(state, data, len, &compressbuf[COMPRESS_CHUNK_HEADER_LEN], 
+			compresslen - (int)COMPRESS_CHUNK_HEADER_LEN);
+	if (res <= 0)
+		return resbuf;
+
+	resbuf.buf = compressbuf;
+	resbuf.len = res + (int)COMPRESS_CHUNK_HEADER_LEN;
+	memcpy(compressbuf, &resbuf.len, sizeof(int));
+	compressbuf[sizeof(int)] = (char)codec->id;
+	memcpy(&compressbuf[sizeof(int) + sizeof(unsigned char)], &len, sizeof(int));
 
-	print_debug("compress end, msg len:%d\n", *(int *)resbuf.buf);
+	print_debug("compress end, msg len:%d\n", resbuf.len);
 	return resbuf;
 }
 
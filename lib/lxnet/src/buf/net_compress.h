@@ -11,34 +11,172 @@
 extern "C" {
 #endif
 
+#include "platform_config.h"
 #include "buf/buf_info.h"
 
+/* compress codec id, same as compress_codec_* of lxnet.h, it is in the header of each compressed chunk. */
+enum enum_compress_codec {
+	enum_codec_none = 0,			/* stored, not compressed. */
+	enum_codec_quicklz = 1,			/* quicklz level 1. */
+	enum_codec_lz4 = 2,				/* lz4 block. */
+	enum_codec_quicklz_stream = 3,	/* quicklz level 1 in streaming mode. */
+	enum_codec_lz4_dict = 4,		/* lz4 block with the shared dictionary. */
+	enum_codec_max,
+};
+
+/*
+ * compressed chunk:
+ * | int chunk len (include this header) | unsigned char codec id | int uncompressed len | codec data |
+ */
+#define COMPRESS_CHUNK_HEADER_LEN (sizeof(int) + sizeof(unsigned char) + sizeof(int))
+
+/* a piece of the output that is uncompressed in pieces, pos is its position in the whole output. */
+struct compress_piece {
+	char *buf;
+	int pos;
+	int len;
+};
+
+/*
+ * the output of a chunk that is uncompressed in pieces, the pieces are one contiguous output logically,
+ * the got piece is not moved or freed until the chunk is done, the codec reference it as the history of the chunk.
+ */
+struct compress_pieces {
+	/* get the next piece of at most len bytes, return its len, if failed, return 0. */
+	int (*next_piece)(void *arg, int len, char **buf);
+	void *arg;
+
+	struct compress_piece *pieces;	/* the got pieces, in the memory of caller. */
+	int piece_max;
+	int piece_num;
+	int rawlen;						/* the whole output len. */
+	int pos;						/* the written len. */
+};
+
+struct compress_codec {
+	unsigned char id;
+	const char *name;
+
+	/*
+	 * if true, the state is of per connection, compress or uncompress reference the history of earlier chunks,
+	 * the state must be zeroed before first use, and the chunks must be uncompressed in the same order.
+	 * or else, the state is only the work memory, which is of per thread.
+	 */
+	bool is_stream;
+
+	/* state size of compress and uncompress, it is the max of both. */
+	size_t (*state_size)();
+
+	/* max compressed len of len bytes. */
+	int (*bound)(int len);
+
+	/* return compressed len, if failed, return 0. */
+	int (*compress)(void *state, const char *src, int len, char *dst, int dstlen);
+
+	/* return uncompressed len, if the data is corrupt or dstlen is not enough, return -1. */
+	int (*uncompress)(void *state, const char *src, int len, char *dst, int dstlen);
+
+	/* uncompress into the pieces of out, return uncompressed len, if the data is corrupt or the pieces is not enough, return -1. */
+	int (*uncompress_pieces)(void *state, const char *src, int len, struct compress_pieces *out);
+};
+
+/* write the header of stored chunk of len bytes, the data follow it. */
+void compressmgr_store_header(char header[COMPRESS_CHUNK_HEADER_LEN], int len);
+
+/* get uncompressed len of the chunk by its header, if the header is invalid, return -1. */
+int compressmgr_chunk_rawlen(const char *data, int len);
+
+/* get codec by id, if not found, or the dictionary codec but not set dictionary, return NULL. */
+const struct compress_codec *compressmgr_get_codec(int id);
+
+/*
+ * set the shared dictionary of dictionary codec, it is copied and indexed,
+ * if data is NULL, release the dictionary. must not be called when any codec is in use.
+ */
+bool compressmgr_set_dict(const void *data, size_t size);
+
+/* the quicklz codec in streaming mode, it is in net_compress_stream.c. */
+const struct compress_codec *compressmgr_quicklz_stream_codec();
+
+/*
+ * set the history window of the streaming codec, it is clamped to (0, NET_COMPRESS_STREAM_BUFFER],
+ * must not be called when the codec is in use.
+ */
+void compressmgr_set_stream_window(size_t window);
+
+/*
+ * init the output of uncompress in pieces, mem is the memory of the piece table, 
+ * the piece num is at most memlen / sizeof(struct compress_piece).
+ */
+void compressmgr_pieces_init(struct compress_pieces *out, int (*next_piece)(void *arg, int len, char **buf), void *arg, 
+		void *mem, int memlen, int rawlen);
+
+/* write len bytes to the pieces, if the pieces is not enough, return false. */
+bool compressmgr_pieces_write(struct compress_pieces *out, const char *data, int len);
+
+/*
+ * uncompress the quicklz (level 1) data without history into pieces, 
+ * work is the work memory of the hash table, at least compressmgr_quicklz_pieces_work_size() bytes.
+ * return uncompressed len, if the data is corrupt or the pieces is not enough, return -1.
+ */
+int compressmgr_quicklz_uncompress_pieces(void *work, const char *src, int len, struct compress_pieces *out);
+
+size_t compressmgr_quicklz_pieces_work_size();
+
+/* the per thread work memory size, it is the max state size of codecs that is not stream, it must be zeroed when created. */
+size_t compressmgr_scratch_size();
+
+/* the per connection state size, it is the max state size of stream codecs. */
+size_t compressmgr_stream_state_size();
+
+/* max source len, that the compressed chunk (include header) is not more than chunk_maxlen. */
+int compressmgr_source_maxlen(const struct compress_codec *codec, int chunk_maxlen);
+
 /*
  * uncompress data.
  * uncompressbuf --- is uncompress buffer.
  * uncompresslen --- is uncompress buffer len.
- * quicklzbuf --- is quicklz lib need buffer.
+ * scratch --- is the per thread work memory, for the codec that is not stream.
+ * stream_state --- is the state of this connection, for the stream codec, can be NULL.
  * data --- is source data.
  * len --- is source data len.
  *
- * return uncompress result data info.
+ * return uncompress result data info, if the codec id is unknown, or is stream codec but no stream_state,
+ * or data is corrupt, or uncompress buffer is too small, return null buf.
+ * the result of stored chunk is in the data, not copy.
+ *
+ * Attention: Will remove the chunk header, and then uncompress, because the header is the compressed added.
+ */
+struct buf_info compressmgr_uncompressdata(char *uncompressbuf, int uncompresslen, void *scratch, void *stream_state, char *data, int len);
+
+/*
+ * uncompress data into pieces, the chunk is not need a contiguous buffer of its uncompressed len.
+ * scratch --- is the per thread work memory, for the codec that is not stream.
+ * stream_state --- is the state of this connection, for the stream codec, can be NULL.
+ * data --- is source data.
+ * len --- is source data len.
+ * out --- is the output pieces, its rawlen is the uncompressed len of the chunk header.
  *
- * Attention: Will remove the original header length, and then uncompress, because the header length is the compressed added.
+ * return false if the codec id is unknown, or is stream codec but no stream_state,
+ * or data is corrupt, or get piece failed. the stored chunk is copied to pieces.
  */
-struct buf_info compressmgr_uncompressdata(char *uncompressbuf, int uncompresslen, char *quicklzbuf, char *data, int len);
+bool compressmgr_uncompress_pieces(void *scratch, void *stream_state, const char *data, int len, struct compress_pieces *out);
 
 /*
  * compress data.
+ * codec --- is the compress codec.
+ * state --- is the per connection state if codec is stream, or else is per thread work memory.
  * compressbuf --- is compress buffer.
- * quicklzbuf --- is quicklz lib need buffer.
+ * compresslen --- is compress buffer len.
  * data --- is source data.
  * len --- is source data len.
  *
- * return compress result data info.
+ * return compress result data info, if failed, return null buf.
  *
- * Attention: Will form a compressed data packet, plus the header length.
+ * Attention: Will form a compressed data packet, plus the chunk header.
  */
-struct buf_info compressmgr_do_compressdata(char *compressbuf, char *quicklzbuf, char *data, int len);
+struct buf_info compressmgr_compressdata(const struct compress_codec *codec, void *state, 
+		char *compressbuf, int compresslen, char *data, int len);
 
 #ifdef __cplusplus
 }
@@ -0,0 +1,140 @@
+
+/*
+ * Copyright (C) lcinx
+ * lcinx@163.com
+ */
+
+/*
+ * quicklz in streaming mode, each chunk reference the history of earlier chunks of the same connection.
+ * this is another build of quicklz.c, its public functions are renamed, so it is linked with the default build.
+ *
+ * NET_COMPRESS_STREAM_BUFFER is the max history size, can be defined on the command line.
+ * the state of each connection is about NET_COMPRESS_STREAM_BUFFER + 68K bytes (64 bit),
+ * the history window is set by compressmgr_set_stream_window, not more than it,
+ * the chunk more than the window is compressed without history.
+ */
+#ifndef NET_COMPRESS_STREAM_BUFFER
+#define NET_COMPRESS_STREAM_BUFFER (64 * 1024)
+#endif
+
+#define QLZ_COMPRESSION_LEVEL 1
+#define QLZ_STREAMING_BUFFER NET_COMPRESS_STREAM_BUFFER
+#define QLZ_MEMORY_SAFE
+
+#define qlz_size_header qlz_stream_size_header
+#define qlz_size_decompressed qlz_stream_size_decompressed
+#define qlz_size_compressed qlz_stream_size_compressed
+#define qlz_compress qlz_stream_compress
+#define qlz_decompress qlz_stream_decompress
+#define qlz_get_setting qlz_stream_get_setting
+
+#include "quicklz.c"
+
+#include <assert.h>
+#include "net_compress.h"
+
+#ifndef max
+#define max(a, b) (((a) > (b))? (a) : (b))
+#endif
+
+/* the history window, both sides must use the same window. */
+static size_t s_stream_window = QLZ_STREAMING_BUFFER;
+
+/* the chunk out of the window restart the history, as qlz_compress/qlz_decompress at the end of the stream buffer. */
+static inline void quicklz_stream_check_window(size_t *stream_counter, size_t len) {
+	if (*stream_counter + len - 1 >= s_stream_window)
+		*stream_counter = QLZ_STREAMING_BUFFER;
+}
+
+static size_t quicklz_stream_state_size() {
+	return max(sizeof(qlz_state_compress), sizeof(qlz_state_decompress));
+}
+
+static int quicklz_stream_bound(int len) {
+	return len + 400;
+}
+
+static int quicklz_stream_compress(void *state, const char *src, int len, char *dst, int dstlen) {
+	if ((len <= 0) || (dstlen < quicklz_stream_bound(len)))
+		return 0;
+
+	quicklz_stream_check_window(&((qlz_state_compress *)state)->stream_counter, (size_t)len);
+	return (int)qlz_compress(src, dst, (size_t)len, (qlz_state_compress *)state);
+}
+
+static int quicklz_stream_uncompress(void *state, const char *src, int len, char *dst, int dstlen) {
+	if ((len < 3) || ((int)qlz_size_header(src) > len) || ((int)qlz_size_compressed(src) != len))
+		return -1;
+
+	if (((int)qlz_size_decompressed(src) > dstlen) || (qlz_size_decompressed(src) == 0))
+		return -1;
+
+	quicklz_stream_check_window(&((qlz_state_decompress *)state)->stream_counter, qlz_size_decompressed(src));
+	return (int)qlz_decompress(src, dst, (qlz_state_decompress *)state);
+}
+
+/*
+ * uncompress into pieces, the chunk in the history is uncompressed into the stream buffer as qlz_decompress,
+ * the stream buffer is the history, so it is copied to the pieces.
+ * the chunk out of the history is uncompressed into the pieces without history, the hash table of the state
+ * is its work memory, and then is cleared, qlz_decompress also restart the history after it.
+ */
+static int quicklz_stream_uncompress_pieces(void *state, const char *src, int len, struct compress_pieces *out) {
+	qlz_state_decompress *st = (qlz_state_decompress *)state;
+	size_t dsiz;
+	int res;
+	if ((len < 3) || ((int)qlz_size_header(src) > len) || ((int)qlz_size_compressed(src) != len))
+		return -1;
+
+	dsiz = qlz_size_decompressed(src);
+	if ((dsiz == 0) || ((int)dsiz != out->rawlen - out->pos))
+		return -1;
+
+	if (((*src & 1) == 0) && ((int)dsiz > len - (int)qlz_size_header(src)))
+		return -1;
+
+	if (st->stream_counter + dsiz - 1 < s_stream_window) {
+		unsigned char *dst = st->stream_buffer + st->stream_counter;
+		if ((*src & 1) == 1) {
+			if (qlz_decompress_core((const unsigned char *)src, dst, dsiz, st, st->stream_buffer) != dsiz)
+				return -1;
+		} else {
+			memcpy(dst, src + qlz_size_header(src), dsiz);
+			reset_table_decompress(st);
+		}
+
+		st->stream_counter += dsiz;
+		return compressmgr_pieces_write(out, (const char *)dst, (int)dsiz)? (int)dsiz : -1;
+	}
+
+	assert(sizeof(st->hash) >= compressmgr_quicklz_pieces_work_size());
+	res = compressmgr_quicklz_uncompress_pieces(st->hash, src, len, out);
+	memset(st->hash, 0, sizeof(st->hash));
+	st->stream_counter = 0;
+	reset_table_decompress(st);
+	return res;
+}
+
+static const struct compress_codec s_quicklz_stream_codec = {
+	enum_codec_quicklz_stream, 
+	"quicklz_stream", 
+	true, 
+	quicklz_stream_state_size, 
+	quicklz_stream_bound, 
+	quicklz_stream_compress, 
+	quicklz_stream_uncompress, 
+	quicklz_stream_uncompress_pieces, 
+};
+
+/*
+ * set the history window of the streaming codec, it is clamped to (0, NET_COMPRESS_STREAM_BUFFER],
+ * must not be called when the codec is in use.
+ */
+void compressmgr_set_stream_window(size_t window) {
+	s_stream_window = ((window > 0) && (window < QLZ_STREAMING_BUFFER))? window : QLZ_STREAMING_BUFFER;
+}
+
+/* the quicklz codec in streaming mode. */
+const struct compress_codec *compressmgr_quicklz_stream_codec() {
+	return &s_quicklz_stream_codec;
+}
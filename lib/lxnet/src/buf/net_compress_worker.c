@@ -0,0 +1,177 @@
+
+/*
+ * Copyright (C) lcinx
+ * lcinx@163.com
+ */
+
+#include <assert.h>
+#include "cthread.h"
+#include "net_compress_worker.h"
+#include "net_thread_buf.h"
+
+/*
+ * the workers of parallel compress, a large send backlog is split into chunks,
+ * the sending thread push the job and resume some workers, then take the tasks as the workers,
+ * and wait for the tasks taken by the workers. the workers suspend when not any job.
+ * each worker use a thread buffer slot of net_thread_buf.c (_MAX_SAFE_THREAD_NUM is shared with
+ * the network threads and the logic threads), so the worker num is limited.
+ */
+#define _MAX_COMPRESS_WORKER_NUM 16
+
+struct compress_worker_mgr {
+	int thread_num;
+	volatile bool need_exit;
+	cspin lock;
+	struct compress_job *job_head;		/* the running jobs, protected by lock. */
+	cthread threads[_MAX_COMPRESS_WORKER_NUM];
+};
+
+static struct compress_worker_mgr s_worker = {0};
+
+static void compressworker_do_job(struct compress_job *job) {
+	void *scratch = threadbuf_get_codec_buf();
+	int index;
+	while ((index = (int)catomic_fetch_add(&job->next, 1)) < job->task_num) {
+		struct compress_task *task = &job->tasks[index];
+		struct buf_info resbuf = compressmgr_compressdata(job->codec, scratch, 
+				task->dst, task->dstlen, task->src, task->srclen);
+
+		task->reslen = resbuf.buf? resbuf.len : 0;
+
+		/* the result is visible to the caller before the done num. */
+		catomic_inc_explicit(&job->done, CATOMIC_RELEASE);
+	}
+}
+
+/* take a job that has task not yet taken, the job is not freed until the helper num is decreased. */
+static struct compress_job *compressworker_take_job() {
+	struct compress_job *job;
+	cspin_lock(&s_worker.lock);
+	for (job = s_worker.job_head; job; job = job->next_job) {
+		if (catomic_read(&job->next) < job->task_num) {
+			catomic_inc(&job->helper);
+			break;
+		}
+	}
+	cspin_unlock(&s_worker.lock);
+	return job;
+}
+
+/* help a job that has task not yet taken, return false if not any. */
+static bool compressworker_help_job() {
+	struct compress_job *job = compressworker_take_job();
+	if (!job)
+		return false;
+
+	compressworker_do_job(job);
+	catomic_dec_explicit(&job->helper, CATOMIC_RELEASE);
+	return true;
+}
+
+/* resume the thread and wait it exit. */
+static void compressworker_release_thread(int thread_num) {
+	int i;
+	s_worker.need_exit = true;
+	for (i = 0; i < thread_num; ++i)
+		cthread_release(&s_worker.threads[i]);
+}
+
+static void compressworker_thread_func(cthread *th) {
+	for (;;) {
+		cthread_suspend(th);
+		if (s_worker.need_exit)
+			break;
+
+		while (compressworker_help_job())
+			;
+	}
+}
+
+/* create thread_num worker threads, if thread_num is 0, not use parallel compress. */
+bool compressworker_init(int thread_num) {
+	int i;
+	if (s_worker.thread_num != 0)
+		return false;
+
+	if (thread_num <= 0)
+		return true;
+
+	if (thread_num > _MAX_COMPRESS_WORKER_NUM)
+		thread_num = _MAX_COMPRESS_WORKER_NUM;
+
+	if (cspin_init(&s_worker.lock) != 0)
+		return false;
+
+	s_worker.need_exit = false;
+	s_worker.job_head = NULL;
+	for (i = 0; i < thread_num; ++i) {
+		if (cthread_create(&s_worker.threads[i], NULL, compressworker_thread_func) != 0) {
+			compressworker_release_thread(i);
+			cspin_destroy(&s_worker.lock);
+			return false;
+		}
+	}
+
+	s_worker.thread_num = thread_num;
+	return true;
+}
+
+void compressworker_release() {
+	if (s_worker.thread_num == 0)
+		return;
+
+	compressworker_release_thread(s_worker.thread_num);
+	assert(s_worker.job_head == NULL);
+	cspin_destroy(&s_worker.lock);
+	s_worker.thread_num = 0;
+}
+
+/* worker thread num, 0 is not use parallel compress. */
+int compressworker_num() {
+	return s_worker.thread_num;
+}
+
+/* compress the tasks of job by the workers and the caller in parallel, return after all tasks done. */
+void compressworker_run(struct compress_job *job) {
+	struct compress_job **pre;
+	int i, resume_num;
+	assert(job->codec != NULL && !job->codec->is_stream);
+	catomic_set(&job->next, 0);
+	catomic_set(&job->done, 0);
+	catomic_set(&job->helper, 0);
+
+	cspin_lock(&s_worker.lock);
+	job->next_job = s_worker.job_head;
+	s_worker.job_head = job;
+	cspin_unlock(&s_worker.lock);
+
+	/* the caller take a task too. */
+	resume_num = job->task_num - 1;
+	if (resume_num > s_worker.thread_num)
+		resume_num = s_worker.thread_num;
+
+	for (i = 0; i < resume_num; ++i)
+		cthread_resume(&s_worker.threads[i]);
+
+	compressworker_do_job(job);
+
+	/*
+	 * wait for the tasks taken by the workers, help the jobs of other sending threads meanwhile,
+	 * so the caller only yield when all tasks are taken, the wait is at most a chunk.
+	 */
+	while (catomic_read_acquire(&job->done) < job->task_num) {
+		if (!compressworker_help_job())
+			cthread_self_sleep(0);
+	}
+
+	cspin_lock(&s_worker.lock);
+	for (pre = &s_worker.job_head; *pre != job; pre = &(*pre)->next_job)
+		assert(*pre != NULL);
+
+	*pre = job->next_job;
+	cspin_unlock(&s_worker.lock);
+
+	/* the worker maybe take it before removed, wait it leave. */
+	while (catomic_read_acquire(&job->helper) != 0)
+		cthread_self_sleep(0);
+}
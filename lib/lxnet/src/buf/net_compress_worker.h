@@ -0,0 +1,53 @@
+
+/*
+ * Copyright (C) lcinx
+ * lcinx@163.com
+ */
+
+#ifndef _H_NET_COMPRESS_WORKER_H_
+#define _H_NET_COMPRESS_WORKER_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "platform_config.h"
+#include "catomic.h"
+#include "net_compress.h"
+
+/* a chunk of parallel compress, the result is a compressed chunk (include header). */
+struct compress_task {
+	char *src;
+	int srclen;
+	char *dst;
+	int dstlen;
+	int reslen;						/* compressed chunk len, 0 is failed. */
+};
+
+/* the tasks are taken by the workers and the caller, the result is in order of tasks. */
+struct compress_job {
+	const struct compress_codec *codec;	/* not stream codec. */
+	struct compress_task *tasks;
+	int task_num;
+
+	catomic next;					/* next task index to take. */
+	catomic done;					/* done task num. */
+	catomic helper;					/* worker num that is doing this job. */
+	struct compress_job *next_job;
+};
+
+/* create thread_num worker threads, if thread_num is 0, not use parallel compress. */
+bool compressworker_init(int thread_num);
+
+void compressworker_release();
+
+/* worker thread num, 0 is not use parallel compress. */
+int compressworker_num();
+
+/* compress the tasks of job by the workers and the caller in parallel, return after all tasks done. */
+void compressworker_run(struct compress_job *job);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
@@ -0,0 +1,534 @@
+
+/*
+ * Copyright (C) lcinx
+ * lcinx@163.com
+ */
+
+#include <string.h>
+#include "platform_config.h"
+#include "net_crypt.h"
+
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+#define _CRYPT_X86
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#define _CRYPT_TARGET(isa)
+#else
+#include <cpuid.h>
+#define _CRYPT_TARGET(isa) __attribute__((target(isa)))
+#endif
+#endif
+
+/* the kernels xor a block of 32 bytes once. */
+#define _CRYPT_BLOCK_LEN 32
+
+/*
+ * xor kernel, len is multiple of _CRYPT_BLOCK_LEN, ext is the key repeated to key_len + _CRYPT_BLOCK_LEN bytes,
+ * so the key of each block is the contiguous ext[phase], phase is moved by _CRYPT_BLOCK_LEN % key_len after a block.
+ * return the phase of next byte.
+ */
+typedef int (*xor_kernel_f)(char *buf, int len, const char *ext, int key_len, int phase);
+
+static int xor_word(char *buf, int len, const char *ext, int key_len, int phase) {
+	int step = _CRYPT_BLOCK_LEN % key_len;
+	int i, j;
+	for (i = 0; i < len; i += _CRYPT_BLOCK_LEN) {
+		for (j = 0; j < _CRYPT_BLOCK_LEN; j += (int)sizeof(uint64)) {
+			uint64 data, key;
+			memcpy(&data, &buf[i + j], sizeof(data));
+			memcpy(&key, &ext[phase + j], sizeof(key));
+			data ^= key;
+			memcpy(&buf[i + j], &data, sizeof(data));
+		}
+
+		phase += step;
+		if (phase >= key_len)
+			phase -= key_len;
+	}
+	return phase;
+}
+
+/*
+ * chacha20 (RFC 8439), the state is 16 words:
+ * | 4 words constant | 8 words key | 1 word block counter | 3 words nonce |
+ * the block counter is not carried into the nonce, the keystream stops before it wraps.
+ */
+#define _CHACHA_BLOCK_LEN 64
+
+#define _CHACHA_ROTL(v, n) (((v) << (n)) | ((v) >> (32 - (n))))
+
+#define _CHACHA_QUARTER_ROUND(a, b, c, d) \
+	a += b; d ^= a; d = _CHACHA_ROTL(d, 16); \
+	c += d; b ^= c; b = _CHACHA_ROTL(b, 12); \
+	a += b; d ^= a; d = _CHACHA_ROTL(d, 8); \
+	c += d; b ^= c; b = _CHACHA_ROTL(b, 7);
+
+/* xor blocks of 64 bytes with the keystream, the block counter of state is increased. */
+typedef void (*chacha_kernel_f)(uint32 state[16], char *buf, int blocks);
+
+static uint32 load32_le(const char *p) {
+	const unsigned char *u = (const unsigned char *)p;
+	return (uint32)u[0] | ((uint32)u[1] << 8) | ((uint32)u[2] << 16) | ((uint32)u[3] << 24);
+}
+
+/* the counter after the last block wraps to 0, but that block is never generated. */
+static void chacha20_add_counter(uint32 state[16], uint32 n) {
+	state[12] += n;
+}
+
+/* generate a block of keystream. */
+static void chacha20_block(uint32 state[16], unsigned char stream[_CHACHA_BLOCK_LEN]) {
+	uint32 x[16];
+	int i;
+	memcpy(x, state, sizeof(x));
+	for (i = 0; i < 10; ++i) {
+		_CHACHA_QUARTER_ROUND(x[0], x[4], x[8], x[12]);
+		_CHACHA_QUARTER_ROUND(x[1], x[5], x[9], x[13]);
+		_CHACHA_QUARTER_ROUND(x[2], x[6], x[10], x[14]);
+		_CHACHA_QUARTER_ROUND(x[3], x[7], x[11], x[15]);
+		_CHACHA_QUARTER_ROUND(x[0], x[5], x[10], x[15]);
+		_CHACHA_QUARTER_ROUND(x[1], x[6], x[11], x[12]);
+		_CHACHA_QUARTER_ROUND(x[2], x[7], x[8], x[13]);
+		_CHACHA_QUARTER_ROUND(x[3], x[4], x[9], x[14]);
+	}
+
+	for (i = 0; i < 16; ++i) {
+		uint32 v = x[i] + state[i];
+		stream[i * 4] = (unsigned char)v;
+		stream[i * 4 + 1] = (unsigned char)(v >> 8);
+		stream[i * 4 + 2] = (unsigned char)(v >> 16);
+		stream[i * 4 + 3] = (unsigned char)(v >> 24);
+	}
+	chacha20_add_counter(state, 1);
+}
+
+static void chacha20_word(uint32 state[16], char *buf, int blocks) {
+	unsigned char stream[_CHACHA_BLOCK_LEN];
+	int i, j;
+	for (i = 0; i < blocks; ++i) {
+		chacha20_block(state, stream);
+		for (j = 0; j < _CHACHA_BLOCK_LEN; j += (int)sizeof(uint64)) {
+			uint64 data, key;
+			memcpy(&data, &buf[j], sizeof(data));
+			memcpy(&key, &stream[j], sizeof(key));
+			data ^= key;
+			memcpy(&buf[j], &data, sizeof(data));
+		}
+		buf += _CHACHA_BLOCK_LEN;
+	}
+}
+
+#ifdef _CRYPT_X86
+_CRYPT_TARGET("sse2")
+static int xor_sse2(char *buf, int len, const char *ext, int key_len, int phase) {
+	int step = _CRYPT_BLOCK_LEN % key_len;
+	int i;
+	for (i = 0; i < len; i += _CRYPT_BLOCK_LEN) {
+		__m128i data0 = _mm_loadu_si128((const __m128i *)&buf[i]);
+		__m128i data1 = _mm_loadu_si128((const __m128i *)&buf[i + 16]);
+		data0 = _mm_xor_si128(data0, _mm_loadu_si128((const __m128i *)&ext[phase]));
+		data1 = _mm_xor_si128(data1, _mm_loadu_si128((const __m128i *)&ext[phase + 16]));
+		_mm_storeu_si128((__m128i *)&buf[i], data0);
+		_mm_storeu_si128((__m128i *)&buf[i + 16], data1);
+
+		phase += step;
+		if (phase >= key_len)
+			phase -= key_len;
+	}
+	return phase;
+}
+
+_CRYPT_TARGET("avx2")
+static int xor_avx2(char *buf, int len, const char *ext, int key_len, int phase) {
+	int step = _CRYPT_BLOCK_LEN % key_len;
+	int i;
+	for (i = 0; i < len; i += _CRYPT_BLOCK_LEN) {
+		__m256i data = _mm256_loadu_si256((const __m256i *)&buf[i]);
+		data = _mm256_xor_si256(data, _mm256_loadu_si256((const __m256i *)&ext[phase]));
+		_mm256_storeu_si256((__m256i *)&buf[i], data);
+
+		phase += step;
+		if (phase >= key_len)
+			phase -= key_len;
+	}
+	return phase;
+}
+
+/*
+ * the simd chacha20 kernels compute 4 (sse2) or 8 (avx2) blocks at once, each vector is a word of all the blocks,
+ * then the vectors are transposed to the blocks. the blocks of the counter wrap are done by chacha20_word.
+ */
+#define _CHACHA_ROUNDS(add, xor, rotl16, rotl12, rotl8, rotl7) \
+	for (i = 0; i < 10; ++i) { \
+		_CHACHA_SIMD_QUARTER_ROUND(add, xor, rotl16, rotl12, rotl8, rotl7, x[0], x[4], x[8], x[12]); \
+		_CHACHA_SIMD_QUARTER_ROUND(add, xor, rotl16, rotl12, rotl8, rotl7, x[1], x[5], x[9], x[13]); \
+		_CHACHA_SIMD_QUARTER_ROUND(add, xor, rotl16, rotl12, rotl8, rotl7, x[2], x[6], x[10], x[14]); \
+		_CHACHA_SIMD_QUARTER_ROUND(add, xor, rotl16, rotl12, rotl8, rotl7, x[3], x[7], x[11], x[15]); \
+		_CHACHA_SIMD_QUARTER_ROUND(add, xor, rotl16, rotl12, rotl8, rotl7, x[0], x[5], x[10], x[15]); \
+		_CHACHA_SIMD_QUARTER_ROUND(add, xor, rotl16, rotl12, rotl8, rotl7, x[1], x[6], x[11], x[12]); \
+		_CHACHA_SIMD_QUARTER_ROUND(add, xor, rotl16, rotl12, rotl8, rotl7, x[2], x[7], x[8], x[13]); \
+		_CHACHA_SIMD_QUARTER_ROUND(add, xor, rotl16, rotl12, rotl8, rotl7, x[3], x[4], x[9], x[14]); \
+	}
+
+#define _CHACHA_SIMD_QUARTER_ROUND(add, xor, rotl16, rotl12, rotl8, rotl7, a, b, c, d) \
+	a = add(a, b); d = rotl16(xor(d, a)); \
+	c = add(c, d); b = rotl12(xor(b, c)); \
+	a = add(a, b); d = rotl8(xor(d, a)); \
+	c = add(c, d); b = rotl7(xor(b, c));
+
+#define _SSE2_ROTL(v, n) _mm_or_si128(_mm_slli_epi32((v), (n)), _mm_srli_epi32((v), 32 - (n)))
+#define _SSE2_ROTL16(v) _SSE2_ROTL(v, 16)
+#define _SSE2_ROTL12(v) _SSE2_ROTL(v, 12)
+#define _SSE2_ROTL8(v) _SSE2_ROTL(v, 8)
+#define _SSE2_ROTL7(v) _SSE2_ROTL(v, 7)
+
+_CRYPT_TARGET("sse2")
+static void chacha20_sse2(uint32 state[16], char *buf, int blocks) {
+	__m128i x[16], origin[16];
+	int i, j;
+
+	/* the counter of the 4 blocks must not wrap. */
+	while ((blocks >= 4) && (state[12] <= 0xffffffffu - 3)) {
+		for (i = 0; i < 16; ++i)
+			origin[i] = _mm_set1_epi32((int)state[i]);
+
+		origin[12] = _mm_add_epi32(origin[12], _mm_set_epi32(3, 2, 1, 0));
+		for (i = 0; i < 16; ++i)
+			x[i] = origin[i];
+
+		_CHACHA_ROUNDS(_mm_add_epi32, _mm_xor_si128, _SSE2_ROTL16, _SSE2_ROTL12, _SSE2_ROTL8, _SSE2_ROTL7);
+
+		/* transpose 4 words of the 4 blocks each time, and xor 16 bytes of each block. */
+		for (j = 0; j < 16; j += 4) {
+			__m128i t0, t1, t2, t3;
+			__m128i w0 = _mm_add_epi32(x[j], origin[j]);
+			__m128i w1 = _mm_add_epi32(x[j + 1], origin[j + 1]);
+			__m128i w2 = _mm_add_epi32(x[j + 2], origin[j + 2]);
+			__m128i w3 = _mm_add_epi32(x[j + 3], origin[j + 3]);
+			t0 = _mm_unpacklo_epi32(w0, w1);
+			t1 = _mm_unpacklo_epi32(w2, w3);
+			t2 = _mm_unpackhi_epi32(w0, w1);
+			t3 = _mm_unpackhi_epi32(w2, w3);
+			w0 = _mm_unpacklo_epi64(t0, t1);
+			w1 = _mm_unpackhi_epi64(t0, t1);
+			w2 = _mm_unpacklo_epi64(t2, t3);
+			w3 = _mm_unpackhi_epi64(t2, t3);
+
+			_mm_storeu_si128((__m128i *)&buf[j * 4], 
+					_mm_xor_si128(w0, _mm_loadu_si128((const __m128i *)&buf[j * 4])));
+			_mm_storeu_si128((__m128i *)&buf[_CHACHA_BLOCK_LEN + j * 4], 
+					_mm_xor_si128(w1, _mm_loadu_si128((const __m128i *)&buf[_CHACHA_BLOCK_LEN + j * 4])));
+			_mm_storeu_si128((__m128i *)&buf[_CHACHA_BLOCK_LEN * 2 + j * 4], 
+					_mm_xor_si128(w2, _mm_loadu_si128((const __m128i *)&buf[_CHACHA_BLOCK_LEN * 2 + j * 4])));
+			_mm_storeu_si128((__m128i *)&buf[_CHACHA_BLOCK_LEN * 3 + j * 4], 
+					_mm_xor_si128(w3, _mm_loadu_si128((const __m128i *)&buf[_CHACHA_BLOCK_LEN * 3 + j * 4])));
+		}
+
+		chacha20_add_counter(state, 4);
+		buf += _CHACHA_BLOCK_LEN * 4;
+		blocks -= 4;
+	}
+
+	chacha20_word(state, buf, blocks);
+}
+
+#define _AVX2_ROTL(v, n) _mm256_or_si256(_mm256_slli_epi32((v), (n)), _mm256_srli_epi32((v), 32 - (n)))
+#define _AVX2_ROTL16(v) _mm256_shuffle_epi8((v), rot16)
+#define _AVX2_ROTL12(v) _AVX2_ROTL(v, 12)
+#define _AVX2_ROTL8(v) _mm256_shuffle_epi8((v), rot8)
+#define _AVX2_ROTL7(v) _AVX2_ROTL(v, 7)
+
+_CRYPT_TARGET("avx2")
+static void chacha20_avx2(uint32 state[16], char *buf, int blocks) {
+	__m256i x[16], origin[16];
+	const __m256i rot16 = _mm256_set_epi8(13, 12, 15, 14, 9, 8, 11, 10, 5, 4, 7, 6, 1, 0, 3, 2, 
+			13, 12, 15, 14, 9, 8, 11, 10, 5, 4, 7, 6, 1, 0, 3, 2);
+	const __m256i rot8 = _mm256_set_epi8(14, 13, 12, 15, 10, 9, 8, 11, 6, 5, 4, 7, 2, 1, 0, 3, 
+			14, 13, 12, 15, 10, 9, 8, 11, 6, 5, 4, 7, 2, 1, 0, 3);
+	int i, j, k;
+
+	/* the counter of the 8 blocks must not wrap. */
+	while ((blocks >= 8) && (state[12] <= 0xffffffffu - 7)) {
+		for (i = 0; i < 16; ++i)
+			origin[i] = _mm256_set1_epi32((int)state[i]);
+
+		origin[12] = _mm256_add_epi32(origin[12], _mm256_set_epi32(7, 6, 5, 4, 3, 2, 1, 0));
+		for (i = 0; i < 16; ++i)
+			x[i] = origin[i];
+
+		_CHACHA_ROUNDS(_mm256_add_epi32, _mm256_xor_si256, _AVX2_ROTL16, _AVX2_ROTL12, _AVX2_ROTL8, _AVX2_ROTL7);
+
+		/*
+		 * transpose 4 words in each 128 bit lane, then the low lane of w[k] is the words of block k,
+		 * the high lane is the words of block k + 4.
+		 */
+		for (j = 0; j < 16; j += 4) {
+			__m256i t0, t1, t2, t3;
+			__m256i w0 = _mm256_add_epi32(x[j], origin[j]);
+			__m256i w1 = _mm256_add_epi32(x[j + 1], origin[j + 1]);
+			__m256i w2 = _mm256_add_epi32(x[j + 2], origin[j + 2]);
+			__m256i w3 = _mm256_add_epi32(x[j + 3], origin[j + 3]);
+			t0 = _mm256_unpacklo_epi32(w0, w1);
+			t1 = _mm256_unpacklo_epi32(w2, w3);
+			t2 = _mm256_unpackhi_epi32(w0, w1);
+			t3 = _mm256_unpackhi_epi32(w2, w3);
+			x[j] = _mm256_unpacklo_epi64(t0, t1);
+			x[j + 1] = _mm256_unpackhi_epi64(t0, t1);
+			x[j + 2] = _mm256_unpacklo_epi64(t2, t3);
+			x[j + 3] = _mm256_unpackhi_epi64(t2, t3);
+		}
+
+		/* join the lanes of words 0-3 and 4-7, 8-11 and 12-15, and xor 32 bytes of each block. */
+		for (k = 0; k < 4; ++k) {
+			char *lo = &buf[_CHACHA_BLOCK_LEN * k];
+			char *hi = &buf[_CHACHA_BLOCK_LEN * (k + 4)];
+			_mm256_storeu_si256((__m256i *)lo, _mm256_xor_si256(_mm256_loadu_si256((const __m256i *)lo), 
+						_mm256_permute2x128_si256(x[k], x[k + 4], 0x20)));
+			_mm256_storeu_si256((__m256i *)&lo[32], _mm256_xor_si256(_mm256_loadu_si256((const __m256i *)&lo[32]), 
+						_mm256_permute2x128_si256(x[k + 8], x[k + 12], 0x20)));
+			_mm256_storeu_si256((__m256i *)hi, _mm256_xor_si256(_mm256_loadu_si256((const __m256i *)hi), 
+						_mm256_permute2x128_si256(x[k], x[k + 4], 0x31)));
+			_mm256_storeu_si256((__m256i *)&hi[32], _mm256_xor_si256(_mm256_loadu_si256((const __m256i *)&hi[32]), 
+						_mm256_permute2x128_si256(x[k + 8], x[k + 12], 0x31)));
+		}
+
+		chacha20_add_counter(state, 8);
+		buf += _CHACHA_BLOCK_LEN * 8;
+		blocks -= 8;
+	}
+
+	chacha20_sse2(state, buf, blocks);
+}
+
+/* cpuid of leaf and subleaf, if the leaf is not supported, return false. */
+static bool crypt_cpuid(unsigned int leaf, unsigned int subleaf, unsigned int regs[4]) {
+#ifdef _MSC_VER
+	int info[4];
+	__cpuid(info, 0);
+	if ((unsigned int)info[0] < leaf)
+		return false;
+
+	__cpuidex(info, (int)leaf, (int)subleaf);
+	regs[0] = (unsigned int)info[0];
+	regs[1] = (unsigned int)info[1];
+	regs[2] = (unsigned int)info[2];
+	regs[3] = (unsigned int)info[3];
+#else
+	if (__get_cpuid_max(0, NULL) < leaf)
+		return false;
+
+	__cpuid_count(leaf, subleaf, regs[0], regs[1], regs[2], regs[3]);
+#endif
+	return true;
+}
+
+/* the register state enabled by os (XCR0). */
+static unsigned int crypt_xgetbv() {
+#ifdef _MSC_VER
+	return (unsigned int)_xgetbv(0);
+#else
+	unsigned int eax, edx;
+	__asm__ __volatile__("xgetbv" : "=a"(eax), "=d"(edx) : "c"(0));
+	return eax;
+#endif
+}
+#endif
+
+static const struct {
+	const char *name;
+	xor_kernel_f xor_func;
+	chacha_kernel_f chacha_func;
+} s_kernels[enum_crypt_kernel_max] = {
+	{"auto", NULL, NULL}, 
+	{"word", xor_word, chacha20_word}, 
+#ifdef _CRYPT_X86
+	{"sse2", xor_sse2, chacha20_sse2}, 
+	{"avx2", xor_avx2, chacha20_avx2}, 
+#else
+	{"sse2", NULL, NULL}, 
+	{"avx2", NULL, NULL}, 
+#endif
+};
+
+/*
+ * the simd chacha20 kernels keep 16 vectors live through the rounds, without optimization (the debug build)
+ * each intrinsic goes through the stack, and they are about half the speed of chacha20_word,
+ * so the auto selection use chacha20_word in that build.
+ */
+#if defined(__OPTIMIZE__) || (defined(_MSC_VER) && !defined(_DEBUG))
+#define _CHACHA_AUTO_SIMD 1
+#else
+#define _CHACHA_AUTO_SIMD 0
+#endif
+
+/*
+ * the kernel in use of xor and chacha20, 0 is not selected yet.
+ * it is selected at first use, the threads select the same one, so not need lock.
+ */
+static int s_kernel = enum_crypt_kernel_auto;
+static int s_chacha_kernel = enum_crypt_kernel_auto;
+
+static int crypt_get_kernel() {
+	int kernel = s_kernel;
+	if (kernel == enum_crypt_kernel_auto)
+		kernel = crypt_set_kernel(enum_crypt_kernel_auto);
+
+	return kernel;
+}
+
+static int crypt_get_chacha_kernel() {
+	int kernel = s_chacha_kernel;
+	if (kernel == enum_crypt_kernel_auto) {
+		crypt_set_kernel(enum_crypt_kernel_auto);
+		kernel = s_chacha_kernel;
+	}
+
+	return kernel;
+}
+
+/* the best kernel supported by cpu and os. */
+static int crypt_detect_kernel() {
+	int kernel = enum_crypt_kernel_word;
+#ifdef _CRYPT_X86
+	unsigned int regs[4];
+	if (!crypt_cpuid(1, 0, regs))
+		return kernel;
+
+	/* edx bit 26 is sse2. */
+	if (regs[3] & (1u << 26))
+		kernel = enum_crypt_kernel_sse2;
+
+	/* ecx bit 27 is osxsave, bit 28 is avx, the os must save the xmm and ymm registers, ebx bit 5 of leaf 7 is avx2. */
+	if ((regs[2] & (1u << 27)) && (regs[2] & (1u << 28)) && ((crypt_xgetbv() & 0x6) == 0x6) && 
+			crypt_cpuid(7, 0, regs) && (regs[1] & (1u << 5)))
+		kernel = enum_crypt_kernel_avx2;
+#endif
+	return kernel;
+}
+
+/*
+ * set the kernel of xor and chacha20, for benchmark and test.
+ * auto is the best supported, the unsupported falls back to the best supported below it, return the kernel in use.
+ */
+int crypt_set_kernel(int kernel) {
+	int best = crypt_detect_kernel();
+	bool is_auto = (kernel <= enum_crypt_kernel_auto);
+	if (is_auto || kernel > best)
+		kernel = best;
+
+	s_chacha_kernel = (is_auto && !_CHACHA_AUTO_SIMD) ? enum_crypt_kernel_word : kernel;
+	s_kernel = kernel;
+	return kernel;
+}
+
+/* get the name of the kernel. */
+const char *crypt_kernel_name(int kernel) {
+	if (kernel < 0 || kernel >= enum_crypt_kernel_max)
+		return "unknown";
+
+	return s_kernels[kernel].name;
+}
+
+/*
+ * xor len bytes of buf with the repeating key, start at key[*idx] (*idx not less than key_len is 0),
+ * *idx is updated to the position of next byte, so the data can be processed in segments.
+ */
+void crypt_xor(char *buf, int len, const char *key, int key_len, int *idx) {
+	char ext[CRYPT_XOR_MAX_KEY_LEN + _CRYPT_BLOCK_LEN];
+	int phase, blocklen, extlen, i;
+	if (!buf || len <= 0 || !key || key_len <= 0 || !idx)
+		return;
+
+	phase = (*idx >= 0 && *idx < key_len) ? *idx : 0;
+	blocklen = len - len % _CRYPT_BLOCK_LEN;
+
+	/* the data less than a block or the long key is xor by byte. */
+	if (blocklen > 0 && key_len <= CRYPT_XOR_MAX_KEY_LEN) {
+		/* expand the key to the block width. */
+		extlen = key_len + _CRYPT_BLOCK_LEN;
+		if (key_len == 1) {
+			memset(ext, key[0], extlen);
+		} else {
+			memcpy(ext, key, key_len);
+			for (i = key_len; i < extlen; ++i)
+				ext[i] = ext[i - key_len];
+		}
+
+		phase = s_kernels[crypt_get_kernel()].xor_func(buf, blocklen, ext, key_len, phase);
+	} else {
+		blocklen = 0;
+	}
+
+	for (i = blocklen; i < len; ++i) {
+		buf[i] ^= key[phase];
+		if (++phase >= key_len)
+			phase = 0;
+	}
+	*idx = phase;
+}
+
+/* init chacha20 with 32 bytes key, 12 bytes nonce and the block counter of first byte. */
+void crypt_chacha20_init(struct crypt_chacha20 *self, const char key[32], const char nonce[12], uint32 counter) {
+	int i;
+	if (!self || !key || !nonce)
+		return;
+
+	/* "expand 32-byte k" */
+	self->state[0] = 0x61707865;
+	self->state[1] = 0x3320646e;
+	self->state[2] = 0x79622d32;
+	self->state[3] = 0x6b206574;
+	for (i = 0; i < 8; ++i)
+		self->state[4 + i] = load32_le(&key[i * 4]);
+
+	self->state[12] = counter;
+	for (i = 0; i < 3; ++i)
+		self->state[13 + i] = load32_le(&nonce[i * 4]);
+
+	self->stream_pos = _CHACHA_BLOCK_LEN;
+	self->block_left = ((uint64)1 << 32) - counter;
+}
+
+/* the keystream bytes left before the block counter wrap. */
+uint64 crypt_chacha20_left(const struct crypt_chacha20 *self) {
+	return (uint64)(_CHACHA_BLOCK_LEN - self->stream_pos) + self->block_left * _CHACHA_BLOCK_LEN;
+}
+
+/*
+ * xor len bytes of buf with the keystream, encrypt and decrypt are the same.
+ * the whole blocks are done by the simd kernel, the rest of the last block is kept for next call.
+ * the keystream must not be reused after the counter wrap (RFC 8439), so fail if it is not enough.
+ */
+bool crypt_chacha20_xor(struct crypt_chacha20 *self, char *buf, int len) {
+	int blocks, i;
+	if (!self || !buf || len <= 0)
+		return false;
+
+	if ((uint64)len > crypt_chacha20_left(self))
+		return false;
+
+	/* the rest of keystream of last call. */
+	while ((self->stream_pos < _CHACHA_BLOCK_LEN) && (len > 0)) {
+		*buf++ ^= (char)self->stream[self->stream_pos++];
+		--len;
+	}
+
+	blocks = len / _CHACHA_BLOCK_LEN;
+	if (blocks > 0) {
+		s_kernels[crypt_get_chacha_kernel()].chacha_func(self->state, buf, blocks);
+		self->block_left -= blocks;
+		buf += blocks * _CHACHA_BLOCK_LEN;
+		len -= blocks * _CHACHA_BLOCK_LEN;
+	}
+
+	if (len > 0) {
+		chacha20_block(self->state, self->stream);
+		--self->block_left;
+		for (i = 0; i < len; ++i)
+			buf[i] ^= (char)self->stream[i];
+
+		self->stream_pos = len;
+	}
+	return true;
+}
@@ -11,8 +11,63 @@
 extern "C" {
 #endif
 
+#include "platform_config.h"
+
 typedef void (*dofunc_f)(void *logicdata, char *buf, int len);
 
+/* the kernel of xor and chacha20, the best supported is selected at runtime by cpuid. */
+enum enum_crypt_kernel {
+	enum_crypt_kernel_auto = 0,
+	enum_crypt_kernel_word,			/* 64 bit word, portable. */
+	enum_crypt_kernel_sse2,			/* x86 sse2. */
+	enum_crypt_kernel_avx2,			/* x86 avx2. */
+	enum_crypt_kernel_max,
+};
+
+/* max key len of the vectorized xor, the longer key is xor by byte. */
+#define CRYPT_XOR_MAX_KEY_LEN 64
+
+/*
+ * xor len bytes of buf with the repeating key, start at key[*idx] (*idx not less than key_len is 0),
+ * *idx is updated to the position of next byte, so the data can be processed in segments.
+ */
+void crypt_xor(char *buf, int len, const char *key, int key_len, int *idx);
+
+/*
+ * set the kernel of xor and chacha20, for benchmark and test.
+ * auto is the best supported, the unsupported falls back to the best supported below it, return the kernel in use.
+ * auto of chacha20 is the word kernel if the lib is built without optimization.
+ */
+int crypt_set_kernel(int kernel);
+
+/* get the name of the kernel. */
+const char *crypt_kernel_name(int kernel);
+
+/*
+ * chacha20 stream cipher (RFC 8439), each direction of connection has its own state (nonce).
+ * the 32 bit block counter must not wrap, so the keystream of a key and nonce is at most 256G bytes,
+ * then the connection must be rekeyed.
+ */
+struct crypt_chacha20 {
+	uint32 state[16];				/* constant, key, block counter, nonce. */
+	unsigned char stream[64];		/* keystream of the block partly used. */
+	int stream_pos;					/* used bytes of stream, 64 is none left. */
+	uint64 block_left;				/* blocks not yet generated before the counter wrap. */
+};
+
+/* init chacha20 with 32 bytes key, 12 bytes nonce and the block counter of first byte. */
+void crypt_chacha20_init(struct crypt_chacha20 *self, const char key[32], const char nonce[12], uint32 counter);
+
+/* the keystream bytes left before the block counter wrap. */
+uint64 crypt_chacha20_left(const struct crypt_chacha20 *self);
+
+/*
+ * xor len bytes of buf with the keystream, encrypt and decrypt are the same,
+ * the data can be processed in segments of any length.
+ * if the keystream left is less than len, buf is not changed and return false, the connection must be rekeyed.
+ */
+bool crypt_chacha20_xor(struct crypt_chacha20 *self, char *buf, int len);
+
 #ifdef __cplusplus
 }
 #endif
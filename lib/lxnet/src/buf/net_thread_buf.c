@@ -9,17 +9,8 @@
 #include "catomic.h"
 #include "cthread.h"
 #include "net_thread_buf.h"
-#include "quicklz.h"
 #include "log.h"
 
-#if QLZ_STREAMING_BUFFER != 0 || QLZ_COMPRESSION_LEVEL != 1
-	#error define QLZ_STREAMING_BUFFER to the zero value and define QLZ_COMPRESSION_LEVEL to the 1 for this lib
-#endif
-
-#ifndef max
-#define max(a, b) (((a) > (b))? (a) : (b))
-#endif
-
 /* max thread num. */
 #define _MAX_SAFE_THREAD_NUM 64
 
@@ -32,14 +23,14 @@ struct threadinfo {
 	bool is_init;
 	size_t msg_maxsize;
 	size_t compress_maxsize;
-	size_t quicklz_size;
+	size_t codec_size;
 
 	struct thread_localuse msgbuf[_MAX_SAFE_THREAD_NUM];		/* for getmsg temp buf */
 	struct thread_localuse compressbuf[_MAX_SAFE_THREAD_NUM];	/* compress/uncompress. */
-	struct thread_localuse quicklzbuf[_MAX_SAFE_THREAD_NUM];	/* for quicklz lib buffer. */
+	struct thread_localuse codecbuf[_MAX_SAFE_THREAD_NUM];		/* for compress codec work memory. */
 	catomic msgbuf_freeindex;
 	catomic compressbuf_freeindex;
-	catomic quicklzbuf_freeindex;
+	catomic codecbuf_freeindex;
 };
 
 static struct threadinfo s_threadlock = {false};
@@ -64,8 +55,8 @@ static void *threadlocal_getbuf(struct thread_localuse self[_MAX_SAFE_THREAD_NUM
 		exit(1);
 	}
 
-	/* if index can use, then create new thread buffer. */
-	self[index].buf = (char *)malloc(need_size);
+	/* if index can use, then create new thread buffer, it is zeroed, the compress codec work memory need it. */
+	self[index].buf = (char *)calloc(1, need_size);
 	if (!self[index].buf) {
 		log_error("if (!self[index])");
 		exit(1);
@@ -101,14 +92,14 @@ struct buf_info threadbuf_get_compress_buf() {
 	return tempbuf;
 }
 
-/* get quicklz compress lib buf. */
-void *threadbuf_get_quicklz_buf() {
+/* get compress codec work memory. */
+void *threadbuf_get_codec_buf() {
 	if (!s_threadlock.is_init) {
 		log_error("if (!s_threadlock.is_init)");
 		exit(1);
 	}
 
-	return threadlocal_getbuf(s_threadlock.quicklzbuf, s_threadlock.quicklz_size, &s_threadlock.quicklzbuf_freeindex);
+	return threadlocal_getbuf(s_threadlock.codecbuf, s_threadlock.codec_size, &s_threadlock.codecbuf_freeindex);
 }
 
 
@@ -136,24 +127,25 @@ static void threadlocal_release(struct thread_localuse self[_MAX_SAFE_THREAD_NUM
  *
  * msg_maxsize --- max packet size.
  * compress_maxsize --- max compress/uncompress buffer size.
+ * codec_size --- compress codec work memory size.
  */
-bool threadbuf_init(size_t msg_maxsize, size_t compress_maxsize) {
+bool threadbuf_init(size_t msg_maxsize, size_t compress_maxsize, size_t codec_size) {
 	if (s_threadlock.is_init)
 		return false;
 
-	if ((msg_maxsize == 0) || (compress_maxsize == 0))
+	if ((msg_maxsize == 0) || (compress_maxsize == 0) || (codec_size == 0))
 		return false;
 
 	s_threadlock.msg_maxsize = msg_maxsize;
 	s_threadlock.compress_maxsize = compress_maxsize;
-	s_threadlock.quicklz_size = max(sizeof(qlz_state_compress), sizeof(qlz_state_decompress));
+	s_threadlock.codec_size = codec_size;
 	threadlocal_init(s_threadlock.msgbuf);
 	threadlocal_init(s_threadlock.compressbuf);
-	threadlocal_init(s_threadlock.quicklzbuf);
+	threadlocal_init(s_threadlock.codecbuf);
 
 	catomic_set(&s_threadlock.msgbuf_freeindex, 0);
 	catomic_set(&s_threadlock.compressbuf_freeindex, 0);
-	catomic_set(&s_threadlock.quicklzbuf_freeindex, 0);
+	catomic_set(&s_threadlock.codecbuf_freeindex, 0);
 	s_threadlock.is_init = true;
 	return true;
 }
@@ -166,6 +158,6 @@ void threadbuf_release() {
 	s_threadlock.is_init = false;
 	threadlocal_release(s_threadlock.msgbuf);
 	threadlocal_release(s_threadlock.compressbuf);
-	threadlocal_release(s_threadlock.quicklzbuf);
+	threadlocal_release(s_threadlock.codecbuf);
 }
 
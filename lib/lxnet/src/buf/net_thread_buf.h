@@ -20,16 +20,17 @@ struct buf_info threadbuf_get_msg_buf();
 /* get temp compress/uncompress buf. */
 struct buf_info threadbuf_get_compress_buf();
 
-/* get quicklz compress lib buf. */
-void *threadbuf_get_quicklz_buf();
+/* get compress codec work memory. */
+void *threadbuf_get_codec_buf();
 
 /*
  * Initialize thread private buffer set, for getmsg and compress, uncompress etc temp buf.
  *
  * msg_maxsize --- max packet size.
  * compress_maxsize --- max compress/uncompress buffer size.
+ * codec_size --- compress codec work memory size.
  */
-bool threadbuf_init(size_t msg_maxsize, size_t compress_maxsize);
+bool threadbuf_init(size_t msg_maxsize, size_t compress_maxsize, size_t codec_size);
 
 /* release thread private buffer set. */
 void threadbuf_release();
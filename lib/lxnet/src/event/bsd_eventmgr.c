@@ -160,6 +160,18 @@ void eventmgr_remove_socket_send_event(struct socketer *self) {
 	debuglog("remove send event from eventmgr.");
 }
 
+/*
+ * post the job to run once on a network thread, can be called on any thread.
+ * the job is not posted again before it begin run, the jobs maybe run in parallel on different threads.
+ */
+void eventmgr_post_job(struct eventmgr_job *job) {
+	struct kevent ev;
+	if (eventmgr_push_job(job)) {
+		EV_SET(&ev, 0, EVFILT_USER, 0, NOTE_TRIGGER, 0, s_mgr);
+		kevent(s_mgr->kqueue_fd, &ev, 1, NULL, 0, NULL);
+	}
+}
+
 static struct kevent *pop_event(struct kqueuemgr *self) {
 	int index = (int)catomic_dec(&self->event_num);
 	if (index < 0)
@@ -180,6 +192,13 @@ static int task_func(void *argv) {
 		if (!ev)
 			return 0;
 		assert(ev->udata != NULL);
+
+		/* posted job event, it is EV_CLEAR, the job posted after it trigger again. */
+		if (ev->filter == EVFILT_USER) {
+			eventmgr_run_jobs();
+			continue;
+		}
+
 		sock = (struct socketer *)ev->udata;
 
 		/* error event. */
@@ -268,6 +287,19 @@ bool eventmgr_init(int socketer_num, int thread_num) {
 		return false;
 	}
 
+	/* the posted job wake the thread by user event. */
+	{
+		struct kevent ev;
+		EV_SET(&ev, 0, EVFILT_USER, EV_ADD | EV_CLEAR, 0, 0, s_mgr);
+		if (kevent(s_mgr->kqueue_fd, &ev, 1, NULL, 0, NULL) == -1) {
+			close(s_mgr->kqueue_fd);
+			free(s_mgr);
+			s_mgr = NULL;
+			return false;
+		}
+	}
+
+	cspin_init(&s_job_queue.lock);
 	s_mgr->thread_num = thread_num;
 	s_mgr->need_exit = false;
 
@@ -295,6 +327,9 @@ void eventmgr_release() {
 	/* release thread pool. */
 	cthread_pool_release(s_mgr->thread_pool);
 
+	/* run the jobs not run by the threads, they release the resource of it. */
+	eventmgr_run_jobs();
+
 	/* close kqueue some. */
 	close(s_mgr->kqueue_fd);
 	free(s_mgr);
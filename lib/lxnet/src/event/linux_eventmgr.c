@@ -8,6 +8,7 @@
 #include <stdlib.h>
 #include <string.h>
 #include <sys/epoll.h>
+#include <sys/eventfd.h>
 #include <signal.h>
 #include <unistd.h>
 #include "socket_internal.h"
@@ -32,6 +33,7 @@ struct epollmgr {
 
 	catomic event_num;								/* current event number. */
 	int epoll_fd;									/* epoll handle. */
+	int job_fd;										/* eventfd for wake thread to run posted job. */
 	struct epoll_event ev_array[THREAD_EVENT_SIZE];	/* event array. */
 };
 
@@ -80,12 +82,12 @@ void eventmgr_setup_socket_recv_event(struct socketer *self) {
 				self->sockfd, (int)catomic_read(&self->ref), cthread_self_id());
 	}
 
-	ev.events = (uint32)catomic_or_fetch(&self->events, EPOLLIN);
+	ev.events = (uint32)(catomic_fetch_or_explicit(&self->events, EPOLLIN, CATOMIC_RELAXED) | EPOLLIN);
 	ev.data.ptr = self;
 	if (epoll_ctl(s_mgr->epoll_fd, EPOLL_CTL_MOD, self->sockfd, &ev) == -1) {
 		/*log_error("epoll, setup recv event to epoll set on fd %d error!, errno:%d", self->sockfd, NET_GetLastError());*/
 		socketer_close(self);
-		if (catomic_dec(&self->ref) < 1) {
+		if (catomic_dec_explicit(&self->ref, CATOMIC_ACQ_REL) < 1) {
 			log_error("%x socket recvlock:%d, sendlock:%d, fd:%d, ref:%d, thread_id:%d, connect:%d, deleted:%d", 
 					self, (int)catomic_read(&self->recvlock), (int)catomic_read(&self->sendlock), self->sockfd, 
 					(int)catomic_read(&self->ref), cthread_self_id(), self->connected, self->deleted);
@@ -107,7 +109,7 @@ void eventmgr_remove_socket_recv_event(struct socketer *self) {
 				self->sockfd, (int)catomic_read(&self->ref), cthread_self_id());
 	}
 
-	ev.events = (uint32)catomic_and_fetch(&self->events, ~(EPOLLIN));
+	ev.events = (uint32)(catomic_fetch_and_explicit(&self->events, ~(EPOLLIN), CATOMIC_RELAXED) & ~(EPOLLIN));
 	ev.data.ptr = self;
 	if (epoll_ctl(s_mgr->epoll_fd, EPOLL_CTL_MOD, self->sockfd, &ev) == -1) {
 		/*log_error("epoll, remove recv event from epoll set on fd %d error!, errno:%d", self->sockfd, NET_GetLastError());*/
@@ -128,12 +130,12 @@ void eventmgr_setup_socket_send_event(struct socketer *self) {
 				self->sockfd, (int)catomic_read(&self->ref), cthread_self_id());
 	}
 
-	ev.events = (uint32)catomic_or_fetch(&self->events, EPOLLOUT);
+	ev.events = (uint32)(catomic_fetch_or_explicit(&self->events, EPOLLOUT, CATOMIC_RELAXED) | EPOLLOUT);
 	ev.data.ptr = self;
 	if (epoll_ctl(s_mgr->epoll_fd, EPOLL_CTL_MOD, self->sockfd, &ev) == -1) {
 		/*log_error("epoll, setup send event to epoll set on fd %d error!, errno:%d", self->sockfd, NET_GetLastError());*/
 		socketer_close(self);
-		if (catomic_dec(&self->ref) < 1) {
+		if (catomic_dec_explicit(&self->ref, CATOMIC_ACQ_REL) < 1) {
 			log_error("%x socket recvlock:%d, sendlock:%d, fd:%d, ref:%d, thread_id:%d, connect:%d, deleted:%d", 
 					self, (int)catomic_read(&self->recvlock), (int)catomic_read(&self->sendlock), self->sockfd, 
 					(int)catomic_read(&self->ref), cthread_self_id(), self->connected, self->deleted);
@@ -154,7 +156,7 @@ void eventmgr_remove_socket_send_event(struct socketer *self) {
 				self->sockfd, (int)catomic_read(&self->ref), cthread_self_id());
 	}
 
-	ev.events = (uint32)catomic_and_fetch(&self->events, ~(EPOLLOUT));
+	ev.events = (uint32)(catomic_fetch_and_explicit(&self->events, ~(EPOLLOUT), CATOMIC_RELAXED) & ~(EPOLLOUT));
 	ev.data.ptr = self;
 	if (epoll_ctl(s_mgr->epoll_fd, EPOLL_CTL_MOD, self->sockfd, &ev) == -1) {
 		/*log_error("epoll, remove send event from epoll set on fd %d error!, errno:%d", self->sockfd, NET_GetLastError());*/
@@ -163,8 +165,22 @@ void eventmgr_remove_socket_send_event(struct socketer *self) {
 	debuglog("remove send event from eventmgr.");
 }
 
+/*
+ * post the job to run once on a network thread, can be called on any thread.
+ * the job is not posted again before it begin run, the jobs maybe run in parallel on different threads.
+ */
+void eventmgr_post_job(struct eventmgr_job *job) {
+	uint64_t one = 1;
+	if (eventmgr_push_job(job)) {
+		if (write(s_mgr->job_fd, &one, sizeof(one)) != (ssize_t)sizeof(one)) {
+			/* the counter is not 0, the thread is waked already. */
+		}
+	}
+}
+
+/* the leader publish the event array by release store event_num, the task thread acquire it. */
 static struct epoll_event *pop_event(struct epollmgr *self) {
-	int index = (int)catomic_dec(&self->event_num);
+	int index = (int)catomic_dec_explicit(&self->event_num, CATOMIC_ACQUIRE);
 	if (index < 0)
 		return NULL;
 	else
@@ -183,6 +199,15 @@ static int task_func(void *argv) {
 		if (!ev)
 			return 0;
 		assert(ev->data.ptr != NULL);
+
+		/* posted job event, reset the eventfd before take the jobs, the job posted after it wake again. */
+		if (ev->data.ptr == mgr) {
+			uint64_t num;
+			if (read(mgr->job_fd, &num, sizeof(num)) == (ssize_t)sizeof(num))
+				eventmgr_run_jobs();
+			continue;
+		}
+
 		sock = (struct socketer *)ev->data.ptr;
 
 		/* error event. */
@@ -193,16 +218,16 @@ static int task_func(void *argv) {
 
 		/* can read event. */
 		if (ev->events & EPOLLIN) {
-			if (catomic_compare_set(&sock->recvlock, 0, 1)) {
-				catomic_inc(&sock->ref);
+			if (catomic_compare_set_explicit(&sock->recvlock, 0, 1, CATOMIC_ACQUIRE)) {
+				catomic_inc_explicit(&sock->ref, CATOMIC_RELAXED);
 			}
 			socketer_on_recv(sock, 0);
 		}
 
 		/* can write event. */
 		if (ev->events & EPOLLOUT) {
-			if (catomic_compare_set(&sock->sendlock, 0, 1)) {
-				catomic_inc(&sock->ref);
+			if (catomic_compare_set_explicit(&sock->sendlock, 0, 1, CATOMIC_ACQUIRE)) {
+				catomic_inc_explicit(&sock->ref, CATOMIC_RELAXED);
 			}
 			socketer_on_send(sock, 0);
 		}
@@ -220,7 +245,7 @@ static int leader_func(void *argv) {
 	} else {
 		int num = epoll_wait(mgr->epoll_fd, mgr->ev_array, THREAD_EVENT_SIZE, 50);
 		if (num > 0) {
-			catomic_set(&mgr->event_num, num);
+			catomic_store_explicit(&mgr->event_num, num, CATOMIC_RELEASE);
 			num = (num + (int)(EVERY_THREAD_PROCESS_EVENT_NUM) - 1) / (int)(EVERY_THREAD_PROCESS_EVENT_NUM);
 		} else if (num < 0) {
 			if (num == -1 && NET_GetLastError() == EINTR)
@@ -267,12 +292,37 @@ bool eventmgr_init(int socketer_num, int thread_num) {
 		return false;
 	}
 
+	/* the posted job wake a thread by eventfd. */
+	s_mgr->job_fd = eventfd(0, EFD_NONBLOCK);
+	if (s_mgr->job_fd == -1) {
+		close(s_mgr->epoll_fd);
+		free(s_mgr);
+		s_mgr = NULL;
+		return false;
+	}
+
+	{
+		struct epoll_event ev;
+		memset(&ev, 0, sizeof(ev));
+		ev.events = EPOLLIN;
+		ev.data.ptr = s_mgr;
+		if (epoll_ctl(s_mgr->epoll_fd, EPOLL_CTL_ADD, s_mgr->job_fd, &ev) == -1) {
+			close(s_mgr->job_fd);
+			close(s_mgr->epoll_fd);
+			free(s_mgr);
+			s_mgr = NULL;
+			return false;
+		}
+	}
+
+	cspin_init(&s_job_queue.lock);
 	s_mgr->thread_num = thread_num;
 	s_mgr->need_exit = false;
 
 	/* first building epoll module, and then create thread pool. */
 	s_mgr->thread_pool = cthread_pool_create(thread_num, s_mgr, leader_func, task_func);
 	if (!s_mgr->thread_pool) {
+		close(s_mgr->job_fd);
 		close(s_mgr->epoll_fd);
 		free(s_mgr);
 		s_mgr = NULL;
@@ -294,7 +344,11 @@ void eventmgr_release() {
 	/* release thread pool. */
 	cthread_pool_release(s_mgr->thread_pool);
 
+	/* run the jobs not run by the threads, they release the resource of it. */
+	eventmgr_run_jobs();
+
 	/* close epoll some. */
+	close(s_mgr->job_fd);
 	close(s_mgr->epoll_fd);
 	free(s_mgr);
 	s_mgr = NULL;
@@ -5,6 +5,46 @@
  */
 
 #include "net_eventmgr.h"
+#include "cthread.h"
+
+/* the posted jobs, the event manager wake a network thread to run them. */
+struct eventmgr_job_queue {
+	cspin lock;
+	struct eventmgr_job *head;
+	struct eventmgr_job *tail;
+};
+
+static struct eventmgr_job_queue s_job_queue = {{0}, NULL, NULL};
+
+/* push the job, return true if the queue is empty before, then need wake a network thread. */
+static bool eventmgr_push_job(struct eventmgr_job *job) {
+	bool wake;
+	job->next = NULL;
+	cspin_lock(&s_job_queue.lock);
+	wake = (s_job_queue.head == NULL);
+	if (s_job_queue.tail)
+		s_job_queue.tail->next = job;
+	else
+		s_job_queue.head = job;
+	s_job_queue.tail = job;
+	cspin_unlock(&s_job_queue.lock);
+	return wake;
+}
+
+/* take all the posted jobs and run them in order. */
+static void eventmgr_run_jobs() {
+	struct eventmgr_job *job, *next;
+	cspin_lock(&s_job_queue.lock);
+	job = s_job_queue.head;
+	s_job_queue.head = NULL;
+	s_job_queue.tail = NULL;
+	cspin_unlock(&s_job_queue.lock);
+
+	for (; job; job = next) {
+		next = job->next;
+		job->func(job);
+	}
+}
 
 #if defined(_WIN32)
 	#include "win_eventmgr.c"
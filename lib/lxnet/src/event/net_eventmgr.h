@@ -39,6 +39,18 @@ void eventmgr_remove_socket_send_event(struct socketer *self);
 /* set send data. */
 void eventmgr_setup_socket_send_data_event(struct socketer *self, char *data, int len);
 
+/* the job run on network thread, it is posted by eventmgr_post_job. */
+struct eventmgr_job {
+	void (*func)(struct eventmgr_job *job);
+	struct eventmgr_job *next;
+};
+
+/*
+ * post the job to run once on a network thread, can be called on any thread.
+ * the job is not posted again before it begin run, the jobs maybe run in parallel on different threads.
+ */
+void eventmgr_post_job(struct eventmgr_job *job);
+
 /*
  * initialize event manager.
  * socketer_num --- socket total number. must greater than 1.
@@ -25,7 +25,7 @@ bool net_module_init(size_t big_buf_size, size_t big_buf_num,
 					size_t small_buf_size, size_t small_buf_num, 
 					size_t listener_num, size_t socketer_num, int thread_num) {
 
-	if ((!bufmgr_init(big_buf_num, big_buf_size, small_buf_num, small_buf_size, socketer_num)) ||
+	if ((!bufmgr_init(big_buf_num, big_buf_size, small_buf_num, small_buf_size)) ||
 		(!eventmgr_init(socketer_num, thread_num)) || (!socketmgr_init()) ||
 		(!netpool_init(socketer_num, socketer_get_size(), listener_num, listener_get_size()))) {
 		net_module_release();
@@ -47,13 +47,25 @@ void net_module_run() {
 	socketmgr_run();
 }
 
-/* get network memory info. */
+/*
+ * trim network pool, call it periodically.
+ * free_seconds --- advise the node pool that free more than this seconds back to system.
+ * return reclaimed bytes.
+ */
+size_t net_module_trim(int free_seconds) {
+	return bufmgr_trim(free_seconds) + netpool_trim(free_seconds);
+}
+
+/*
+ * get network memory info.
+ * fill at most num entries, return the filled num, if array is NULL, return the num of entries it has.
+ */
 size_t net_module_get_memory_info(struct poolmgr_info *array, size_t num) {
-	size_t index = 0;
-	if (!array || num < 1)
-		return 0;
+	size_t index;
+	if (!array)
+		return bufmgr_get_memory_info(NULL, 0) + netpool_get_memory_info(NULL, 0);
 
-	index = bufmgr_get_memory_info(&array[index], num - index);
+	index = bufmgr_get_memory_info(array, num);
 	return index + netpool_get_memory_info(&array[index], num - index);
 }
 
@@ -36,10 +36,20 @@ void net_module_release();
 /* network run. */
 void net_module_run();
 
+/*
+ * trim network pool, call it periodically.
+ * free_seconds --- advise the node pool that free more than this seconds back to system.
+ * return reclaimed bytes.
+ */
+size_t net_module_trim(int free_seconds);
+
 
 struct poolmgr_info;
 
-/* get network memory info. */
+/*
+ * get network memory info.
+ * fill at most num entries, return the filled num, if array is NULL, return the num of entries it has.
+ */
 size_t net_module_get_memory_info(struct poolmgr_info *array, size_t num);
 
 #ifdef __cplusplus
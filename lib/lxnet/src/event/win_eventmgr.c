@@ -24,6 +24,7 @@ enum e_socket_ioevent {
 	e_socket_io_event_read_complete = 0,	/* read operate. */
 	e_socket_io_event_write_end,			/* write operate. */
 	e_socket_io_thread_shutdown,			/* stop iocp. */
+	e_socket_io_run_job,					/* run posted job. */
 };
 
 struct iocpmgr {
@@ -31,10 +32,20 @@ struct iocpmgr {
 	bool is_run;
 	int thread_num;
 	HANDLE completeport;
+	struct overlappedstruct job_event;		/* posted job event. */
 };
 
 static struct iocpmgr s_iocp = {false};
 
+/*
+ * post the job to run once on a network thread, can be called on any thread.
+ * the job is not posted again before it begin run, the jobs maybe run in parallel on different threads.
+ */
+void eventmgr_post_job(struct eventmgr_job *job) {
+	if (eventmgr_push_job(job))
+		PostQueuedCompletionStatus(s_iocp.completeport, 0, (ULONG_PTR)&s_iocp, &s_iocp.job_event.m_overlap);
+}
+
 /* add socket to event manager. */
 void eventmgr_add_socket(struct socketer *self) {
 	/* socket object point into iocp. */
@@ -194,6 +205,10 @@ static void _iocp_thread_run(void *data) {
 					socketer_on_send(sser, (int)len);
 				}
 				break;
+			case e_socket_io_run_job: {
+					eventmgr_run_jobs();
+				}
+				break;
 			case e_socket_io_thread_shutdown: {
 					Sleep(100);
 					free((void *)s);
@@ -232,6 +247,10 @@ bool eventmgr_init(int socketer_num, int thread_num) {
 	if (!s_iocp.completeport)
 		return false;
 
+	memset(&s_iocp.job_event, 0, sizeof(s_iocp.job_event));
+	s_iocp.job_event.m_event = e_socket_io_run_job;
+	cspin_init(&s_job_queue.lock);
+
 	s_iocp.is_init = true;
 	s_iocp.is_run = true;
 
@@ -271,6 +290,9 @@ void eventmgr_release() {
 	s_iocp.is_init = false;
 
 	Sleep(500);
+
+	/* run the jobs not run by the threads, they release the resource of it. */
+	eventmgr_run_jobs();
 	CloseHandle(s_iocp.completeport);
 	WSACleanup();
 }
@@ -14,6 +14,7 @@
 #include "net_pool.h"
 #include "net_buf.h"
 #include "net_eventmgr.h"
+#include "buf/block.h"
 #include "log.h"
 
 #ifdef _DEBUG_NETWORK
@@ -45,6 +46,28 @@ struct socketmgr {
 
 static struct socketmgr s_mgr = {false};
 
+/* if buffer is empty more than this time(ms), then release its block, if 0, then not release. */
+static int64 s_idle_buf_release_time = 0;
+
+/* the user data size of each socketer object. */
+static size_t s_udata_size = 0;
+
+/*
+ * the socketer object is allocated from pool together with its bufs and user data:
+ * | struct socketer | recv buf | send buf | user data |
+ * each part begin at cache line, so the recv buf and send buf not share cache line.
+ */
+#define SOCKETER_PART_SIZE(size)	\
+	(((size) + (SOCKETER_CACHE_LINE_SIZE - 1)) & ~((size_t)SOCKETER_CACHE_LINE_SIZE - 1))
+
+static inline void *socketer_recvbuf_mem(struct socketer *self) {
+	return (char *)self + SOCKETER_PART_SIZE(sizeof(struct socketer));
+}
+
+static inline void *socketer_sendbuf_mem(struct socketer *self) {
+	return (char *)socketer_recvbuf_mem(self) + SOCKETER_PART_SIZE(buf_get_size());
+}
+
 /* add to delay close list. */
 static void socketmgr_add_to_wait(struct socketer *self) {
 	cspin_lock(&s_mgr.mgr_lock);
@@ -79,41 +102,135 @@ static struct socketer *socketmgr_pop_front() {
 	return so;
 }
 
-/* get socket object size. */
+/* get socket object size, include its bufs and user data. */
 size_t socketer_get_size() {
-	return (sizeof(struct socketer));
+	return SOCKETER_PART_SIZE(sizeof(struct socketer)) + 
+		SOCKETER_PART_SIZE(buf_get_size()) * 2 + s_udata_size;
+}
+
+/* set the user data size of each socketer object, must be called before net init. */
+void socketer_set_udata_size(size_t size) {
+	s_udata_size = size;
+}
+
+/* get the user data of socketer, it is released with the socketer. */
+void *socketer_get_udata(struct socketer *self) {
+	if (!self || s_udata_size == 0)
+		return NULL;
+
+	return (char *)socketer_sendbuf_mem(self) + SOCKETER_PART_SIZE(buf_get_size());
 }
 
 /* default encrypt/decrypt function key. */
 static const char default_key = 0xae;
 static void default_decrypt_func(void *logicdata, char *buf, int len) {
-	int i;
-	for (i = 0; i < len; ++i) {
-		buf[i] ^= default_key;
-	}
+	int idx = 0;
+	crypt_xor(buf, len, &default_key, 1, &idx);
 }
 
 static void default_encrypt_func(void *logicdata, char *buf, int len) {
-	int i;
-	for (i = 0; i < len; ++i) {
-		buf[i] ^= default_key;
-	}
+	int idx = 0;
+	crypt_xor(buf, len, &default_key, 1, &idx);
 }
 
 static void socketer_init_recv_buf(struct socketer *self) {
 	if (!self->recvbuf) {
-		self->recvbuf = buf_create(self->bigbuf);
+		self->recvbuf = buf_create(socketer_recvbuf_mem(self), self->bigbuf);
 		buf_set_do_func(self->recvbuf, default_decrypt_func, NULL, NULL);
 	}
 }
 
+/*
+ * the send buffer of subscriber is written by the publish job on network thread too,
+ * then the logic thread lock it for write, or else it is only written by the logic thread, not lock.
+ */
+static inline bool socketer_lock_send_buf(struct socketer *self) {
+	if (self->subscribe_num == 0)
+		return false;
+
+	cspin_lock(&self->sendbuf_lock);
+	return true;
+}
+
+static inline void socketer_unlock_send_buf(struct socketer *self, bool locked) {
+	if (locked)
+		cspin_unlock(&self->sendbuf_lock);
+}
+
 static void socketer_init_send_buf(struct socketer *self) {
 	if (!self->sendbuf) {
-		self->sendbuf = buf_create(self->bigbuf);
+		self->sendbuf = buf_create(socketer_sendbuf_mem(self), self->bigbuf);
 		buf_set_do_func(self->sendbuf, default_encrypt_func, NULL, NULL);
 	}
 }
 
+/*
+ * release the block of idle send buffer.
+ * when sendlock is 0, network thread do not use send buffer, 
+ * so can release it, if it has not custom setting, then release the buf too.
+ */
+static void socketer_check_idle_send_buf(struct socketer *self) {
+	if (s_idle_buf_release_time <= 0 || !self->sendbuf)
+		return;
+
+	if (self->send_idle_time == 0) {
+		self->send_idle_time = s_mgr.currenttime;
+		return;
+	}
+
+	if (s_mgr.currenttime - self->send_idle_time < s_idle_buf_release_time)
+		return;
+
+	if (catomic_load_explicit(&self->sendlock, CATOMIC_ACQUIRE) != 0)
+		return;
+
+	self->send_idle_time = 0;
+	if (!buf_release_idle_block(self->sendbuf))
+		return;
+
+	if (buf_is_default_setting(self->sendbuf, default_encrypt_func)) {
+		buf_release(self->sendbuf);
+		self->sendbuf = NULL;
+	}
+}
+
+/*
+ * release the block of idle recv buffer.
+ * if recvlock is 0, network thread do not use recv buffer.
+ * or else recv event is set, hold recvguard for stop network thread recv.
+ */
+static void socketer_check_idle_recv_buf(struct socketer *self) {
+	if (s_idle_buf_release_time <= 0 || !self->recvbuf)
+		return;
+
+	if (self->recv_idle_time == 0) {
+		self->recv_idle_time = s_mgr.currenttime;
+		return;
+	}
+
+	if (s_mgr.currenttime - self->recv_idle_time < s_idle_buf_release_time)
+		return;
+
+	self->recv_idle_time = 0;
+	if (catomic_load_explicit(&self->recvlock, CATOMIC_ACQUIRE) == 0) {
+		if (!buf_release_idle_block(self->recvbuf))
+			return;
+
+		if (buf_is_default_setting(self->recvbuf, default_decrypt_func)) {
+			buf_release(self->recvbuf);
+			self->recvbuf = NULL;
+		}
+		return;
+	}
+
+#ifndef _WIN32
+	if (catomic_compare_set_explicit(&self->recvguard, 0, 2, CATOMIC_ACQUIRE)) {
+		buf_release_idle_block(self->recvbuf);
+		catomic_store_explicit(&self->recvguard, 0, CATOMIC_RELEASE);
+	}
+#endif
+}
+
 static bool socketer_init(struct socketer *self, bool bigbuf) {
 
 #ifdef _WIN32
@@ -133,6 +250,16 @@ static bool socketer_init(struct socketer *self, bool bigbuf) {
 	catomic_set(&self->already_event, 0);
 	catomic_set(&self->sendlock, 0);
 	catomic_set(&self->recvlock, 0);
+
+#ifndef _WIN32
+	catomic_set(&self->recvguard, 0);
+#endif
+
+	self->recv_idle_time = 0;
+	self->send_idle_time = 0;
+	cspin_init(&self->sendbuf_lock);
+	self->subscribe_num = 0;
+	self->sendbuf_reserved = false;
 	self->deleted = false;
 	self->connected = false;
 	self->bigbuf = bigbuf;
@@ -182,11 +309,13 @@ struct socketer *socketer_create_for_accept(bool bigbuf, void *sockfd) {
 }
 
 static void socketer_real_release(struct socketer *self) {
+	assert(self->subscribe_num == 0);
 	self->next = NULL;
 	buf_release(self->recvbuf);
 	buf_release(self->sendbuf);
 	self->recvbuf = NULL;
 	self->sendbuf = NULL;
+	cspin_destroy(&self->sendbuf_lock);
 	netpool_release_socketer(self);
 }
 
@@ -405,6 +534,7 @@ failed_do:
 }
 
 bool socketer_send_msg(struct socketer *self, void *data, int len) {
+	bool locked, res;
 	assert(self != NULL);
 	assert(data != NULL);
 	assert(len > 0);
@@ -414,11 +544,19 @@ bool socketer_send_msg(struct socketer *self, void *data, int len) {
 	if (self->deleted || !self->connected)
 		return false;
 
+	locked = socketer_lock_send_buf(self);
 	socketer_init_send_buf(self);
-	return buf_put_message(self->sendbuf, data, len);
+
+	/* push failed, maybe some of data is pushed, so the stream is broken. */
+	res = buf_put_message(self->sendbuf, data, len);
+	socketer_unlock_send_buf(self, locked);
+	if (!res)
+		socketer_close(self);
+	return res;
 }
 
 bool socketer_send_data(struct socketer *self, void *data, int len) {
+	bool locked, res;
 	assert(self != NULL);
 	assert(data != NULL);
 	assert(len > 0);
@@ -428,41 +566,115 @@ bool socketer_send_data(struct socketer *self, void *data, int len) {
 	if (self->deleted || !self->connected)
 		return false;
 
+	locked = socketer_lock_send_buf(self);
 	socketer_init_send_buf(self);
-	return buf_put_data(self->sendbuf, data, len);
+
+	/* push failed, maybe some of data is pushed, so the stream is broken. */
+	res = buf_put_data(self->sendbuf, data, len);
+	socketer_unlock_send_buf(self, locked);
+	if (!res)
+		socketer_close(self);
+	return res;
+}
+
+/* push the message of shared block by reference, not copy. */
+bool socketer_send_shared(struct socketer *self, struct block *shared) {
+	bool locked, res;
+	assert(self != NULL);
+	assert(shared != NULL);
+	if (!self || !shared)
+		return false;
+
+	if (self->deleted || !self->connected)
+		return false;
+
+	locked = socketer_lock_send_buf(self);
+	socketer_init_send_buf(self);
+
+	/* create reference failed, not any data is pushed, the stream is ok. */
+	res = buf_put_shared(self->sendbuf, shared);
+	socketer_unlock_send_buf(self, locked);
+	return res;
 }
 
 /*
- * when sending data. test send limit as len.
- * if return true, close this connect.
+ * reserve len contiguous bytes in the send buffer for write message in place,
+ * return the write buffer, if failed, return NULL.
+ * must call socketer_commit_send before send other data.
  */
-bool socketer_send_is_limit(struct socketer *self, size_t len) {
+char *socketer_reserve_send(struct socketer *self, int len) {
+	char *buf;
+	bool locked;
 	assert(self != NULL);
-	if (!self)
-		return true;
+	assert(len > 0);
+	if (!self || len <= 0)
+		return NULL;
+
+	if (self->deleted || !self->connected)
+		return NULL;
 
+	/* the subscriber hold the lock until commit, the publish job wait it. */
+	assert(!self->sendbuf_reserved);
+	locked = socketer_lock_send_buf(self);
 	socketer_init_send_buf(self);
-	return buf_add_is_limit(self->sendbuf, len);
+	buf = buf_reserve_send(self->sendbuf, len);
+	if (buf && locked)
+		self->sendbuf_reserved = true;
+	else
+		socketer_unlock_send_buf(self, locked);
+	return buf;
 }
 
-/* set send event. */
-void socketer_check_send(struct socketer *self) {
+/* commit the reserved buffer as message of len bytes, write the length header, len can be 0 for cancel. */
+bool socketer_commit_send(struct socketer *self, int len) {
+	bool res;
 	assert(self != NULL);
-	if (!self)
-		return;
+	if (!self || !self->sendbuf)
+		return false;
 
-	if (self->deleted || !self->connected)
-		return;
+	res = buf_commit_send(self->sendbuf, len);
+	if (self->sendbuf_reserved) {
+		self->sendbuf_reserved = false;
+		cspin_unlock(&self->sendbuf_lock);
+	}
+	return res;
+}
+
+/*
+ * when sending data. test send limit and send policy as len.
+ * return enum_send_accept, enum_send_drop or enum_send_close.
+ */
+int socketer_send_check(struct socketer *self, size_t len) {
+	bool locked;
+	int res;
+	assert(self != NULL);
+	if (!self)
+		return enum_send_close;
 
+	locked = socketer_lock_send_buf(self);
 	socketer_init_send_buf(self);
+	res = buf_send_check(self->sendbuf, len);
+	socketer_unlock_send_buf(self, locked);
+	return res;
+}
+
+/* set send event, the publish job call it with sendbuf_lock. */
+static void socketer_do_check_send(struct socketer *self) {
+	/* if not has send buffer, then not has data for send. */
+	if (!self->sendbuf)
+		return;
 
 	/* if not has data for send. */
-	if (buf_can_not_send(self->sendbuf))
+	if (buf_can_not_send(self->sendbuf)) {
+		socketer_check_idle_send_buf(self);
 		return;
+	}
+
+	self->send_idle_time = 0;
 
 	/* if 0, then set 1, and set sendevent. */
-	if (catomic_compare_set(&self->sendlock, 0, 1)) {
-		if (catomic_inc(&self->ref) <= 1) {
+	if (catomic_compare_set_explicit(&self->sendlock, 0, 1, CATOMIC_ACQUIRE)) {
+		if (catomic_inc_explicit(&self->ref, CATOMIC_RELAXED) <= 1) {
 			log_error("%x socket recvlock:%d, sendlock:%d, fd:%d, ref:%d, thread_id:%d, connect:%d, deleted:%d", 
 					self, (int)catomic_read(&self->recvlock), (int)catomic_read(&self->sendlock), self->sockfd, 
 					(int)catomic_read(&self->ref), cthread_self_id(), self->connected, self->deleted);
@@ -471,6 +683,74 @@ void socketer_check_send(struct socketer *self) {
 	}
 }
 
+/* set send event. */
+void socketer_check_send(struct socketer *self) {
+	bool locked;
+	assert(self != NULL);
+	if (!self)
+		return;
+
+	if (self->deleted || !self->connected)
+		return;
+
+	locked = socketer_lock_send_buf(self);
+	socketer_do_check_send(self);
+	socketer_unlock_send_buf(self, locked);
+}
+
+/*
+ * push the message of shared block on network thread for the publish job, lock the send buffer,
+ * test send limit and send policy, if copy is true, then copy the message, or else push by reference.
+ * then set send event, return true if pushed.
+ */
+bool socketer_publish_shared(struct socketer *self, struct block *shared, bool copy) {
+	bool res = false;
+	int len, action;
+	assert(self != NULL);
+	assert(shared != NULL);
+	assert(self->subscribe_num > 0);
+
+	cspin_lock(&self->sendbuf_lock);
+	if (self->deleted || !self->connected) {
+		cspin_unlock(&self->sendbuf_lock);
+		return false;
+	}
+
+	socketer_init_send_buf(self);
+	len = block_get_readsize(shared);
+	action = buf_send_check(self->sendbuf, (size_t)len);
+	if (action == enum_send_accept) {
+		res = copy ? buf_put_message(self->sendbuf, block_get_readbuf(shared), len) : 
+			buf_put_shared(self->sendbuf, shared);
+
+		/* copy failed, maybe some of data is pushed, so the stream is broken. */
+		if (!res && copy)
+			action = enum_send_close;
+	}
+
+	if (res)
+		socketer_do_check_send(self);
+	cspin_unlock(&self->sendbuf_lock);
+
+	if (action == enum_send_close)
+		socketer_close(self);
+	return res;
+}
+
+/* the socketer subscribe a channel, the send buffer is written by the publish job too, call on logic thread. */
+void socketer_subscribe(struct socketer *self) {
+	assert(self != NULL);
+	assert(!self->sendbuf_reserved);
+	++self->subscribe_num;
+}
+
+/* the socketer unsubscribe a channel, call after the publish job not access it. */
+void socketer_unsubscribe(struct socketer *self) {
+	assert(self != NULL);
+	assert(self->subscribe_num > 0);
+	--self->subscribe_num;
+}
+
 void *socketer_get_msg(struct socketer *self, char *buf, size_t bufsize) {
 	void *msg;
 	bool need_close = false;
@@ -478,13 +758,80 @@ void *socketer_get_msg(struct socketer *self, char *buf, size_t bufsize) {
 	if (!self)
 		return NULL;
 
-	socketer_init_recv_buf(self);
+	if (!self->recvbuf)
+		return NULL;
+
 	msg = buf_get_message(self->recvbuf, &need_close, buf, bufsize);
 	if (need_close)
 		socketer_close(self);
+
+	if (msg)
+		self->recv_idle_time = 0;
+	else
+		socketer_check_idle_recv_buf(self);
 	return msg;
 }
 
+/*
+ * peek message, if the message is contiguous in block, then return the pointer to block, not copy.
+ * if return not NULL, must call socketer_release_msg after use it.
+ */
+void *socketer_peek_msg(struct socketer *self, char *buf, size_t bufsize) {
+	void *msg;
+	bool need_close = false;
+	assert(self != NULL);
+	if (!self)
+		return NULL;
+
+	if (!self->recvbuf)
+		return NULL;
+
+	msg = buf_peek_message(self->recvbuf, &need_close, buf, bufsize);
+	if (need_close)
+		socketer_close(self);
+
+	if (msg)
+		self->recv_idle_time = 0;
+	else
+		socketer_check_idle_recv_buf(self);
+	return msg;
+}
+
+/*
+ * peek all complete messages in one pass, up to max, msgs[i] point to them, return the message num.
+ * the message straddle blocks is copied to arena (if arena is NULL, then use the thread buffer).
+ * if return greater than 0, must call socketer_release_msg after use them.
+ */
+int socketer_peek_msg_batch(struct socketer *self, char **msgs, int max, char *arena, size_t arenasize) {
+	int num;
+	bool need_close = false;
+	assert(self != NULL);
+	if (!self)
+		return 0;
+
+	if (!self->recvbuf)
+		return 0;
+
+	num = buf_peek_message_batch(self->recvbuf, &need_close, arena, arenasize, msgs, max);
+	if (need_close)
+		socketer_close(self);
+
+	if (num > 0)
+		self->recv_idle_time = 0;
+	else
+		socketer_check_idle_recv_buf(self);
+	return num;
+}
+
+/* release the message of socketer_peek_msg or socketer_peek_msg_batch. */
+void socketer_release_msg(struct socketer *self) {
+	assert(self != NULL);
+	if (!self || !self->recvbuf)
+		return;
+
+	buf_release_message(self->recvbuf);
+}
+
 void *socketer_get_data(struct socketer *self, char *buf, size_t bufsize, int *datalen) {
 	void *data;
 	bool need_close = false;
@@ -492,10 +839,17 @@ void *socketer_get_data(struct socketer *self, char *buf, size_t bufsize, int *d
 	if (!self)
 		return NULL;
 
-	socketer_init_recv_buf(self);
+	if (!self->recvbuf)
+		return NULL;
+
 	data = buf_get_data(self->recvbuf, &need_close, buf, (int)bufsize, datalen);
 	if (need_close)
 		socketer_close(self);
+
+	if (data)
+		self->recv_idle_time = 0;
+	else
+		socketer_check_idle_recv_buf(self);
 	return data;
 }
 
@@ -504,7 +858,9 @@ int socketer_find_data_end_size(struct socketer *self, const char *data, int dat
 	if (!self)
 		return -1;
 
-	socketer_init_recv_buf(self);
+	if (!self->recvbuf)
+		return 0;
+
 	return buf_find_data_end_size(self->recvbuf, data, datalen);
 }
 
@@ -524,13 +880,47 @@ void socketer_check_recv(struct socketer *self) {
 		return;
 
 	/* if 0, then set 1, and set recvevent. */
-	if (catomic_compare_set(&self->recvlock, 0, 1)) {
-		if (catomic_inc(&self->ref) <= 1) {
+	if (catomic_compare_set_explicit(&self->recvlock, 0, 1, CATOMIC_ACQUIRE)) {
+		if (catomic_inc_explicit(&self->ref, CATOMIC_RELAXED) <= 1) {
 			log_error("%x socket recvlock:%d, sendlock:%d, fd:%d, ref:%d, thread_id:%d, connect:%d, deleted:%d", 
 					self, (int)catomic_read(&self->recvlock), (int)catomic_read(&self->sendlock), self->sockfd, 
 					(int)catomic_read(&self->ref), cthread_self_id(), self->connected, self->deleted);
 		}
 
+		/*
+		 * the received data stopped by the uncompress budget has no recv event if the peer not send more,
+		 * uncompress it now (the recvlock is held, the network thread not access the recv buffer).
+		 */
+		if (buf_has_uncompress_data(self->recvbuf)) {
+			if (!buf_recv_end_do(self->recvbuf)) {
+				/* uncompress error, close socket. */
+				socketer_close(self);
+
+				if (catomic_dec_explicit(&self->ref, CATOMIC_ACQ_REL) < 1) {
+					log_error("%x socket recvlock:%d, sendlock:%d, fd:%d, ref:%d, thread_id:%d, connect:%d, deleted:%d", 
+							self, (int)catomic_read(&self->recvlock), (int)catomic_read(&self->sendlock), self->sockfd, 
+							(int)catomic_read(&self->ref), cthread_self_id(), self->connected, self->deleted);
+				}
+				return;
+			}
+
+			/* over the budget again, not set recv event, wait the logic read. */
+			if (buf_can_not_recv(self->recvbuf)) {
+				if (catomic_dec_explicit(&self->ref, CATOMIC_ACQ_REL) < 1) {
+					log_error("%x socket recvlock:%d, sendlock:%d, fd:%d, ref:%d, thread_id:%d, connect:%d, deleted:%d", 
+							self, (int)catomic_read(&self->recvlock), (int)catomic_read(&self->sendlock), self->sockfd, 
+							(int)catomic_read(&self->ref), cthread_self_id(), self->connected, self->deleted);
+				}
+
+				if (catomic_dec_explicit(&self->recvlock, CATOMIC_RELEASE) != 0) {
+					log_error("%x socket recvlock:%d, sendlock:%d, fd:%d, ref:%d, thread_id:%d, connect:%d, deleted:%d", 
+							self, (int)catomic_read(&self->recvlock), (int)catomic_read(&self->sendlock), self->sockfd, 
+							(int)catomic_read(&self->ref), cthread_self_id(), self->connected, self->deleted);
+				}
+				return;
+			}
+		}
+
 		eventmgr_setup_socket_recv_event(self);
 	}
 }
@@ -547,42 +937,94 @@ void socketer_set_recv_limit(struct socketer *self, int size) {
 
 /* set send data limit. */
 void socketer_set_send_limit(struct socketer *self, int size) {
+	bool locked;
 	assert(self != NULL);
 	if (!self)
 		return;
 
+	locked = socketer_lock_send_buf(self);
 	socketer_init_send_buf(self);
 	buf_set_limit_size(self->sendbuf, size);
+	socketer_unlock_send_buf(self, locked);
 }
 
-void socketer_use_compress(struct socketer *self) {
+/* compress send data with the codec, must be called before send any data. */
+bool socketer_use_compress(struct socketer *self, int codec_id) {
+	bool locked, res;
 	assert(self != NULL);
 	if (!self)
-		return;
+		return false;
 
+	locked = socketer_lock_send_buf(self);
 	socketer_init_send_buf(self);
-	buf_use_compress(self->sendbuf);
+	res = buf_use_compress(self->sendbuf, codec_id);
+	socketer_unlock_send_buf(self, locked);
+	return res;
 }
 
-void socketer_use_uncompress(struct socketer *self) {
+/* uncompress recv data, codec_id is for the stream codec of peer, must be called before recv any data. */
+bool socketer_use_uncompress(struct socketer *self, int codec_id) {
 	assert(self != NULL);
 	if (!self)
-		return;
+		return false;
+
+	socketer_init_recv_buf(self);
+	return buf_use_uncompress(self->recvbuf, codec_id);
+}
+
+/* get compress stat of send data. */
+void socketer_get_compress_stat(struct socketer *self, struct buf_compress_stat *stat) {
+	assert(self != NULL);
+	buf_get_compress_stat(self ? self->sendbuf : NULL, stat);
+}
+
+/* network thread split the recv data into messages, must be called before recv any data. */
+bool socketer_use_msg_preparse(struct socketer *self) {
+	assert(self != NULL);
+	if (!self)
+		return false;
 
 	socketer_init_recv_buf(self);
-	buf_use_uncompress(self->recvbuf);
+	return buf_use_msg_preparse(self->recvbuf);
+}
+
+/*
+ * use ring buffer for send/recv instead of block chain, size is 0 means not use, must be called before send/recv any data.
+ * the data in ring is always contiguous, send/recv only once system call. (only linux.)
+ */
+bool socketer_use_ring_buffer(struct socketer *self, size_t send_size, size_t recv_size) {
+	bool res = true;
+	assert(self != NULL);
+	if (!self)
+		return false;
+
+	if (send_size > 0) {
+		bool locked = socketer_lock_send_buf(self);
+		socketer_init_send_buf(self);
+		res = buf_use_ring(self->sendbuf, send_size) && res;
+		socketer_unlock_send_buf(self, locked);
+	}
+
+	if (recv_size > 0) {
+		socketer_init_recv_buf(self);
+		res = buf_use_ring(self->recvbuf, recv_size) && res;
+	}
+	return res;
 }
 
 /* set encrypt function and logic data. */
 void socketer_set_encrypt_function(struct socketer *self, 
 		dofunc_f encrypt_func, void (*release_logicdata)(void *), void *logicdata) {
 
+	bool locked;
 	assert(self != NULL);
 	if (!self || !encrypt_func)
 		return;
 
+	locked = socketer_lock_send_buf(self);
 	socketer_init_send_buf(self);
 	buf_set_do_func(self->sendbuf, encrypt_func, release_logicdata, logicdata);
+	socketer_unlock_send_buf(self, locked);
 }
 
 /* set encrypt function and logic data. */
@@ -597,13 +1039,40 @@ void socketer_set_decrypt_function(struct socketer *self,
 	buf_set_do_func(self->recvbuf, decrypt_func, release_logicdata, logicdata);
 }
 
+/* set encrypt function to chacha20, key is 32 bytes, nonce is 12 bytes. */
+bool socketer_set_encrypt_chacha20(struct socketer *self, const char *key, const char *nonce) {
+	bool locked, res;
+	assert(self != NULL);
+	if (!self)
+		return false;
+
+	locked = socketer_lock_send_buf(self);
+	socketer_init_send_buf(self);
+	res = buf_use_chacha20(self->sendbuf, key, nonce);
+	socketer_unlock_send_buf(self, locked);
+	return res;
+}
+
+/* set decrypt function to chacha20, key is 32 bytes, nonce is 12 bytes. */
+bool socketer_set_decrypt_chacha20(struct socketer *self, const char *key, const char *nonce) {
+	assert(self != NULL);
+	if (!self)
+		return false;
+
+	socketer_init_recv_buf(self);
+	return buf_use_chacha20(self->recvbuf, key, nonce);
+}
+
 void socketer_use_encrypt(struct socketer *self) {
+	bool locked;
 	assert(self != NULL);
 	if (!self)
 		return;
 
+	locked = socketer_lock_send_buf(self);
 	socketer_init_send_buf(self);
 	buf_use_encrypt(self->sendbuf);
+	socketer_unlock_send_buf(self, locked);
 }
 
 void socketer_use_decrypt(struct socketer *self) {
@@ -635,12 +1104,15 @@ void socketer_set_proxy_param(struct socketer *self,
 }
 
 void socketer_set_raw_datasize(struct socketer *self, int size) {
+	bool locked;
 	assert(self != NULL);
 	if (!self)
 		return;
 
+	locked = socketer_lock_send_buf(self);
 	socketer_init_send_buf(self);
 	buf_set_raw_datasize(self->sendbuf, size);
+	socketer_unlock_send_buf(self, locked);
 }
 
 /*
@@ -649,7 +1121,25 @@ void socketer_set_raw_datasize(struct socketer *self, int size) {
  * ================================================================================
  */
 
+static void socketer_do_recv(struct socketer *self, int len);
+
 void socketer_on_recv(struct socketer *self, int len) {
+#ifndef _WIN32
+	/*
+	 * if logic thread is releasing idle recv block, then skip this time,
+	 * the recv event is level triggered, so will be trigger again.
+	 */
+	if (!catomic_compare_set_explicit(&self->recvguard, 0, 1, CATOMIC_ACQUIRE))
+		return;
+
+	socketer_do_recv(self, len);
+	catomic_store_explicit(&self->recvguard, 0, CATOMIC_RELEASE);
+#else
+	socketer_do_recv(self, len);
+#endif
+}
+
+static void socketer_do_recv(struct socketer *self, int len) {
 	int res;
 	struct buf_info writebuf;
 	debuglog("on recv\n");
@@ -675,7 +1165,7 @@ void socketer_on_recv(struct socketer *self, int len) {
 				/* uncompress error, close socket. */
 				socketer_close(self);
 
-				if (catomic_dec(&self->ref) < 1) {
+				if (catomic_dec_explicit(&self->ref, CATOMIC_ACQ_REL) < 1) {
 					log_error("%x socket recvlock:%d, sendlock:%d, fd:%d, ref:%d, thread_id:%d, connect:%d, deleted:%d", 
 							self, (int)catomic_read(&self->recvlock), (int)catomic_read(&self->sendlock), self->sockfd, 
 							(int)catomic_read(&self->ref), cthread_self_id(), self->connected, self->deleted);
@@ -689,13 +1179,13 @@ void socketer_on_recv(struct socketer *self, int len) {
 			eventmgr_remove_socket_recv_event(self);
 #endif
 
-			if (catomic_dec(&self->ref) < 1) {
+			if (catomic_dec_explicit(&self->ref, CATOMIC_ACQ_REL) < 1) {
 				log_error("%x socket recvlock:%d, sendlock:%d, fd:%d, ref:%d, thread_id:%d, connect:%d, deleted:%d", 
 						self, (int)catomic_read(&self->recvlock), (int)catomic_read(&self->sendlock), self->sockfd, 
 						(int)catomic_read(&self->ref), cthread_self_id(), self->connected, self->deleted);
 			}
 
-			if (catomic_dec(&self->recvlock) != 0) {
+			if (catomic_dec_explicit(&self->recvlock, CATOMIC_RELEASE) != 0) {
 				log_error("%x socket recvlock:%d, sendlock:%d, fd:%d, ref:%d, thread_id:%d, connect:%d, deleted:%d", 
 						self, (int)catomic_read(&self->recvlock), (int)catomic_read(&self->sendlock), self->sockfd, 
 						(int)catomic_read(&self->ref), cthread_self_id(), self->connected, self->deleted);
@@ -713,7 +1203,7 @@ void socketer_on_recv(struct socketer *self, int len) {
 				/* uncompress error, close socket. */
 				socketer_close(self);
 
-				if (catomic_dec(&self->ref) < 1) {
+				if (catomic_dec_explicit(&self->ref, CATOMIC_ACQ_REL) < 1) {
 					log_error("%x socket recvlock:%d, sendlock:%d, fd:%d, ref:%d, thread_id:%d, connect:%d, deleted:%d", 
 							self, (int)catomic_read(&self->recvlock), (int)catomic_read(&self->sendlock), self->sockfd, 
 							(int)catomic_read(&self->ref), cthread_self_id(), self->connected, self->deleted);
@@ -726,7 +1216,7 @@ void socketer_on_recv(struct socketer *self, int len) {
 				/* error, close socket. */
 				socketer_close(self);
 
-				if (catomic_dec(&self->ref) < 1) {
+				if (catomic_dec_explicit(&self->ref, CATOMIC_ACQ_REL) < 1) {
 					log_error("%x socket recvlock:%d, sendlock:%d, fd:%d, ref:%d, thread_id:%d, connect:%d, deleted:%d", 
 							self, (int)catomic_read(&self->recvlock), (int)catomic_read(&self->sendlock), self->sockfd, 
 							(int)catomic_read(&self->ref), cthread_self_id(), self->connected, self->deleted);
@@ -745,18 +1235,25 @@ void socketer_on_recv(struct socketer *self, int len) {
 					eventmgr_setup_socket_recv_data_event(self, writebuf.buf, writebuf.len);
 					debuglog("setup recv event...\n");
 				} else {
-					if (catomic_dec(&self->ref) < 1) {
+					if (catomic_dec_explicit(&self->ref, CATOMIC_ACQ_REL) < 1) {
 						log_error("%x socket recvlock:%d, sendlock:%d, fd:%d, ref:%d, thread_id:%d, connect:%d, deleted:%d", 
 								self, (int)catomic_read(&self->recvlock), (int)catomic_read(&self->sendlock), self->sockfd, 
 								(int)catomic_read(&self->ref), cthread_self_id(), self->connected, self->deleted);
 					}
 
-					if (catomic_dec(&self->recvlock) != 0) {
+					if (catomic_dec_explicit(&self->recvlock, CATOMIC_RELEASE) != 0) {
 						log_error("%x socket recvlock:%d, sendlock:%d, fd:%d, ref:%d, thread_id:%d, connect:%d, deleted:%d", 
 								self, (int)catomic_read(&self->recvlock), (int)catomic_read(&self->sendlock), self->sockfd, 
 								(int)catomic_read(&self->ref), cthread_self_id(), self->connected, self->deleted);
 					}
 				}
+#else
+				/*
+				 * the uncompress is stopped by the budget, the event is not fired if the peer not send more,
+				 * so remove recv event as limit (at the head of loop), CheckRecv continue it after the logic read.
+				 */
+				if (buf_can_not_recv(self->recvbuf))
+					continue;
 #endif
 			}
 			/* return. !!! */
@@ -783,7 +1280,17 @@ void socketer_on_send(struct socketer *self, int len) {
 #endif
 
 	/* do something before real send. */
-	buf_send_before_do(self->sendbuf);
+	if (!buf_send_before_do(self->sendbuf)) {
+		/* compress data push failed, close socket. */
+		socketer_close(self);
+
+		if (catomic_dec_explicit(&self->ref, CATOMIC_ACQ_REL) < 1) {
+			log_error("%x socket recvlock:%d, sendlock:%d, fd:%d, ref:%d, thread_id:%d, connect:%d, deleted:%d", 
+					self, (int)catomic_read(&self->recvlock), (int)catomic_read(&self->sendlock), self->sockfd, 
+					(int)catomic_read(&self->ref), cthread_self_id(), self->connected, self->deleted);
+		}
+		return;
+	}
 
 	for (;;) {
 		readbuf = buf_get_read_bufinfo(self->sendbuf);
@@ -795,13 +1302,13 @@ void socketer_on_send(struct socketer *self, int len) {
 			eventmgr_remove_socket_send_event(self);
 #endif
 
-			if (catomic_dec(&self->ref) < 1) {
+			if (catomic_dec_explicit(&self->ref, CATOMIC_ACQ_REL) < 1) {
 				log_error("%x socket recvlock:%d, sendlock:%d, fd:%d, ref:%d, thread_id:%d, connect:%d, deleted:%d", 
 						self, (int)catomic_read(&self->recvlock), (int)catomic_read(&self->sendlock), self->sockfd, 
 						(int)catomic_read(&self->ref), cthread_self_id(), self->connected, self->deleted);
 			}
 
-			if (catomic_dec(&self->sendlock) != 0) {
+			if (catomic_dec_explicit(&self->sendlock, CATOMIC_RELEASE) != 0) {
 				log_error("%x socket recvlock:%d, sendlock:%d, fd:%d, ref:%d, thread_id:%d, connect:%d, deleted:%d", 
 						self, (int)catomic_read(&self->recvlock), (int)catomic_read(&self->sendlock), self->sockfd, 
 						(int)catomic_read(&self->ref), cthread_self_id(), self->connected, self->deleted);
@@ -820,7 +1327,7 @@ void socketer_on_send(struct socketer *self, int len) {
 				/* error, close socket. */
 				socketer_close(self);
 
-				if (catomic_dec(&self->ref) < 1) {
+				if (catomic_dec_explicit(&self->ref, CATOMIC_ACQ_REL) < 1) {
 					log_error("%x socket recvlock:%d, sendlock:%d, fd:%d, ref:%d, thread_id:%d, connect:%d, deleted:%d", 
 							self, (int)catomic_read(&self->recvlock), (int)catomic_read(&self->sendlock), self->sockfd, 
 							(int)catomic_read(&self->ref), cthread_self_id(), self->connected, self->deleted);
@@ -844,6 +1351,14 @@ void socketer_on_send(struct socketer *self, int len) {
 	}
 }
 
+/*
+ * set the time(ms) of buffer is empty, after it release the buffer block, 
+ * if less than or equal to 0, then not release.
+ */
+void socketmgr_set_idle_buf_release_time(int ms) {
+	s_idle_buf_release_time = (ms > 0) ? ms : 0;
+}
+
 /* create and init socketer manager. */
 bool socketmgr_init() {
 	if (s_mgr.is_init)
@@ -877,7 +1392,7 @@ void socketmgr_run() {
 			return;
 
 #ifdef _WIN32
-		if (catomic_dec(&sock->ref) != 0) {
+		if (catomic_dec_explicit(&sock->ref, CATOMIC_ACQ_REL) != 0) {
 			log_error("%x socket recvlock:%d, sendlock:%d, fd:%d, ref:%d, thread_id:%d, connect:%d, deleted:%d", 
 					sock, (int)catomic_read(&sock->recvlock), (int)catomic_read(&sock->sendlock), sock->sockfd, 
 					(int)catomic_read(&sock->ref), cthread_self_id(), sock->connected, sock->deleted);
@@ -890,7 +1405,7 @@ void socketmgr_run() {
 			log_error(" if (sock != resock)");
 			if (resock) {
 #ifdef _WIN32
-				if (catomic_read(&resock->ref) != 0) {
+				if (catomic_load_explicit(&resock->ref, CATOMIC_ACQUIRE) != 0) {
 					log_error("%x socket recvlock:%d, sendlock:%d, fd:%d, ref:%d, thread_id:%d, connect:%d, deleted:%d", 
 							resock, (int)catomic_read(&resock->recvlock), (int)catomic_read(&resock->sendlock), resock->sockfd, 
 							(int)catomic_read(&resock->ref), cthread_self_id(), resock->connected, resock->deleted);
@@ -901,7 +1416,7 @@ void socketmgr_run() {
 		}
 
 #ifdef _WIN32
-		if (catomic_read(&sock->ref) != 0)
+		if (catomic_load_explicit(&sock->ref, CATOMIC_ACQUIRE) != 0)
 			log_error("%x socket recvlock:%d, sendlock:%d, fd:%d, ref:%d, thread_id:%d, connect:%d, deleted:%d", 
 					sock, (int)catomic_read(&sock->recvlock), (int)catomic_read(&sock->sendlock), sock->sockfd, 
 					(int)catomic_read(&sock->ref), cthread_self_id(), sock->connected, sock->deleted);
@@ -16,9 +16,15 @@ extern "C" {
 
 struct socketer;
 
-/* get socket object size. */
+/* get socket object size, include its bufs and user data. */
 size_t socketer_get_size();
 
+/* set the user data size of each socketer object, must be called before net init. */
+void socketer_set_udata_size(size_t size);
+
+/* get the user data of socketer, it is released with the socketer. */
+void *socketer_get_udata(struct socketer *self);
+
 /*
  * create socketer.
  * bigbuf --- if is true, then is bigbuf; or else is smallbuf.
@@ -50,17 +56,61 @@ bool socketer_send_msg(struct socketer *self, void *data, int len);
 
 bool socketer_send_data(struct socketer *self, void *data, int len);
 
+struct block;
+
+/* push the message of shared block by reference, not copy. */
+bool socketer_send_shared(struct socketer *self, struct block *shared);
+
 /*
- * when sending data. test send limit as len.
- * if return true, close this connect.
+ * push the message of shared block on network thread for the publish job, lock the send buffer,
+ * test send limit and send policy, if copy is true, then copy the message, or else push by reference.
+ * then set send event, return true if pushed.
  */
-bool socketer_send_is_limit(struct socketer *self, size_t len);
+bool socketer_publish_shared(struct socketer *self, struct block *shared, bool copy);
+
+/* the socketer subscribe a channel, the send buffer is written by the publish job too, call on logic thread. */
+void socketer_subscribe(struct socketer *self);
+
+/* the socketer unsubscribe a channel, call after the publish job not access it. */
+void socketer_unsubscribe(struct socketer *self);
+
+/*
+ * reserve len contiguous bytes in the send buffer for write message in place,
+ * return the write buffer, if failed, return NULL.
+ * must call socketer_commit_send before send other data.
+ */
+char *socketer_reserve_send(struct socketer *self, int len);
+
+/* commit the reserved buffer as message of len bytes, write the length header, len can be 0 for cancel. */
+bool socketer_commit_send(struct socketer *self, int len);
+
+/*
+ * when sending data. test send limit and send policy as len.
+ * return enum_send_accept, enum_send_drop or enum_send_close.
+ */
+int socketer_send_check(struct socketer *self, size_t len);
 
 /* set send event. */
 void socketer_check_send(struct socketer *self);
 
 void *socketer_get_msg(struct socketer *self, char *buf, size_t bufsize);
 
+/*
+ * peek message, if the message is contiguous in block, then return the pointer to block, not copy.
+ * if return not NULL, must call socketer_release_msg after use it.
+ */
+void *socketer_peek_msg(struct socketer *self, char *buf, size_t bufsize);
+
+/*
+ * peek all complete messages in one pass, up to max, msgs[i] point to them, return the message num.
+ * the message straddle blocks is copied to arena (if arena is NULL, then use the thread buffer).
+ * if return greater than 0, must call socketer_release_msg after use them.
+ */
+int socketer_peek_msg_batch(struct socketer *self, char **msgs, int max, char *arena, size_t arenasize);
+
+/* release the message of socketer_peek_msg or socketer_peek_msg_batch. */
+void socketer_release_msg(struct socketer *self);
+
 void *socketer_get_data(struct socketer *self, char *buf, size_t bufsize, int *datalen);
 
 int socketer_find_data_end_size(struct socketer *self, const char *data, int datalen);
@@ -76,9 +126,24 @@ void socketer_set_recv_limit(struct socketer *self, int size);
 /* set send data limit. */
 void socketer_set_send_limit(struct socketer *self, int size);
 
-void socketer_use_compress(struct socketer *self);
+/* compress send data with the codec, must be called before send any data. */
+bool socketer_use_compress(struct socketer *self, int codec_id);
+
+/* uncompress recv data, codec_id is for the stream codec of peer, must be called before recv any data. */
+bool socketer_use_uncompress(struct socketer *self, int codec_id);
 
-void socketer_use_uncompress(struct socketer *self);
+struct buf_compress_stat;
+/* get compress stat of send data. */
+void socketer_get_compress_stat(struct socketer *self, struct buf_compress_stat *stat);
+
+/* network thread split the recv data into messages, must be called before recv any data. */
+bool socketer_use_msg_preparse(struct socketer *self);
+
+/*
+ * use ring buffer for send/recv instead of block chain, size is 0 means not use, must be called before send/recv any data.
+ * the data in ring is always contiguous, send/recv only once system call. (only linux.)
+ */
+bool socketer_use_ring_buffer(struct socketer *self, size_t send_size, size_t recv_size);
 
 /* set encrypt function and logic data. */
 void socketer_set_encrypt_function(struct socketer *self, 
@@ -88,6 +153,12 @@ void socketer_set_encrypt_function(struct socketer *self,
 void socketer_set_decrypt_function(struct socketer *self, 
 		dofunc_f decrypt_func, void (*release_logicdata)(void *), void *logicdata);
 
+/* set encrypt function to chacha20, key is 32 bytes, nonce is 12 bytes. */
+bool socketer_set_encrypt_chacha20(struct socketer *self, const char *key, const char *nonce);
+
+/* set decrypt function to chacha20, key is 32 bytes, nonce is 12 bytes. */
+bool socketer_set_decrypt_chacha20(struct socketer *self, const char *key, const char *nonce);
+
 void socketer_use_encrypt(struct socketer *self);
 
 void socketer_use_decrypt(struct socketer *self);
@@ -109,6 +180,12 @@ void socketer_on_recv(struct socketer *self, int len);
 
 void socketer_on_send(struct socketer *self, int len);
 
+/*
+ * set the time(ms) of buffer is empty, after it release the buffer block, 
+ * if less than or equal to 0, then not release.
+ */
+void socketmgr_set_idle_buf_release_time(int ms);
+
 /* create and init socketer manager. */
 bool socketmgr_init();
 
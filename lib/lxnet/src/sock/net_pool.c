@@ -6,6 +6,7 @@
 
 #include <assert.h>
 #include "net_pool.h"
+#include "socket_internal.h"
 #include "cthread.h"
 #include "pool.h"
 
@@ -40,7 +41,8 @@ bool netpool_init(size_t socketer_num, size_t socketer_size, size_t listener_num
 		(listener_num == 0) || (listener_size == 0))
 		return false;
 
-	s_netpool.socketer_pool = poolmgr_create(socketer_size, 8, socketer_num, 1, "socketer pools");
+	s_netpool.socketer_pool = poolmgr_create(socketer_size, SOCKETER_CACHE_LINE_SIZE, 
+												socketer_num, 1, "socketer pools");
 	s_netpool.listener_pool = poolmgr_create(listener_size, 8, listener_num, 1, "listener pools");
 	if (!s_netpool.socketer_pool || !s_netpool.listener_pool) {
 		poolmgr_release(s_netpool.socketer_pool);
@@ -124,10 +126,36 @@ void netpool_release_listener(void *self) {
 	cspin_unlock(&s_netpool.listener_lock);
 }
 
-/* get net some pool info. */
+/*
+ * trim socketer pool and listener pool, call it periodically.
+ * free_seconds --- advise the node pool that free more than this seconds back to system.
+ * return reclaimed bytes.
+ */
+size_t netpool_trim(int free_seconds) {
+	size_t bytes = 0;
+	if (!s_netpool.is_init)
+		return 0;
+
+	cspin_lock(&s_netpool.socketer_lock);
+	bytes += poolmgr_trim(s_netpool.socketer_pool, free_seconds);
+	cspin_unlock(&s_netpool.socketer_lock);
+
+	cspin_lock(&s_netpool.listener_lock);
+	bytes += poolmgr_trim(s_netpool.listener_pool, free_seconds);
+	cspin_unlock(&s_netpool.listener_lock);
+	return bytes;
+}
+
+/*
+ * get net some pool info.
+ * fill at most num entries, return the filled num, if array is NULL, return the num of entries it has.
+ */
 size_t netpool_get_memory_info(struct poolmgr_info *array, size_t num) {
 	size_t index = 0;
-	if (!array || num < 2)
+	if (!array)
+		return 2;
+
+	if (num == 0)
 		return 0;
 
 	cspin_lock(&s_netpool.socketer_lock);
@@ -135,6 +163,9 @@ size_t netpool_get_memory_info(struct poolmgr_info *array, size_t num) {
 	cspin_unlock(&s_netpool.socketer_lock);
 	++index;
 
+	if (index >= num)
+		return index;
+
 	cspin_lock(&s_netpool.listener_lock);
 	poolmgr_get_info(s_netpool.listener_pool, &array[index]);
 	cspin_unlock(&s_netpool.listener_lock);
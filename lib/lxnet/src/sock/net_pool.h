@@ -34,10 +34,20 @@ void *netpool_create_listener();
 
 void netpool_release_listener(void *self);
 
+/*
+ * trim socketer pool and listener pool, call it periodically.
+ * free_seconds --- advise the node pool that free more than this seconds back to system.
+ * return reclaimed bytes.
+ */
+size_t netpool_trim(int free_seconds);
+
 
 struct poolmgr_info;
 
-/* get net some pool info. */
+/*
+ * get net some pool info.
+ * fill at most num entries, return the filled num, if array is NULL, return the num of entries it has.
+ */
 size_t netpool_get_memory_info(struct poolmgr_info *array, size_t num);
 
 #ifdef __cplusplus
@@ -13,6 +13,7 @@ extern "C" {
 
 #include "net_common.h"
 #include "catomic.h"
+#include "cthread.h"
 
 #ifdef _WIN32
 struct overlappedstruct {
@@ -21,31 +22,57 @@ struct overlappedstruct {
 };
 #endif
 
-struct net_buf;
-struct socketer {
-#ifdef _WIN32
-	struct overlappedstruct recv_event;
-	struct overlappedstruct send_event;
+/*
+ * the state written by the logic thread, the send thread and the recv thread is put on separate cache line,
+ * the socketer is allocated from a pool aligned to it.
+ */
+#define SOCKETER_CACHE_LINE_SIZE 64
+
+#ifdef _MSC_VER
+	#define socketer_cache_align __declspec(align(SOCKETER_CACHE_LINE_SIZE))
 #else
-	catomic events;						/* for epoll event. */
+	#define socketer_cache_align __attribute__((aligned(SOCKETER_CACHE_LINE_SIZE)))
 #endif
 
+struct net_buf;
+struct socketer {
+	/* read mostly, set on create, connect and close. */
 	net_socket sockfd;					/* socket fd. */
 	int64 try_connect_time;				/* the one fd try connect 1000 ms, after close it. */
 	int64 close_time;					/* close time. */
 	struct socketer *next;
-	struct net_buf *recvbuf;
-	struct net_buf *sendbuf;
-
-	catomic already_event;				/* if 0, then do not join. if 1, is added. */
-
-	catomic sendlock;					/* if 0, then not set send event. if 1, already set. */
-	catomic recvlock;					/* if 0, then not set recv event. if 1, already set. */
 	volatile bool deleted;				/* delete flag. */
 	volatile bool connected;			/* connect flag. */
 	bool bigbuf;						/* if true, then is bigbuf */
 
-	catomic ref;						/* the socketer object reference number */
+	/* written by both send side and recv side. */
+	socketer_cache_align catomic ref;	/* the socketer object reference number */
+	catomic already_event;				/* if 0, then do not join. if 1, is added. */
+#ifndef _WIN32
+	catomic events;						/* for epoll event. */
+#endif
+
+	/* send side, the logic thread push data and set send event, the network thread send it. */
+	socketer_cache_align catomic sendlock;	/* if 0, then not set send event. if 1, already set. */
+	struct net_buf *sendbuf;
+	int64 send_idle_time;				/* begin time of send buffer is empty, 0 is not empty. */
+	cspin sendbuf_lock;					/* lock for write send buffer, when the publish job write it too. */
+	int subscribe_num;					/* subscribed channel num, if > 0, the logic thread lock sendbuf_lock. */
+	bool sendbuf_reserved;				/* reserve_send hold sendbuf_lock until commit_send. */
+#ifdef _WIN32
+	struct overlappedstruct send_event;
+#endif
+
+	/* recv side, the network thread push data, the logic thread get message and set recv event. */
+	socketer_cache_align catomic recvlock;	/* if 0, then not set recv event. if 1, already set. */
+#ifndef _WIN32
+	catomic recvguard;					/* if 1, network thread in recv. if 2, release idle recv block. */
+#endif
+	struct net_buf *recvbuf;
+	int64 recv_idle_time;				/* begin time of recv buffer is empty, 0 is not empty. */
+#ifdef _WIN32
+	struct overlappedstruct recv_event;
+#endif
 };
 
 #ifdef __cplusplus
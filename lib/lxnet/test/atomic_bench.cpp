@@ -0,0 +1,204 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include "catomic.h"
+#include "cthread.h"
+#include "crosslib.h"
+
+/*
+ * per message atomic cost, the old catomic (out-of-line and full barrier for all) and the ordered inline catomic.
+ * one message on recv path do: lock the socket, publish datasize and frame num,
+ * the logic thread read them, pop the frame and give back datasize, unlock.
+ */
+
+#ifdef _MSC_VER
+	#define bench_noinline __declspec(noinline)
+#else
+	#define bench_noinline __attribute__((noinline))
+#endif
+
+/* the old catomic.c, every function is a call and full barrier. */
+static bench_noinline int64 old_read(catomic *v) {
+	return *((volatile int64 *)&v->counter);
+}
+
+static bench_noinline int64 old_fetch_add(catomic *v, int64 value) {
+	return catomic_fetch_add_explicit(v, value, CATOMIC_SEQ_CST);
+}
+
+static bench_noinline int64 old_inc(catomic *v) {
+	return catomic_fetch_add_explicit(v, 1, CATOMIC_SEQ_CST) + 1;
+}
+
+static bench_noinline int64 old_dec(catomic *v) {
+	return catomic_fetch_add_explicit(v, -1, CATOMIC_SEQ_CST) - 1;
+}
+
+static bench_noinline bool old_compare_set(catomic *v, int64 old, int64 set) {
+	return catomic_compare_set_explicit(v, old, set, CATOMIC_SEQ_CST);
+}
+
+struct bench_socket {
+	catomic recvlock;
+	catomic ref;
+	catomic datasize;
+	catomic push_num;
+	catomic pop_num;
+};
+
+static void bench_socket_init(struct bench_socket *s) {
+	catomic_set(&s->recvlock, 0);
+	catomic_set(&s->ref, 1);
+	catomic_set(&s->datasize, 0);
+	catomic_set(&s->push_num, 0);
+	catomic_set(&s->pop_num, 0);
+}
+
+static int64 old_message(struct bench_socket *s, int len) {
+	int64 sum = 0;
+	if (old_compare_set(&s->recvlock, 0, 1))
+		old_inc(&s->ref);
+
+	old_fetch_add(&s->datasize, len);
+	if (old_read(&s->push_num) - old_read(&s->pop_num) < 128)
+		old_fetch_add(&s->push_num, 1);
+
+	if (old_read(&s->pop_num) < old_read(&s->push_num))
+		sum += old_read(&s->datasize);
+	old_inc(&s->pop_num);
+	old_fetch_add(&s->datasize, -len);
+
+	old_dec(&s->ref);
+	old_dec(&s->recvlock);
+	return sum;
+}
+
+static int64 new_message(struct bench_socket *s, int len) {
+	int64 sum = 0;
+	if (catomic_compare_set_explicit(&s->recvlock, 0, 1, CATOMIC_ACQUIRE))
+		catomic_inc_explicit(&s->ref, CATOMIC_RELAXED);
+
+	catomic_fetch_add_explicit(&s->datasize, len, CATOMIC_RELEASE);
+	if (catomic_read(&s->push_num) - catomic_read_acquire(&s->pop_num) < 128)
+		catomic_fetch_add_explicit(&s->push_num, 1, CATOMIC_RELEASE);
+
+	if (catomic_read(&s->pop_num) < catomic_read_acquire(&s->push_num))
+		sum += catomic_read_acquire(&s->datasize);
+	catomic_inc_explicit(&s->pop_num, CATOMIC_RELEASE);
+	catomic_fetch_add_explicit(&s->datasize, -len, CATOMIC_RELEASE);
+
+	catomic_dec_explicit(&s->ref, CATOMIC_ACQ_REL);
+	catomic_dec_explicit(&s->recvlock, CATOMIC_RELEASE);
+	return sum;
+}
+
+static void bench_single(int num) {
+	struct bench_socket s;
+	int64 begin, sum = 0;
+	double old_ns, new_ns;
+	int i;
+
+	bench_socket_init(&s);
+	begin = get_microsecond();
+	for (i = 0; i < num; ++i)
+		sum += old_message(&s, 64);
+	old_ns = (double)(get_microsecond() - begin) * 1000.0 / num;
+
+	bench_socket_init(&s);
+	begin = get_microsecond();
+	for (i = 0; i < num; ++i)
+		sum += new_message(&s, 64);
+	new_ns = (double)(get_microsecond() - begin) * 1000.0 / num;
+
+	printf("single thread, per message: old %.2f ns, new %.2f ns (%d)\n", old_ns, new_ns, (int)(sum & 1));
+}
+
+
+
+/*
+ * the network thread publish datasize per message, the logic thread read and give back it.
+ * the waiting thread yield, so it work on single cpu.
+ */
+enum {
+	enum_ring_size = 1024,
+};
+
+struct bench_spsc {
+	catomic datasize;
+	char pad[64];
+	int ring[enum_ring_size];
+	int num;
+	bool use_old;
+};
+
+static void spsc_producer(cthread *th) {
+	struct bench_spsc *b = (struct bench_spsc *)cthread_get_udata(th);
+	int i;
+	for (i = 0; i < b->num; ++i) {
+		if (b->use_old) {
+			while (old_read(&b->datasize) >= enum_ring_size)
+				cthread_self_sleep(0);
+			b->ring[i % enum_ring_size] = i;
+			old_fetch_add(&b->datasize, 1);
+		} else {
+			while (catomic_read_acquire(&b->datasize) >= enum_ring_size)
+				cthread_self_sleep(0);
+			b->ring[i % enum_ring_size] = i;
+			catomic_fetch_add_explicit(&b->datasize, 1, CATOMIC_RELEASE);
+		}
+	}
+}
+
+static double bench_spsc_run(bool use_old, int num) {
+	struct bench_spsc *b = (struct bench_spsc *)malloc(sizeof(struct bench_spsc));
+	cthread th;
+	int64 begin;
+	int i, error = 0;
+	double ns;
+
+	catomic_set(&b->datasize, 0);
+	b->num = num;
+	b->use_old = use_old;
+
+	begin = get_microsecond();
+	cthread_create(&th, b, spsc_producer);
+	for (i = 0; i < num; ++i) {
+		if (use_old) {
+			while (old_read(&b->datasize) == 0)
+				cthread_self_sleep(0);
+			error += (b->ring[i % enum_ring_size] != i);
+			old_fetch_add(&b->datasize, -1);
+		} else {
+			while (catomic_read_acquire(&b->datasize) == 0)
+				cthread_self_sleep(0);
+			error += (b->ring[i % enum_ring_size] != i);
+			catomic_fetch_add_explicit(&b->datasize, -1, CATOMIC_RELEASE);
+		}
+	}
+	cthread_join(&th);
+	ns = (double)(get_microsecond() - begin) * 1000.0 / num;
+	cthread_release(&th);
+	free(b);
+
+	if (error != 0)
+		printf("spsc data error:%d\n", error);
+	return ns;
+}
+
+static void bench_spsc(int num) {
+	double old_ns = bench_spsc_run(true, num);
+	double new_ns = bench_spsc_run(false, num);
+	printf("two thread handoff, per message: old %.2f ns, new %.2f ns\n", old_ns, new_ns);
+}
+
+int main(int argc, char *argv[]) {
+	int num = 10000000;
+	if (argc == 2)
+		sscanf(argv[1], "%d", &num);
+
+	if (num <= 0)
+		num = 10000000;
+
+	bench_single(num);
+	bench_spsc(num);
+	return 0;
+}
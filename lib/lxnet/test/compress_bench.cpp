@@ -0,0 +1,223 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include "net_compress.h"
+#include "crosslib.h"
+
+/*
+ * compare the compress codecs on the traffic, ratio and speed of compress and uncompress.
+ * the traffic is a file of the messages as sent by SendMsg (each with the int length header),
+ * e.g. the tcp payload of a connection without compress and encrypt, or the synthesized game messages.
+ * the traffic is split into chunks like the send buffer, each chunk is compressed once (stream codec in order).
+ *
+ * the dictionary file (trained by dict_train) is used by lz4_dict codec, it is skipped without dictionary.
+ *
+ * usage: compress_bench [traffic file | -] [chunk size] [dictionary file]
+ */
+
+static unsigned int s_seed = 20181;
+static unsigned int bench_rand() {
+	s_seed = s_seed * 1103515245 + 12345;
+	return (s_seed >> 8) & 0xffffff;
+}
+
+static int put_message(char *buf, int type, const void *body, int bodylen) {
+	int len = (int)sizeof(int) + (int)sizeof(short) + bodylen;
+	short t = (short)type;
+	memcpy(buf, &len, sizeof(int));
+	memcpy(&buf[sizeof(int)], &t, sizeof(short));
+	memcpy(&buf[sizeof(int) + sizeof(short)], body, bodylen);
+	return len;
+}
+
+/* position update, chat and item list, like the messages of game server. */
+static int synthesize_traffic(char *buf, int size) {
+	static const char *words[] = {"hello", "team", "boss", "go", "wait", "heal", "the", "dungeon", "gold", "ok", "lol", "attack"};
+	float pos[64][3];
+	char body[1024];
+	int len = 0, i;
+	for (i = 0; i < 64; ++i) {
+		pos[i][0] = (float)(bench_rand() % 1000);
+		pos[i][1] = (float)(bench_rand() % 1000);
+		pos[i][2] = 0.0f;
+	}
+
+	while (len + (int)sizeof(body) + 16 < size) {
+		int kind = bench_rand() % 10;
+		int bodylen = 0;
+		if (kind < 7) {
+			int id = bench_rand() % 64;
+			short dir = (short)(bench_rand() % 360);
+			pos[id][0] += (float)(bench_rand() % 5) - 2.0f;
+			pos[id][1] += (float)(bench_rand() % 5) - 2.0f;
+			memcpy(&body[0], &id, sizeof(id));
+			memcpy(&body[4], pos[id], sizeof(pos[id]));
+			memcpy(&body[16], &dir, sizeof(dir));
+			bodylen = 18;
+			len += put_message(&buf[len], 101, body, bodylen);
+		} else if (kind < 9) {
+			int n = 1 + bench_rand() % 12, j;
+			for (j = 0; j < n; ++j) {
+				const char *w = words[bench_rand() % (sizeof(words) / sizeof(words[0]))];
+				memcpy(&body[bodylen], w, strlen(w));
+				bodylen += (int)strlen(w);
+				body[bodylen++] = ' ';
+			}
+			len += put_message(&buf[len], 202, body, bodylen);
+		} else {
+			int n = 1 + bench_rand() % 40, j;
+			for (j = 0; j < n; ++j) {
+				int item[4] = {10000 + (int)(bench_rand() % 50), (int)(bench_rand() % 99) + 1, 0, j};
+				memcpy(&body[bodylen], item, sizeof(item));
+				bodylen += (int)sizeof(item);
+			}
+			len += put_message(&buf[len], 303, body, bodylen);
+		}
+	}
+	return len;
+}
+
+static int load_traffic(const char *filename, char **buf) {
+	FILE *fp = fopen(filename, "rb");
+	long size;
+	if (!fp)
+		return -1;
+
+	fseek(fp, 0, SEEK_END);
+	size = ftell(fp);
+	fseek(fp, 0, SEEK_SET);
+	if (size <= 0) {
+		fclose(fp);
+		return -1;
+	}
+
+	*buf = (char *)malloc(size);
+	if (fread(*buf, 1, size, fp) != (size_t)size) {
+		fclose(fp);
+		return -1;
+	}
+	fclose(fp);
+	return (int)size;
+}
+
+static void bench_codec(int codec_id, const char *traffic, int size, int chunk_size) {
+	const struct compress_codec *codec = compressmgr_get_codec(codec_id);
+	if (!codec)
+		return;
+
+	size_t state_size = codec->is_stream? compressmgr_stream_state_size() : compressmgr_scratch_size();
+	void *compress_state = malloc(state_size);
+	void *uncompress_state = malloc(state_size);
+	int bufsize = chunk_size + 1024;
+	char *compressbuf = (char *)malloc(bufsize);
+	char *uncompressbuf = (char *)malloc(bufsize);
+	char **chunks = (char **)malloc(sizeof(char *) * (size / chunk_size + 1));
+	int *chunks_len = (int *)malloc(sizeof(int) * (size / chunk_size + 1));
+	int chunk_num = 0, pass, pass_num, i, error = 0;
+	int64 compressed = 0;
+	int64 begin, compress_us = 0, uncompress_us = 0;
+
+	/* about 256M bytes each. */
+	pass_num = (int)(256 * 1024 * 1024 / size) + 1;
+	for (pass = 0; pass < pass_num; ++pass) {
+		int pos = 0;
+		memset(compress_state, 0, state_size);
+		chunk_num = 0;
+		compressed = 0;
+
+		begin = get_microsecond();
+		while (pos < size) {
+			int len = (size - pos < chunk_size)? size - pos : chunk_size;
+			struct buf_info res = compressmgr_compressdata(codec, compress_state,
+					compressbuf, bufsize, (char *)&traffic[pos], len);
+			if (!res.buf) {
+				printf("%s compress failed\n", codec->name);
+				return;
+			}
+
+			if (pass == 0) {
+				chunks[chunk_num] = (char *)malloc(res.len);
+				memcpy(chunks[chunk_num], res.buf, res.len);
+			}
+			chunks_len[chunk_num++] = res.len;
+			compressed += res.len;
+			pos += len;
+		}
+		compress_us += get_microsecond() - begin;
+	}
+
+	for (pass = 0; pass < pass_num; ++pass) {
+		int pos = 0;
+		memset(uncompress_state, 0, state_size);
+
+		begin = get_microsecond();
+		for (i = 0; i < chunk_num; ++i) {
+			struct buf_info res = compressmgr_uncompressdata(uncompressbuf, bufsize,
+					uncompress_state, uncompress_state, chunks[i], chunks_len[i]);
+			if (!res.buf || memcmp(res.buf, &traffic[pos], res.len) != 0)
+				++error;
+
+			pos += res.len;
+		}
+		uncompress_us += get_microsecond() - begin;
+	}
+
+	printf("%-16s ratio %6.2f%%   compress %8.1f MB/s   uncompress %8.1f MB/s   %s\n", codec->name,
+			(double)compressed * 100.0 / size,
+			(double)size * pass_num / (compress_us + 1),
+			(double)size * pass_num / (uncompress_us + 1),
+			(error == 0)? "ok" : "ERROR");
+
+	for (i = 0; i < chunk_num; ++i)
+		free(chunks[i]);
+
+	free(chunks);
+	free(chunks_len);
+	free(compressbuf);
+	free(uncompressbuf);
+	free(compress_state);
+	free(uncompress_state);
+}
+
+int main(int argc, char *argv[]) {
+	char *traffic = NULL;
+	int size = 0;
+	int chunk_size = 4096;
+	int codec_id;
+
+	if (argc >= 2 && strcmp(argv[1], "-") != 0) {
+		size = load_traffic(argv[1], &traffic);
+		if (size <= 0) {
+			printf("load traffic file failed:%s\n", argv[1]);
+			return 1;
+		}
+	} else {
+		size = 8 * 1024 * 1024;
+		traffic = (char *)malloc(size);
+		size = synthesize_traffic(traffic, size);
+	}
+
+	if (argc >= 3)
+		sscanf(argv[2], "%d", &chunk_size);
+
+	if (chunk_size <= 0 || chunk_size > 128 * 1024)
+		chunk_size = 4096;
+
+	if (argc >= 4) {
+		char *dict = NULL;
+		int dict_size = load_traffic(argv[3], &dict);
+		if (dict_size <= 0 || !compressmgr_set_dict(dict, dict_size)) {
+			printf("load dictionary file failed:%s\n", argv[3]);
+			return 1;
+		}
+		free(dict);
+	}
+
+	printf("traffic %d bytes, chunk size %d\n", size, chunk_size);
+	for (codec_id = enum_codec_none + 1; codec_id < enum_codec_max; ++codec_id)
+		bench_codec(codec_id, traffic, size, chunk_size);
+
+	compressmgr_set_dict(NULL, 0);
+	free(traffic);
+	return 0;
+}
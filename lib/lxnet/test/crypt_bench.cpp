@@ -0,0 +1,250 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include "net_crypt.h"
+#include "crosslib.h"
+
+/*
+ * compare the xor kernels of the built-in encryption with the byte loops they replace,
+ * check the result on random keys and segments, and the throughput of the default key and a 32 bytes key.
+ * check the chacha20 kernels with the test vectors of RFC 8439 and on random segments, and the throughput.
+ *
+ * usage: crypt_bench [segment size]
+ */
+
+static unsigned int s_seed = 20181;
+static unsigned int bench_rand() {
+	s_seed = s_seed * 1103515245 + 12345;
+	return (s_seed >> 8) & 0xffffff;
+}
+
+/* the byte loop of default_encrypt_func. */
+static void ref_default_xor(char *buf, int len) {
+	static const char default_key = (char)0xae;
+	int i;
+	for (i = 0; i < len; ++i) {
+		buf[i] ^= default_key;
+	}
+}
+
+/* the byte loop of encrypt_decrypt_as_key_do_func. */
+static void ref_key_xor(char *buf, int len, const char *key, int max_idx, int *now_idx) {
+	for (int i = 0; i < len; ++i) {
+		if (*now_idx >= max_idx)
+			*now_idx = 0;
+
+		buf[i] ^= key[*now_idx];
+		++*now_idx;
+	}
+}
+
+/* xor random data in random segments by both, the result must be the same. */
+static bool check_kernel() {
+	char key[128];
+	char data[2048], expect[2048];
+	int round, i;
+	for (round = 0; round < 20000; ++round) {
+		int key_len = (round % 10 == 0) ? 1 + (int)(bench_rand() % 100) : 1 + (int)(bench_rand() % 32);
+		int len = (int)(bench_rand() % sizeof(data));
+		int pos = 0, idx = 0, ref_idx = 0;
+		for (i = 0; i < key_len; ++i)
+			key[i] = (char)bench_rand();
+
+		for (i = 0; i < len; ++i)
+			data[i] = expect[i] = (char)bench_rand();
+
+		while (pos < len) {
+			int seg = 1 + (int)(bench_rand() % 300);
+			if (seg > len - pos)
+				seg = len - pos;
+
+			ref_key_xor(&expect[pos], seg, key, key_len, &ref_idx);
+			crypt_xor(&data[pos], seg, key, key_len, &idx);
+			pos += seg;
+		}
+
+		if (memcmp(data, expect, len) != 0)
+			return false;
+	}
+	return true;
+}
+
+static void hex_to_bin(const char *hex, char *bin) {
+	int i;
+	for (i = 0; hex[i * 2]; ++i) {
+		unsigned int v;
+		sscanf(&hex[i * 2], "%2x", &v);
+		bin[i] = (char)v;
+	}
+}
+
+/* RFC 8439 2.3.2 (block function) and 2.4.2 (encryption). */
+static bool check_chacha20_vector() {
+	static const char *block_stream = 
+		"10f1e7e4d13b5915500fdd1fa32071c4c7d1f4c733c068030422aa9ac3d46c4e"
+		"d2826446079faa0914c2d705d98b02a2b5129cd1de164eb9cbd083e8a2503c4e";
+	static const char *plaintext = 
+		"Ladies and Gentlemen of the class of '99: If I could offer you only one tip for the future, sunscreen would be it.";
+	static const char *ciphertext = 
+		"6e2e359a2568f98041ba0728dd0d6981e97e7aec1d4360c20a27afccfd9fae0b"
+		"f91b65c5524733ab8f593dabcd62b3571639d624e65152ab8f530c359f0861d8"
+		"07ca0dbf500d6a6156a38e088a22b65e52bc514d16ccf806818ce91ab7793736"
+		"5af90bbf74a35be6b40b8eedf2785e42874d";
+	struct crypt_chacha20 cipher;
+	char key[32], nonce[12], expect[128], data[128];
+	int len = (int)strlen(plaintext), i;
+	for (i = 0; i < 32; ++i)
+		key[i] = (char)i;
+
+	/* the keystream is the encrypted zeros. */
+	hex_to_bin("000000090000004a00000000", nonce);
+	hex_to_bin(block_stream, expect);
+	memset(data, 0, sizeof(data));
+	crypt_chacha20_init(&cipher, key, nonce, 1);
+	crypt_chacha20_xor(&cipher, data, 64);
+	if (memcmp(data, expect, 64) != 0)
+		return false;
+
+	/* whole and in segments of 1, 7 and 64 bytes. */
+	hex_to_bin("000000000000004a00000000", nonce);
+	hex_to_bin(ciphertext, expect);
+	for (i = 0; i < 4; ++i) {
+		static const int seg_size[] = {128, 1, 7, 64};
+		int pos;
+		memcpy(data, plaintext, len);
+		crypt_chacha20_init(&cipher, key, nonce, 1);
+		for (pos = 0; pos < len; pos += seg_size[i])
+			crypt_chacha20_xor(&cipher, &data[pos], (len - pos < seg_size[i]) ? len - pos : seg_size[i]);
+
+		if (memcmp(data, expect, len) != 0)
+			return false;
+	}
+	return true;
+}
+
+/* encrypt random data in random segments, the result must be the same as the word kernel in one call. */
+static bool check_chacha20_kernel(int kernel) {
+	static char data[64 * 1024], expect[64 * 1024];
+	struct crypt_chacha20 cipher;
+	char key[32], nonce[12];
+	int round, i;
+	for (round = 0; round < 200; ++round) {
+		int len = (int)(bench_rand() % sizeof(data));
+		int pos = 0;
+
+		/* near the counter wrap sometimes, the keystream stops before the wrap. */
+		uint32 counter = (round % 4 == 0) ? 0xffffffffu - (bench_rand() % 16) : bench_rand();
+		for (i = 0; i < 32; ++i)
+			key[i] = (char)bench_rand();
+
+		for (i = 0; i < 12; ++i)
+			nonce[i] = (char)bench_rand();
+
+		crypt_set_kernel(enum_crypt_kernel_word);
+		crypt_chacha20_init(&cipher, key, nonce, counter);
+		if ((uint64)len > crypt_chacha20_left(&cipher))
+			len = (int)crypt_chacha20_left(&cipher);
+
+		for (i = 0; i < len; ++i)
+			data[i] = expect[i] = (char)bench_rand();
+
+		if (!crypt_chacha20_xor(&cipher, expect, len) && (len > 0))
+			return false;
+
+		if ((round % 4 == 0) && crypt_chacha20_xor(&cipher, expect, (int)crypt_chacha20_left(&cipher) + 1))
+			return false;
+
+		crypt_set_kernel(kernel);
+		crypt_chacha20_init(&cipher, key, nonce, counter);
+		while (pos < len) {
+			int seg = 1 + (int)(bench_rand() % 3000);
+			if (seg > len - pos)
+				seg = len - pos;
+
+			if (!crypt_chacha20_xor(&cipher, &data[pos], seg))
+				return false;
+
+			pos += seg;
+		}
+
+		if (memcmp(data, expect, len) != 0)
+			return false;
+	}
+	return true;
+}
+
+int main(int argc, char *argv[]) {
+	const int total = 256 * 1024 * 1024;
+	char key[32];
+	int seg_size = 16 * 1024;
+	int kernel, i, pos, idx;
+	char *buf;
+	int64 begin;
+
+	if (argc >= 2)
+		sscanf(argv[1], "%d", &seg_size);
+
+	if (seg_size <= 0 || seg_size > 1024 * 1024)
+		seg_size = 16 * 1024;
+
+	buf = (char *)malloc(seg_size);
+	for (i = 0; i < seg_size; ++i)
+		buf[i] = (char)bench_rand();
+
+	for (i = 0; i < (int)sizeof(key); ++i)
+		key[i] = (char)bench_rand();
+
+	printf("segment size %d, best kernel %s\n", seg_size, crypt_kernel_name(crypt_set_kernel(enum_crypt_kernel_auto)));
+
+	begin = get_microsecond();
+	for (pos = 0; pos < total; pos += seg_size)
+		ref_default_xor(buf, seg_size);
+	printf("%-16s default key %8.1f MB/s", "byte loop", (double)total / (get_microsecond() - begin + 1));
+
+	idx = 0;
+	begin = get_microsecond();
+	for (pos = 0; pos < total; pos += seg_size)
+		ref_key_xor(buf, seg_size, key, (int)sizeof(key), &idx);
+	printf("   32 bytes key %8.1f MB/s\n", (double)total / (get_microsecond() - begin + 1));
+
+	for (kernel = enum_crypt_kernel_auto + 1; kernel < enum_crypt_kernel_max; ++kernel) {
+		static const char default_key = (char)0xae;
+		bool ok;
+		if (crypt_set_kernel(kernel) != kernel)
+			continue;
+
+		ok = check_kernel();
+		begin = get_microsecond();
+		for (pos = 0; pos < total; pos += seg_size) {
+			idx = 0;
+			crypt_xor(buf, seg_size, &default_key, 1, &idx);
+		}
+		printf("%-16s default key %8.1f MB/s", crypt_kernel_name(kernel), (double)total / (get_microsecond() - begin + 1));
+
+		idx = 0;
+		begin = get_microsecond();
+		for (pos = 0; pos < total; pos += seg_size)
+			crypt_xor(buf, seg_size, key, (int)sizeof(key), &idx);
+		printf("   32 bytes key %8.1f MB/s   %s\n", (double)total / (get_microsecond() - begin + 1), ok ? "ok" : "ERROR");
+	}
+
+	/* auto is the kernel selected for this build. */
+	for (kernel = enum_crypt_kernel_auto; kernel < enum_crypt_kernel_max; ++kernel) {
+		struct crypt_chacha20 cipher;
+		char nonce[12] = {0};
+		bool ok;
+		if ((crypt_set_kernel(kernel) != kernel) && (kernel != enum_crypt_kernel_auto))
+			continue;
+
+		ok = check_chacha20_vector() && check_chacha20_kernel(kernel);
+		crypt_chacha20_init(&cipher, key, nonce, 0);
+		begin = get_microsecond();
+		for (pos = 0; pos < total / 4; pos += seg_size)
+			crypt_chacha20_xor(&cipher, buf, seg_size);
+		printf("%-16s chacha20 %8.1f MB/s   %s\n", crypt_kernel_name(kernel), 
+				(double)(total / 4) / (get_microsecond() - begin + 1), ok ? "ok" : "ERROR");
+	}
+
+	free(buf);
+	return 0;
+}
@@ -0,0 +1,161 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+
+/*
+ * train the shared dictionary of compress_codec_lz4_dict (SetCompressDict) from the captured traffic.
+ * the traffic is a file of the messages as sent by SendMsg (each with the int length header),
+ * e.g. the tcp payload of a connection without compress and encrypt.
+ *
+ * the traffic is split into epochs, the best segment of each epoch is selected,
+ * the score of segment is the frequency of its k-mers in the whole traffic, the selected k-mers are not scored again,
+ * so the dictionary has the frequent and different content. the segment of higher score is put at the end,
+ * which is nearer to the data.
+ *
+ * usage: dict_train traffic_file dict_file [dict size]
+ */
+
+enum {
+	enum_kmer_len = 8,
+	enum_segment_len = 64,
+	enum_hash_log = 20,
+	enum_max_dict_size = 64 * 1024 - 1,
+};
+
+struct segment {
+	int pos;
+	unsigned int score;
+};
+
+static unsigned int kmer_hash(const char *p) {
+	unsigned long long value;
+	memcpy(&value, p, sizeof(value));
+	return (unsigned int)((value * 0x9E3779B185EBCA87ULL) >> (64 - enum_hash_log));
+}
+
+static bool segment_less(const segment &a, const segment &b) {
+	return a.score < b.score;
+}
+
+static int load_traffic(const char *filename, char **buf) {
+	FILE *fp = fopen(filename, "rb");
+	long size;
+	if (!fp)
+		return -1;
+
+	fseek(fp, 0, SEEK_END);
+	size = ftell(fp);
+	fseek(fp, 0, SEEK_SET);
+	if (size <= 0) {
+		fclose(fp);
+		return -1;
+	}
+
+	*buf = (char *)malloc(size);
+	if (fread(*buf, 1, size, fp) != (size_t)size) {
+		fclose(fp);
+		return -1;
+	}
+	fclose(fp);
+	return (int)size;
+}
+
+int main(int argc, char *argv[]) {
+	char *traffic = NULL;
+	int size, dict_size = 16 * 1024;
+	int epoch_num, epoch_len, epoch, seg_num = 0, dict_len = 0, i;
+	unsigned int *count;
+	segment *segs;
+	char *dict;
+	FILE *fp;
+
+	if (argc < 3) {
+		printf("usage: dict_train traffic_file dict_file [dict size]\n");
+		return 1;
+	}
+
+	size = load_traffic(argv[1], &traffic);
+	if (size < enum_segment_len) {
+		printf("load traffic file failed or too small:%s\n", argv[1]);
+		return 1;
+	}
+
+	if (argc >= 4)
+		sscanf(argv[3], "%d", &dict_size);
+
+	if (dict_size < enum_segment_len || dict_size > enum_max_dict_size)
+		dict_size = 16 * 1024;
+
+	/* frequency of each k-mer. */
+	count = (unsigned int *)calloc(1 << enum_hash_log, sizeof(unsigned int));
+	for (i = 0; i + enum_kmer_len <= size; ++i)
+		++count[kmer_hash(&traffic[i])];
+
+	epoch_num = dict_size / enum_segment_len;
+	epoch_len = size / epoch_num;
+	if (epoch_len < enum_segment_len) {
+		epoch_len = enum_segment_len;
+		epoch_num = size / epoch_len;
+	}
+
+	segs = (segment *)malloc(sizeof(segment) * epoch_num);
+	for (epoch = 0; epoch < epoch_num; ++epoch) {
+		int begin = epoch * epoch_len;
+		int end = std::min(begin + epoch_len, size) - enum_segment_len;
+		int kmer_num = enum_segment_len - enum_kmer_len + 1;
+		unsigned int score = 0, best_score = 0;
+		int best_pos = -1, pos;
+		if (end < begin)
+			continue;
+
+		/* slide the segment, the score is the sum of its k-mer frequency. */
+		for (i = 0; i < kmer_num; ++i)
+			score += count[kmer_hash(&traffic[begin + i])];
+
+		for (pos = begin; ; ++pos) {
+			if (score > best_score) {
+				best_score = score;
+				best_pos = pos;
+			}
+
+			if (pos >= end)
+				break;
+
+			score -= count[kmer_hash(&traffic[pos])];
+			score += count[kmer_hash(&traffic[pos + kmer_num])];
+		}
+
+		/* the k-mers in dictionary are not scored again. */
+		if (best_pos < 0 || best_score <= (unsigned int)kmer_num)
+			continue;
+
+		for (i = 0; i < kmer_num; ++i)
+			count[kmer_hash(&traffic[best_pos + i])] = 0;
+
+		segs[seg_num].pos = best_pos;
+		segs[seg_num].score = best_score;
+		++seg_num;
+	}
+
+	std::stable_sort(segs, segs + seg_num, segment_less);
+	dict = (char *)malloc(dict_size);
+	for (i = 0; i < seg_num && dict_len + enum_segment_len <= dict_size; ++i) {
+		memcpy(&dict[dict_len], &traffic[segs[i].pos], enum_segment_len);
+		dict_len += enum_segment_len;
+	}
+
+	fp = fopen(argv[2], "wb");
+	if (!fp || fwrite(dict, 1, dict_len, fp) != (size_t)dict_len) {
+		printf("write dict file failed:%s\n", argv[2]);
+		return 1;
+	}
+	fclose(fp);
+
+	printf("traffic %d bytes, dictionary %d bytes, %d segments\n", size, dict_len, seg_num);
+	free(dict);
+	free(segs);
+	free(count);
+	free(traffic);
+	return 0;
+}